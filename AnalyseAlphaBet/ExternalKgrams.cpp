@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include "ExternalKgrams.hpp"
+
+using namespace std;
+
+namespace {
+
+// A window up to its first zero byte, padded with zeros, with the files of one group
+// of 64 that contain it as bits, and the number of times it occurs in them
+struct Record
+{
+    unsigned char key[WINDOW_LENGTH];
+    uint32_t group;
+    uint64_t files;
+    uint64_t count;
+};
+
+const size_t BUFFER_RECORDS = 4096;  // records per read or write buffer of a run
+const size_t CHUNK_SIZE = 1 << 16;   // bytes read from a file at a time
+
+bool lessThan(const Record &a, const Record &b)
+{
+    int c = memcmp(a.key, b.key, WINDOW_LENGTH);
+    return c != 0 ? c < 0 : a.group < b.group;
+}
+
+bool sameKey(const Record &a, const Record &b)
+{
+    return memcmp(a.key, b.key, WINDOW_LENGTH) == 0 && a.group == b.group;
+}
+
+int keyLength(const unsigned char* key)
+{
+    const void* zero = memchr(key, 0, WINDOW_LENGTH);
+    return zero == nullptr ? WINDOW_LENGTH : static_cast<int>(static_cast<const unsigned char*>(zero) - key);
+}
+
+
+// Writes records to a new run file through a buffer
+class RunWriter
+{
+public:
+    RunWriter(const string& path, ExternalStats& stats) : path(path), stats(stats), out(path, ios::binary | ios::trunc)
+    {
+        if (!out)
+            throw runtime_error("Cannot create " + path);
+        buffer.reserve(BUFFER_RECORDS);
+    }
+
+    // Adds a record, combining it with the previous one if they have the same key and group
+    void add(const Record& r)
+    {
+        if (!buffer.empty() && sameKey(buffer.back(), r)) {
+            buffer.back().files |= r.files;
+            buffer.back().count += r.count;
+            return;
+        }
+        if (buffer.size() == BUFFER_RECORDS)
+            flush();
+        buffer.push_back(r);
+    }
+
+    void close()
+    {
+        flush();
+        out.close();
+        if (!out)
+            throw runtime_error("Error writing " + path);
+    }
+
+private:
+    string path;
+    ExternalStats& stats;
+    ofstream out;
+    vector<Record> buffer;
+
+    void flush()
+    {
+        out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<streamsize>(buffer.size() * sizeof(Record)));
+        if (!out)
+            throw runtime_error("Error writing " + path);
+        stats.bytes_written += buffer.size() * sizeof(Record);
+        buffer.clear();
+    }
+};
+
+
+// Reads the records of a run file through a buffer
+class RunReader
+{
+public:
+    explicit RunReader(const string& path) : path(path), in(path, ios::binary), buffer(BUFFER_RECORDS), size(0), next(0)
+    {
+        if (!in)
+            throw runtime_error("Cannot open " + path);
+    }
+
+    // Returns the next record, or null at the end of the run
+    const Record* peek()
+    {
+        if (next == size) {
+            in.read(reinterpret_cast<char*>(buffer.data()), static_cast<streamsize>(buffer.size() * sizeof(Record)));
+            if (in.bad() || in.gcount() % sizeof(Record) != 0)
+                throw runtime_error("Error reading " + path);
+            size = static_cast<size_t>(in.gcount()) / sizeof(Record);
+            next = 0;
+            if (size == 0)
+                return nullptr;
+        }
+        return &buffer[next];
+    }
+
+    void pop()
+    {
+        next++;
+    }
+
+private:
+    string path;
+    ifstream in;
+    vector<Record> buffer;
+    size_t size;
+    size_t next;
+};
+
+
+// Merges the given runs in sorted order and calls consume(record) for each distinct
+// key and group, with the records of all runs combined
+template <typename Consume>
+void mergeRuns(const vector<string>& paths, Consume consume)
+{
+    vector<unique_ptr<RunReader>> readers;
+    for (const string& path : paths)
+        readers.emplace_back(new RunReader(path));
+    auto greater = [&readers](size_t a, size_t b) {
+        return lessThan(*readers[b]->peek(), *readers[a]->peek());
+    };
+    priority_queue<size_t, vector<size_t>, decltype(greater)> queue(greater);
+    for (size_t i = 0; i < readers.size(); i++) {
+        if (readers[i]->peek() != nullptr)
+            queue.push(i);
+    }
+    bool pending = false;
+    Record current = {};
+    while (!queue.empty()) {
+        size_t i = queue.top();
+        queue.pop();
+        const Record& r = *readers[i]->peek();
+        if (pending && sameKey(current, r)) {
+            current.files |= r.files;
+            current.count += r.count;
+        } else {
+            if (pending)
+                consume(current);
+            current = r;
+            pending = true;
+        }
+        readers[i]->pop();
+        if (readers[i]->peek() != nullptr)
+            queue.push(i);
+    }
+    if (pending)
+        consume(current);
+}
+
+
+// The counts and file bitsets of the prefixes of the current window, one per Trie level
+class PrefixWalk
+{
+public:
+    PrefixWalk(size_t number_files, SubstringRanking& ranking) :
+            number_files(number_files), ranking(ranking), levels(WINDOW_LENGTH + 1), length(0)
+    {
+        for (Level& level : levels)
+            level.words.assign((number_files + 63) / 64, 0);
+        memset(key, 0, sizeof(key));
+    }
+
+    void add(const Record& r)
+    {
+        const int len = keyLength(r.key);
+        if (len == 0)
+            return;  // Like the Trie, which inserts nothing for such a window
+        int common = 0;
+        while (common < min(len, length) && key[common] == r.key[common])
+            common++;
+        for (int d = length; d > common; d--)
+            close(d);
+        memcpy(key, r.key, sizeof(key));
+        length = len;
+        for (int d = 1; d <= len; d++) {
+            Level& level = levels[d];
+            uint64_t& word = level.words[r.group];
+            if (word == 0)
+                level.touched.push_back(r.group);
+            level.files_set += static_cast<size_t>(popcount(word | r.files) - popcount(word));
+            word |= r.files;
+            level.count += r.count;
+        }
+    }
+
+    void finish()
+    {
+        for (int d = length; d > 0; d--)
+            close(d);
+        length = 0;
+    }
+
+private:
+    struct Level
+    {
+        unsigned long long count = 0;
+        size_t files_set = 0;
+        vector<uint64_t> words;
+        vector<uint32_t> touched;  // groups with a non-zero word
+    };
+
+    size_t number_files;
+    SubstringRanking& ranking;
+    vector<Level> levels;
+    unsigned char key[WINDOW_LENGTH];
+    int length;
+
+    static int popcount(uint64_t x)
+    {
+        int n = 0;
+        for (; x != 0; x &= x - 1)
+            n++;
+        return n;
+    }
+
+    // Ranks the prefix of the given length, as the Trie node for it is complete, and resets its level
+    void close(int d)
+    {
+        Level& level = levels[d];
+        if (d > 1 && level.files_set == number_files) {
+            long long score = static_cast<long long>(level.count / number_files) * d;
+            if (score != 0)
+                ranking.add(string(reinterpret_cast<const char*>(key), static_cast<size_t>(d)), d, score);
+        }
+        for (uint32_t g : level.touched)
+            level.words[g] = 0;
+        level.touched.clear();
+        level.files_set = 0;
+        level.count = 0;
+    }
+};
+
+}
+
+
+vector<SharedSubstring> rankExternal(const vector<string>& paths, const ExternalOptions& options,
+                                     size_t limit, ExternalStats* stats)
+{
+    if (options.memory_limit < MIN_MEMORY_LIMIT)
+        throw invalid_argument("Memory limit too small");
+    if (paths.empty())
+        return vector<SharedSubstring>();
+    ExternalStats local_stats;
+    ExternalStats& st = stats != nullptr ? *stats : local_stats;
+    const string prefix = options.temp_dir + "/kgrams-"
+            + to_string(chrono::steady_clock::now().time_since_epoch().count()) + "-";
+    vector<string> runs;
+    size_t run_number = 0;
+    auto newRun = [&]() {
+        runs.push_back(prefix + to_string(run_number++) + ".run");
+        st.runs++;
+        return runs.back();
+    };
+
+    try {
+        // Cut the windows of all files into sorted runs
+        vector<Record> buffer;
+        buffer.reserve(options.memory_limit / sizeof(Record));
+        auto writeRun = [&]() {
+            sort(buffer.begin(), buffer.end(), lessThan);
+            RunWriter writer(newRun(), st);
+            for (const Record& r : buffer)
+                writer.add(r);
+            writer.close();
+            buffer.clear();
+        };
+        vector<unsigned char> bytes;
+        for (size_t f = 0; f < paths.size(); f++) {
+            ifstream in(paths[f], ios::binary);
+            if (!in)
+                throw runtime_error("Cannot open " + paths[f]);
+            bytes.clear();
+            while (true) {
+                // Windows need one more byte after them, so the last WINDOW_LENGTH bytes wait for the next chunk
+                size_t carried = bytes.size();
+                bytes.resize(carried + CHUNK_SIZE);
+                in.read(reinterpret_cast<char*>(bytes.data() + carried), CHUNK_SIZE);
+                if (in.bad())
+                    throw runtime_error("Error reading " + paths[f]);
+                bytes.resize(carried + static_cast<size_t>(in.gcount()));
+                if (in.gcount() == 0)
+                    break;
+                size_t i = 0;
+                for (; i + WINDOW_LENGTH < bytes.size(); i++) {
+                    if (buffer.size() == buffer.capacity())
+                        writeRun();
+                    Record r;
+                    memset(r.key, 0, sizeof(r.key));
+                    for (int j = 0; j < WINDOW_LENGTH && bytes[i + j] != 0; j++)
+                        r.key[j] = bytes[i + j];
+                    r.group = static_cast<uint32_t>(f / 64);
+                    r.files = static_cast<uint64_t>(1) << (f % 64);
+                    r.count = 1;
+                    buffer.push_back(r);
+                    st.windows++;
+                }
+                bytes.erase(bytes.begin(), bytes.begin() + static_cast<ptrdiff_t>(i));
+            }
+        }
+        if (!buffer.empty())
+            writeRun();
+        vector<Record>().swap(buffer);
+
+        // Merge the runs, as many at a time as their buffers and one output buffer fit in memory
+        const size_t fan_in = max<size_t>(2, options.memory_limit / (BUFFER_RECORDS * sizeof(Record)) - 1);
+        size_t first = 0;
+        while (runs.size() - first > fan_in) {
+            vector<string> inputs(runs.begin() + static_cast<ptrdiff_t>(first), runs.begin() + static_cast<ptrdiff_t>(first + fan_in));
+            RunWriter writer(newRun(), st);
+            mergeRuns(inputs, [&writer](const Record& r) { writer.add(r); });
+            writer.close();
+            for (const string& path : inputs)
+                remove(path.c_str());
+            first += fan_in;
+            st.merges++;
+        }
+
+        // The last merge walks the Trie
+        SubstringRanking ranking(limit);
+        PrefixWalk walk(paths.size(), ranking);
+        mergeRuns(vector<string>(runs.begin() + static_cast<ptrdiff_t>(first), runs.end()),
+                  [&walk](const Record& r) { walk.add(r); });
+        walk.finish();
+        st.merges++;
+        for (size_t i = first; i < runs.size(); i++)
+            remove(runs[i].c_str());
+        return ranking.result();
+    } catch (...) {
+        for (const string& path : runs)
+            remove(path.c_str());
+        throw;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Trie.hpp"
+
+// Options of rankExternal()
+struct ExternalOptions
+{
+    // bytes of memory for the records of a run and for the merge buffers
+    std::size_t memory_limit = static_cast<std::size_t>(64) << 20;
+    // directory for the run files, which are removed afterwards
+    std::string temp_dir = "/tmp";
+};
+
+// What rankExternal() did
+struct ExternalStats
+{
+    unsigned long long windows = 0;
+    std::size_t runs = 0;
+    int merges = 0;  // including the final one
+    unsigned long long bytes_written = 0;
+};
+
+// The smallest memory_limit that rankExternal() accepts
+const std::size_t MIN_MEMORY_LIMIT = static_cast<std::size_t>(1) << 20;
+
+// Ranks the substrings shared by all the given files, with the same result as traverseTree()
+// on a Trie of insertWindows() of every file, but in bounded memory instead of a node per
+// distinct substring. Every window (up to its first zero byte) becomes a record holding the
+// file's bit within a group of 64 files and a count. The records fill a buffer of memory_limit
+// bytes, which is sorted, has equal windows of a group combined, and is written as a run file.
+// The runs are then merged, as many at a time as their read buffers fit in memory_limit, in as
+// many passes as it takes. In sorted order, all windows that start with a substring are
+// consecutive, like the leaves under a Trie node, so the final merge visits every Trie node in
+// turn while keeping only the counts and file bitsets of the WINDOW_LENGTH prefixes of the
+// current window. Throws std::invalid_argument if memory_limit is below MIN_MEMORY_LIMIT and
+// std::runtime_error on I/O errors.
+std::vector<SharedSubstring> rankExternal(const std::vector<std::string>& paths, const ExternalOptions& options,
+                                          std::size_t limit, ExternalStats* stats = nullptr);
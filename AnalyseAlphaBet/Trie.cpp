@@ -0,0 +1,217 @@
+#include <iostream>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "stack"
+#include "Trie.hpp"
+
+using namespace std;
+
+static long long returnScore(const vector<int>& files, int number_files, int level){
+    if (static_cast<int>(files.size()) < number_files)
+        return 0;
+    long long sum = 0;
+    for(int i : files){
+        if (i == 0)
+            return 0;
+        sum += i;
+    }
+    long long avg = sum/number_files;
+    return avg * level;
+}
+
+
+// true if a ranks above b; a heap with this order has the worst substring on top
+static bool betterThan(const SharedSubstring &a, const SharedSubstring &b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+    return a.code_word < b.code_word;
+}
+
+
+
+// Function that returns a new Trie node
+Trie* getNewTrieNode()
+{
+    Trie* node = new Trie;
+    node->isLeaf = false;
+
+    return node;
+}
+
+// Iterative function to insert a string in Trie.
+void insert(Trie*& head, char* str, const int& file_number)
+{
+    if (head == nullptr)
+        head = getNewTrieNode();
+
+    // start from root node
+    Trie* curr = head;
+
+    while (*str)
+    {
+        // create a new node if path doesn't exists
+        if (curr->map.find(*str) == curr->map.end())
+            curr->map[*str] = getNewTrieNode();
+
+        // go to next node
+        curr = curr->map[*str];
+        if (static_cast<int>(curr->files.size()) <= file_number)
+            curr->files.resize(file_number + 1, 0);
+        curr->files[file_number] ++;
+        // move to next character
+        str++;
+    }
+
+    // mark current node as leaf
+    curr->isLeaf = true;
+}
+
+// returns true if given node has any children
+bool haveChildren(Trie const* curr)
+{
+    // don't use (curr->map).size() to check for children
+
+    for (auto it : curr->map)
+        if (it.second != nullptr)
+            return true;
+
+    return false;
+}
+
+// Recursive function to delete a string in Trie.
+bool deletion(Trie*& curr, char* str)
+{
+    // return if Trie is empty
+    if (curr == nullptr)
+        return false;
+
+    // if we have not reached the end of the string
+    if (*str)
+    {
+        // recur for the node corresponding to next character in
+        // the string and if it returns true, delete current node
+        // (if it is non-leaf)
+        if (curr != nullptr &&  curr->map.find(*str) != curr->map.end() &&
+            deletion(curr->map[*str], str + 1) && curr->isLeaf == false)
+        {
+            if (!haveChildren(curr))
+            {
+                delete curr;;
+                curr = nullptr;
+                return true;
+            }
+            else {
+                return false;
+            }
+        }
+    }
+
+    // if we have reached the end of the string
+    if (*str == '\0' && curr->isLeaf)
+    {
+        // if current node is a leaf node and don't have any children
+        if (!haveChildren(curr))
+        {
+            delete curr;; // delete current node
+            curr = nullptr;
+            return true; // delete non-leaf parent nodes
+        }
+
+            // if current node is a leaf node and have children
+        else
+        {
+            // mark current node as non-leaf node (DON'T DELETE IT)
+            curr->isLeaf = false;
+            return false;	   // don't delete its parent nodes
+        }
+    }
+
+    return false;
+}
+
+// Iterative function to search a string in Trie. It returns true
+// if the string is found in the Trie, else it returns false
+bool search(Trie* head, char* str)
+{
+    // return false if Trie is empty
+    if (head == nullptr)
+        return false;
+
+    Trie* curr = head;
+    while (*str)
+    {
+        // go to next node
+        curr = curr->map[*str];
+
+        // if string is invalid (reached end of path in Trie)
+        if (curr == nullptr)
+            return false;
+
+        // move to next character
+        str++;
+    }
+
+    // if current node is a leaf and we have reached the
+    // end of the string, return true
+    return curr->isLeaf;
+}
+
+SubstringRanking::SubstringRanking(size_t limit) : limit(limit)
+{
+}
+
+void SubstringRanking::add(const string& code_word, int level, long long score)
+{
+    if (limit == 0)
+        return;
+    SharedSubstring entry{code_word, level, score};
+    if (heap.size() == limit) {
+        if (!betterThan(entry, heap.front()))
+            return;
+        pop_heap(heap.begin(), heap.end(), betterThan);
+        heap.pop_back();
+    }
+    heap.push_back(entry);
+    push_heap(heap.begin(), heap.end(), betterThan);
+}
+
+vector<SharedSubstring> SubstringRanking::result() const
+{
+    vector<SharedSubstring> sorted(heap);
+    sort(sorted.begin(), sorted.end(), betterThan);
+    return sorted;
+}
+
+vector<SharedSubstring> traverseTree(const Trie &node, int number_files, size_t limit){
+        // depth-first, with the string of each node next to it; its level is the string's length
+        struct Entry {
+            const Trie *node;
+            string code_word;
+        };
+        SubstringRanking ranking(limit);
+        stack<Entry> trie_stack;
+        trie_stack.push(Entry{&node, ""});
+        while (!trie_stack.empty()) {
+            Entry tmp = trie_stack.top();
+            trie_stack.pop();
+            const int level = static_cast<int>(tmp.code_word.size());
+            for (auto child : tmp.node->map)
+                trie_stack.push(Entry{child.second, tmp.code_word + child.first});
+            long long score = level > 1 ? returnScore(tmp.node->files, number_files, level) : 0;
+            if (score != 0)
+                ranking.add(tmp.code_word, level, score);
+        }
+        return ranking.result();
+    }
+
+void insertWindows(Trie*& head, const vector<unsigned char>& data, int file_number)
+{
+    for (size_t i = 0 ; i + WINDOW_LENGTH < data.size() ; i ++){
+        string s(data.begin() + i, data.begin() + i + WINDOW_LENGTH);
+        insert(head, const_cast<char*>(s.c_str()), file_number);
+    }
+}
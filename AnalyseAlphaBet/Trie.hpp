@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Length of the windows that are inserted for every position of a file
+const int WINDOW_LENGTH = 16;
+
+// A Trie node
+struct Trie
+{
+    // true when node is a leaf node
+    bool isLeaf;
+    // occurrences per file number, grown as files are inserted
+    std::vector<int> files;
+    std::string code_word;
+    int level;
+    int score;
+
+    // each node stores a map to its child nodes
+    std::unordered_map<char, Trie*> map;
+    Trie* parent;
+
+};
+
+// Function that returns a new Trie node
+Trie* getNewTrieNode();
+
+// Iterative function to insert a string in Trie.
+void insert(Trie*& head, char* str, const int& file_number);
+
+// returns true if given node has any children
+bool haveChildren(Trie const* curr);
+
+// Recursive function to delete a string in Trie.
+bool deletion(Trie*& curr, char* str);
+
+// Iterative function to search a string in Trie. It returns true
+// if the string is found in the Trie, else it returns false
+bool search(Trie* head, char* str);
+
+// A substring that occurs in all files, and its score: the average
+// number of occurrences per file times its length
+struct SharedSubstring
+{
+    std::string code_word;
+    int level;
+    long long score;
+};
+
+// Keeps the best substrings offered to it: highest score first,
+// and for equal scores the smaller string (compared as unsigned bytes)
+class SubstringRanking
+{
+public:
+    explicit SubstringRanking(std::size_t limit);
+
+    void add(const std::string& code_word, int level, long long score);
+
+    // The kept substrings, best first
+    std::vector<SharedSubstring> result() const;
+
+private:
+    std::size_t limit;
+    std::vector<SharedSubstring> heap;  // worst on top
+};
+
+// Walks the Trie and ranks the substrings of at least 2 characters shared by
+// all of the given number of files, returning the best ones up to the limit
+std::vector<SharedSubstring> traverseTree(const Trie &node, int number_files, std::size_t limit);
+
+// Inserts the window of WINDOW_LENGTH bytes at every position of the given file
+// data but the last one, up to the first zero byte of each window
+void insertWindows(Trie*& head, const std::vector<unsigned char>& data, int file_number);
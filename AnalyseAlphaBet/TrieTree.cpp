@@ -1,257 +1,123 @@
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
-#include <functional>
-#include <utility>
 #include <vector>
 #include <fstream>
-#include <unordered_map>
-#include <queue>
-#include "stack"
+#include <sstream>
+#include <string>
+#include "ExternalKgrams.hpp"
+#include "Trie.hpp"
 
 using namespace std;
 
-template <class T, class S, class C>
-S& Container(priority_queue<T, S, C>& q) {
-    struct HackedQueue : private priority_queue<T, S, C> {
-        static S& Container(priority_queue<T, S, C>& q) {
-            return q.*&HackedQueue::c;
-        }
-    };
-    return HackedQueue::Container(q);
-}
-
-// A Trie node
-struct Trie
-{
-    // true when node is a leaf node
-    bool isLeaf;
-    vector<int> files{0,0,0,0,0};
-    string code_word;
-    int level;
-    int score;
-
-    // each node stores a map to its child nodes
-    unordered_map<char, Trie*> map;
-    Trie* parent;
-
-};
-
-static int returnScore(const vector<int>& files, int level){
-    int sum = 0;
-    for(int i : files){
-        if (i == 0)
-            return 0;
-        sum += i;
-    }
-    int avg = sum/files.size();
-    return avg * level;
-}
-
-
-struct OrderByScore
-{
-    bool operator() (Trie const &a, Trie const &b) {
-        return a.score < b.score;
-    }
-};
-
-
+// Ranks the substrings shared by all the given files.
+// Usage: Huffman_Improved [-m MemoryMiB] [-d TempDir] [-n Top] File...
+// Without -m the windows of all files go into one in-memory Trie; with -m the
+// same ranking is computed from sorted runs on disk (see ExternalKgrams.hpp)
+// using about MemoryMiB mebibytes, so the files may be larger than memory.
 
-// Function that returns a new Trie node
-Trie* getNewTrieNode()
+static void usage(const char* program)
 {
-    Trie* node = new Trie;
-    node->isLeaf = false;
-
-    return node;
+    cerr << "Usage: " << program << " [-m MemoryMiB] [-d TempDir] [-n Top] File..." << endl;
 }
 
-// Iterative function to insert a string in Trie.
-void insert(Trie*& head, char* str, const int& file_number)
+static unsigned long parseNumber(const char* s)
 {
-    if (head == nullptr)
-        head = getNewTrieNode();
-
-    // start from root node
-    Trie* curr = head;
-
-    while (*str)
-    {
-        // create a new node if path doesn't exists
-        if (curr->map.find(*str) == curr->map.end())
-            curr->map[*str] = getNewTrieNode();
-
-        // go to next node
-        curr = curr->map[*str];
-        curr->files[file_number] ++;
-        // move to next character
-        str++;
-    }
-
-    // mark current node as leaf
-    curr->isLeaf = true;
+    char* end;
+    unsigned long result = strtoul(s, &end, 10);
+    if (*s == '\0' || *end != '\0')
+        throw invalid_argument(string("Invalid number: ") + s);
+    return result;
 }
 
-// returns true if given node has any children
-bool haveChildren(Trie const* curr)
+// Prints a substring with its non-printable bytes as \xNN
+static string escape(const string& s)
 {
-    // don't use (curr->map).size() to check for children
-
-    for (auto it : curr->map)
-        if (it.second != nullptr)
-            return true;
-
-    return false;
-}
-
-// Recursive function to delete a string in Trie.
-bool deletion(Trie*& curr, char* str)
-{
-    // return if Trie is empty
-    if (curr == nullptr)
-        return false;
-
-    // if we have not reached the end of the string
-    if (*str)
-    {
-        // recur for the node corresponding to next character in
-        // the string and if it returns true, delete current node
-        // (if it is non-leaf)
-        if (curr != nullptr &&  curr->map.find(*str) != curr->map.end() &&
-            deletion(curr->map[*str], str + 1) && curr->isLeaf == false)
-        {
-            if (!haveChildren(curr))
-            {
-                delete curr;;
-                curr = nullptr;
-                return true;
-            }
-            else {
-                return false;
-            }
-        }
-    }
-
-    // if we have reached the end of the string
-    if (*str == '\0' && curr->isLeaf)
-    {
-        // if current node is a leaf node and don't have any children
-        if (!haveChildren(curr))
-        {
-            delete curr;; // delete current node
-            curr = nullptr;
-            return true; // delete non-leaf parent nodes
-        }
-
-            // if current node is a leaf node and have children
+    ostringstream out;
+    for (unsigned char c : s) {
+        if (c >= 0x20 && c < 0x7F && c != '\\')
+            out << c;
         else
-        {
-            // mark current node as non-leaf node (DON'T DELETE IT)
-            curr->isLeaf = false;
-            return false;	   // don't delete its parent nodes
-        }
+            out << "\\x" << hex << setw(2) << setfill('0') << static_cast<int>(c) << dec;
     }
-
-    return false;
+    return out.str();
 }
 
-// Iterative function to search a string in Trie. It returns true
-// if the string is found in the Trie, else it returns false
-bool search(Trie* head, char* str)
-{
-    // return false if Trie is empty
-    if (head == nullptr)
-        return false;
-
-    Trie* curr = head;
-    while (*str)
-    {
-        // go to next node
-        curr = curr->map[*str];
-
-        // if string is invalid (reached end of path in Trie)
-        if (curr == nullptr)
-            return false;
-
-        // move to next character
-        str++;
-    }
-
-    // if current node is a leaf and we have reached the
-    // end of the string, return true
-    return curr->isLeaf;
-}
-
-void traverseTree(const Trie &node){
-        stack<Trie> trie_stack;
-        priority_queue<Trie, vector<Trie>, OrderByScore> trie_pq;
-        Trie head(node);
-        trie_stack.push(head);
-        head.code_word = "";
-        head.level = 0;
-        head.parent = nullptr;
-        while (!trie_stack.empty()) {
-            Trie tmp = trie_stack.top();
-            trie_stack.pop();
-            for (auto child : tmp.map) {
-                child.second->parent = &tmp;
-                child.second->level = child.second->parent->level + 1;
-                child.second->code_word = tmp.code_word + child.first;
-                child.second->score = returnScore(child.second->files, child.second->level);
-                trie_stack.push(*child.second);
-            }
-            if (tmp.level > 1 && tmp.score != 0)
-                trie_pq.push(tmp);
-        }
-
-/*        vector<Trie> &top_results = Container(trie_pq);
-        int i = 20;
-        for(const auto& trie : top_results){
-            if(i == 0)
-                break;
-            cout << "level: " << trie.level << " score: " << trie.score << endl;
-            cout << "string: " << trie.code_word << endl;
-            for(auto i : trie.files)
-                cout << i << " ";
-            cout << "\n" << endl;
-            i--;
-        }*/
-    }
-
 // Memory efficient Trie Implementation in C++ using Map
-    int main()
+    int main(int argc, char* argv[])
     {
-        string files [] = {"binarySerach.out", "BST.out", "bubbleSort.out", "matrixMultiply.out", "palindrom.out"};
-        Trie* head = nullptr;
-        std :: vector<int> data;
-        int number_file = 0;
-        for (const auto &file : files){
-            try {
-                string input = "/Users/itaytu/CLionProjects/Data-Compression/files/" + file;
-                ifstream in(input, ios::binary);
-                while(true) {
-                    int b = in.get();
-                    if(b == EOF)
-                        break;
-                    data.push_back(b);
+        vector<string> files;
+        bool external = false;
+        ExternalOptions options;
+        size_t top = 20;
+        try {
+            for (int i = 1; i < argc; i++) {
+                string arg = argv[i];
+                if (arg != "-m" && arg != "-d" && arg != "-n") {
+                    files.push_back(arg);
+                    continue;
                 }
-                in.close();
-            }
-            catch (const std :: exception& e){
-                std :: cout << e.what() << std :: endl;
+                if (i + 1 >= argc)
+                    throw invalid_argument("Missing value for option " + arg);
+                const char* value = argv[++i];
+                if (arg == "-m") {
+                    external = true;
+                    options.memory_limit = static_cast<size_t>(parseNumber(value)) << 20;
+                } else if (arg == "-d")
+                    options.temp_dir = value;
+                else
+                    top = parseNumber(value);
             }
+        } catch (const std :: exception& e) {
+            cerr << e.what() << endl;
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (files.empty()) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
 
-            for (int i = 0 ; i < data.size() - 16 ; i ++){
-                string s = "";
-                for (int j = i; j < 16 + i ; j ++){
-                    s += data[j];
+        vector<SharedSubstring> ranking;
+        try {
+            if (external) {
+                ExternalStats stats;
+                ranking = rankExternal(files, options, top, &stats);
+                cerr << stats.windows << " windows, " << stats.runs << " runs, " << stats.merges << " merges, "
+                     << stats.bytes_written << " bytes written" << endl;
+            } else {
+                Trie* head = nullptr;
+                vector<unsigned char> data;
+                int number_file = 0;
+                for (const auto &file : files){
+                    ifstream in(file, ios::binary);
+                    if (!in)
+                        throw runtime_error("Cannot open " + file);
+                    while(true) {
+                        int b = in.get();
+                        if(b == EOF)
+                            break;
+                        data.push_back(static_cast<unsigned char>(b));
+                    }
+                    in.close();
+                    insertWindows(head, data, number_file);
+                    data.clear();
+                    number_file ++;
                 }
-                insert(head, const_cast<char*>(s.c_str()), number_file);
+                if (head != nullptr)
+                    ranking = traverseTree(*head, number_file, top);
             }
-            data.clear();
-            number_file ++;
+        }
+        catch (const std :: exception& e){
+            cerr << e.what() << endl;
+            return EXIT_FAILURE;
         }
 
-        traverseTree(*head);
+        for (const SharedSubstring& s : ranking) {
+            cout << "level: " << s.level << " score: " << s.score << endl;
+            cout << "string: " << escape(s.code_word) << "\n" << endl;
+        }
 
         return 0;
-    }
\ No newline at end of file
+    }
@@ -0,0 +1,80 @@
+/*
+ * Code tables for the adaptive coder, cached by code lengths
+ */
+
+#include <stdexcept>
+#include "AdaptiveCodeCache.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+
+
+const int AdaptiveCodeCache::NUM_SLOTS;
+
+
+AdaptiveCodeCache::AdaptiveCodeCache() :
+		active(0),
+		clock(0),
+		hits(0),
+		misses(0) {
+	for (std::unique_ptr<Slot> &slot : slots)
+		slot.reset(new Slot);
+}
+
+
+const AdaptiveCodeCache::Kernel &AdaptiveCodeCache::select(const uint32_t *lengths) {
+	// FNV-1a over the lengths
+	uint64_t hash = UINT64_C(0xCBF29CE484222325);
+	for (int i = 0; i < 257; i++)
+		hash = (hash ^ lengths[i]) * UINT64_C(0x100000001B3);
+	clock++;
+
+	// The hash only narrows the search; a hit requires identical lengths
+	int victim = -1;
+	for (int i = 0; i < NUM_SLOTS; i++) {
+		Slot &slot = *slots[i];
+		if (slot.valid && slot.hash == hash) {
+			bool same = true;
+			for (int j = 0; j < 257 && same; j++)
+				same = slot.lengths[j] == lengths[j];
+			if (same) {
+				hits++;
+				slot.lastUse = clock;
+				active = i;
+				return slot.kernel;
+			}
+		}
+		if (i != active && (victim == -1 || !slot.valid || (slots[victim]->valid && slot.lastUse < slots[victim]->lastUse)))
+			victim = i;
+	}
+
+	misses++;
+	Slot &slot = *slots[victim];
+	slot.valid = false;
+	slot.kernel.build(lengths);  // Leaves the slot invalid if it throws
+	for (int j = 0; j < 257; j++)
+		slot.lengths[j] = static_cast<uint8_t>(lengths[j]);
+	slot.hash = hash;
+	slot.lastUse = clock;
+	slot.valid = true;
+	active = victim;
+	return slot.kernel;
+}
+
+
+const AdaptiveCodeCache::Kernel &AdaptiveCodeCache::select(const AdaptiveModel &model) {
+	if (model.getSymbolLimit() != 257)
+		throw std::invalid_argument("Model doesn't have 257 symbols");
+	return select(model.getCodeLengths());
+}
+
+
+uint64_t AdaptiveCodeCache::getHits() const {
+	return hits;
+}
+
+
+uint64_t AdaptiveCodeCache::getMisses() const {
+	return misses;
+}
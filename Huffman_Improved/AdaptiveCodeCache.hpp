@@ -0,0 +1,77 @@
+/*
+ * Code tables for the adaptive coder, cached by code lengths
+ *
+ * Every rebuild of an AdaptiveModel yields a new set of code lengths, and both the encoder and
+ * the decoder need a table for it. Instead of building a tree and walking it bit by bit, the cache
+ * builds a HuffmanKernel directly from the lengths, so a symbol takes one table lookup. The kernels
+ * live in a few slots managed as a least recently used list and keyed by a hash of the lengths;
+ * a rebuild that reproduces recent lengths (as happens once the statistics settle, or after the
+ * frequencies are reset to their initial values) just switches slots. The active slot is never
+ * evicted, so a new table is always built into a second buffer while the current one stays valid.
+ * The cache allocates nothing after construction.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include "AdaptiveModel.hpp"
+#include "HuffmanKernel.hpp"
+
+
+class AdaptiveCodeCache final {
+
+	/*---- Types and constants ----*/
+
+	// Byte values and the EOF symbol, with the model's length limit.
+	public: typedef HuffmanKernel<257, AdaptiveModel::MAX_CODE_LENGTH> Kernel;
+
+	public: static const int NUM_SLOTS = 4;
+
+
+	/*---- Fields ----*/
+
+	private: struct Slot final {
+		bool valid = false;
+		std::uint64_t hash = 0;
+		std::uint64_t lastUse = 0;
+		std::array<std::uint8_t, 257> lengths;
+		Kernel kernel;
+	};
+
+	private: std::array<std::unique_ptr<Slot>, NUM_SLOTS> slots;
+
+	// Index of the slot returned by the last call to select().
+	private: int active;
+
+	private: std::uint64_t clock;
+
+	private: std::uint64_t hits;
+
+	private: std::uint64_t misses;
+
+
+	/*---- Constructor ----*/
+
+	public: AdaptiveCodeCache();
+
+
+	/*---- Methods ----*/
+
+	// Returns the kernel for the given 257 code lengths, building it if it isn't cached.
+	// The reference stays valid until the next call. Throws std::invalid_argument if the lengths
+	// don't form a complete code of at most MAX_CODE_LENGTH bits.
+	public: const Kernel &select(const std::uint32_t *lengths);
+
+
+	// Returns the kernel for the current code of the given model, which must have 257 symbols.
+	public: const Kernel &select(const AdaptiveModel &model);
+
+
+	public: std::uint64_t getHits() const;
+
+
+	public: std::uint64_t getMisses() const;
+
+};
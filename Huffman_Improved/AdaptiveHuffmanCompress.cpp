@@ -1,13 +1,16 @@
 /* 
  * Compression application using adaptive Huffman coding
  * 
- * Usage: AdaptiveHuffmanCompress InputFile OutputFile
+ * Usage: AdaptiveHuffmanCompress InputFile OutputFile [Policy]
  * Then use the corresponding "AdaptiveHuffmanDecompress" application to recreate the original input file.
  * Note that the application starts with a flat frequency table of 257 symbols (all set to a frequency of 1),
  * collects statistics while bytes are being encoded, and regenerates the Huffman code periodically. The
  * corresponding decompressor program also starts with a flat frequency table, updates it while bytes are being
  * decoded, and regenerates the Huffman code periodically at the exact same points in time. It is by design that
  * the compressor and decompressor have synchronized states, so that the data can be decompressed properly.
+ * The optional Policy argument selects when the code is regenerated (see RebuildPolicy::parse(), default
+ * "backoff"); the decompressor must be given the same policy. A summary of the rebuild cost and the
+ * achieved ratio is printed to standard error.
  * 
  * Copyright (c) Project Nayuki
  * 
@@ -19,26 +22,32 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include "BitIoStream.hpp"
-#include "FrequencyTable.hpp"
+#include "AdaptiveModel.hpp"
 #include "HuffmanCoder.hpp"
+#include "RebuildPolicy.hpp"
 
 using std::uint32_t;
 
 
-static bool isPowerOf2(uint32_t x);
-
-
 int main(int argc, char *argv[]) {
 	// Handle command line arguments
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " InputFile OutputFile" << std::endl;
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " InputFile OutputFile [Policy]" << std::endl;
 		return EXIT_FAILURE;
 	}
 	const char *inputFile  = argv[1];
 	const char *outputFile = argv[2];
+	std::unique_ptr<RebuildPolicy> policy;
+	try {
+		policy = RebuildPolicy::parse(argc == 4 ? argv[3] : "backoff");
+	} catch (const std::invalid_argument &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
 	
 	// Perform file compression
 	std::ifstream in(inputFile, std::ios::binary);
@@ -47,11 +56,9 @@ int main(int argc, char *argv[]) {
 	try {
 		
 		const std::vector<uint32_t> initFreqs(257, 1);
-		FrequencyTable freqs(initFreqs);
+		AdaptiveModel model(initFreqs, *policy);
 		HuffmanEncoder enc(bout);
-		CodeTree tree = freqs.buildCodeTree();  // Don't need to make canonical code because we don't transmit the code tree
-		enc.codeTree = &tree;
-		uint32_t count = 0;  // Number of bytes read from the input file
+		enc.codeTree = &model.getCodeTree();
 		while (true) {
 			// Read and encode one byte
 			int symbol = in.get();
@@ -60,18 +67,22 @@ int main(int argc, char *argv[]) {
 			if (symbol < 0 || symbol > 255)
 				throw std::logic_error("Assertion error");
 			enc.write(static_cast<uint32_t>(symbol));
-			count++;
 			
 			// Update the frequency table and possibly the code tree
-			freqs.increment(static_cast<uint32_t>(symbol));
-			if ((count < 262144 && isPowerOf2(count)) || count % 262144 == 0)  // Update code tree
-				tree = freqs.buildCodeTree();
-			if (count % 262144 == 0)  // Reset frequency table
-				freqs = FrequencyTable(initFreqs);
+			model.update(static_cast<uint32_t>(symbol));
 		}
 		
 		enc.write(256);  // EOF
 		bout.finish();
+		
+		// Report the rebuild cost versus the achieved ratio
+		std::streamoff outSize = out.tellp();
+		std::cerr << "policy=" << policy->describe()
+			<< " input_bytes=" << model.getCount()
+			<< " output_bytes=" << outSize
+			<< " bits_per_byte=" << (model.getCount() > 0 ? outSize * 8.0 / model.getCount() : 0.0)
+			<< " rebuilds=" << model.getNumRebuilds()
+			<< " rebuild_ms=" << model.getRebuildSeconds() * 1000 << std::endl;
 		return EXIT_SUCCESS;
 		
 	} catch (const char *msg) {
@@ -79,8 +90,3 @@ int main(int argc, char *argv[]) {
 		return EXIT_FAILURE;
 	}
 }
-
-
-static bool isPowerOf2(uint32_t x) {
-	return x > 0 && (x & (x - 1)) == 0;
-}
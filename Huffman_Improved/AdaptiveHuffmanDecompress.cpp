@@ -1,8 +1,9 @@
 /* 
  * Decompression application using adaptive Huffman coding
  * 
- * Usage: AdaptiveHuffmanDecompress InputFile OutputFile
+ * Usage: AdaptiveHuffmanDecompress InputFile OutputFile [Policy]
  * This decompresses files generated by the "AdaptiveHuffmanCompress" application.
+ * The Policy argument must match the one given to the compressor (default "backoff").
  * 
  * Copyright (c) Project Nayuki
  * 
@@ -14,66 +15,79 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
-#include <limits>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
 #include <vector>
-#include "BitIoStream.hpp"
-#include "FrequencyTable.hpp"
-#include "HuffmanCoder.hpp"
+#include "AdaptiveCodeCache.hpp"
+#include "AdaptiveModel.hpp"
+#include "BitBuffer.hpp"
+#include "RebuildPolicy.hpp"
 
+using std::uint8_t;
 using std::uint32_t;
 
 
-static bool isPowerOf2(uint32_t x);
-
-
 int main(int argc, char *argv[]) {
 	// Handle command line arguments
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " InputFile OutputFile" << std::endl;
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " InputFile OutputFile [Policy]" << std::endl;
 		return EXIT_FAILURE;
 	}
 	const char *inputFile  = argv[1];
 	const char *outputFile = argv[2];
+	std::unique_ptr<RebuildPolicy> policy;
+	try {
+		policy = RebuildPolicy::parse(argc == 4 ? argv[3] : "backoff");
+	} catch (const std::invalid_argument &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
 	
-	// Perform file decompression
+	// Perform file decompression. The whole input is read into memory, so that
+	// symbols can be decoded with table lookups instead of walking the code tree.
 	std::ifstream in(inputFile, std::ios::binary);
 	std::ofstream out(outputFile, std::ios::binary);
-	BitInputStream bin(in);
 	try {
 		
+		const std::vector<uint8_t> input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		BitReader bin(input.data(), input.size());
 		const std::vector<uint32_t> initFreqs(257, 1);
-		FrequencyTable freqs(initFreqs);
-		HuffmanDecoder dec(bin);
-		CodeTree tree = freqs.buildCodeTree();  // Use same algorithm as the compressor
-		dec.codeTree = &tree;
-		uint32_t count = 0;  // Number of bytes written to the output file
+		AdaptiveModel model(initFreqs, *policy, false);  // Use same model as the compressor
+		AdaptiveCodeCache cache;
+		const AdaptiveCodeCache::Kernel *kernel = &cache.select(model);
+		std::vector<char> buffer;
+		buffer.reserve(1 << 16);
 		while (true) {
-			// Decode and write one byte
-			uint32_t symbol = dec.read();
+			// Decode and buffer one byte
+			bin.refill();
+			uint32_t symbol = kernel->decodeOne(bin);
 			if (symbol == 256)  // EOF symbol
 				break;
-			int b = static_cast<int>(symbol);
-			if (std::numeric_limits<char>::is_signed)
-				b -= (b >> 7) << 8;
-			out.put(static_cast<char>(b));
-			count++;
+			buffer.push_back(static_cast<char>(static_cast<uint8_t>(symbol)));
+			if (buffer.size() == buffer.capacity()) {
+				out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+				buffer.clear();
+			}
 			
-			// Update the frequency table and possibly the code tree
-			freqs.increment(symbol);
-			if ((count < 262144 && isPowerOf2(count)) || count % 262144 == 0)  // Update code tree
-				tree = freqs.buildCodeTree();
-			if (count % 262144 == 0)  // Reset frequency table
-				freqs = FrequencyTable(initFreqs);
+			// Update the frequency table and possibly the code
+			if (model.update(symbol))
+				kernel = &cache.select(model);
 		}
+		out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		std::cerr << "policy=" << policy->describe()
+			<< " output_bytes=" << model.getCount()
+			<< " rebuilds=" << model.getNumRebuilds()
+			<< " rebuild_ms=" << model.getRebuildSeconds() * 1000
+			<< " table_cache_hits=" << cache.getHits()
+			<< " table_builds=" << cache.getMisses() << std::endl;
 		return EXIT_SUCCESS;
 		
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
 	} catch (const char *msg) {
 		std::cerr << msg << std::endl;
 		return EXIT_FAILURE;
 	}
 }
-
-
-static bool isPowerOf2(uint32_t x) {
-	return x > 0 && (x & (x - 1)) == 0;
-}
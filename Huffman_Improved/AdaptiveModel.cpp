@@ -0,0 +1,95 @@
+/*
+ * Adaptive Huffman model shared by the adaptive compressor and decompressor
+ */
+
+#include <chrono>
+#include <stdexcept>
+#include "AdaptiveModel.hpp"
+#include "CanonicalCode.hpp"
+#include "Instrumentation.hpp"
+
+using std::uint32_t;
+
+
+const uint32_t AdaptiveModel::MAX_CODE_LENGTH;
+
+
+AdaptiveModel::AdaptiveModel(const std::vector<uint32_t> &initFrq, RebuildPolicy &pol, bool withTree) :
+		initFreqs(initFrq),
+		freqs(initFrq),
+		policy(pol),
+		count(0),
+		numRebuilds(0),
+		rebuildSeconds(0) {
+	if (initFreqs.size() > ZeroRun::SYMBOL_LIMIT)
+		throw std::domain_error("Too many symbols");
+	buildCodeLengths();
+	if (withTree)
+		tree.reset(new CodeTree(makeCodeTree()));
+}
+
+
+const CodeTree &AdaptiveModel::getCodeTree() const {
+	if (!tree)
+		throw std::logic_error("Model has no code tree");
+	return *tree;
+}
+
+
+const uint32_t *AdaptiveModel::getCodeLengths() const {
+	return lengths.data();
+}
+
+
+uint32_t AdaptiveModel::getSymbolLimit() const {
+	return freqs.getSymbolLimit();
+}
+
+
+bool AdaptiveModel::update(uint32_t symbol) {
+	freqs.increment(symbol);
+	count++;
+	bool rebuilt = false;
+	if (policy.shouldRebuild(count, freqs, getCodeLengths())) {
+		HUFF_PHASE(Phase::REBUILD);
+		HUFF_COUNT(Counter::TREE_REBUILDS, 1);
+		auto start = std::chrono::steady_clock::now();
+		buildCodeLengths();
+		if (tree)
+			*tree = makeCodeTree();
+		rebuildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		numRebuilds++;
+		rebuilt = true;
+	}
+	policy.updateStatistics(count, freqs, initFreqs);
+	return rebuilt;
+}
+
+
+void AdaptiveModel::buildCodeLengths() {
+	const uint32_t symbolLimit = freqs.getSymbolLimit();
+	for (uint32_t i = 0; i < ZeroRun::SYMBOL_LIMIT; i++)
+		buildFreqs[i] = i < symbolLimit ? freqs.get(i) : 0;
+	lengthBuilder.build(buildFreqs.data(), MAX_CODE_LENGTH, lengths.data());
+}
+
+
+CodeTree AdaptiveModel::makeCodeTree() const {
+	const uint32_t *lengths = getCodeLengths();
+	return CanonicalCode(std::vector<uint32_t>(lengths, lengths + freqs.getSymbolLimit())).toCodeTree();
+}
+
+
+uint32_t AdaptiveModel::getCount() const {
+	return count;
+}
+
+
+uint32_t AdaptiveModel::getNumRebuilds() const {
+	return numRebuilds;
+}
+
+
+double AdaptiveModel::getRebuildSeconds() const {
+	return rebuildSeconds;
+}
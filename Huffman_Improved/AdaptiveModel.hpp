@@ -0,0 +1,107 @@
+/*
+ * Adaptive Huffman model shared by the adaptive compressor and decompressor
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "CodeLengthBuilder.hpp"
+#include "CodeTree.hpp"
+#include "FrequencyTable.hpp"
+#include "RebuildPolicy.hpp"
+#include "ZeroRun.hpp"
+
+
+/*
+ * Holds the frequency table and code of an adaptive Huffman coder, and applies
+ * a rebuild policy after every symbol. The encoder and decoder each own one model with
+ * the same initial frequencies and policy, and call update() with the same symbols,
+ * so their codes are identical at every point in the code stream.
+ * The code is the canonical code for lengths limited to MAX_CODE_LENGTH bits, so a coder can
+ * work from the lengths alone (see AdaptiveCodeCache). The code tree is optional.
+ */
+class AdaptiveModel final {
+
+	/*---- Constants ----*/
+
+	public: static const std::uint32_t MAX_CODE_LENGTH = 12;
+
+
+	/*---- Fields ----*/
+
+	private: std::vector<std::uint32_t> initFreqs;
+
+	private: FrequencyTable freqs;
+
+	private: RebuildPolicy &policy;
+
+	// The frequencies for the code being built, padded to ZeroRun::SYMBOL_LIMIT symbols.
+	private: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT> buildFreqs;
+
+	// Code lengths of the current code, padded likewise.
+	private: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT> lengths;
+
+	// Computes the code lengths without allocating.
+	private: CodeLengthBuilder lengthBuilder;
+
+	// The code tree for the next symbol, or null if the model was constructed without one.
+	// Its address stays the same for the lifetime of this model, so a HuffmanEncoder or
+	// HuffmanDecoder can keep pointing at it.
+	private: std::unique_ptr<CodeTree> tree;
+
+	// Number of symbols passed to update().
+	private: std::uint32_t count;
+
+	// Number of times the code was regenerated after construction.
+	private: std::uint32_t numRebuilds;
+
+	// Total wall time spent regenerating codes, in seconds.
+	private: double rebuildSeconds;
+
+
+	/*---- Constructor ----*/
+
+	// Constructs a model with the given initial frequencies (at most ZeroRun::SYMBOL_LIMIT symbols)
+	// and rebuild policy. The policy object must outlive this model. Coders that only need the
+	// code lengths pass withTree = false, which saves building a tree on every rebuild.
+	public: explicit AdaptiveModel(const std::vector<std::uint32_t> &initFrq, RebuildPolicy &pol, bool withTree = true);
+
+
+	/*---- Methods ----*/
+
+	// Returns the code tree to use for the next symbol. Requires a model constructed with a tree.
+	public: const CodeTree &getCodeTree() const;
+
+
+	// Returns the code lengths of the code for the next symbol, one per symbol.
+	public: const std::uint32_t *getCodeLengths() const;
+
+
+	public: std::uint32_t getSymbolLimit() const;
+
+
+	// Counts the given symbol and regenerates the code if the policy says so.
+	// Returns true if the code changed.
+	public: bool update(std::uint32_t symbol);
+
+
+	public: std::uint32_t getCount() const;
+
+
+	public: std::uint32_t getNumRebuilds() const;
+
+
+	public: double getRebuildSeconds() const;
+
+
+	// Sets the code lengths for the current frequencies.
+	private: void buildCodeLengths();
+
+
+	// Returns the canonical code tree for the current code lengths.
+	private: CodeTree makeCodeTree() const;
+
+};
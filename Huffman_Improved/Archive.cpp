@@ -0,0 +1,365 @@
+/*
+ * Multi-file archives of block container streams
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include "Archive.hpp"
+#include "BlockPipeline.hpp"
+#include "ByteIo.hpp"
+#include "Crc32c.hpp"
+#include "ElfLayout.hpp"
+#include "Huffman4Codec.hpp"
+#include "Instrumentation.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+const uint8_t Archive::DIRECTORY_SHARED_CODE;
+const size_t Archive::MAX_NAME_LENGTH;
+
+static const uint8_t MAGIC[] = {'H', 'U', 'F', 'A'};
+static const uint8_t VERSION = 1;
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 1;
+static const size_t TRAILER_SIZE = 8 + sizeof(MAGIC);
+
+// Bytes read at a time when counting the symbols of the corpus.
+static const size_t COUNT_CHUNK_SIZE = 1 << 20;
+
+
+// Returns the longest code length that the given codec accepts in a cached code.
+static uint32_t getMaxCodeLength(BlockCodec codec) {
+	return codec == BlockCodec::HUFFMAN ? HuffmanKernels::LongKernel::MAX_LENGTH : Huffman4Codec::MAX_CODE_LENGTH;
+}
+
+
+static void openFile(std::ifstream &file, const std::string &path) {
+	file.open(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Cannot open " + path);
+}
+
+
+// Builds a code for the zero-run symbols of all the given files together that gives every symbol a length.
+static void buildSharedCode(const vector<std::string> &paths, SharedCode &code, CoderContext &ctx) {
+	uint64_t counts[ZeroRun::SYMBOL_LIMIT] = {};
+	vector<uint8_t> chunk(COUNT_CHUNK_SIZE);
+	for (const std::string &path : paths) {
+		std::ifstream file;
+		openFile(file, path);
+		while (true) {
+			file.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+			const size_t len = static_cast<size_t>(file.gcount());
+			if (file.bad())
+				throw std::runtime_error("Error reading " + path);
+			if (len == 0)
+				break;
+			ctx.symbols.clear();
+			ZeroRun::toSymbols(chunk.data(), len, ctx.symbols);
+			for (uint32_t sym : ctx.symbols)
+				counts[sym]++;
+		}
+	}
+
+	// Scale the counts so that their sum fits the 32-bit weights of buildCodeLengths()
+	uint64_t total = ZeroRun::SYMBOL_LIMIT;
+	for (uint64_t count : counts)
+		total += count;
+	int shift = 0;
+	for (; (total >> shift) >= (static_cast<uint64_t>(1) << 31); shift++);
+	for (uint32_t sym = 0; sym < ZeroRun::SYMBOL_LIMIT; sym++)
+		ctx.freqs[sym] = static_cast<uint32_t>(std::max<uint64_t>(counts[sym] >> shift, 1));
+	ctx.buildCodeLengths(getMaxCodeLength(code.codec));
+	std::copy(ctx.lengths.begin(), ctx.lengths.end(), code.lengths.begin());
+}
+
+
+CodingStats Archive::create(std::ostream &out, const vector<std::string> &paths, const vector<std::string> &names,
+		const CompressOptions &options, bool splitElf) {
+	if (paths.size() != names.size())
+		throw std::invalid_argument("Every member needs a name");
+	if (paths.size() > UINT32_MAX)
+		throw std::invalid_argument("Too many members");
+	std::set<std::string> seen;
+	for (const std::string &name : names) {
+		if (name.empty() || name.size() > MAX_NAME_LENGTH)
+			throw std::invalid_argument("Invalid member name: " + name);
+		if (!seen.insert(name).second)
+			throw std::invalid_argument("Duplicate member name: " + name);
+	}
+	if (options.blockSize == 0 || options.blockSize > BlockWriter::MAX_BLOCK_SIZE)
+		throw std::invalid_argument("Invalid block size");
+	const auto start = std::chrono::steady_clock::now();
+	CodingStats stats;
+
+	// A corpus code only pays when several members can share it
+	ArchiveDirectory dir;
+	CompressOptions memberOptions = options;
+	memberOptions.blockCuts.clear();
+	memberOptions.sharedCode = nullptr;
+	if (paths.size() >= 2 && options.reuseCodes && (options.autoCodec || BlockCoder::canCacheCode(options.codec))) {
+		std::unique_ptr<CoderContext> ctx(new CoderContext);
+		dir.hasSharedCode = true;
+		dir.sharedCode.codec = options.autoCodec ? BlockCodec::HUFFMAN : options.codec;
+		buildSharedCode(paths, dir.sharedCode, *ctx);
+		memberOptions.sharedCode = &dir.sharedCode;
+	}
+
+	vector<uint8_t> header(MAGIC, MAGIC + sizeof(MAGIC));
+	header.push_back(VERSION);
+	out.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+	uint64_t position = header.size();
+
+	// The read stage walks through the files, cutting each into groups; every member gets at least
+	// one slot, so that the write stage sees each of them begin
+	const uint32_t groupSize = StreamCoder::getGroupSize(memberOptions);
+	const uint64_t minRegionSize = options.autoCodec || options.codec == BlockCodec::LZ77 ? ElfLayout::MIN_LZ77_REGION_SIZE : ElfLayout::MIN_REGION_SIZE;
+	size_t nextMember = 0;
+	std::ifstream file;
+	uint64_t filePosition = 0;
+	vector<uint64_t> cuts;
+	size_t nextCut = 0;
+
+	const uint8_t streamFlags = StreamCoder::getStreamFlags(memberOptions);
+	dir.members.resize(paths.size());
+	std::atomic<uint64_t> sharedUses(0);
+	size_t member = 0;  // Being written
+	std::unique_ptr<BlockWriter> writer;
+	auto finishMember = [&]() {
+		writer->finish();
+		ArchiveMember &entry = dir.members[member];
+		entry.compressedSize = writer->getBytesWritten();
+		position += entry.compressedSize;
+		writer.reset();
+	};
+
+	BlockPipeline pipeline(std::max(options.threads, 1U));
+	pipeline.run(
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::READ_INPUT);
+			if (!file.is_open()) {
+				if (nextMember == paths.size())
+					return false;
+				openFile(file, paths[nextMember]);
+				cuts.clear();
+				if (splitElf)
+					cuts = ElfLayout::getCuts(ElfLayout::parse(file, minRegionSize));
+				filePosition = 0;
+				nextCut = 0;
+			}
+			slot.source = nextMember;
+			for (; nextCut < cuts.size() && cuts[nextCut] <= filePosition; nextCut++);
+			uint32_t size = groupSize;
+			if (nextCut < cuts.size())
+				size = static_cast<uint32_t>(std::min<uint64_t>(size, cuts[nextCut] - filePosition));
+			slot.input.resize(groupSize);
+			file.read(reinterpret_cast<char*>(slot.input.data()), static_cast<std::streamsize>(size));
+			slot.rawLength = static_cast<uint32_t>(file.gcount());
+			if (file.bad())
+				throw std::runtime_error("Error reading " + paths[nextMember]);
+			filePosition += slot.rawLength;
+			HUFF_COUNT(Counter::BYTES_IN, slot.rawLength);
+			if (file.peek() == std::char_traits<char>::eof()) {
+				file.close();
+				nextMember++;
+			}
+			return true;
+		},
+		[&](PipelineSlot &slot, CoderContext &ctx) {
+			sharedUses += StreamCoder::encodeGroup(slot, ctx, memberOptions);
+		},
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::WRITE_OUTPUT);
+			if (writer == nullptr || slot.source != member) {
+				if (writer != nullptr)
+					finishMember();
+				member = slot.source;
+				dir.members[member].name = names[member];
+				dir.members[member].offset = position;
+				writer.reset(new BlockWriter(out, streamFlags));
+			}
+			size_t offset = 0;
+			for (const BlockHeader &block : slot.blocks) {
+				HUFF_COUNT(Counter::BYTES_OUT, writer->getBlockHeaderSize() + block.payloadSize);
+				writer->writeBlock(block, slot.output.data() + offset);
+				offset += block.payloadSize;
+				dir.members[member].rawSize += block.rawSize;
+				stats.bytesIn += block.rawSize;
+				StreamCoder::countBlock(stats, block);
+			}
+		});
+	if (writer != nullptr)
+		finishMember();
+
+	// Directory and trailer. The member streams can do without a shared code that no block uses.
+	dir.hasSharedCode = sharedUses > 0;
+	vector<uint8_t> directory;
+	directory.push_back(dir.hasSharedCode ? DIRECTORY_SHARED_CODE : 0);
+	if (dir.hasSharedCode) {
+		directory.push_back(static_cast<uint8_t>(dir.sharedCode.codec));
+		for (uint32_t len : dir.sharedCode.lengths)
+			directory.push_back(static_cast<uint8_t>(len));
+	}
+	ByteIo::putU32(directory, static_cast<uint32_t>(dir.members.size()));
+	for (const ArchiveMember &entry : dir.members) {
+		ByteIo::putU16(directory, static_cast<uint32_t>(entry.name.size()));
+		directory.insert(directory.end(), entry.name.begin(), entry.name.end());
+		ByteIo::putU64(directory, entry.rawSize);
+		ByteIo::putU64(directory, entry.offset);
+		ByteIo::putU64(directory, entry.compressedSize);
+	}
+	ByteIo::putU32(directory, Crc32c::compute(directory.data(), directory.size()));
+	ByteIo::putU64(directory, position);
+	directory.insert(directory.end(), MAGIC, MAGIC + sizeof(MAGIC));
+	out.write(reinterpret_cast<const char*>(directory.data()), static_cast<std::streamsize>(directory.size()));
+	out.flush();
+	if (!out)
+		throw std::runtime_error("Error writing output");
+	stats.bytesOut = position + directory.size();
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+
+// Reads exactly len bytes at the given position of the archive.
+static void readAt(std::istream &in, uint64_t position, uint8_t *data, size_t len) {
+	in.clear();
+	in.seekg(static_cast<std::streamoff>(position));
+	in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(len));
+	if (static_cast<size_t>(in.gcount()) != len)
+		throw std::runtime_error("Truncated archive");
+}
+
+
+// Tests whether the given code lengths, none longer than maxLength, form a complete prefix code.
+static bool isCompleteCode(const uint32_t *lengths, uint32_t maxLength) {
+	uint64_t kraft = 0;
+	for (uint32_t sym = 0; sym < ZeroRun::SYMBOL_LIMIT; sym++) {
+		if (lengths[sym] > maxLength)
+			return false;
+		if (lengths[sym] > 0)
+			kraft += static_cast<uint64_t>(1) << (maxLength - lengths[sym]);
+	}
+	return kraft == static_cast<uint64_t>(1) << maxLength;
+}
+
+
+ArchiveDirectory Archive::readDirectory(std::istream &in) {
+	in.clear();
+	in.seekg(0, std::ios::end);
+	const std::streamoff end = in.tellg();
+	if (end < 0)
+		throw std::runtime_error("Archive is not seekable");
+	const uint64_t size = static_cast<uint64_t>(end);
+	if (size < HEADER_SIZE + TRAILER_SIZE)
+		throw std::runtime_error("Not an archive");
+	uint8_t header[HEADER_SIZE];
+	readAt(in, 0, header, sizeof(header));
+	if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), header))
+		throw std::runtime_error("Not an archive");
+	if (header[sizeof(MAGIC)] != VERSION)
+		throw std::runtime_error("Unsupported archive version");
+	uint8_t trailer[TRAILER_SIZE];
+	readAt(in, size - TRAILER_SIZE, trailer, sizeof(trailer));
+	if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), trailer + 8))
+		throw std::runtime_error("Missing archive trailer");
+
+	ArchiveDirectory dir;
+	const uint8_t *p = trailer;
+	dir.offset = ByteIo::getU64(p, trailer + 8);
+	if (dir.offset < HEADER_SIZE || dir.offset > size - TRAILER_SIZE)
+		throw std::runtime_error("Invalid directory offset");
+	vector<uint8_t> directory(static_cast<size_t>(size - TRAILER_SIZE - dir.offset));
+	readAt(in, dir.offset, directory.data(), directory.size());
+	if (directory.size() < 4)
+		throw std::runtime_error("Truncated directory");
+	const uint8_t *const crcStart = directory.data() + directory.size() - 4;
+	const uint8_t *q = crcStart;
+	if (ByteIo::getU32(q, crcStart + 4) != Crc32c::compute(directory.data(), directory.size() - 4))
+		throw std::runtime_error("Directory checksum mismatch");
+
+	p = directory.data();
+	const uint8_t *const dirEnd = crcStart;
+	const uint32_t flags = ByteIo::getU8(p, dirEnd);
+	if ((flags & ~static_cast<uint32_t>(DIRECTORY_SHARED_CODE)) != 0)
+		throw std::runtime_error("Unknown directory flags");
+	dir.hasSharedCode = (flags & DIRECTORY_SHARED_CODE) != 0;
+	if (dir.hasSharedCode) {
+		const uint32_t codec = ByteIo::getU8(p, dirEnd);
+		if (!BlockCoder::isValid(static_cast<uint8_t>(codec)) || !BlockCoder::canCacheCode(static_cast<BlockCodec>(codec)))
+			throw std::runtime_error("Invalid shared code");
+		dir.sharedCode.codec = static_cast<BlockCodec>(codec);
+		for (uint32_t &len : dir.sharedCode.lengths)
+			len = ByteIo::getU8(p, dirEnd);
+		if (!isCompleteCode(dir.sharedCode.lengths.data(), getMaxCodeLength(dir.sharedCode.codec)))
+			throw std::runtime_error("Invalid shared code");
+	}
+	const uint32_t count = ByteIo::getU32(p, dirEnd);
+	if (count > static_cast<size_t>(dirEnd - p) / 26)  // Each entry takes at least 26 bytes
+		throw std::runtime_error("Invalid member count");
+	dir.members.resize(count);
+	for (ArchiveMember &entry : dir.members) {
+		const uint32_t nameLength = ByteIo::getU16(p, dirEnd);
+		if (nameLength > static_cast<size_t>(dirEnd - p))
+			throw std::runtime_error("End of stream");
+		entry.name.assign(reinterpret_cast<const char*>(p), nameLength);
+		p += nameLength;
+		entry.rawSize = ByteIo::getU64(p, dirEnd);
+		entry.offset = ByteIo::getU64(p, dirEnd);
+		entry.compressedSize = ByteIo::getU64(p, dirEnd);
+		if (entry.offset < HEADER_SIZE || entry.offset > dir.offset || entry.compressedSize > dir.offset - entry.offset)
+			throw std::runtime_error("Invalid member position");
+	}
+	if (p != dirEnd)
+		throw std::runtime_error("Malformed directory");
+	return dir;
+}
+
+
+size_t Archive::findMember(const ArchiveDirectory &dir, const std::string &name) {
+	size_t i = 0;
+	for (; i < dir.members.size() && dir.members[i].name != name; i++);
+	return i;
+}
+
+
+bool Archive::isArchive(std::istream &in) {
+	uint8_t header[sizeof(MAGIC)];
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	const bool result = in.gcount() == static_cast<std::streamsize>(sizeof(header)) && std::equal(MAGIC, MAGIC + sizeof(MAGIC), header);
+	in.clear();
+	in.seekg(0);
+	return result;
+}
+
+
+CodingStats Archive::extract(std::istream &in, const ArchiveDirectory &dir, size_t index, std::ostream &out, unsigned int threads) {
+	const ArchiveMember &entry = dir.members.at(index);
+	in.clear();
+	in.seekg(static_cast<std::streamoff>(entry.offset));
+	CodingStats stats = StreamCoder::decompress(in, out, threads, dir.hasSharedCode ? &dir.sharedCode : nullptr);
+	if (stats.bytesOut != entry.rawSize)
+		throw std::runtime_error("Member size mismatch: " + entry.name);
+	return stats;
+}
+
+
+SearchResult Archive::search(std::istream &in, const ArchiveDirectory &dir, size_t index, const vector<uint8_t> &pattern, unsigned int threads) {
+	const ArchiveMember &entry = dir.members.at(index);
+	in.clear();
+	in.seekg(static_cast<std::streamoff>(entry.offset));
+	SearchResult result = StreamSearch::search(in, pattern, threads, dir.hasSharedCode ? &dir.sharedCode : nullptr);
+	if (result.rawBytes != entry.rawSize)
+		throw std::runtime_error("Member size mismatch: " + entry.name);
+	return result;
+}
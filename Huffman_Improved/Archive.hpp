@@ -0,0 +1,124 @@
+/*
+ * Multi-file archives of block container streams
+ *
+ * An archive holds each member file as a complete block container stream (see BlockContainer.hpp),
+ * followed by a central directory, so a single member is extracted by reading the fixed-size
+ * trailer, then the directory, then seeking straight to the member's stream. All integers are big
+ * endian. Layout:
+ * - Archive header: the magic bytes "HUFA" and a version byte (1).
+ * - The member streams, one after another in directory order.
+ * - Directory: a flags byte (DIRECTORY_SHARED_CODE), then if that flag is set the shared code, as its
+ *   codec identifier (1 byte) and ZeroRun::SYMBOL_LIMIT code lengths (1 byte each), then the number
+ *   of members (4 bytes) and for each member: name length (2 bytes), name (UTF-8, no terminator),
+ *   raw size (8 bytes), offset of its stream from the start of the archive (8 bytes) and size of
+ *   its stream (8 bytes); then the CRC-32C of all preceding directory bytes (4 bytes).
+ * - Trailer: the offset of the directory (8 bytes) and the magic bytes "HUFA".
+ *
+ * Small files gain little from a code of their own, since the table costs as much as a few hundred
+ * bytes of data. When the codec can use cached codes (HUFFMAN, HUFFMAN4 or auto) and codes may be
+ * reused, create() therefore first counts the zero-run symbols of all members and builds one code
+ * for the whole corpus that gives every symbol a length. Each block of every member may use it
+ * without a table when that is smaller (see CompressOptions::sharedCode); the code is stored once, in
+ * the directory, unless no block ended up using it. The members are then compressed by one
+ * BlockPipeline whose read stage walks through the files, so blocks of different members are coded
+ * concurrently and memory stays bounded by the pipeline's 2 * threads + 1 slots no matter how many
+ * or how large the files are.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CoderContext.hpp"
+#include "StreamCoder.hpp"
+#include "StreamSearch.hpp"
+
+
+/*
+ * One entry of the central directory.
+ */
+struct ArchiveMember final {
+
+	std::string name;
+
+	std::uint64_t rawSize = 0;
+
+	// Position of the member's block container stream from the start of the archive, and its length.
+	std::uint64_t offset = 0;
+
+	std::uint64_t compressedSize = 0;
+
+};
+
+
+
+/*
+ * The central directory of an archive.
+ */
+struct ArchiveDirectory final {
+
+	std::vector<ArchiveMember> members;
+
+	bool hasSharedCode = false;
+
+	// The code that the member streams may refer to, if hasSharedCode.
+	SharedCode sharedCode;
+
+	// Position of the directory from the start of the archive.
+	std::uint64_t offset = 0;
+
+};
+
+
+
+class Archive final {
+
+	/*---- Constants ----*/
+
+	// Directory flag for a stored shared code.
+	public: static const std::uint8_t DIRECTORY_SHARED_CODE = 0x01;
+
+	// Longest member name in bytes.
+	public: static const std::size_t MAX_NAME_LENGTH = 65535;
+
+
+	/*---- Methods ----*/
+
+	// Compresses the files at the given paths into an archive written to out, storing each under the
+	// corresponding name, with the given options for every member; blockCuts are replaced by the
+	// region boundaries of ELF members if splitElf is true, and sharedCode by the corpus code.
+	// Throws std::invalid_argument if a name is empty, too long or repeated, and std::runtime_error
+	// on I/O errors.
+	public: static CodingStats create(std::ostream &out, const std::vector<std::string> &paths,
+		const std::vector<std::string> &names, const CompressOptions &options, bool splitElf);
+
+
+	// Reads the central directory of the given seekable archive.
+	// Throws std::runtime_error if the archive is malformed or on I/O errors.
+	public: static ArchiveDirectory readDirectory(std::istream &in);
+
+
+	// Returns the index of the member with the given name, or the number of members if there is none.
+	public: static std::size_t findMember(const ArchiveDirectory &dir, const std::string &name);
+
+
+	// Tests whether the given seekable stream starts with the magic bytes of an archive, and seeks back to its start.
+	public: static bool isArchive(std::istream &in);
+
+
+	// Decompresses the member with the given index of the given archive to out, like StreamCoder::decompress().
+	// Throws std::runtime_error if the member is malformed or on I/O errors.
+	public: static CodingStats extract(std::istream &in, const ArchiveDirectory &dir, std::size_t index,
+		std::ostream &out, unsigned int threads);
+
+
+	// Searches the member with the given index of the given archive for the given pattern, like StreamSearch::search().
+	// Throws std::runtime_error if the member is malformed or on I/O errors.
+	public: static SearchResult search(std::istream &in, const ArchiveDirectory &dir, std::size_t index,
+		const std::vector<std::uint8_t> &pattern, unsigned int threads);
+
+};
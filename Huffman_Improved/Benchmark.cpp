@@ -0,0 +1,703 @@
+/*
+ * Micro and macro benchmarks
+ *
+ * Usage: huffman_bench [--benchmark_filter=Regex] [--benchmark_format=json] [--benchmark_out=File]
+ * Covers the bit streams, checksums, code construction, the table-driven and templated symbol kernels, every block codec on several inputs, the adaptive
+ * model under each rebuild policy, and trie insertion. The inputs are the concatenated files of
+ * the corpus directory (HUFF_CORPUS_DIR in the environment, or the repository's "files" directory)
+ * and synthetic data: random bytes, zero-heavy bytes and text. Throughput is reported in bytes per
+ * second (MB/s) and as time per input byte ("time_per_symbol", ns/symbol). The BM_Context
+ * benchmarks also count heap allocations per block ("allocs") and fail if it is not 0, since a
+ * reused CoderContext makes these codecs allocation-free. Use the JSON output to track regressions between builds.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <benchmark/benchmark.h>
+#include "../AnalyseAlphaBet/Trie.hpp"
+#include "AdaptiveModel.hpp"
+#include "BitBuffer.hpp"
+#include "BitIoStream.hpp"
+#include "BitOps.hpp"
+#include "BlockCodec.hpp"
+#include "BlockSplitter.hpp"
+#include "CanonicalCode.hpp"
+#include "CoderContext.hpp"
+#include "Crc32c.hpp"
+#include "FrequencyTable.hpp"
+#include "HuffmanKernel.hpp"
+#include "HuffmanTable.hpp"
+#include "MultiSymbolTable.hpp"
+#include "RebuildPolicy.hpp"
+#include "X86Filter.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::size_t;
+using std::string;
+using std::vector;
+
+
+/*---- Allocation counting ----*/
+
+static std::atomic<std::uint64_t> numAllocations(0);
+
+
+// Replacements for every global allocation function of C++14, so that each allocation is counted
+// however it is made. They are kept out of line: inlined into a delete expression, free() would be
+// seen releasing a pointer from operator new, which GCC reports as a mismatched pair.
+
+static void *countedAlloc(size_t size) noexcept {
+	numAllocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size > 0 ? size : 1);
+}
+
+
+__attribute__((noinline)) void *operator new(size_t size) {
+	if (void *p = countedAlloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+
+__attribute__((noinline)) void *operator new[](size_t size) {
+	if (void *p = countedAlloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+
+__attribute__((noinline)) void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return countedAlloc(size);
+}
+
+
+__attribute__((noinline)) void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return countedAlloc(size);
+}
+
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
+
+
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept {
+	std::free(p);
+}
+
+
+__attribute__((noinline)) void operator delete(void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+
+__attribute__((noinline)) void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+
+/*---- Inputs ----*/
+
+static const size_t SYNTHETIC_SIZE = 1 << 20;
+
+
+static vector<uint8_t> loadCorpus() {
+	const char *env = std::getenv("HUFF_CORPUS_DIR");
+	string dir = env != nullptr ? env : HUFF_CORPUS_DIR;
+	vector<string> names;
+	if (DIR *d = opendir(dir.c_str())) {
+		while (struct dirent *entry = readdir(d)) {
+			if (entry->d_name[0] != '.')
+				names.push_back(entry->d_name);
+		}
+		closedir(d);
+	}
+	std::sort(names.begin(), names.end());
+	vector<uint8_t> result;
+	for (const string &name : names) {
+		std::ifstream in(dir + "/" + name, std::ios::binary);
+		result.insert(result.end(), std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	return result;
+}
+
+
+static vector<uint8_t> makeRandom() {
+	std::mt19937 rng(1);
+	vector<uint8_t> result(SYNTHETIC_SIZE);
+	for (uint8_t &b : result)
+		b = static_cast<uint8_t>(rng());
+	return result;
+}
+
+
+// Runs of zeros (geometric lengths) between short stretches of skewed non-zero bytes.
+static vector<uint8_t> makeZeroHeavy() {
+	std::mt19937 rng(2);
+	std::geometric_distribution<int> runLength(1.0 / 24);
+	std::geometric_distribution<int> literal(0.15);
+	vector<uint8_t> result;
+	while (result.size() < SYNTHETIC_SIZE) {
+		result.insert(result.end(), static_cast<size_t>(runLength(rng)), 0);
+		for (int n = static_cast<int>(rng() % 8); n > 0; n--)
+			result.push_back(static_cast<uint8_t>(1 + literal(rng) % 255));
+	}
+	result.resize(SYNTHETIC_SIZE);
+	return result;
+}
+
+
+static vector<uint8_t> makeText() {
+	static const char *const WORDS[] = {
+		"the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with",
+		"be", "by", "on", "not", "he", "this", "are", "or", "his", "from", "at", "which",
+		"but", "have", "an", "had", "they", "you", "were", "their", "one", "all", "we", "can",
+		"compression", "symbol", "frequency", "canonical", "stream", "block", "table", "code"};
+	const size_t numWords = sizeof(WORDS) / sizeof(WORDS[0]);
+	std::mt19937 rng(3);
+	vector<uint8_t> result;
+	while (result.size() < SYNTHETIC_SIZE) {
+		// Zipf-like choice: favour the first words
+		size_t w = static_cast<size_t>(rng() % numWords);
+		w = static_cast<size_t>(rng() % (w + 1));
+		const char *word = WORDS[w];
+		result.insert(result.end(), word, word + std::char_traits<char>::length(word));
+		result.push_back(rng() % 12 == 0 ? '\n' : ' ');
+	}
+	result.resize(SYNTHETIC_SIZE);
+	return result;
+}
+
+
+enum InputKind { CORPUS, RANDOM, ZERO_HEAVY, TEXT, NUM_INPUTS };
+
+static const char *const INPUT_NAMES[] = {"corpus", "random", "zeros", "text"};
+
+
+static const vector<uint8_t> &getInput(int kind) {
+	static vector<uint8_t> inputs[NUM_INPUTS] = {loadCorpus(), makeRandom(), makeZeroHeavy(), makeText()};
+	return inputs[kind];
+}
+
+
+static FrequencyTable getSymbolFrequencies(const vector<uint8_t> &data) {
+	vector<uint32_t> symbols;
+	ZeroRun::toSymbols(data.data(), data.size(), symbols);
+	FrequencyTable freqs(vector<uint32_t>(ZeroRun::SYMBOL_LIMIT, 0));
+	for (uint32_t sym : symbols)
+		freqs.increment(sym);
+	freqs.increment(ZeroRun::EOF_SYMBOL);
+	return freqs;
+}
+
+
+static void setThroughput(benchmark::State &state, size_t bytesPerIteration) {
+	state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * bytesPerIteration));
+	// Seconds per input byte; the console shows it with an SI prefix (e.g. "4.2ns")
+	state.counters["time_per_symbol"] = benchmark::Counter(static_cast<double>(bytesPerIteration),
+		benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+
+/*---- Bit I/O ----*/
+
+static void BM_BitOutputStream(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(RANDOM);
+	for (auto _ : state) {
+		std::ostringstream out;
+		BitOutputStream bout(out);
+		for (uint8_t b : data) {
+			for (int j = 7; j >= 0; j--)
+				bout.write((b >> j) & 1);
+		}
+		bout.finish();
+		benchmark::DoNotOptimize(out);
+	}
+	setThroughput(state, data.size());
+}
+BENCHMARK(BM_BitOutputStream);
+
+
+static void BM_BitInputStream(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(RANDOM);
+	const string buf(data.begin(), data.end());
+	for (auto _ : state) {
+		std::istringstream in(buf);
+		BitInputStream bin(in);
+		int sum = 0;
+		while (bin.read() != -1)
+			sum++;
+		benchmark::DoNotOptimize(sum);
+	}
+	setThroughput(state, data.size());
+}
+BENCHMARK(BM_BitInputStream);
+
+
+// Writes and reads codes of 1 to 13 bits, like a Huffman coder would
+static void BM_BitWriter(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(RANDOM);
+	vector<uint8_t> out;
+	for (auto _ : state) {
+		out.clear();
+		BitWriter bout(out);
+		for (uint8_t b : data)
+			bout.write(b, 1 + b % 13);
+		bout.finish();
+		benchmark::DoNotOptimize(out.data());
+	}
+	setThroughput(state, data.size());
+}
+BENCHMARK(BM_BitWriter);
+
+
+static void BM_BitReader(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(RANDOM);
+	for (auto _ : state) {
+		BitReader bin(data.data(), data.size());
+		uint32_t sum = 0;
+		for (size_t i = 0; i < data.size() / 2; i++)
+			sum += bin.read(1 + static_cast<int>(i % 13));
+		benchmark::DoNotOptimize(sum);
+	}
+	setThroughput(state, data.size());
+}
+BENCHMARK(BM_BitReader);
+
+
+static void BM_Crc32c(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(RANDOM);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(Crc32c::compute(data.data(), data.size()));
+	setThroughput(state, data.size());
+	state.SetLabel(Crc32c::isHardwareAccelerated() ? "sse4.2" : "software");
+}
+BENCHMARK(BM_Crc32c);
+
+
+// Filters and restores the input in place, so every iteration sees the same data
+static void BM_X86Filter(benchmark::State &state) {
+	vector<uint8_t> data = getInput(static_cast<int>(state.range(0)));
+	for (auto _ : state) {
+		X86Filter::encode(data.data(), data.size());
+		X86Filter::decode(data.data(), data.size());
+		benchmark::DoNotOptimize(data.data());
+	}
+	if (data != getInput(static_cast<int>(state.range(0))))
+		state.SkipWithError("Restored data differs from the input");
+	setThroughput(state, 2 * data.size());
+	state.SetLabel(string(INPUT_NAMES[state.range(0)]) + (X86Filter::detect(data.data(), data.size()) ? ", x86" : ""));
+}
+BENCHMARK(BM_X86Filter)->DenseRange(0, NUM_INPUTS - 1);
+
+
+// Splits the whole input with a reused CoderContext, after a warm-up pass
+static void BM_BlockSplitter(benchmark::State &state) {
+	const vector<uint8_t> data = getInput(static_cast<int>(state.range(0)));
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	vector<uint32_t> lengths;
+	BlockSplitter::split(data.data(), data.size(), BlockCodec::HUFFMAN4, lengths, *ctx);
+	const std::uint64_t allocsBefore = numAllocations.load();
+	for (auto _ : state) {
+		BlockSplitter::split(data.data(), data.size(), BlockCodec::HUFFMAN4, lengths, *ctx);
+		benchmark::DoNotOptimize(lengths.data());
+	}
+	state.counters["allocs"] = static_cast<double>(numAllocations.load() - allocsBefore) / state.iterations();
+	setThroughput(state, data.size());
+	state.SetLabel(string(INPUT_NAMES[state.range(0)]) + ", " + std::to_string(lengths.size()) + " parts");
+}
+BENCHMARK(BM_BlockSplitter)->DenseRange(0, NUM_INPUTS - 1);
+
+
+/*---- Code construction ----*/
+
+static void BM_BuildCodeTree(benchmark::State &state) {
+	const FrequencyTable freqs = getSymbolFrequencies(getInput(static_cast<int>(state.range(0))));
+	for (auto _ : state) {
+		CodeTree tree = freqs.buildCodeTree();
+		benchmark::DoNotOptimize(&tree);
+	}
+	state.SetLabel(INPUT_NAMES[state.range(0)]);
+}
+BENCHMARK(BM_BuildCodeTree)->DenseRange(0, NUM_INPUTS - 1);
+
+
+static void BM_ToCodeTree(benchmark::State &state) {
+	const FrequencyTable freqs = getSymbolFrequencies(getInput(static_cast<int>(state.range(0))));
+	const CanonicalCode code(freqs.buildCodeTree(), freqs.getSymbolLimit());
+	for (auto _ : state) {
+		CodeTree tree = code.toCodeTree();
+		benchmark::DoNotOptimize(&tree);
+	}
+	state.SetLabel(INPUT_NAMES[state.range(0)]);
+}
+BENCHMARK(BM_ToCodeTree)->DenseRange(0, NUM_INPUTS - 1);
+
+
+/*---- Symbol kernels ----*/
+
+// Zero-run symbols of an input and a code limited to 11 bits, shared by the kernel benchmarks.
+struct KernelInput final {
+	vector<uint32_t> symbols;
+	CanonicalCode code;
+	vector<uint8_t> bits;
+
+	explicit KernelInput(InputKind kind) :
+			code(getSymbolFrequencies(getInput(kind)).buildCodeLengths(11)) {
+		const vector<uint8_t> &data = getInput(kind);
+		ZeroRun::toSymbols(data.data(), data.size(), symbols);
+		BitWriter out(bits);
+		const EncodeTable table(code);
+		for (uint32_t sym : symbols)
+			table.write(out, sym);
+		out.finish();
+	}
+};
+
+// Returns the kernel input for the text, or for the zero-heavy bytes if lowEntropy is true.
+static const KernelInput &getKernelInput(bool lowEntropy = false) {
+	static KernelInput text(TEXT);
+	static KernelInput zeroHeavy(ZERO_HEAVY);
+	return lowEntropy ? zeroHeavy : text;
+}
+
+
+// Arg 0 uses the generic EncodeTable, arg 1 the HuffmanKernel instantiation
+static void BM_SymbolEncode(benchmark::State &state) {
+	const KernelInput &input = getKernelInput();
+	const EncodeTable table(input.code);
+	const HuffmanKernels::ShortKernel kernel(input.code);
+	vector<uint8_t> out;
+	out.reserve(input.bits.size() + 8);
+	for (auto _ : state) {
+		out.clear();
+		BitWriter bout(out);
+		if (state.range(0) == 0) {
+			for (uint32_t sym : input.symbols)
+				table.write(bout, sym);
+		} else
+			kernel.encode(input.symbols.data(), input.symbols.size(), bout);
+		bout.finish();
+		benchmark::DoNotOptimize(out.data());
+	}
+	setThroughput(state, input.symbols.size());
+	state.SetLabel(state.range(0) == 0 ? "table" : "kernel");
+}
+BENCHMARK(BM_SymbolEncode)->DenseRange(0, 1);
+
+
+// Arg 0 uses the generic DecodeTable, arg 1 the HuffmanKernel instantiation, arg 2 a MultiSymbolTable
+// of the width that MultiSymbolTable::chooseWidth() picks, or of the code's longest length if it picks
+// none, and arg 3 the widest MultiSymbolTable. The second arg selects the text or the zero-heavy input.
+static void BM_SymbolDecode(benchmark::State &state) {
+	const KernelInput &input = getKernelInput(state.range(1) != 0);
+	const DecodeTable table(input.code);
+	const HuffmanKernels::ShortKernel kernel(input.code);
+	int width = MultiSymbolTable::MAX_WIDTH;
+	if (state.range(0) == 2) {
+		vector<uint32_t> lengths(input.code.getSymbolLimit());
+		for (uint32_t sym = 0; sym < input.code.getSymbolLimit(); sym++)
+			lengths[sym] = input.code.getCodeLength(sym);
+		width = MultiSymbolTable::chooseWidth(lengths.data(), input.code.getSymbolLimit(), input.symbols.size());
+		if (width == 0)
+			width = static_cast<int>(*std::max_element(lengths.begin(), lengths.end()));
+	}
+	const MultiSymbolTable multi(input.code, state.range(0) >= 2 ? width : MultiSymbolTable::MAX_WIDTH, ZeroRun::EOF_SYMBOL);
+	vector<uint32_t> out(input.symbols.size());
+	for (auto _ : state) {
+		BitReader bin(input.bits.data(), input.bits.size());
+		if (state.range(0) == 0) {
+			for (uint32_t &sym : out)
+				sym = table.read(bin);
+		} else if (state.range(0) == 1)
+			kernel.decode(bin, out.data(), out.size());
+		else
+			multi.decode(bin, out.data(), out.size());
+		benchmark::DoNotOptimize(out.data());
+	}
+	if (out != input.symbols)
+		state.SkipWithError("Decoded symbols differ from the input");
+	setThroughput(state, input.symbols.size());
+	const char *const methods[] = {"table", "kernel", "multi", "multi"};
+	state.SetLabel(string(methods[state.range(0)]) + (state.range(0) >= 2 ? ":" + std::to_string(width) : "")
+		+ "/" + INPUT_NAMES[state.range(1) != 0 ? ZERO_HEAVY : TEXT] + (state.range(0) != 0 && BitOps::hasBmi2() ? "/bmi2" : ""));
+}
+BENCHMARK(BM_SymbolDecode)->ArgsProduct({benchmark::CreateDenseRange(0, 3, 1), {0, 1}});
+
+
+/*---- Block codecs ----*/
+
+static const BlockCodec CODECS[] = {BlockCodec::HUFFMAN, BlockCodec::HUFFMAN4, BlockCodec::RANS, BlockCodec::ORDER1, BlockCodec::FIXED, BlockCodec::STORED, BlockCodec::LZ77};
+static const int NUM_CODECS = sizeof(CODECS) / sizeof(CODECS[0]);
+
+
+static void setCodecLabel(benchmark::State &state, size_t rawSize, size_t payloadSize) {
+	BlockCodec codec = CODECS[state.range(0)];
+	state.SetLabel(string(BlockCoder::getName(codec)) + "/" + INPUT_NAMES[state.range(1)]);
+	state.counters["ratio"] = rawSize > 0 ? static_cast<double>(payloadSize) / rawSize : 0;
+}
+
+
+static void BM_Encode(benchmark::State &state) {
+	const BlockCodec codec = CODECS[state.range(0)];
+	const vector<uint8_t> &data = getInput(static_cast<int>(state.range(1)));
+	vector<uint8_t> payload;
+	for (auto _ : state) {
+		payload.clear();
+		BlockCoder::encode(codec, data.data(), data.size(), payload);
+		benchmark::DoNotOptimize(payload.data());
+	}
+	setThroughput(state, data.size());
+	setCodecLabel(state, data.size(), payload.size());
+}
+BENCHMARK(BM_Encode)->ArgsProduct({benchmark::CreateDenseRange(0, NUM_CODECS - 1, 1), benchmark::CreateDenseRange(0, NUM_INPUTS - 1, 1)});
+
+
+static void BM_Decode(benchmark::State &state) {
+	const BlockCodec codec = CODECS[state.range(0)];
+	const vector<uint8_t> &data = getInput(static_cast<int>(state.range(1)));
+	vector<uint8_t> payload;
+	BlockCoder::encode(codec, data.data(), data.size(), payload);
+	vector<uint8_t> out(data.size());
+	for (auto _ : state) {
+		BlockCoder::decode(codec, payload.data(), payload.size(), out.data(), out.size());
+		benchmark::DoNotOptimize(out.data());
+	}
+	if (out != data)
+		state.SkipWithError("Decoded data differs from the input");
+	setThroughput(state, data.size());
+	setCodecLabel(state, data.size(), payload.size());
+}
+BENCHMARK(BM_Decode)->ArgsProduct({benchmark::CreateDenseRange(0, NUM_CODECS - 1, 1), benchmark::CreateDenseRange(0, NUM_INPUTS - 1, 1)});
+
+
+// FIXED on uniform random bytes drawn from the given number of values, which covers every code
+// width from 1 to 8 bits and the number of codes that each refill of the decoder takes
+static void BM_FixedWidth(benchmark::State &state) {
+	const uint32_t numValues = static_cast<uint32_t>(state.range(0));
+	std::mt19937 rng(4);
+	vector<uint8_t> data(SYNTHETIC_SIZE);
+	for (uint8_t &b : data)
+		b = static_cast<uint8_t>('a' + rng() % numValues);
+	vector<uint8_t> payload;
+	BlockCoder::encode(BlockCodec::FIXED, data.data(), data.size(), payload);
+	vector<uint8_t> out(data.size());
+	for (auto _ : state) {
+		BlockCoder::decode(BlockCodec::FIXED, payload.data(), payload.size(), out.data(), out.size());
+		benchmark::DoNotOptimize(out.data());
+	}
+	if (out != data)
+		state.SkipWithError("Decoded data differs from the input");
+	setThroughput(state, data.size());
+	state.SetLabel(std::to_string(numValues) + " values");
+	state.counters["ratio"] = static_cast<double>(payload.size()) / data.size();
+}
+BENCHMARK(BM_FixedWidth)->Arg(2)->Arg(3)->Arg(5)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(128);
+
+
+// The automatic codec choice, which skips the trials for incompressible and near-uniform inputs
+static void BM_EncodeBest(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(static_cast<int>(state.range(0)));
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	vector<uint8_t> payload;
+	BlockCodec codec = BlockCodec::HUFFMAN;
+	for (auto _ : state) {
+		payload.clear();
+		codec = BlockCoder::encodeBest(data.data(), data.size(), payload, *ctx);
+		benchmark::DoNotOptimize(payload.data());
+	}
+	setThroughput(state, data.size());
+	state.SetLabel(string(BlockCoder::getName(codec)) + "/" + INPUT_NAMES[state.range(0)]);
+	state.counters["ratio"] = static_cast<double>(payload.size()) / data.size();
+}
+BENCHMARK(BM_EncodeBest)->DenseRange(0, NUM_INPUTS - 1);
+
+
+// LZ77 at the fastest, the default and the strongest level
+static void BM_Lz77Level(benchmark::State &state) {
+	const int level = static_cast<int>(state.range(0));
+	const vector<uint8_t> &data = getInput(static_cast<int>(state.range(1)));
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	vector<uint8_t> payload;
+	for (auto _ : state) {
+		payload.clear();
+		BlockCoder::encodeLz77(data.data(), data.size(), level, payload, *ctx);
+		benchmark::DoNotOptimize(payload.data());
+	}
+	setThroughput(state, data.size());
+	state.SetLabel("level " + std::to_string(level) + "/" + INPUT_NAMES[state.range(1)]);
+	state.counters["ratio"] = data.size() > 0 ? static_cast<double>(payload.size()) / data.size() : 0;
+}
+BENCHMARK(BM_Lz77Level)->ArgsProduct({{Lz77Codec::MIN_LEVEL, Lz77Codec::DEFAULT_LEVEL, Lz77Codec::MAX_LEVEL}, benchmark::CreateDenseRange(0, NUM_INPUTS - 1, 1)});
+
+
+// Codes the input as 16 KiB blocks with one reused CoderContext, like a worker thread of
+// StreamCoder, and reports the heap allocations per block after a warm-up pass. Any allocation
+// is reported as an error, since these codecs must not allocate once the context is warmed up.
+static const BlockCodec CONTEXT_CODECS[] = {BlockCodec::HUFFMAN, BlockCodec::HUFFMAN4, BlockCodec::LZ77};
+static const int NUM_CONTEXT_CODECS = sizeof(CONTEXT_CODECS) / sizeof(CONTEXT_CODECS[0]);
+static const size_t CONTEXT_BLOCK_SIZE = 16 * 1024;
+
+
+static void BM_ContextEncode(benchmark::State &state) {
+	const BlockCodec codec = CONTEXT_CODECS[state.range(0)];
+	const vector<uint8_t> &data = getInput(static_cast<int>(state.range(1)));
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	vector<uint8_t> payload;
+	size_t blocks = 0;
+	auto encodeAll = [&]() {
+		for (size_t off = 0; off < data.size(); off += CONTEXT_BLOCK_SIZE) {
+			payload.clear();
+			BlockCoder::encode(codec, data.data() + off, std::min(CONTEXT_BLOCK_SIZE, data.size() - off), payload, *ctx);
+			benchmark::DoNotOptimize(payload.data());
+		}
+	};
+	encodeAll();
+	const std::uint64_t allocsBefore = numAllocations.load();
+	for (auto _ : state) {
+		encodeAll();
+		blocks += (data.size() + CONTEXT_BLOCK_SIZE - 1) / CONTEXT_BLOCK_SIZE;
+	}
+	const std::uint64_t allocs = numAllocations.load() - allocsBefore;
+	state.counters["allocs"] = blocks > 0 ? static_cast<double>(allocs) / blocks : 0;
+	if (allocs != 0)
+		state.SkipWithError("Coding with a reused CoderContext allocated memory");
+	setThroughput(state, data.size());
+	state.SetLabel(string(BlockCoder::getName(codec)) + "/" + INPUT_NAMES[state.range(1)]);
+}
+BENCHMARK(BM_ContextEncode)->ArgsProduct({benchmark::CreateDenseRange(0, NUM_CONTEXT_CODECS - 1, 1), benchmark::CreateDenseRange(0, NUM_INPUTS - 1, 1)});
+
+
+static void BM_ContextDecode(benchmark::State &state) {
+	const BlockCodec codec = CONTEXT_CODECS[state.range(0)];
+	const vector<uint8_t> &data = getInput(static_cast<int>(state.range(1)));
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	vector<vector<uint8_t> > payloads;
+	for (size_t off = 0; off < data.size(); off += CONTEXT_BLOCK_SIZE) {
+		payloads.emplace_back();
+		BlockCoder::encode(codec, data.data() + off, std::min(CONTEXT_BLOCK_SIZE, data.size() - off), payloads.back(), *ctx);
+	}
+	vector<uint8_t> out(data.size());
+	size_t blocks = 0;
+	auto decodeAll = [&]() {
+		for (size_t j = 0, off = 0; j < payloads.size(); j++, off += CONTEXT_BLOCK_SIZE) {
+			BlockCoder::decode(codec, payloads[j].data(), payloads[j].size(),
+				out.data() + off, std::min(CONTEXT_BLOCK_SIZE, data.size() - off), *ctx);
+		}
+		benchmark::DoNotOptimize(out.data());
+	};
+	decodeAll();
+	const std::uint64_t allocsBefore = numAllocations.load();
+	for (auto _ : state) {
+		decodeAll();
+		blocks += payloads.size();
+	}
+	const std::uint64_t allocs = numAllocations.load() - allocsBefore;
+	state.counters["allocs"] = blocks > 0 ? static_cast<double>(allocs) / blocks : 0;
+	if (allocs != 0)
+		state.SkipWithError("Coding with a reused CoderContext allocated memory");
+	if (out != data)
+		state.SkipWithError("Decoded data differs from the input");
+	setThroughput(state, data.size());
+	state.SetLabel(string(BlockCoder::getName(codec)) + "/" + INPUT_NAMES[state.range(1)]);
+}
+BENCHMARK(BM_ContextDecode)->ArgsProduct({benchmark::CreateDenseRange(0, NUM_CONTEXT_CODECS - 1, 1), benchmark::CreateDenseRange(0, NUM_INPUTS - 1, 1)});
+
+
+/*---- Adaptive coding ----*/
+
+// The last threshold needs more than 6 decimals, so BM_AdaptiveDecode checks that the stored specification round-trips
+static const char *const POLICIES[] = {"backoff", "interval:4096", "decay:16384", "gain:4096:0.02", "gain:16:0.095384517"};
+
+
+// Measures the model updates and rebuilds alone, without bit output
+static void BM_AdaptiveRebuild(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(CORPUS);
+	const std::unique_ptr<RebuildPolicy> policy = RebuildPolicy::parse(POLICIES[state.range(0)]);
+	uint32_t rebuilds = 0;
+	for (auto _ : state) {
+		AdaptiveModel model(vector<uint32_t>(257, 1), *policy, false);
+		for (uint8_t b : data)
+			model.update(b);
+		rebuilds = model.getNumRebuilds();
+		benchmark::DoNotOptimize(&model);
+	}
+	setThroughput(state, data.size());
+	state.counters["rebuilds"] = rebuilds;
+	state.SetLabel(policy->describe());
+}
+BENCHMARK(BM_AdaptiveRebuild)->DenseRange(0, sizeof(POLICIES) / sizeof(POLICIES[0]) - 1);
+
+
+// The ADAPTIVE block codec, with the table cache of the decoder
+static void BM_AdaptiveDecode(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(CORPUS);
+	vector<uint8_t> payload;
+	BlockCoder::encodeAdaptive(data.data(), data.size(), POLICIES[state.range(0)], payload);
+	vector<uint8_t> out(data.size());
+	for (auto _ : state) {
+		BlockCoder::decode(BlockCodec::ADAPTIVE, payload.data(), payload.size(), out.data(), out.size());
+		benchmark::DoNotOptimize(out.data());
+	}
+	if (out != data)
+		state.SkipWithError("Decoded data differs from the input");
+	setThroughput(state, data.size());
+	state.counters["ratio"] = static_cast<double>(payload.size()) / data.size();
+	state.SetLabel(POLICIES[state.range(0)]);
+}
+BENCHMARK(BM_AdaptiveDecode)->DenseRange(0, sizeof(POLICIES) / sizeof(POLICIES[0]) - 1);
+
+
+/*---- Substring analysis ----*/
+
+static void freeTrie(Trie *node) {
+	for (auto &child : node->map)
+		freeTrie(child.second);
+	delete node;
+}
+
+
+static void BM_TrieInsert(benchmark::State &state) {
+	const vector<uint8_t> &data = getInput(CORPUS);
+	const size_t window = 16;
+	const size_t count = std::min(static_cast<size_t>(state.range(0)), data.size() - window);
+	for (auto _ : state) {
+		Trie *head = nullptr;
+		for (size_t i = 0; i < count; i++) {
+			string s(data.begin() + static_cast<std::ptrdiff_t>(i), data.begin() + static_cast<std::ptrdiff_t>(i + window));
+			insert(head, const_cast<char*>(s.c_str()), static_cast<int>(i % 5));
+		}
+		benchmark::DoNotOptimize(head);
+		state.PauseTiming();
+		freeTrie(head);
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_TrieInsert)->Arg(4096);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,178 @@
+/*
+ * Bit streams over memory buffers
+ *
+ * Bits are ordered big endian within bytes, exactly like BitInputStream and BitOutputStream,
+ * so data written by one kind of stream can be read by the other. Unlike the stream classes,
+ * these keep up to 64 bits in a register and move several bits per call, which is what the
+ * table-driven Huffman coders need.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+/*
+ * Appends bits to a byte vector.
+ */
+class BitWriter final {
+
+	/*---- Fields ----*/
+
+	// The byte vector to append to.
+	private: std::vector<std::uint8_t> &output;
+
+	// The low numBits bits are pending output.
+	private: std::uint64_t bitBuf;
+
+	// Number of pending bits, always between 0 and 31 (inclusive) between calls.
+	private: int numBits;
+
+
+	/*---- Constructor ----*/
+
+	public: explicit BitWriter(std::vector<std::uint8_t> &out) :
+		output(out),
+		bitBuf(0),
+		numBits(0) {}
+
+
+	/*---- Methods ----*/
+
+	// Writes the low n bits of the given value, most significant first. Requires 0 <= n <= 32,
+	// and the value must not have bits set above the low n bits.
+	public: void write(std::uint32_t value, int n) {
+		bitBuf = (bitBuf << n) | value;
+		numBits += n;
+		if (numBits >= 32) {
+			numBits -= 32;
+			std::uint32_t word = static_cast<std::uint32_t>(bitBuf >> numBits);
+			std::uint8_t bytes[4] = {
+				static_cast<std::uint8_t>(word >> 24), static_cast<std::uint8_t>(word >> 16),
+				static_cast<std::uint8_t>(word >>  8), static_cast<std::uint8_t>(word)};
+			output.insert(output.end(), bytes, bytes + 4);
+		}
+	}
+
+
+	// Writes the low n bits of the given value, for any 0 <= n <= 64.
+	public: void writeLong(std::uint64_t value, int n) {
+		if (n > 32) {
+			write(static_cast<std::uint32_t>(value >> 32), n - 32);
+			n = 32;
+		}
+		write(static_cast<std::uint32_t>(n == 32 ? value : value & ((static_cast<std::uint64_t>(1) << n) - 1)), n);
+	}
+
+
+	// Writes the pending bits, padding with 0's up to the next byte boundary.
+	public: void finish() {
+		while (numBits > 0) {
+			if (numBits >= 8) {
+				numBits -= 8;
+				output.push_back(static_cast<std::uint8_t>(bitBuf >> numBits));
+			} else {
+				output.push_back(static_cast<std::uint8_t>(bitBuf << (8 - numBits)));
+				numBits = 0;
+			}
+		}
+		bitBuf = 0;
+	}
+
+};
+
+
+
+/*
+ * Reads bits from a byte buffer. Peeking past the end of the buffer yields 0 bits,
+ * but consuming past the end throws an exception.
+ */
+class BitReader final {
+
+	/*---- Fields ----*/
+
+	private: const std::uint8_t *next;
+
+	private: const std::uint8_t *end;
+
+	// The top numBits bits are the next bits of the stream. The bits below them
+	// are either 0 or a copy of the stream bits that follow.
+	private: std::uint64_t bitBuf;
+
+	private: int numBits;
+
+
+	/*---- Constructor ----*/
+
+	public: explicit BitReader(const std::uint8_t *data, std::size_t len) :
+			next(data),
+			end(data + len),
+			bitBuf(0),
+			numBits(0) {
+		refill();
+	}
+
+
+	/*---- Methods ----*/
+
+	// Makes at least 56 bits available, unless the end of the buffer is reached.
+	public: void refill() {
+		if (end - next >= 8) {
+			std::uint64_t word = 0;
+			for (int i = 0; i < 8; i++)
+				word = (word << 8) | next[i];
+			bitBuf |= word >> numBits;
+			next += (63 - numBits) >> 3;
+			numBits |= 56;
+		} else {
+			while (numBits <= 56 && next != end) {
+				bitBuf |= static_cast<std::uint64_t>(*next) << (56 - numBits);
+				next++;
+				numBits += 8;
+			}
+		}
+	}
+
+
+	// Returns the next n bits without consuming them. Requires 1 <= n <= 56 and a prior refill().
+	public: std::uint32_t peek(int n) const {
+		return static_cast<std::uint32_t>(bitBuf >> (64 - n));
+	}
+
+
+	// Discards the next n bits. Requires n <= 56 and a prior refill().
+	public: void consume(int n) {
+		if (n > numBits)
+			throw std::runtime_error("End of stream");
+		bitBuf <<= n;
+		numBits -= n;
+	}
+
+
+	// Returns the number of stream bits held, which is at least 56 after a refill() unless the end of the buffer is near.
+	public: int getBitCount() const {
+		return numBits;
+	}
+
+
+	// Reads n bits, for 0 <= n <= 32.
+	public: std::uint32_t read(int n) {
+		if (n == 0)
+			return 0;
+		refill();
+		std::uint32_t result = peek(n);
+		consume(n);
+		return result;
+	}
+
+
+	// Returns the number of bytes consumed since the given start of the buffer,
+	// counting a partially consumed byte as a whole one.
+	public: std::size_t bytesConsumed(const std::uint8_t *start) const {
+		return static_cast<std::size_t>(next - start) - static_cast<std::size_t>(numBits / 8);
+	}
+
+};
@@ -0,0 +1,26 @@
+/*
+ * Bit scanning and run-time dispatch of the bit I/O loops
+ */
+
+#include "BitOps.hpp"
+
+
+#ifdef HUFF_BMI2_DISPATCH
+
+static bool detectBmi2() {
+	__builtin_cpu_init();  // Needed because this runs during static initialization
+	return __builtin_cpu_supports("bmi") != 0 && __builtin_cpu_supports("bmi2") != 0;
+}
+
+static const bool BMI2 = detectBmi2();
+
+#else
+
+static const bool BMI2 = false;
+
+#endif
+
+
+bool BitOps::hasBmi2() {
+	return BMI2;
+}
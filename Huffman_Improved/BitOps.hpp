@@ -0,0 +1,76 @@
+/*
+ * Bit scanning and run-time dispatch of the bit I/O loops
+ *
+ * The bit buffers of BitReader and BitWriter shift by variable amounts on every code. Baseline
+ * x86-64 only has shifts by the CL register, which take several micro-ops and a flags dependency
+ * each; with BMI2 the compiler uses SHLX/SHRX (and BZHI for masks). The decoding and encoding loops
+ * therefore run through BitOps::dispatch(), which calls them from a copy compiled for BMI2 when the
+ * processor has it (detected at run time), so one binary runs everywhere. Other compilers and
+ * processors use the portable code only. Bit scans (floorLog2()) need no dispatch: baseline x86
+ * BSR already returns the index of the highest set bit, where LZCNT would need a subtraction after it.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define HUFF_BMI2_DISPATCH
+	#define HUFF_TARGET_BMI2 __attribute__((target("bmi,bmi2")))
+#endif
+
+// Compiles a lambda passed to BitOps::dispatch(), or a helper it calls, into each caller, so that
+// the copy reached through the BMI2 path uses the BMI2 instructions too.
+#if defined(__GNUC__)
+	#define HUFF_ALWAYS_INLINE __attribute__((always_inline))
+#else
+	#define HUFF_ALWAYS_INLINE
+#endif
+
+
+class BitOps final {
+
+	// Returns floor(log2(x)) for x > 0. On x86 this is a single BSR instruction.
+	public: static int floorLog2(std::uint32_t x) {
+#if defined(__GNUC__)
+		return 31 - __builtin_clz(x);
+#else
+		int result = 0;
+		for (int shift = 16; shift > 0; shift >>= 1) {
+			if ((x >> shift) != 0) {
+				x >>= shift;
+				result += shift;
+			}
+		}
+		return result;
+#endif
+	}
+
+
+	// Tests whether the processor supports BMI2, and dispatch() uses it.
+	public: static bool hasBmi2();
+
+
+	// Calls func(), from a copy compiled for BMI2 if the processor has it. func should be
+	// a lambda marked HUFF_ALWAYS_INLINE, so that its body and the inline methods it calls (such as
+	// those of BitReader and BitWriter) are compiled into each copy.
+	public: template <typename Func>
+	static void dispatch(Func func) {
+#ifdef HUFF_BMI2_DISPATCH
+		if (hasBmi2()) {
+			callBmi2(func);
+			return;
+		}
+#endif
+		func();
+	}
+
+
+#ifdef HUFF_BMI2_DISPATCH
+	private: template <typename Func>
+	HUFF_TARGET_BMI2 static void callBmi2(Func &func) {
+		func();
+	}
+#endif
+
+};
@@ -0,0 +1,764 @@
+/*
+ * Entropy coding backends for a single block of the block container
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "AdaptiveCodeCache.hpp"
+#include "AdaptiveModel.hpp"
+#include "BitBuffer.hpp"
+#include "BlockCodec.hpp"
+#include "ByteIo.hpp"
+#include "CoderContext.hpp"
+#include "CanonicalCode.hpp"
+#include "FrequencyTable.hpp"
+#include "Huffman4Codec.hpp"
+#include "HuffmanKernel.hpp"
+#include "HuffmanTable.hpp"
+#include "Instrumentation.hpp"
+#include "Lz77Codec.hpp"
+#include "Order1Codec.hpp"
+#include "RansCoder.hpp"
+#include "RebuildPolicy.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+
+const int BlockCoder::NUM_CODECS;
+
+// Typical size in bytes of the code length table of an entropy-coded payload.
+static const double CODE_TABLE_SIZE = 64;
+
+// Size in bytes of the bitmap that starts a FIXED payload.
+static const std::size_t FIXED_BITMAP_SIZE = 32;
+
+// FIXED is chosen when its payload is at most this much larger than the predicted entropy-coded one;
+// the small loss buys decoding without any table lookups beyond one byte.
+static const double FIXED_SLACK = 0.02;
+
+
+// Returns the number of bits in a fixed-length code for the given number of values.
+static int fixedCodeWidth(uint32_t numValues) {
+	int width = 0;
+	while ((static_cast<uint32_t>(1) << width) < numValues)
+		width++;
+	return width;
+}
+
+
+void BlockCoder::encode(BlockCodec codec, const uint8_t *data, std::size_t len, vector<uint8_t> &out) {
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	encode(codec, data, len, out, *ctx);
+}
+
+
+void BlockCoder::encode(BlockCodec codec, const uint8_t *data, std::size_t len, vector<uint8_t> &out, CoderContext &ctx) {
+	if (codec == BlockCodec::ADAPTIVE) {
+		encodeAdaptive(data, len, "backoff", out);
+		return;
+	} else if (codec == BlockCodec::STORED) {
+		encodeStored(data, len, out);
+		return;
+	} else if (codec == BlockCodec::FIXED) {
+		encodeFixed(data, len, out);
+		return;
+	} else if (codec == BlockCodec::LZ77) {
+		encodeLz77(data, len, Lz77Codec::DEFAULT_LEVEL, out, ctx);
+		return;
+	}
+	toSymbols(data, len, ctx);
+	encodeSymbols(codec, out, ctx);
+	if (codec == BlockCodec::HUFFMAN)
+		HUFF_COUNT(Counter::EOF_SYMBOLS, 1);
+}
+
+
+BlockCodec BlockCoder::encodeBest(const uint8_t *data, std::size_t len, vector<uint8_t> &out) {
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	return encodeBest(data, len, out, *ctx);
+}
+
+
+BlockCodec BlockCoder::encodeOrStore(BlockCodec codec, const uint8_t *data, std::size_t len, vector<uint8_t> &out, CoderContext &ctx) {
+	if (codec != BlockCodec::STORED && estimate(data, len).shortcut != BlockCodec::STORED) {
+		const std::size_t start = out.size();
+		encode(codec, data, len, out, ctx);
+		if (out.size() - start < len)
+			return codec;
+		out.resize(start);
+	}
+	encodeStored(data, len, out);
+	return BlockCodec::STORED;
+}
+
+
+// How much larger a HUFFMAN block may get to have a code that gives every symbol a length.
+static const uint64_t COVERING_CODE_MAX_EXTRA_BITS = 256;
+
+
+// Returns the size in bits of the table and the symbols of a block coded with ctx.lengths.
+static uint64_t getCodeBits(BlockCodec codec, const CoderContext &ctx) {
+	uint64_t result = codec == BlockCodec::HUFFMAN ? 8 * ZeroRun::SYMBOL_LIMIT
+		: (CodeLengthIo::getBitSize(ctx.lengths.data(), ctx.lengths.size()) + 7) / 8 * 8;
+	for (uint32_t sym = 0; sym < ZeroRun::SYMBOL_LIMIT; sym++)
+		result += static_cast<uint64_t>(ctx.freqs[sym]) * ctx.lengths[sym];
+	return result;
+}
+
+
+BlockCodec BlockCoder::encodeCached(BlockCodec codec, const uint8_t *data, std::size_t len, vector<uint8_t> &out, CoderContext &ctx, int &codeReference) {
+	if (!canCacheCode(codec))
+		throw std::domain_error("Codec can't use cached codes");
+	codeReference = 0;
+	if (estimate(data, len).shortcut == BlockCodec::STORED) {
+		encodeStored(data, len, out);
+		return BlockCodec::STORED;
+	}
+	toSymbols(data, len, ctx);
+	{
+		HUFF_PHASE(Phase::COUNT);
+		ctx.countSymbols(codec == BlockCodec::HUFFMAN ? 1 : 0);
+	}
+	uint64_t bestBits;
+	{
+		HUFF_PHASE(Phase::BUILD_CODE);
+		// A fresh code. For HUFFMAN, whose table costs the same whatever it holds, prefer the code
+		// built with every unused symbol counted once if it costs little more, because a cached code
+		// only serves later blocks of the group that use no symbol outside it.
+		const uint32_t maxLength = codec == BlockCodec::HUFFMAN ? HuffmanKernels::LongKernel::MAX_LENGTH : Huffman4Codec::MAX_CODE_LENGTH;
+		ctx.buildCodeLengths(maxLength);
+		bestBits = getCodeBits(codec, ctx);
+		if (codec == BlockCodec::HUFFMAN) {
+			uint32_t exact[ZeroRun::SYMBOL_LIMIT];
+			std::copy(ctx.lengths.begin(), ctx.lengths.begin() + ZeroRun::SYMBOL_LIMIT, exact);
+			bool unused[ZeroRun::SYMBOL_LIMIT];
+			for (uint32_t sym = 0; sym < ZeroRun::SYMBOL_LIMIT; sym++) {
+				unused[sym] = ctx.freqs[sym] == 0;
+				if (unused[sym])
+					ctx.freqs[sym] = 1;
+			}
+			ctx.buildCodeLengths(maxLength);
+			for (uint32_t sym = 0; sym < ZeroRun::SYMBOL_LIMIT; sym++) {
+				if (unused[sym])
+					ctx.freqs[sym] = 0;
+			}
+			const uint64_t coveringBits = getCodeBits(codec, ctx);
+			if (coveringBits <= bestBits + COVERING_CODE_MAX_EXTRA_BITS)
+				bestBits = coveringBits;
+			else
+				std::copy(exact, exact + ZeroRun::SYMBOL_LIMIT, ctx.lengths.begin());
+		}
+
+		// A cached code can be used if it gives every occurring symbol a code
+		const CodeCache &cache = ctx.codeCache;
+		for (int i = 0; i < cache.getSize(); i++) {
+			if (cache.getCodec(i) != codec)
+				continue;
+			const uint32_t *lens = cache.getLengths(i);
+			uint64_t bits = 0;
+			uint32_t sym = 0;
+			for (; sym < ZeroRun::SYMBOL_LIMIT && (ctx.freqs[sym] == 0 || lens[sym] != 0); sym++)
+				bits += static_cast<uint64_t>(ctx.freqs[sym]) * lens[sym];
+			if (sym == ZeroRun::SYMBOL_LIMIT && bits < bestBits) {
+				bestBits = bits;
+				codeReference = i + 1;
+			}
+		}
+		if (codeReference != 0) {
+			const uint32_t *lens = cache.getLengths(codeReference - 1);
+			std::copy(lens, lens + ZeroRun::SYMBOL_LIMIT, ctx.lengths.begin());
+		}
+	}
+
+	const std::size_t start = out.size();
+	ctx.runs.write(out);
+	if (codec == BlockCodec::HUFFMAN) {
+		encodeHuffmanWithCode(out, ctx, codeReference == 0);
+		HUFF_COUNT(Counter::EOF_SYMBOLS, 1);
+	} else
+		Huffman4Codec::encodeWithCode(out, ctx, codeReference == 0);
+	if (out.size() - start >= len) {
+		out.resize(start);
+		encodeStored(data, len, out);
+		codeReference = 0;
+		return BlockCodec::STORED;
+	}
+	if (codeReference == 0)
+		ctx.codeCache.push(codec, ctx.lengths.data());
+	return codec;
+}
+
+
+BlockCodec BlockCoder::encodeBest(const uint8_t *data, std::size_t len, vector<uint8_t> &out, CoderContext &ctx, int lz77Level) {
+	const BlockEstimate est = estimate(data, len);
+	if (est.shortcut != BlockCodec::HUFFMAN) {
+		encode(est.shortcut, data, len, out, ctx);
+		return est.shortcut;
+	}
+
+	// LZ77 first, because it uses the symbol buffer for its matches
+	ctx.bestPayload.clear();
+	encodeLz77(data, len, lz77Level, ctx.bestPayload, ctx);
+	BlockCodec best = BlockCodec::LZ77;
+	toSymbols(data, len, ctx);
+	const BlockCodec candidates[] = {BlockCodec::HUFFMAN4, BlockCodec::HUFFMAN, BlockCodec::RANS, BlockCodec::ORDER1};
+	for (BlockCodec codec : candidates) {
+		ctx.trialPayload.clear();
+		encodeSymbols(codec, ctx.trialPayload, ctx);
+		if (ctx.trialPayload.size() < ctx.bestPayload.size()) {
+			best = codec;
+			ctx.bestPayload.swap(ctx.trialPayload);
+		}
+	}
+	if (ctx.bestPayload.size() >= len) {
+		encodeStored(data, len, out);
+		return BlockCodec::STORED;
+	}
+	out.insert(out.end(), ctx.bestPayload.begin(), ctx.bestPayload.end());
+	if (best == BlockCodec::HUFFMAN)
+		HUFF_COUNT(Counter::EOF_SYMBOLS, 1);
+	return best;
+}
+
+
+void BlockCoder::decode(BlockCodec codec, const uint8_t *in, std::size_t inLen, uint8_t *out, std::size_t rawLen) {
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	decode(codec, in, inLen, out, rawLen, *ctx);
+}
+
+
+void BlockCoder::decode(BlockCodec codec, const uint8_t *in, std::size_t inLen, uint8_t *out, std::size_t rawLen, CoderContext &ctx) {
+	decode(codec, in, inLen, out, rawLen, ctx, 0);
+}
+
+
+void BlockCoder::decode(BlockCodec codec, const uint8_t *in, std::size_t inLen, uint8_t *out, std::size_t rawLen, CoderContext &ctx, int codeReference) {
+	HUFF_PHASE(Phase::DECODE);
+	ctx.symbols.clear();
+	CodeCache &cache = ctx.codeCache;
+	const uint64_t kernelSerial = cache.kernelSerial;
+	cache.kernelSerial = 0;  // Until this block is known to leave a cached code in the kernels
+	if (codeReference != 0 && (!canCacheCode(codec) || codeReference < 0
+			|| codeReference > cache.getSize() || cache.getCodec(codeReference - 1) != codec))
+		throw std::runtime_error("Invalid code reference");
+	switch (codec) {
+		case BlockCodec::STORED:
+			if (inLen != rawLen)
+				throw std::runtime_error("Stored block size mismatch");
+			if (rawLen > 0)
+				std::memcpy(out, in, rawLen);
+			return;
+		case BlockCodec::FIXED:
+			decodeFixed(in, inLen, out, rawLen);
+			return;
+		case BlockCodec::ADAPTIVE:
+			decodeAdaptive(in, inLen, out, rawLen);
+			return;
+		case BlockCodec::LZ77:
+			Lz77Codec::decode(in, inLen, out, rawLen, ctx);
+			return;
+		case BlockCodec::HUFFMAN:
+		case BlockCodec::RANS:
+		case BlockCodec::ORDER1:
+		case BlockCodec::HUFFMAN4:
+			break;
+		default:
+			throw std::runtime_error("Unknown block codec");
+	}
+
+	// The payload of a zero-run codec starts with the run table
+	const uint8_t *p = in;
+	ctx.runs.read(p, in + inLen);
+	inLen -= static_cast<std::size_t>(p - in);
+	uint64_t serial = 0;  // Of the code used by this block, if cached
+	bool kernelHoldsCode = false;
+	bool buildKernel = true;
+	if (codeReference != 0) {
+		const uint32_t *lens = cache.getLengths(codeReference - 1);
+		std::copy(lens, lens + ZeroRun::SYMBOL_LIMIT, ctx.lengths.begin());
+		serial = cache.getSerial(codeReference - 1);
+		buildKernel = serial != kernelSerial;
+	}
+	switch (codec) {
+		case BlockCodec::HUFFMAN:
+			kernelHoldsCode = decodeHuffman(p, inLen, rawLen, ctx, codeReference == 0, buildKernel);
+			break;
+		case BlockCodec::RANS:
+			RansCoder::decode(p, inLen, rawLen, ctx.symbols);
+			break;
+		case BlockCodec::ORDER1:
+			Order1Codec::decode(p, inLen, rawLen, ctx.symbols);
+			break;
+		case BlockCodec::HUFFMAN4:
+			if (codeReference != 0 && buildKernel)
+				ctx.shortKernel.build(ctx.lengths.data());
+			Huffman4Codec::decode(p, inLen, rawLen, ctx, codeReference == 0);
+			kernelHoldsCode = true;
+			break;
+		default:
+			throw std::logic_error("Unreachable");
+	}
+	if (codeReference == 0 && canCacheCode(codec))
+		serial = cache.push(codec, ctx.lengths.data());
+	cache.kernelSerial = kernelHoldsCode ? serial : 0;
+	expandSymbols(ctx.symbols, ctx.runs, out, rawLen);
+}
+
+
+bool BlockCoder::findByteValues(BlockCodec codec, const uint8_t *in, std::size_t inLen, CoderContext &ctx,
+		int codeReference, std::array<bool, 256> &present) {
+	switch (codec) {
+		case BlockCodec::FIXED:
+			if (inLen < FIXED_BITMAP_SIZE)
+				throw std::runtime_error("End of stream");
+			for (uint32_t b = 0; b < 256; b++)
+				present[b] = present[b] || ((in[b >> 3] << (b & 7)) & 0x80) != 0;
+			return true;
+		case BlockCodec::LZ77: {
+			// A match copies earlier bytes of the same block, so every byte value is coded as a literal first
+			std::array<uint32_t, Lz77Codec::LITERAL_LIMIT> literalLengths;
+			BitReader bin(in, inLen);
+			CodeLengthIo::readUnchecked(bin, Lz77Codec::LITERAL_LIMIT, literalLengths.data());
+			for (uint32_t b = 0; b < 256; b++)
+				present[b] = present[b] || literalLengths[b] != 0;
+			return true;
+		}
+		case BlockCodec::HUFFMAN:
+		case BlockCodec::RANS:
+		case BlockCodec::HUFFMAN4:
+			break;
+		default:
+			return false;
+	}
+
+	// Byte 0 comes from symbol 0 and from every run symbol
+	const uint8_t *p = in;
+	ctx.runs.read(p, in + inLen);
+	readCode(codec, p, in + inLen, ctx, codeReference);
+	for (uint32_t b = 0; b < 256; b++)
+		present[b] = present[b] || ctx.lengths[b] != 0;
+	for (uint32_t sym = ZeroRun::EOF_SYMBOL + 1; sym < ZeroRun::SYMBOL_LIMIT; sym++)
+		present[0] = present[0] || ctx.lengths[sym] != 0;
+	return true;
+}
+
+
+void BlockCoder::skip(BlockCodec codec, const uint8_t *in, std::size_t inLen, CoderContext &ctx, int codeReference) {
+	// The kernels are untouched, so the cache's kernelSerial stays valid
+	if (codeReference != 0 || !canCacheCode(codec))
+		return;
+	const uint8_t *p = in;
+	ctx.runs.read(p, in + inLen);
+	readCode(codec, p, in + inLen, ctx, 0);
+	ctx.codeCache.push(codec, ctx.lengths.data());
+}
+
+
+BlockEstimate BlockCoder::estimate(const uint8_t *data, std::size_t len) {
+	HUFF_PHASE(Phase::COUNT);
+	uint32_t hist[256];
+	countBytes(data, len, hist);
+
+	BlockEstimate result;
+	double bits = 0;
+	for (int b = 0; b < 256; b++) {
+		uint32_t freq = hist[b];
+		if (freq == 0)
+			continue;
+		result.distinctBytes++;
+		bits -= freq * std::log2(static_cast<double>(freq) / len);
+	}
+	result.entropy = len > 0 ? bits / len : 0;
+	result.codedSize = bits / 8 + CODE_TABLE_SIZE;
+	const double fixedSize = FIXED_BITMAP_SIZE + std::ceil(len * static_cast<double>(fixedCodeWidth(result.distinctBytes)) / 8);
+	if (std::min(result.codedSize, fixedSize) >= len)
+		result.shortcut = BlockCodec::STORED;
+	else if (fixedSize <= result.codedSize * (1 + FIXED_SLACK))
+		result.shortcut = BlockCodec::FIXED;
+	return result;
+}
+
+
+void BlockCoder::countBytes(const uint8_t *data, std::size_t len, uint32_t *hist) {
+	// Four interleaved histograms, so that runs of equal bytes don't serialize on one counter
+	uint32_t counts[4][256] = {};
+	std::size_t i = 0;
+	for (; i + 4 <= len; i += 4) {
+		counts[0][data[i + 0]]++;
+		counts[1][data[i + 1]]++;
+		counts[2][data[i + 2]]++;
+		counts[3][data[i + 3]]++;
+	}
+	for (; i < len; i++)
+		counts[0][data[i]]++;
+	for (int b = 0; b < 256; b++)
+		hist[b] = counts[0][b] + counts[1][b] + counts[2][b] + counts[3][b];
+}
+
+
+const char *BlockCoder::getName(BlockCodec codec) {
+	switch (codec) {
+		case BlockCodec::HUFFMAN:  return "huffman";
+		case BlockCodec::RANS:     return "rans";
+		case BlockCodec::ORDER1:   return "order1";
+		case BlockCodec::HUFFMAN4: return "huffman4";
+		case BlockCodec::ADAPTIVE: return "adaptive";
+		case BlockCodec::STORED:   return "stored";
+		case BlockCodec::FIXED:    return "fixed";
+		case BlockCodec::LZ77:     return "lz77";
+		default:  throw std::domain_error("Unknown block codec");
+	}
+}
+
+
+BlockCodec BlockCoder::parseName(const std::string &name) {
+	if (name == "huffman" || name == "static")
+		return BlockCodec::HUFFMAN;
+	else if (name == "rans")
+		return BlockCodec::RANS;
+	else if (name == "order1")
+		return BlockCodec::ORDER1;
+	else if (name == "huffman4")
+		return BlockCodec::HUFFMAN4;
+	else if (name == "adaptive")
+		return BlockCodec::ADAPTIVE;
+	else if (name == "stored")
+		return BlockCodec::STORED;
+	else if (name == "fixed")
+		return BlockCodec::FIXED;
+	else if (name == "lz77")
+		return BlockCodec::LZ77;
+	else
+		throw std::invalid_argument("Unknown codec: " + name);
+}
+
+
+bool BlockCoder::isValid(uint8_t id) {
+	return id < NUM_CODECS;
+}
+
+
+bool BlockCoder::canCacheCode(BlockCodec codec) {
+	return codec == BlockCodec::HUFFMAN || codec == BlockCodec::HUFFMAN4;
+}
+
+
+void BlockCoder::encodeSymbols(BlockCodec codec, vector<uint8_t> &out, CoderContext &ctx) {
+	ctx.runs.write(out);
+	switch (codec) {
+		case BlockCodec::HUFFMAN:
+			encodeHuffman(out, ctx);
+			break;
+		case BlockCodec::RANS: {
+			HUFF_PHASE(Phase::ENCODE);
+			RansCoder::encode(ctx.symbols, ZeroRun::SYMBOL_LIMIT, RansCoder::MAX_STATES, out);
+			break;
+		}
+		case BlockCodec::ORDER1: {
+			HUFF_PHASE(Phase::ENCODE);
+			Order1Codec::encode(ctx.symbols, out);
+			break;
+		}
+		case BlockCodec::HUFFMAN4:
+			Huffman4Codec::encode(out, ctx);
+			break;
+		default:
+			throw std::domain_error("Unknown block codec");
+	}
+}
+
+
+void BlockCoder::toSymbols(const uint8_t *data, std::size_t len, CoderContext &ctx) {
+	HUFF_PHASE(Phase::SYMBOLIZE);
+	ctx.symbols.clear();
+	ctx.symbols.reserve(len + 1);
+	ctx.runs.tune(data, len, ctx.runHistogram);
+	ctx.runs.toSymbols(data, len, ctx.symbols);
+	HUFF_COUNT_SYMBOLS(ctx.symbols.data(), ctx.symbols.size());
+}
+
+
+void BlockCoder::encodeHuffman(vector<uint8_t> &out, CoderContext &ctx) {
+	{
+		HUFF_PHASE(Phase::COUNT);
+		ctx.countSymbols(1);  // The EOF symbol gets a frequency of 1
+	}
+	{
+		// Limit the lengths so that a kernel table always fits
+		HUFF_PHASE(Phase::BUILD_CODE);
+		ctx.buildCodeLengths(HuffmanKernels::LongKernel::MAX_LENGTH);
+	}
+	encodeHuffmanWithCode(out, ctx, true);
+}
+
+
+void BlockCoder::encodeHuffmanWithCode(vector<uint8_t> &out, CoderContext &ctx, bool writeTable) {
+	HUFF_RECORD_CODE(ctx.freqs.data(), ctx.lengths.data(), ZeroRun::SYMBOL_LIMIT);
+	BitWriter bout(out);
+	if (writeTable) {
+		HUFF_PHASE(Phase::WRITE_HEADER);
+		// Write code length table
+		for (uint32_t len : ctx.lengths)
+			bout.write(len, 8);
+	}
+	HUFF_PHASE(Phase::ENCODE);
+	const uint32_t eof = ZeroRun::EOF_SYMBOL;
+	const vector<uint32_t> &symbols = ctx.symbols;
+	ctx.withKernel([&](const auto &kernel) {
+		kernel.encode(symbols.data(), symbols.size(), bout);
+		kernel.encode(&eof, 1, bout);
+	});
+	bout.finish();
+}
+
+
+bool BlockCoder::decodeHuffman(const uint8_t *in, std::size_t inLen, std::size_t rawLen, CoderContext &ctx, bool hasTable, bool buildKernel) {
+	BitReader bin(in, inLen);
+
+	// Read code length table
+	if (hasTable) {
+		for (uint32_t &len : ctx.lengths)
+			len = bin.read(8);
+	}
+	vector<uint32_t> &symbols = ctx.symbols;
+	bool done;
+	try {
+		// Every symbol expands to at least one byte
+		const int width = ctx.multiSymbolDecode ? MultiSymbolTable::chooseWidth(ctx.lengths.data(), ZeroRun::SYMBOL_LIMIT, rawLen) : 0;
+		if (width != 0) {
+			ctx.multiTable.build(ctx.lengths.data(), ZeroRun::SYMBOL_LIMIT, width, ZeroRun::EOF_SYMBOL);
+			ctx.multiTable.decodeUntil(bin, rawLen, symbols);
+			return false;  // The kernels weren't built
+		}
+		done = ctx.withKernel([&](const auto &kernel) {
+			kernel.decodeUntil(bin, ZeroRun::EOF_SYMBOL, rawLen, symbols);
+		}, hasTable || buildKernel);
+		if (!done) {
+			// Codes longer than any kernel supports, from another encoder
+			const CanonicalCode code(vector<uint32_t>(ctx.lengths.begin(), ctx.lengths.end()));
+			HuffmanKernels::decodeUntil(code, bin, ZeroRun::EOF_SYMBOL, rawLen, symbols);
+		}
+	} catch (const std::invalid_argument &e) {
+		throw std::runtime_error(std::string("Invalid code length table: ") + e.what());
+	} catch (const std::domain_error &e) {
+		throw std::runtime_error(std::string("Invalid code: ") + e.what());
+	}
+	return done;
+}
+
+
+void BlockCoder::encodeLz77(const uint8_t *data, std::size_t len, int level, vector<uint8_t> &out, CoderContext &ctx) {
+	Lz77Codec::encode(data, len, level, out, ctx);
+}
+
+
+void BlockCoder::encodeAdaptive(const uint8_t *data, std::size_t len, const std::string &policy, vector<uint8_t> &out) {
+	const std::string spec = RebuildPolicy::parse(policy)->describe();
+	if (spec.size() > 255)
+		throw std::invalid_argument("Rebuild policy specification too long");
+	out.push_back(static_cast<uint8_t>(spec.size()));
+	out.insert(out.end(), spec.begin(), spec.end());
+	// Code with the policy that the decoder will parse from the stored specification
+	const std::unique_ptr<RebuildPolicy> pol = RebuildPolicy::parse(spec);
+
+	HUFF_PHASE(Phase::ENCODE);
+	HUFF_COUNT(Counter::LITERAL_SYMBOLS, len);
+	HUFF_COUNT(Counter::EOF_SYMBOLS, 1);
+	BitWriter bout(out);
+	AdaptiveModel model(vector<uint32_t>(257, 1), *pol, false);
+	AdaptiveCodeCache cache;
+	const AdaptiveCodeCache::Kernel *kernel = &cache.select(model);
+	for (std::size_t i = 0; i < len; i++) {
+		const uint32_t symbol = data[i];
+		kernel->encode(&symbol, 1, bout);
+		if (model.update(symbol))
+			kernel = &cache.select(model);
+	}
+	const uint32_t eof = 256;
+	kernel->encode(&eof, 1, bout);
+	bout.finish();
+}
+
+
+void BlockCoder::readCode(BlockCodec codec, const uint8_t *p, const uint8_t *end, CoderContext &ctx, int codeReference) {
+	const CodeCache &cache = ctx.codeCache;
+	if (codeReference != 0) {
+		if (!canCacheCode(codec) || codeReference < 0 || codeReference > cache.getSize() || cache.getCodec(codeReference - 1) != codec)
+			throw std::runtime_error("Invalid code reference");
+		const uint32_t *lens = cache.getLengths(codeReference - 1);
+		std::copy(lens, lens + ZeroRun::SYMBOL_LIMIT, ctx.lengths.begin());
+	} else if (codec == BlockCodec::HUFFMAN) {
+		for (uint32_t &len : ctx.lengths)
+			len = ByteIo::getU8(p, end);
+	} else if (codec == BlockCodec::HUFFMAN4) {
+		ByteIo::getVarint(p, end);  // Number of symbols
+		for (int k = 0; k < Huffman4Codec::NUM_STREAMS - 1; k++)
+			ByteIo::getU32(p, end);  // Jump table
+		BitReader header(p, static_cast<std::size_t>(end - p));
+		CodeLengthIo::readUnchecked(header, ZeroRun::SYMBOL_LIMIT, ctx.lengths.data());
+	} else {
+		ByteIo::getU8(p, end);  // Number of states
+		ByteIo::getVarint(p, end);  // Number of symbols
+		const uint32_t usedLimit = ByteIo::getVarint(p, end);
+		if (usedLimit > ZeroRun::SYMBOL_LIMIT)
+			throw std::runtime_error("Invalid rANS symbol limit");
+		std::fill(ctx.lengths.begin(), ctx.lengths.end(), 0);
+		for (uint32_t i = 0; i < usedLimit; i++)
+			ctx.lengths[i] = ByteIo::getVarint(p, end);
+	}
+}
+
+
+void BlockCoder::decodeAdaptive(const uint8_t *in, std::size_t inLen, uint8_t *out, std::size_t rawLen) {
+	const uint8_t *p = in;
+	const uint8_t *const end = in + inLen;
+	std::size_t specLen = ByteIo::getU8(p, end);
+	if (specLen > static_cast<std::size_t>(end - p))
+		throw std::runtime_error("End of stream");
+	std::unique_ptr<RebuildPolicy> pol;
+	try {
+		pol = RebuildPolicy::parse(std::string(reinterpret_cast<const char*>(p), specLen));
+	} catch (const std::exception &e) {
+		throw std::runtime_error(std::string("Invalid rebuild policy: ") + e.what());
+	}
+	p += specLen;
+
+	BitReader bin(p, static_cast<std::size_t>(end - p));
+	AdaptiveModel model(vector<uint32_t>(257, 1), *pol, false);  // Use same model as the compressor
+	AdaptiveCodeCache cache;
+	const AdaptiveCodeCache::Kernel *kernel = &cache.select(model);
+	std::size_t pos = 0;
+	while (true) {
+		bin.refill();
+		uint32_t symbol = kernel->decodeOne(bin);
+		if (symbol == 256)  // EOF symbol
+			break;
+		if (pos == rawLen)
+			throw std::runtime_error("Block data exceeds its declared size");
+		out[pos] = static_cast<uint8_t>(symbol);
+		pos++;
+		if (model.update(symbol))
+			kernel = &cache.select(model);
+	}
+	if (pos != rawLen)
+		throw std::runtime_error("Block data is shorter than its declared size");
+}
+
+
+void BlockCoder::encodeStored(const uint8_t *data, std::size_t len, vector<uint8_t> &out) {
+	HUFF_PHASE(Phase::ENCODE);
+	out.insert(out.end(), data, data + len);
+}
+
+
+void BlockCoder::encodeFixed(const uint8_t *data, std::size_t len, vector<uint8_t> &out) {
+	HUFF_PHASE(Phase::ENCODE);
+	bool used[256] = {};
+	for (std::size_t i = 0; i < len; i++)
+		used[data[i]] = true;
+	uint8_t bitmap[FIXED_BITMAP_SIZE] = {};
+	uint32_t ranks[256];
+	uint32_t numValues = 0;
+	for (uint32_t b = 0; b < 256; b++) {
+		if (used[b]) {
+			bitmap[b >> 3] |= static_cast<uint8_t>(0x80 >> (b & 7));
+			ranks[b] = numValues;
+			numValues++;
+		}
+	}
+	const int width = fixedCodeWidth(numValues);
+	out.reserve(out.size() + FIXED_BITMAP_SIZE + (len * static_cast<std::size_t>(width) + 7) / 8);
+	out.insert(out.end(), bitmap, bitmap + FIXED_BITMAP_SIZE);
+	if (width == 0)
+		return;
+
+	// Four codes per write, without branches on the data
+	BitWriter bout(out);
+	std::size_t i = 0;
+	for (; i + 4 <= len; i += 4) {
+		bout.write(ranks[data[i]] << (3 * width) | ranks[data[i + 1]] << (2 * width)
+			| ranks[data[i + 2]] << width | ranks[data[i + 3]], 4 * width);
+	}
+	for (; i < len; i++)
+		bout.write(ranks[data[i]], width);
+	bout.finish();
+}
+
+
+void BlockCoder::decodeFixed(const uint8_t *in, std::size_t inLen, uint8_t *out, std::size_t rawLen) {
+	if (inLen < FIXED_BITMAP_SIZE)
+		throw std::runtime_error("End of stream");
+	uint8_t values[256];
+	uint32_t numValues = 0;
+	for (uint32_t b = 0; b < 256; b++) {
+		if (((in[b >> 3] << (b & 7)) & 0x80) != 0) {
+			values[numValues] = static_cast<uint8_t>(b);
+			numValues++;
+		}
+	}
+	if (numValues == 0 && rawLen > 0)
+		throw std::runtime_error("Block data is shorter than its declared size");
+	const int width = fixedCodeWidth(numValues);
+	const std::size_t expected = FIXED_BITMAP_SIZE + (rawLen * static_cast<std::size_t>(width) + 7) / 8;
+	if (inLen != expected)
+		throw std::runtime_error(inLen < expected ? "Block data is shorter than its declared size" : "Block data exceeds its declared size");
+	if (width == 0) {
+		std::memset(out, numValues > 0 ? values[0] : 0, rawLen);
+		return;
+	}
+
+	// Ranks past the last value can only come from a corrupt payload. They decode to 0 and are
+	// detected once at the end, which keeps the loop free of data-dependent branches.
+	std::fill(values + numValues, values + 256, 0);
+	BitReader bin(in + FIXED_BITMAP_SIZE, inLen - FIXED_BITMAP_SIZE);
+	const int perRefill = 56 / width;
+	uint32_t maxRank = 0;
+	std::size_t i = 0;
+	for (; i + static_cast<std::size_t>(perRefill) <= rawLen; i += static_cast<std::size_t>(perRefill)) {
+		bin.refill();
+		for (int j = 0; j < perRefill; j++) {
+			uint32_t rank = bin.peek(width);
+			bin.consume(width);
+			maxRank = std::max(maxRank, rank);
+			out[i + static_cast<std::size_t>(j)] = values[rank];
+		}
+	}
+	for (; i < rawLen; i++) {
+		uint32_t rank = bin.read(width);
+		maxRank = std::max(maxRank, rank);
+		out[i] = values[rank];
+	}
+	if (maxRank >= numValues)
+		throw std::runtime_error("Invalid symbol in block");
+}
+
+
+void BlockCoder::expandSymbols(const vector<uint32_t> &symbols, const RunTable &runs, uint8_t *out, std::size_t rawLen) {
+	std::size_t pos = 0;
+	for (uint32_t sym : symbols) {
+		if (sym < 256) {
+			if (pos == rawLen)
+				throw std::runtime_error("Block data exceeds its declared size");
+			out[pos] = static_cast<uint8_t>(sym);
+			pos++;
+		} else {
+			std::size_t n = runs.expandedLength(sym);
+			if (n == 0)
+				throw std::runtime_error("Invalid symbol in block");
+			if (n > rawLen - pos)
+				throw std::runtime_error("Block data exceeds its declared size");
+			std::memset(out + pos, 0, n);
+			pos += n;
+		}
+	}
+	if (pos != rawLen)
+		throw std::runtime_error("Block data is shorter than its declared size");
+}
@@ -0,0 +1,210 @@
+/*
+ * Entropy coding backends for a single block of the block container
+ *
+ * Every block is coded independently over the zero-run alphabet (see ZeroRun.hpp),
+ * by one of these backends. The payloads of HUFFMAN, RANS, ORDER1 and HUFFMAN4 start with
+ * the block's run table (see RunTable::write()), which gives the lengths of the run symbols.
+ * - HUFFMAN: the format of HuffmanCompress, i.e. the 322 code lengths of a canonical code
+ *   as 8-bit values, followed by the Huffman-coded symbols and the EOF symbol, padded to a byte.
+ *   The encoder limits codes to 13 bits; the decoder accepts any length.
+ * - RANS: interleaved static rANS (see RansCoder.hpp).
+ * - ORDER1: Huffman coding with one code per previous-byte context (see Order1Codec.hpp).
+ * - HUFFMAN4: Huffman coding split into four interleaved streams (see Huffman4Codec.hpp).
+ * - ADAPTIVE: adaptive Huffman coding of the raw bytes, like AdaptiveHuffmanCompress. The payload
+ *   starts with the rebuild policy (1 length byte and the text of RebuildPolicy::describe()),
+ *   followed by the bit stream that AdaptiveHuffmanCompress would produce with that policy
+ *   (canonical codes of at most AdaptiveModel::MAX_CODE_LENGTH bits, see AdaptiveModel.hpp).
+ * - STORED: the raw bytes, for blocks that entropy coding wouldn't shrink.
+ * - FIXED: a fixed-length code for blocks whose bytes are close to uniformly distributed over the
+ *   byte values they use. The payload is a 32-byte bitmap of the used values (bit 7 of byte 0 is
+ *   value 0), followed by the rank of each byte among them in ceil(log2(count)) bits, padded to a byte.
+ * - LZ77: repeated strings replaced by matches, then Huffman coding (see Lz77Codec.hpp).
+ * No zero-run symbols are involved in STORED, FIXED and LZ77.
+ * A HUFFMAN or HUFFMAN4 payload can also leave out its code length table and use a code of an
+ * earlier block instead (see encodeCached()).
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Lz77Codec.hpp"
+
+class CoderContext;
+class RunTable;
+
+
+enum class BlockCodec : std::uint8_t {
+	HUFFMAN  = 0,
+	RANS     = 1,
+	ORDER1   = 2,
+	HUFFMAN4 = 3,
+	ADAPTIVE = 4,
+	STORED   = 5,
+	FIXED    = 6,
+	LZ77     = 7,
+};
+
+
+
+/*
+ * Statistics of a block's byte histogram, which predict whether entropy coding can pay off.
+ */
+struct BlockEstimate final {
+
+	// Number of distinct byte values.
+	std::uint32_t distinctBytes = 0;
+
+	// Order-0 entropy in bits per byte.
+	double entropy = 0;
+
+	// Predicted size of an entropy-coded payload in bytes, including its code table.
+	double codedSize = 0;
+
+	// The codec to use without trying the entropy coders: STORED if they wouldn't shrink the block,
+	// FIXED if a fixed-length code is about as small, otherwise HUFFMAN (meaning no shortcut).
+	BlockCodec shortcut = BlockCodec::HUFFMAN;
+
+};
+
+
+
+class BlockCoder final {
+
+	/*---- Constants ----*/
+
+	// Number of codec identifiers; valid identifiers are 0 to NUM_CODECS-1.
+	public: static const int NUM_CODECS = 8;
+
+
+	/*---- Methods ----*/
+
+	// Encodes the given bytes as one block with the given codec, appending the payload to out.
+	// The overloads without a CoderContext use a temporary one.
+	public: static void encode(BlockCodec codec, const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out);
+
+	public: static void encode(BlockCodec codec, const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+
+	// Encodes the given bytes with the ADAPTIVE codec and the given rebuild policy specification.
+	public: static void encodeAdaptive(const std::uint8_t *data, std::size_t len, const std::string &policy, std::vector<std::uint8_t> &out);
+
+
+	// Encodes the given bytes with the LZ77 codec at the given level (see Lz77Codec).
+	public: static void encodeLz77(const std::uint8_t *data, std::size_t len, int level, std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+
+	// Encodes the given bytes with the given static codec, appends the payload to out and returns the codec,
+	// unless the block is predicted to be incompressible or the payload isn't smaller than the input;
+	// then the bytes are appended as a STORED payload and STORED is returned.
+	public: static BlockCodec encodeOrStore(BlockCodec codec, const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+
+	// Like encodeOrStore() for HUFFMAN or HUFFMAN4, but leaves out the code length table if one of the codes
+	// in the context's code cache, used as is, makes the payload smaller than a new code with its table.
+	// Sets codeReference to 1 plus the index of that code, or to 0 if the block gets a new code, which
+	// is then added to the cache. The decoder needs the same cache contents (see decode()).
+	// Throws std::domain_error for other codecs.
+	public: static BlockCodec encodeCached(BlockCodec codec, const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out,
+		CoderContext &ctx, int &codeReference);
+
+
+	// Encodes the given bytes with every static codec (LZ77 at the given level) and keeps the smallest
+	// payload, which is appended to out. Returns the codec that was chosen. Blocks whose estimate
+	// has a shortcut skip the trials, and a block that no codec shrinks is STORED.
+	public: static BlockCodec encodeBest(const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out);
+
+	public: static BlockCodec encodeBest(const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out, CoderContext &ctx,
+		int lz77Level = Lz77Codec::DEFAULT_LEVEL);
+
+
+	// Decodes the given payload, which must expand to exactly rawLen bytes, into out.
+	// Throws std::runtime_error if the payload is malformed.
+	public: static void decode(BlockCodec codec, const std::uint8_t *in, std::size_t inLen, std::uint8_t *out, std::size_t rawLen);
+
+	public: static void decode(BlockCodec codec, const std::uint8_t *in, std::size_t inLen, std::uint8_t *out, std::size_t rawLen, CoderContext &ctx);
+
+
+	// Decodes a payload produced by encodeCached() with the given code reference. A HUFFMAN or HUFFMAN4
+	// block with its own code adds it to the context's code cache, like the encoder, and a block with
+	// a code reference takes its code from there without building it again if the kernels still hold it.
+	// Throws std::runtime_error if the payload is malformed or the reference doesn't match a cached code.
+	public: static void decode(BlockCodec codec, const std::uint8_t *in, std::size_t inLen, std::uint8_t *out, std::size_t rawLen,
+		CoderContext &ctx, int codeReference);
+
+
+	// Sets present[b] for every byte value b that the block may decode to (before X86Filter::decode()), reading only
+	// the code table or bitmap at the start of its payload, and returns true; the other entries are left alone.
+	// Returns false for codecs without such a table: STORED, ADAPTIVE and ORDER1. The code cache is only read.
+	// Throws std::runtime_error if the table is malformed or the code reference is invalid.
+	public: static bool findByteValues(BlockCodec codec, const std::uint8_t *in, std::size_t inLen, CoderContext &ctx,
+		int codeReference, std::array<bool, 256> &present);
+
+
+	// Updates the code cache of the context as decode() would for the given payload, without decoding it,
+	// so that the rest of the group can still be decoded. Throws std::runtime_error if the table is malformed.
+	public: static void skip(BlockCodec codec, const std::uint8_t *in, std::size_t inLen, CoderContext &ctx, int codeReference);
+
+
+	// Computes the byte histogram of the given block and the estimate derived from it.
+	public: static BlockEstimate estimate(const std::uint8_t *data, std::size_t len);
+
+
+	// Sets hist[0] to hist[255] to the number of times each byte value occurs in the given data.
+	public: static void countBytes(const std::uint8_t *data, std::size_t len, std::uint32_t *hist);
+
+
+	// Returns the command line name of the given codec.
+	public: static const char *getName(BlockCodec codec);
+
+
+	// Returns the codec with the given command line name, or throws std::invalid_argument.
+	public: static BlockCodec parseName(const std::string &name);
+
+
+	// Returns true if the given byte is a known codec identifier.
+	public: static bool isValid(std::uint8_t id);
+
+
+	// Returns true if blocks of the given codec can share codes through a CodeCache: HUFFMAN and HUFFMAN4.
+	public: static bool canCacheCode(BlockCodec codec);
+
+
+	// Encodes the run table and the symbols of the context with the given codec.
+	private: static void encodeSymbols(BlockCodec codec, std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+	// Chooses the run table of the context for the given bytes and replaces the symbols
+	// of the context with the zero-run symbols of the bytes.
+	private: static void toSymbols(const std::uint8_t *data, std::size_t len, CoderContext &ctx);
+
+	private: static void encodeHuffman(std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+	// Encodes the symbols and EOF with the code in the lengths of the context, after its table if writeTable is true.
+	private: static void encodeHuffmanWithCode(std::vector<std::uint8_t> &out, CoderContext &ctx, bool writeTable);
+
+	// Decodes a HUFFMAN payload into the symbols of the context. If hasTable is false, the payload has
+	// no code length table, and the lengths of the context must hold its code; the kernel for them is
+	// built only if buildKernel is true, and not at all if the multi-symbol table is used instead.
+	// Returns true if a kernel of the context holds the code afterwards.
+	private: static bool decodeHuffman(const std::uint8_t *in, std::size_t inLen, std::size_t rawLen, CoderContext &ctx,
+		bool hasTable, bool buildKernel);
+
+	// Reads the code of a HUFFMAN, RANS or HUFFMAN4 payload into the lengths of the context, starting after its run
+	// table: the code lengths of its table, or the cached code it refers to, or for RANS the symbol frequencies.
+	private: static void readCode(BlockCodec codec, const std::uint8_t *p, const std::uint8_t *end, CoderContext &ctx, int codeReference);
+
+	private: static void decodeAdaptive(const std::uint8_t *in, std::size_t inLen, std::uint8_t *out, std::size_t rawLen);
+
+	private: static void encodeStored(const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out);
+
+	private: static void encodeFixed(const std::uint8_t *data, std::size_t len, std::vector<std::uint8_t> &out);
+
+	private: static void decodeFixed(const std::uint8_t *in, std::size_t inLen, std::uint8_t *out, std::size_t rawLen);
+
+	// Expands the given zero-run symbols into exactly rawLen bytes at out.
+	private: static void expandSymbols(const std::vector<std::uint32_t> &symbols, const RunTable &runs, std::uint8_t *out, std::size_t rawLen);
+
+};
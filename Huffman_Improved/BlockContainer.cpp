@@ -0,0 +1,203 @@
+/*
+ * Block container format
+ */
+
+#include <stdexcept>
+#include "BlockContainer.hpp"
+#include "ByteIo.hpp"
+#include "Crc32c.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::vector;
+
+
+static const uint8_t MAGIC[] = {'H', 'U', 'F', 'B'};
+static const uint8_t VERSION = 2;
+static const uint8_t END_MARKER = 0xFF;
+
+const uint32_t BlockWriter::MAX_BLOCK_SIZE;
+const uint8_t BlockWriter::FLAG_BLOCK_CHECKSUMS;
+const uint8_t BlockWriter::FLAG_STREAM_CHECKSUM;
+const uint8_t BlockWriter::FLAG_SHARED_CODE;
+const uint8_t BlockWriter::BLOCK_X86_FILTER;
+const uint8_t BlockWriter::BLOCK_CONTINUES_GROUP;
+const int BlockWriter::CODE_REFERENCE_SHIFT;
+static const uint8_t CODE_REFERENCE_MASK = 3 << BlockWriter::CODE_REFERENCE_SHIFT;
+static const uint8_t KNOWN_FLAGS = BlockWriter::FLAG_BLOCK_CHECKSUMS | BlockWriter::FLAG_STREAM_CHECKSUM | BlockWriter::FLAG_SHARED_CODE;
+
+
+// Codec identifier, raw size, payload size and the optional checksum.
+static std::size_t blockHeaderSize(uint8_t flags) {
+	return (flags & BlockWriter::FLAG_BLOCK_CHECKSUMS) != 0 ? 13 : 9;
+}
+
+
+// Stream header, end marker and the optional stream checksum.
+static std::size_t framingSize(uint8_t flags) {
+	return sizeof(MAGIC) + 2 + 1 + ((flags & BlockWriter::FLAG_STREAM_CHECKSUM) != 0 ? 4 : 0);
+}
+
+
+BlockWriter::BlockWriter(std::ostream &out, uint8_t flg) :
+		output(out),
+		bytesWritten(0),
+		flags(flg),
+		streamChecksum(0) {
+	if ((flags & ~KNOWN_FLAGS) != 0)
+		throw std::invalid_argument("Unknown block container flags");
+	vector<uint8_t> header(MAGIC, MAGIC + sizeof(MAGIC));
+	header.push_back(VERSION);
+	header.push_back(flags);
+	writeBytes(header.data(), header.size());
+}
+
+
+void BlockWriter::writeBlock(BlockCodec codec, uint32_t rawSize, const vector<uint8_t> &payload, uint32_t checksum, bool x86Filter) {
+	if (payload.size() > MAX_BLOCK_SIZE)
+		throw std::length_error("Block too large");
+	BlockHeader header;
+	header.codec = codec;
+	header.rawSize = rawSize;
+	header.payloadSize = static_cast<uint32_t>(payload.size());
+	header.checksum = checksum;
+	header.x86Filter = x86Filter;
+	writeBlock(header, payload.data());
+}
+
+
+void BlockWriter::writeBlock(const BlockHeader &header, const uint8_t *payload) {
+	if (header.rawSize > MAX_BLOCK_SIZE || header.payloadSize > MAX_BLOCK_SIZE)
+		throw std::length_error("Block too large");
+	if (header.codeReference < 0 || header.codeReference > 3 || (header.codeReference != 0
+			&& ((!header.continuesGroup && (flags & FLAG_SHARED_CODE) == 0) || !BlockCoder::canCacheCode(header.codec))))
+		throw std::domain_error("Invalid code reference");
+	vector<uint8_t> fields;
+	fields.push_back(static_cast<uint8_t>(static_cast<uint8_t>(header.codec) | (header.x86Filter ? BLOCK_X86_FILTER : 0)
+		| (header.continuesGroup ? BLOCK_CONTINUES_GROUP : 0) | header.codeReference << CODE_REFERENCE_SHIFT));
+	ByteIo::putU32(fields, header.rawSize);
+	ByteIo::putU32(fields, header.payloadSize);
+	if ((flags & FLAG_BLOCK_CHECKSUMS) != 0)
+		ByteIo::putU32(fields, header.checksum);
+	writeBytes(fields.data(), fields.size());
+	writeBytes(payload, header.payloadSize);
+	if ((flags & FLAG_STREAM_CHECKSUM) != 0)
+		streamChecksum = Crc32c::combine(streamChecksum, header.checksum, header.rawSize);
+}
+
+
+void BlockWriter::finish() {
+	vector<uint8_t> trailer(1, END_MARKER);
+	if ((flags & FLAG_STREAM_CHECKSUM) != 0)
+		ByteIo::putU32(trailer, streamChecksum);
+	writeBytes(trailer.data(), trailer.size());
+}
+
+
+std::uint64_t BlockWriter::getBytesWritten() const {
+	return bytesWritten;
+}
+
+
+std::size_t BlockWriter::getBlockHeaderSize() const {
+	return blockHeaderSize(flags);
+}
+
+
+void BlockWriter::writeBytes(const uint8_t *data, std::size_t len) {
+	output.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(len));
+	if (!output)
+		throw std::runtime_error("Write error");
+	bytesWritten += len;
+}
+
+
+BlockReader::BlockReader(std::istream &in) :
+		input(in),
+		flags(0),
+		streamChecksum(0) {
+	uint8_t header[sizeof(MAGIC) + 2];
+	readBytes(header, sizeof(header));
+	for (std::size_t i = 0; i < sizeof(MAGIC); i++) {
+		if (header[i] != MAGIC[i])
+			throw std::runtime_error("Not a block container stream");
+	}
+	if (header[sizeof(MAGIC)] != VERSION)
+		throw std::runtime_error("Unsupported block container version");
+	flags = header[sizeof(MAGIC) + 1];
+	if ((flags & ~KNOWN_FLAGS) != 0)
+		throw std::runtime_error("Unsupported block container flags");
+}
+
+
+bool BlockReader::readBlock(BlockHeader &header, vector<uint8_t> &payload) {
+	uint8_t id;
+	readBytes(&id, 1);
+	if (id == END_MARKER) {
+		if ((flags & BlockWriter::FLAG_STREAM_CHECKSUM) != 0) {
+			uint8_t bytes[4];
+			readBytes(bytes, sizeof(bytes));
+			const uint8_t *p = bytes;
+			streamChecksum = ByteIo::getU32(p, bytes + sizeof(bytes));
+		}
+		return false;
+	}
+	header.x86Filter = (id & BlockWriter::BLOCK_X86_FILTER) != 0;
+	header.continuesGroup = (id & BlockWriter::BLOCK_CONTINUES_GROUP) != 0;
+	header.codeReference = (id & CODE_REFERENCE_MASK) >> BlockWriter::CODE_REFERENCE_SHIFT;
+	id &= static_cast<uint8_t>(~(BlockWriter::BLOCK_X86_FILTER | BlockWriter::BLOCK_CONTINUES_GROUP | CODE_REFERENCE_MASK));
+	if (!BlockCoder::isValid(id))
+		throw std::runtime_error("Unknown block codec");
+	header.codec = static_cast<BlockCodec>(id);
+	if (header.codeReference != 0 && ((!header.continuesGroup && (flags & BlockWriter::FLAG_SHARED_CODE) == 0)
+			|| !BlockCoder::canCacheCode(header.codec)))
+		throw std::runtime_error("Invalid code reference");
+
+	const bool hasChecksum = (flags & BlockWriter::FLAG_BLOCK_CHECKSUMS) != 0;
+	uint8_t fields[12];
+	const uint8_t *const end = fields + (hasChecksum ? 12 : 8);
+	readBytes(fields, static_cast<std::size_t>(end - fields));
+	const uint8_t *p = fields;
+	header.rawSize = ByteIo::getU32(p, end);
+	header.payloadSize = ByteIo::getU32(p, end);
+	header.checksum = hasChecksum ? ByteIo::getU32(p, end) : 0;
+	if (header.rawSize > BlockWriter::MAX_BLOCK_SIZE || header.payloadSize > BlockWriter::MAX_BLOCK_SIZE)
+		throw std::runtime_error("Block too large");
+	const std::size_t start = payload.size();
+	payload.resize(start + header.payloadSize);
+	readBytes(payload.data() + start, header.payloadSize);
+	return true;
+}
+
+
+bool BlockReader::nextContinuesGroup() {
+	const int next = input.peek();
+	return next != std::char_traits<char>::eof() && next != END_MARKER && (next & BlockWriter::BLOCK_CONTINUES_GROUP) != 0;
+}
+
+
+uint8_t BlockReader::getFlags() const {
+	return flags;
+}
+
+
+uint32_t BlockReader::getStreamChecksum() const {
+	return streamChecksum;
+}
+
+
+std::size_t BlockReader::getBlockHeaderSize() const {
+	return blockHeaderSize(flags);
+}
+
+
+std::size_t BlockReader::getFramingSize() const {
+	return framingSize(flags);
+}
+
+
+void BlockReader::readBytes(uint8_t *data, std::size_t len) {
+	input.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(len));
+	if (static_cast<std::size_t>(input.gcount()) != len)
+		throw std::runtime_error("End of stream");
+}
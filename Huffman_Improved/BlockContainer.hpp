@@ -0,0 +1,192 @@
+/*
+ * Block container format
+ *
+ * A compressed stream is a sequence of independently coded blocks, so that each block
+ * can pick its own codec. All integers are big endian. Layout:
+ * - Stream header: the magic bytes "HUFB", a version byte (2) and a flags byte.
+ * - Each block: codec identifier (1 byte, see BlockCodec; plus BLOCK_X86_FILTER if the raw bytes
+ *   were coded after X86Filter::encode(), plus BLOCK_CONTINUES_GROUP if the block belongs to the
+ *   group of the preceding block, plus a code reference from 1 to 3 shifted left by
+ *   CODE_REFERENCE_SHIFT if the payload has no code table), raw size (4 bytes),
+ *   payload size (4 bytes), the CRC-32C of the raw bytes (4 bytes, only with
+ *   FLAG_BLOCK_CHECKSUMS), then the payload.
+ * - End marker: the single byte 0xFF, followed by the CRC-32C of all raw bytes
+ *   (4 bytes, only with FLAG_STREAM_CHECKSUM).
+ * The checksums cover the uncompressed data, so they also catch decoder errors. The blocks of a
+ * group are decoded in order by one decoder, so that a block can refer to the code of an earlier
+ * block of the group (see BlockCoder::encodeCached()) instead of carrying a code table; groups
+ * are independent, and a block without BLOCK_CONTINUES_GROUP is a group of its own. With
+ * FLAG_SHARED_CODE, every group starts with a code that the stream doesn't contain (see SharedCode)
+ * as its first cached code, so the first block of a group can refer to it too.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include "BlockCodec.hpp"
+
+
+/*
+ * The header fields of one block.
+ */
+struct BlockHeader final {
+
+	BlockCodec codec = BlockCodec::HUFFMAN;
+
+	std::uint32_t rawSize = 0;
+
+	std::uint32_t payloadSize = 0;
+
+	// CRC-32C of the raw bytes, when the stream has block or stream checksums.
+	std::uint32_t checksum = 0;
+
+	// Whether the raw bytes are coded after X86Filter::encode().
+	bool x86Filter = false;
+
+	// Whether the block belongs to the group of the preceding block.
+	bool continuesGroup = false;
+
+	// 0 if the payload has its own code, otherwise which of the codes cached by the preceding
+	// blocks of the group it uses (see BlockCoder::encodeCached()). Requires continuesGroup,
+	// unless the stream has FLAG_SHARED_CODE.
+	int codeReference = 0;
+
+};
+
+
+
+/*
+ * Writes the block container format to a byte stream.
+ */
+class BlockWriter final {
+
+	/*---- Constants ----*/
+
+	// Upper bound on the raw and payload size of a single block, which protects the reader against absurd allocations.
+	public: static const std::uint32_t MAX_BLOCK_SIZE = static_cast<std::uint32_t>(1) << 30;
+
+	// Stream header flags.
+	public: static const std::uint8_t FLAG_BLOCK_CHECKSUMS = 0x01;
+
+	public: static const std::uint8_t FLAG_STREAM_CHECKSUM = 0x02;
+
+	public: static const std::uint8_t FLAG_SHARED_CODE = 0x04;
+
+	// Bit added to the codec identifier of a block whose raw bytes must go through X86Filter::decode() after decoding.
+	public: static const std::uint8_t BLOCK_X86_FILTER = 0x80;
+
+	// Bit added to the codec identifier of a block that belongs to the group of the preceding block.
+	public: static const std::uint8_t BLOCK_CONTINUES_GROUP = 0x08;
+
+	// Position of the 2-bit code reference in the codec identifier of a block.
+	public: static const int CODE_REFERENCE_SHIFT = 5;
+
+
+	/*---- Fields ----*/
+
+	// The underlying byte stream to write to.
+	private: std::ostream &output;
+
+	// Total number of bytes written so far, including headers.
+	private: std::uint64_t bytesWritten;
+
+	private: std::uint8_t flags;
+
+	// CRC-32C of the raw bytes of all blocks written so far.
+	private: std::uint32_t streamChecksum;
+
+
+	/*---- Constructor ----*/
+
+	// Constructs a block writer and writes the stream header with the given flags to the given byte stream.
+	public: explicit BlockWriter(std::ostream &out, std::uint8_t flags = 0);
+
+
+	/*---- Methods ----*/
+
+	// Writes one block with the given codec, uncompressed size and payload, marking it as filtered if x86Filter is true.
+	// If the stream has checksums, checksum must be the CRC-32C of the raw (unfiltered) bytes; otherwise it is ignored.
+	public: void writeBlock(BlockCodec codec, std::uint32_t rawSize, const std::vector<std::uint8_t> &payload, std::uint32_t checksum = 0, bool x86Filter = false);
+
+
+	// Writes one block with the given header fields and the given payload of header.payloadSize bytes.
+	public: void writeBlock(const BlockHeader &header, const std::uint8_t *payload);
+
+
+	// Writes the end marker and the stream checksum, if any. Note that this method does not close the underlying stream.
+	public: void finish();
+
+
+	public: std::uint64_t getBytesWritten() const;
+
+
+	// Returns the size of the header that precedes each block's payload in this stream.
+	public: std::size_t getBlockHeaderSize() const;
+
+
+	private: void writeBytes(const std::uint8_t *data, std::size_t len);
+
+};
+
+
+
+/*
+ * Reads the block container format from a byte stream.
+ */
+class BlockReader final {
+
+	/*---- Fields ----*/
+
+	// The underlying byte stream to read from.
+	private: std::istream &input;
+
+	private: std::uint8_t flags;
+
+	// Valid after readBlock() has returned false.
+	private: std::uint32_t streamChecksum;
+
+
+	/*---- Constructor ----*/
+
+	// Constructs a block reader and reads the stream header from the given byte stream.
+	// Throws std::runtime_error if the header is missing or unsupported.
+	public: explicit BlockReader(std::istream &in);
+
+
+	/*---- Methods ----*/
+
+	// Reads the header of the next block into the given header, appends its payload to the given vector
+	// and returns true, or returns false if the end marker (and stream checksum) was reached. The checksum
+	// is set to 0 if the stream has no block checksums.
+	// Throws std::runtime_error if the stream is truncated or malformed.
+	public: bool readBlock(BlockHeader &header, std::vector<std::uint8_t> &payload);
+
+
+	// Tests whether the next block belongs to the group of the block read last, without consuming it.
+	public: bool nextContinuesGroup();
+
+
+	// Returns the flags of the stream header.
+	public: std::uint8_t getFlags() const;
+
+
+	// Returns the stored CRC-32C of all raw bytes. Requires FLAG_STREAM_CHECKSUM and
+	// that readBlock() has returned false.
+	public: std::uint32_t getStreamChecksum() const;
+
+
+	// Returns the size of the header that precedes each block's payload in this stream.
+	public: std::size_t getBlockHeaderSize() const;
+
+
+	// Returns the combined size of the stream header, the end marker and the stream checksum, if any.
+	public: std::size_t getFramingSize() const;
+
+
+	private: void readBytes(std::uint8_t *data, std::size_t len);
+
+};
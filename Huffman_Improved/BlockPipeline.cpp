@@ -0,0 +1,203 @@
+/*
+ * Pipelined block processing: read, code and write stages running concurrently
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "BlockPipeline.hpp"
+
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+// Shared state of one BlockPipeline::run() call.
+struct PipelineState final {
+
+	// Guards everything below except the worker queues.
+	std::mutex mutex;
+
+	std::condition_variable slotFreed;    // Signalled to the reader
+
+	std::condition_variable workQueued;   // Signalled to the workers
+
+	std::condition_variable slotCoded;    // Signalled to the writer
+
+	// Indexes of the slots that aren't in flight.
+	vector<size_t> freeSlots;
+
+	// Number of queued slots not yet claimed by a worker. A worker claims one here before
+	// taking it from a queue, so a claimed slot is always found in some queue.
+	size_t unclaimed = 0;
+
+	// For each sequence number modulo the number of slots: 1 + the index of its coded slot, or 0.
+	vector<size_t> coded;
+
+	bool readerDone = false;
+
+	// Number of blocks read; final once readerDone is set.
+	uint64_t blocksRead = 0;
+
+	bool aborted = false;
+
+	std::exception_ptr error;
+
+
+	// Per-worker queues of slot indexes, each with its own lock so that dealing and stealing
+	// don't contend on the main mutex.
+	struct WorkQueue final {
+		std::mutex mutex;
+		std::deque<size_t> slots;
+	};
+
+	vector<std::unique_ptr<WorkQueue> > queues;
+
+
+	// Records the current exception, if it is the first, and wakes every stage so that they stop.
+	void abort() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!error)
+			error = std::current_exception();
+		aborted = true;
+		slotFreed.notify_all();
+		workQueued.notify_all();
+		slotCoded.notify_all();
+	}
+
+};
+
+
+BlockPipeline::BlockPipeline(unsigned int workers) {
+	if (workers == 0)
+		workers = 1;
+	for (unsigned int i = 0; i < workers; i++)
+		contexts.emplace_back(new CoderContext);
+	for (unsigned int i = 0; i < workers * 2 + 1; i++)
+		slots.emplace_back(new PipelineSlot);
+}
+
+
+size_t BlockPipeline::getNumSlots() const {
+	return slots.size();
+}
+
+
+void BlockPipeline::run(const ReadStage &read, const CodeStage &code, const WriteStage &write) {
+	const size_t numSlots = slots.size();
+	const size_t numWorkers = contexts.size();
+	PipelineState state;
+	for (size_t i = numSlots; i > 0; i--)
+		state.freeSlots.push_back(i - 1);
+	state.coded.assign(numSlots, 0);
+	for (size_t i = 0; i < numWorkers; i++)
+		state.queues.emplace_back(new PipelineState::WorkQueue);
+
+	auto reader = [&]() {
+		try {
+			for (uint64_t seq = 0; ; seq++) {
+				size_t index;
+				{
+					std::unique_lock<std::mutex> lock(state.mutex);
+					state.slotFreed.wait(lock, [&]() { return state.aborted || !state.freeSlots.empty(); });
+					if (state.aborted)
+						return;
+					index = state.freeSlots.back();
+					state.freeSlots.pop_back();
+				}
+				PipelineSlot &slot = *slots[index];
+				slot.sequence = seq;
+				if (!read(slot)) {
+					std::lock_guard<std::mutex> lock(state.mutex);
+					state.freeSlots.push_back(index);
+					state.readerDone = true;
+					state.workQueued.notify_all();
+					state.slotCoded.notify_all();
+					return;
+				}
+				PipelineState::WorkQueue &queue = *state.queues[seq % numWorkers];
+				{
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					queue.slots.push_back(index);
+				}
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.blocksRead = seq + 1;
+				state.unclaimed++;
+				state.workQueued.notify_one();
+			}
+		} catch (...) {
+			state.abort();
+		}
+	};
+
+	auto worker = [&](size_t self) {
+		try {
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lock(state.mutex);
+					state.workQueued.wait(lock, [&]() { return state.aborted || state.unclaimed > 0 || state.readerDone; });
+					if (state.aborted || state.unclaimed == 0)
+						return;
+					state.unclaimed--;
+				}
+				// Take the oldest slot of our own queue, else steal the oldest of another queue
+				size_t index = numSlots;
+				for (size_t i = 0; index == numSlots; i = (i + 1) % numWorkers) {
+					PipelineState::WorkQueue &queue = *state.queues[(self + i) % numWorkers];
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					if (!queue.slots.empty()) {
+						index = queue.slots.front();
+						queue.slots.pop_front();
+					}
+				}
+				PipelineSlot &slot = *slots[index];
+				code(slot, *contexts[self]);
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.coded[slot.sequence % numSlots] = index + 1;
+				state.slotCoded.notify_one();
+			}
+		} catch (...) {
+			state.abort();
+		}
+	};
+
+	vector<std::thread> threads;
+	try {
+		threads.emplace_back(reader);
+		for (size_t i = 0; i < numWorkers; i++)
+			threads.emplace_back(worker, i);
+	} catch (...) {
+		state.abort();
+	}
+
+	// The calling thread writes the slots in sequence order
+	try {
+		for (uint64_t next = 0; ; next++) {
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock(state.mutex);
+				size_t &entry = state.coded[next % numSlots];
+				state.slotCoded.wait(lock, [&]() {
+					return state.aborted || entry != 0 || (state.readerDone && next == state.blocksRead);
+				});
+				if (state.aborted || entry == 0)
+					break;
+				index = entry - 1;
+				entry = 0;
+			}
+			write(*slots[index]);
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.freeSlots.push_back(index);
+			state.slotFreed.notify_one();
+		}
+	} catch (...) {
+		state.abort();
+	}
+
+	for (std::thread &th : threads)
+		th.join();
+	if (state.error)
+		std::rethrow_exception(state.error);
+}
@@ -0,0 +1,93 @@
+/*
+ * Pipelined block processing: read, code and write stages running concurrently
+ *
+ * A reader thread fills blocks from the input into a fixed ring of reusable slots, a pool of
+ * worker threads codes them, and the calling thread writes the finished blocks strictly in input
+ * order. Each worker has its own queue and CoderContext; the reader deals blocks out round-robin,
+ * and a worker whose queue is empty steals the oldest block from another queue, so a slow block
+ * doesn't hold up the blocks queued behind it. When all slots are in use the reader waits for the
+ * writer to release one, which bounds memory to the slots no matter how fast the input arrives.
+ * The first exception thrown by any stage stops all stages and is rethrown by run().
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "BlockCodec.hpp"
+#include "BlockContainer.hpp"
+#include "CoderContext.hpp"
+
+
+/*
+ * One block in flight. Its buffers keep their capacity when the slot is reused.
+ */
+struct PipelineSlot final {
+
+	// Position of the block in the input, starting at 0.
+	std::uint64_t sequence = 0;
+
+	// Index of the input that the block belongs to, for pipelines over several inputs (see Archive).
+	std::size_t source = 0;
+
+	// Data read by the read stage: raw bytes when compressing, payloads when decompressing.
+	std::vector<std::uint8_t> input;
+
+	// Data produced by the code stage for the write stage: payloads when compressing, raw bytes when decompressing.
+	std::vector<std::uint8_t> output;
+
+	// Raw size of the block.
+	std::uint32_t rawLength = 0;
+
+	// The container blocks that the input block is coded as, whose payloads are concatenated
+	// in output when compressing and in input when decompressing. When decompressing, they
+	// form a group of blocks that share codes (see BlockHeader::codeReference).
+	std::vector<BlockHeader> blocks;
+
+};
+
+
+
+class BlockPipeline final {
+
+	/*---- Types ----*/
+
+	// Fills the given slot with the next block and returns true, or returns false at the end of the input.
+	// Always called from the same thread.
+	public: typedef std::function<bool(PipelineSlot &slot)> ReadStage;
+
+	// Codes the given slot using the given context. Called concurrently for different slots.
+	public: typedef std::function<void(PipelineSlot &slot, CoderContext &ctx)> CodeStage;
+
+	// Consumes the given slot. Called on the thread that called run(), in sequence order.
+	public: typedef std::function<void(PipelineSlot &slot)> WriteStage;
+
+
+	/*---- Fields ----*/
+
+	private: std::vector<std::unique_ptr<PipelineSlot> > slots;
+
+	// One per worker thread.
+	private: std::vector<std::unique_ptr<CoderContext> > contexts;
+
+
+	/*---- Constructor ----*/
+
+	// Creates a pipeline with the given number of worker threads (at least 1) and 2 slots per worker,
+	// plus one for the block being read.
+	public: explicit BlockPipeline(unsigned int workers);
+
+
+	/*---- Methods ----*/
+
+	// Runs the three stages until the read stage reports the end of the input and every block has
+	// been written. Rethrows the first exception thrown by any stage, after all threads have stopped.
+	public: void run(const ReadStage &read, const CodeStage &code, const WriteStage &write);
+
+
+	public: std::size_t getNumSlots() const;
+
+};
@@ -0,0 +1,141 @@
+/*
+ * Entropy-driven block splitting
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "BlockSplitter.hpp"
+#include "CoderContext.hpp"
+#include "HuffmanTable.hpp"
+#include "Instrumentation.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::int32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+const uint32_t BlockSplitter::SEGMENT_SIZE;
+
+// Container block header with checksum, run table and final padding, which every part pays.
+static const uint64_t BLOCK_OVERHEAD_BITS = 8 * 16;
+
+
+// Returns the estimated size in bits of the code description that the given codec writes for ctx.lengths.
+static uint64_t getTableBits(BlockCodec codec, const CoderContext &ctx) {
+	switch (codec) {
+		case BlockCodec::HUFFMAN:
+			return 8 * ZeroRun::SYMBOL_LIMIT;  // One byte per length
+		case BlockCodec::HUFFMAN4:  // Packed lengths, with the run symbols mostly unused, and 4 stream sizes
+			return CodeLengthIo::getBitSize(ctx.lengths.data(), 256) + 9 * 3 + 32 * 4;
+		case BlockCodec::RANS: {  // A varint per frequency up to the last used byte
+			int used = 256;
+			while (used > 0 && ctx.freqs[used - 1] == 0)
+				used--;
+			return static_cast<uint64_t>(used) * 12 + 8 * 8;
+		}
+		default:
+			throw std::domain_error("Block splitting not supported for codec");
+	}
+}
+
+
+bool BlockSplitter::supports(BlockCodec codec) {
+	return codec == BlockCodec::HUFFMAN || codec == BlockCodec::HUFFMAN4 || codec == BlockCodec::RANS;
+}
+
+
+// Returns the estimated coded size in bits of the bytes with the histogram a, plus b if not null.
+static double estimateBits(const uint32_t *a, const uint32_t *b, BlockCodec codec, CoderContext &ctx) {
+	std::fill(ctx.freqs.begin() + 256, ctx.freqs.end(), 0);
+	if (b == nullptr)
+		std::copy(a, a + 256, ctx.freqs.begin());
+	else {
+		for (int i = 0; i < 256; i++)
+			ctx.freqs[i] = a[i] + b[i];
+	}
+	ctx.buildCodeLengths(HuffmanKernels::LongKernel::MAX_LENGTH);
+	uint64_t bits = 0;
+	for (int i = 0; i < 256; i++)
+		bits += static_cast<uint64_t>(ctx.freqs[i]) * ctx.lengths[i];
+	return static_cast<double>(bits + getTableBits(codec, ctx) + BLOCK_OVERHEAD_BITS);
+}
+
+
+void BlockSplitter::split(const uint8_t *data, size_t len, BlockCodec codec, vector<uint32_t> &lengths, CoderContext &ctx) {
+	if (!supports(codec))
+		throw std::domain_error("Block splitting not supported for codec");
+	lengths.clear();
+	const size_t numSegments = (len + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	if (numSegments <= 1) {
+		if (len > 0)
+			lengths.push_back(static_cast<uint32_t>(len));
+		return;
+	}
+	if (numSegments > static_cast<size_t>(INT32_MAX) / 256)
+		throw std::length_error("Block too large");
+	HUFF_PHASE(Phase::COUNT);
+	BlockSplitter::Workspace &ws = ctx.splitter;
+	ws.histograms.resize(numSegments * 256);
+	ws.parts.resize(numSegments);
+	uint32_t *const hist = ws.histograms.data();
+	vector<Part> &parts = ws.parts;
+
+	const int32_t n = static_cast<int32_t>(numSegments);
+	for (int32_t i = 0; i < n; i++) {
+		Part &p = parts[i];
+		p.start = static_cast<uint32_t>(i);
+		p.length = static_cast<uint32_t>(std::min<size_t>(SEGMENT_SIZE, len - static_cast<size_t>(i) * SEGMENT_SIZE));
+		BlockCoder::countBytes(data + static_cast<size_t>(i) * SEGMENT_SIZE, p.length, hist + i * 256);
+		p.next = i + 1 < n ? i + 1 : -1;
+		p.prev = i - 1;
+		p.version = 0;
+		p.bits = estimateBits(hist + i * 256, nullptr, codec, ctx);
+	}
+	vector<Candidate> &heap = ws.candidates;
+	heap.clear();
+	const auto lessGain = [](const Candidate &x, const Candidate &y) { return x.gain < y.gain; };
+	auto updateGain = [&](int32_t i) {
+		Part &p = parts[i];
+		p.version++;
+		if (p.next != -1) {
+			const Part &q = parts[p.next];
+			p.mergeGain = p.bits + q.bits - estimateBits(hist + p.start * 256, hist + q.start * 256, codec, ctx);
+			if (p.mergeGain > 0) {
+				heap.push_back(Candidate{p.mergeGain, i, p.version});
+				std::push_heap(heap.begin(), heap.end(), lessGain);
+			}
+		}
+	};
+	for (int32_t i = 0; i + 1 < n; i++)
+		updateGain(i);
+
+	// Merge the most profitable pair until no merge saves bits
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end(), lessGain);
+		const Candidate c = heap.back();
+		heap.pop_back();
+		Part &p = parts[c.part];
+		if (c.version != p.version)
+			continue;  // Stale
+		Part &q = parts[p.next];
+		uint32_t *h = hist + p.start * 256;
+		const uint32_t *g = hist + q.start * 256;
+		for (int i = 0; i < 256; i++)
+			h[i] += g[i];
+		p.length += q.length;
+		p.bits += q.bits - c.gain;
+		p.next = q.next;
+		q.version++;
+		if (p.next != -1)
+			parts[p.next].prev = c.part;
+		updateGain(c.part);
+		if (p.prev != -1)
+			updateGain(p.prev);
+	}
+
+	for (int32_t i = 0; i != -1; i = parts[i].next)
+		lengths.push_back(parts[i].length);
+}
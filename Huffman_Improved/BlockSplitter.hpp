@@ -0,0 +1,81 @@
+/*
+ * Entropy-driven block splitting
+ *
+ * A block coded with a single code pays for the mismatch wherever its statistics change.
+ * BlockSplitter finds the places where they change enough to be worth a new code table: it counts
+ * a byte histogram for every SEGMENT_SIZE bytes, then repeatedly merges the two adjacent parts
+ * whose merge saves the most estimated bits, until no merge saves anything. The estimated size of
+ * a part is that of a static Huffman code of its bytes: the sum of frequency times code length,
+ * with the lengths from CoderContext::buildCodeLengths(), plus the size of the code description
+ * that the target codec writes and of the block header. Merging saves a table and a header but can make the code fit both
+ * halves worse. The candidate merges wait in a heap ordered by gain, and each merge needs two new
+ * code builds on 256 symbols, so splitting 1 MiB costs a few hundred builds and stays ahead of the coders.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "BlockCodec.hpp"
+
+
+class BlockSplitter final {
+
+	/*---- Constants ----*/
+
+	// Granularity of the cut positions.
+	public: static const std::uint32_t SEGMENT_SIZE = 8192;
+
+
+	/*---- Types ----*/
+
+	// A run of adjacent segments.
+	public: struct Part final {
+		std::uint32_t start;   // First segment
+		std::uint32_t length;  // Bytes
+		std::int32_t next;     // Index of the following part, or -1
+		std::int32_t prev;     // Index of the preceding part, or -1
+		std::uint32_t version; // Incremented whenever mergeGain changes or the part is merged away
+		double bits;           // Estimated coded size
+		double mergeGain;      // Bits saved by merging with the following part
+	};
+
+
+	// A queued merge of a part with the following part, current if the versions match.
+	public: struct Candidate final {
+		double gain;
+		std::int32_t part;
+		std::uint32_t version;
+	};
+
+
+	/*
+	 * Working memory of the splitter, kept in a CoderContext so that splitting doesn't allocate once warmed up.
+	 */
+	public: struct Workspace final {
+
+		// Byte histogram of each part, stored at the index of its first segment.
+		std::vector<std::uint32_t> histograms;
+
+		// Indexed by first segment.
+		std::vector<Part> parts;
+
+		// Max-heap of merge candidates by gain.
+		std::vector<Candidate> candidates;
+
+	};
+
+
+	/*---- Methods ----*/
+
+	// Tests whether split() can estimate block sizes for the given codec: HUFFMAN, HUFFMAN4 and RANS.
+	public: static bool supports(BlockCodec codec);
+
+
+	// Splits the given bytes into consecutive parts that are cheaper to code separately with the given
+	// codec and sets lengths to the sizes of the parts, which add up to len. A block of at most one
+	// segment is not split. Throws std::domain_error if the codec isn't supported.
+	public: static void split(const std::uint8_t *data, std::size_t len, BlockCodec codec, std::vector<std::uint32_t> &lengths, CoderContext &ctx);
+
+};
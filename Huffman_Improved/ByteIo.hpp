@@ -0,0 +1,92 @@
+/*
+ * Byte serialization helpers for the block formats
+ *
+ * Fixed-width integers are stored in big endian, like the bit streams.
+ * Variable-length integers use 7 bits per byte, least significant group first,
+ * with the high bit set on every byte except the last.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+class ByteIo final {
+
+	public: static void putU16(std::vector<std::uint8_t> &out, std::uint32_t val) {
+		out.push_back(static_cast<std::uint8_t>(val >> 8));
+		out.push_back(static_cast<std::uint8_t>(val));
+	}
+
+
+	public: static void putU32(std::vector<std::uint8_t> &out, std::uint32_t val) {
+		for (int i = 24; i >= 0; i -= 8)
+			out.push_back(static_cast<std::uint8_t>(val >> i));
+	}
+
+
+	public: static void putU64(std::vector<std::uint8_t> &out, std::uint64_t val) {
+		putU32(out, static_cast<std::uint32_t>(val >> 32));
+		putU32(out, static_cast<std::uint32_t>(val));
+	}
+
+
+	public: static void putVarint(std::vector<std::uint8_t> &out, std::uint32_t val) {
+		while (val >= 0x80) {
+			out.push_back(static_cast<std::uint8_t>(val | 0x80));
+			val >>= 7;
+		}
+		out.push_back(static_cast<std::uint8_t>(val));
+	}
+
+
+	// The get functions advance the given pointer and throw if it would pass the end.
+
+	public: static std::uint32_t getU8(const std::uint8_t *&p, const std::uint8_t *end) {
+		if (p == end)
+			throw std::runtime_error("End of stream");
+		return *p++;
+	}
+
+
+	public: static std::uint32_t getU16(const std::uint8_t *&p, const std::uint8_t *end) {
+		if (end - p < 2)
+			throw std::runtime_error("End of stream");
+		std::uint32_t result = static_cast<std::uint32_t>(p[0]) << 8 | p[1];
+		p += 2;
+		return result;
+	}
+
+
+	public: static std::uint32_t getU32(const std::uint8_t *&p, const std::uint8_t *end) {
+		if (end - p < 4)
+			throw std::runtime_error("End of stream");
+		std::uint32_t result = static_cast<std::uint32_t>(p[0]) << 24 | static_cast<std::uint32_t>(p[1]) << 16
+			| static_cast<std::uint32_t>(p[2]) << 8 | p[3];
+		p += 4;
+		return result;
+	}
+
+
+	public: static std::uint64_t getU64(const std::uint8_t *&p, const std::uint8_t *end) {
+		std::uint64_t high = getU32(p, end);
+		return high << 32 | getU32(p, end);
+	}
+
+
+	public: static std::uint32_t getVarint(const std::uint8_t *&p, const std::uint8_t *end) {
+		std::uint32_t result = 0;
+		for (int shift = 0; ; shift += 7) {
+			if (shift > 28)
+				throw std::runtime_error("Malformed variable-length integer");
+			std::uint32_t b = getU8(p, end);
+			result |= (b & 0x7F) << shift;
+			if (b < 0x80)
+				return result;
+		}
+	}
+
+};
@@ -0,0 +1,110 @@
+/*
+ * Length-limited Huffman code lengths without heap allocation
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "CodeLengthBuilder.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+
+
+uint32_t CodeLengthBuilder::build(const uint32_t *freqs, uint32_t maxLength, uint32_t *lengths) {
+	if (maxLength < 9 || maxLength > 31)
+		throw std::domain_error("Maximum code length out of range");
+	std::fill(lengths, lengths + ZeroRun::SYMBOL_LIMIT, 0);
+
+	// Sort the used symbols by increasing frequency, then symbol
+	uint32_t n = 0;
+	for (uint32_t sym = 0; sym < ZeroRun::SYMBOL_LIMIT; sym++) {
+		if (freqs[sym] > 0)
+			sortKeys[n++] = static_cast<uint64_t>(freqs[sym]) << 32 | sym;
+	}
+	if (n < 2) {
+		// Give the only symbol (if any) and one more symbol a 1-bit code
+		uint32_t sym = n == 1 ? static_cast<uint32_t>(sortKeys[0]) : 0;
+		lengths[sym] = 1;
+		lengths[sym == 0 ? 1 : 0] = 1;
+		return 1;
+	}
+	std::sort(sortKeys.begin(), sortKeys.begin() + n);
+
+	// Compute optimal code lengths in place (Moffat and Katajainen). On entry work holds the
+	// weights in increasing order; on exit it holds the code lengths, in decreasing order.
+	uint64_t *const keys = sortKeys.data();
+	uint32_t *const a = work.data();
+	for (uint32_t i = 0; i < n; i++)
+		a[i] = static_cast<uint32_t>(keys[i] >> 32);
+	// First pass, left to right: combine weights, storing parent pointers
+	a[0] += a[1];
+	uint32_t root = 0;
+	uint32_t leaf = 2;
+	for (uint32_t next = 1; next < n - 1; next++) {
+		if (leaf >= n || a[root] < a[leaf]) {
+			a[next] = a[root];
+			a[root++] = next;
+		} else
+			a[next] = a[leaf++];
+		if (leaf >= n || (root < next && a[root] < a[leaf])) {
+			a[next] += a[root];
+			a[root++] = next;
+		} else
+			a[next] += a[leaf++];
+	}
+	// Second pass, right to left: depths of the internal nodes
+	a[n - 2] = 0;
+	for (uint32_t next = n - 2; next-- > 0; )
+		a[next] = a[a[next]] + 1;
+	// Third pass, right to left: depths of the leaves
+	{
+		std::int64_t avail = 1;
+		std::int64_t used = 0;
+		uint32_t depth = 0;
+		std::int64_t r = static_cast<std::int64_t>(n) - 2;
+		std::int64_t next = static_cast<std::int64_t>(n) - 1;
+		while (avail > 0) {
+			while (r >= 0 && a[r] == depth) {
+				used++;
+				r--;
+			}
+			while (avail > used) {
+				a[next--] = depth;
+				avail--;
+			}
+			avail = 2 * used;
+			depth++;
+			used = 0;
+		}
+	}
+
+	// Count codes per length, folding overlong ones into maxLength, then fix the Kraft sum
+	// the same way as FrequencyTable::buildCodeLengths()
+	uint32_t numCodes[32] = {};
+	for (uint32_t i = 0; i < n; i++)
+		numCodes[std::min(a[i], maxLength)]++;
+	uint64_t kraft = 0;
+	for (uint32_t i = 1; i <= maxLength; i++)
+		kraft += static_cast<uint64_t>(numCodes[i]) << (maxLength - i);
+	for (; kraft > (static_cast<uint64_t>(1) << maxLength); kraft--) {
+		numCodes[maxLength]--;
+		for (uint32_t i = maxLength - 1; i > 0; i--) {
+			if (numCodes[i] > 0) {
+				numCodes[i]--;
+				numCodes[i + 1] += 2;
+				break;
+			}
+		}
+	}
+
+	// The least frequent symbols get the longest codes
+	uint32_t k = 0;
+	uint32_t longest = 0;
+	for (uint32_t len = maxLength; len > 0; len--) {
+		if (numCodes[len] > 0 && longest == 0)
+			longest = len;
+		for (uint32_t j = 0; j < numCodes[len]; j++, k++)
+			lengths[static_cast<uint32_t>(keys[k])] = len;
+	}
+	return longest;
+}
@@ -0,0 +1,35 @@
+/*
+ * Length-limited Huffman code lengths without heap allocation
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "ZeroRun.hpp"
+
+
+/*
+ * Computes optimal prefix code lengths for the zero-run alphabet in place, on fixed arrays
+ * instead of through a CodeTree of heap nodes, so that rebuilding a code never allocates.
+ * Used by CoderContext for the static codecs and by AdaptiveModel for its rebuilds.
+ * An instance is about 4 KiB and must not be shared by concurrent callers.
+ */
+class CodeLengthBuilder final {
+
+	/*---- Fields ----*/
+
+	// Scratch space: (frequency << 32 | symbol) keys, then weights and depths.
+	private: std::array<std::uint64_t, ZeroRun::SYMBOL_LIMIT> sortKeys;
+
+	private: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT> work;
+
+
+	/*---- Methods ----*/
+
+	// Sets lengths to an optimal prefix code for freqs (ZeroRun::SYMBOL_LIMIT of each) whose codes are
+	// at most maxLength bits long, and returns the longest length. At least 2 symbols get codes, even if
+	// fewer have a non-zero frequency. Requires 9 <= maxLength <= 31, so that every symbol could be given a code.
+	public: std::uint32_t build(const std::uint32_t *freqs, std::uint32_t maxLength, std::uint32_t *lengths);
+
+};
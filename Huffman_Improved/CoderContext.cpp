@@ -0,0 +1,107 @@
+/*
+ * Reusable working memory for the block codecs
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "CoderContext.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+
+
+const int CodeCache::CAPACITY;
+
+
+CodeCache::CodeCache() :
+		size(0),
+		newest(0),
+		lastSerial(0),
+		shared(nullptr),
+		sharedSerial(0),
+		kernelSerial(0) {}
+
+
+void CodeCache::clear() {
+	size = 0;
+	if (shared != nullptr)
+		put(shared->codec, shared->lengths.data(), sharedSerial);
+}
+
+
+void CodeCache::setShared(const SharedCode *code) {
+	if (code != shared) {
+		shared = code;
+		lastSerial++;
+		sharedSerial = lastSerial;
+	}
+	clear();
+}
+
+
+bool CodeCache::isShared(int i) const {
+	return shared != nullptr && serials[indexOf(i)] == sharedSerial;
+}
+
+
+uint64_t CodeCache::push(BlockCodec codec, const uint32_t *codeLengths) {
+	lastSerial++;
+	put(codec, codeLengths, lastSerial);
+	return lastSerial;
+}
+
+
+int CodeCache::getSize() const {
+	return size;
+}
+
+
+BlockCodec CodeCache::getCodec(int i) const {
+	return codecs[indexOf(i)];
+}
+
+
+const uint32_t *CodeCache::getLengths(int i) const {
+	return lengths[indexOf(i)].data();
+}
+
+
+uint64_t CodeCache::getSerial(int i) const {
+	return serials[indexOf(i)];
+}
+
+
+void CodeCache::put(BlockCodec codec, const uint32_t *codeLengths, uint64_t serial) {
+	newest = (newest + 1) % CAPACITY;
+	std::copy(codeLengths, codeLengths + ZeroRun::SYMBOL_LIMIT, lengths[newest].begin());
+	codecs[newest] = codec;
+	serials[newest] = serial;
+	size = std::min(size + 1, CAPACITY);
+}
+
+
+int CodeCache::indexOf(int i) const {
+	if (i < 0 || i >= size)
+		throw std::out_of_range("Code cache index out of range");
+	return (newest + CAPACITY - i) % CAPACITY;
+}
+
+
+CoderContext::CoderContext() :
+		multiSymbolDecode(true) {
+	freqs.fill(0);
+	lengths.fill(0);
+}
+
+
+void CoderContext::countSymbols(uint32_t numEof) {
+	freqs.fill(0);
+	for (uint32_t sym : symbols)
+		freqs[sym]++;
+	freqs[ZeroRun::EOF_SYMBOL] += numEof;
+}
+
+
+uint32_t CoderContext::buildCodeLengths(uint32_t maxLength) {
+	return lengthBuilder.build(freqs.data(), maxLength, lengths.data());
+}
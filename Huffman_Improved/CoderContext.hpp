@@ -0,0 +1,220 @@
+/*
+ * Reusable working memory for the block codecs
+ *
+ * Coding a block needs a symbol buffer, a run table, a frequency table, code lengths, code tables
+ * and scratch output. A CoderContext owns all of them and keeps their capacity between blocks, so
+ * that once it has coded a block of the largest size, coding further blocks with the static
+ * Huffman codecs (HUFFMAN and HUFFMAN4) performs no heap allocation at all. Code lengths are
+ * computed in place by a CodeLengthBuilder instead of through a CodeTree of heap nodes.
+ * The other codecs accept a context too, but still allocate internally.
+ * A context is about 30 KiB, plus up to 64 KiB for the multi-symbol decode table once a block has
+ * used it, so allocate it on the heap or reuse one per thread; it must not be shared by concurrent coders.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "BlockCodec.hpp"
+#include "BlockSplitter.hpp"
+#include "CodeLengthBuilder.hpp"
+#include "DeltaCodec.hpp"
+#include "HuffmanKernel.hpp"
+#include "Lz77Codec.hpp"
+#include "MultiSymbolTable.hpp"
+#include "ZeroRun.hpp"
+
+
+/*
+ * A code that is known to both ends without being stored in the stream, such as the corpus-level
+ * code of an archive (see Archive), which every group can refer to.
+ */
+struct SharedCode final {
+
+	// HUFFMAN or HUFFMAN4.
+	BlockCodec codec = BlockCodec::HUFFMAN;
+
+	// A complete code whose lengths fit the codec.
+	std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT> lengths = {};
+
+};
+
+
+
+/*
+ * The codes of the latest blocks of a group that carried their own code table, which the later
+ * blocks of the group can refer to instead (see BlockCoder::encodeCached()). Each code gets a
+ * serial number, so that a decoder can tell whether its kernels still hold it. With a shared code,
+ * every group starts with it as the only entry.
+ */
+class CodeCache final {
+
+	/*---- Constants ----*/
+
+	public: static const int CAPACITY = 3;
+
+
+	/*---- Fields ----*/
+
+	// Entry i (0 being the newest) is at index (newest + CAPACITY - i) % CAPACITY.
+	private: std::array<std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT>, CAPACITY> lengths;
+
+	private: std::array<BlockCodec, CAPACITY> codecs;
+
+	private: std::array<std::uint64_t, CAPACITY> serials;
+
+	private: int size;
+
+	private: int newest;
+
+	private: std::uint64_t lastSerial;
+
+	// The code that clear() puts in the cache, or null, and its serial number, which stays the same across groups.
+	private: const SharedCode *shared;
+
+	private: std::uint64_t sharedSerial;
+
+	// Serial number of the code that the kernels of the context were last built for, or 0 if unknown.
+	public: std::uint64_t kernelSerial;
+
+
+	/*---- Constructor ----*/
+
+	public: CodeCache();
+
+
+	/*---- Methods ----*/
+
+	// Removes all entries but the shared code, if any, at the start of a group.
+	public: void clear();
+
+
+	// Sets the code that starts every group, which must stay valid while it is set, or none if null. Clears the cache.
+	public: void setShared(const SharedCode *code);
+
+
+	// Tests whether entry i is the shared code.
+	public: bool isShared(int i) const;
+
+
+	// Adds the given code as entry 0, dropping the oldest entry if the cache is full, and returns its serial number.
+	public: std::uint64_t push(BlockCodec codec, const std::uint32_t *codeLengths);
+
+
+	public: int getSize() const;
+
+
+	// Returns the codec, code lengths (ZeroRun::SYMBOL_LIMIT of them) or serial number of entry i,
+	// where 0 <= i < getSize().
+	public: BlockCodec getCodec(int i) const;
+
+	public: const std::uint32_t *getLengths(int i) const;
+
+	public: std::uint64_t getSerial(int i) const;
+
+
+	private: void put(BlockCodec codec, const std::uint32_t *codeLengths, std::uint64_t serial);
+
+	private: int indexOf(int i) const;
+
+};
+
+
+
+class CoderContext final {
+
+	/*---- Fields ----*/
+
+	// Zero-run symbols of the current block.
+	public: std::vector<std::uint32_t> symbols;
+
+	// Run lengths of the zero-run symbols of the current block.
+	public: RunTable runs;
+
+	// Scratch space for RunTable::tune().
+	public: std::vector<std::uint64_t> runHistogram;
+
+	// Per-symbol frequencies of the current block.
+	public: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT> freqs;
+
+	// Per-symbol code lengths of the current code.
+	public: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT> lengths;
+
+	// Payload buffers for BlockCoder::encodeBest(): the candidate being tried and the best so far.
+	public: std::vector<std::uint8_t> trialPayload;
+
+	public: std::vector<std::uint8_t> bestPayload;
+
+	// Code tables for short and long codes.
+	public: HuffmanKernels::ShortKernel shortKernel;
+
+	public: HuffmanKernels::LongKernel longKernel;
+
+	// Decode table for blocks where several symbols per lookup are worth its size (see MultiSymbolTable::chooseWidth()).
+	public: MultiSymbolTable multiTable;
+
+	// Whether the decoders may use multiTable; true by default. Decoding gives the same result either way.
+	public: bool multiSymbolDecode;
+
+	// Match finder and code tables of the LZ77 codec, created when it is first used.
+	public: std::unique_ptr<Lz77Codec::Workspace> lz77;
+
+	// Code tables of the delta codec, created when it is first used.
+	public: std::unique_ptr<DeltaCodec::Workspace> delta;
+
+	// Decoded bytes of the current group for StreamSearch, which only scans them.
+	public: std::vector<std::uint8_t> scratch;
+
+	// Codes that later blocks of the current group can refer to.
+	public: CodeCache codeCache;
+
+	// Working memory of BlockSplitter::split(), and the part sizes it returned.
+	public: BlockSplitter::Workspace splitter;
+
+	public: std::vector<std::uint32_t> partLengths;
+
+	// Scratch space for buildCodeLengths().
+	private: CodeLengthBuilder lengthBuilder;
+
+
+	/*---- Constructor ----*/
+
+	public: CoderContext();
+
+
+	/*---- Methods ----*/
+
+	// Sets freqs to the histogram of symbols, plus the given number of EOF symbols.
+	public: void countSymbols(std::uint32_t numEof);
+
+
+	// Sets lengths to an optimal prefix code for freqs whose codes are at most maxLength bits long,
+	// and returns the longest length. At least 2 symbols get codes, even if fewer have a non-zero
+	// frequency. Requires 9 <= maxLength <= 31, so that every symbol could be given a code.
+	public: std::uint32_t buildCodeLengths(std::uint32_t maxLength);
+
+
+	// Builds the smaller kernel that fits the current lengths and calls func(kernel), or returns false
+	// if the longest length exceeds LongKernel::MAX_LENGTH. Throws std::invalid_argument if the lengths
+	// don't form a complete code. If build is false, that kernel must already hold the current lengths.
+	public: template <typename Func>
+	bool withKernel(Func func, bool build = true) {
+		std::uint32_t longest = 0;
+		for (std::uint32_t len : lengths)
+			longest = len > longest ? len : longest;
+		if (longest <= static_cast<std::uint32_t>(HuffmanKernels::ShortKernel::MAX_LENGTH)) {
+			if (build)
+				shortKernel.build(lengths.data());
+			func(static_cast<const HuffmanKernels::ShortKernel&>(shortKernel));
+		} else if (longest <= static_cast<std::uint32_t>(HuffmanKernels::LongKernel::MAX_LENGTH)) {
+			if (build)
+				longKernel.build(lengths.data());
+			func(static_cast<const HuffmanKernels::LongKernel&>(longKernel));
+		} else
+			return false;
+		return true;
+	}
+
+};
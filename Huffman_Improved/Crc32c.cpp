@@ -0,0 +1,140 @@
+/*
+ * CRC-32C (Castagnoli) checksums
+ */
+
+#include <cstring>
+#include "Crc32c.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define HUFF_CRC32C_SSE42
+	#include <nmmintrin.h>
+#endif
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+
+
+// Bit-reflected polynomial 0x1EDC6F41
+static const uint32_t POLYNOMIAL = 0x82F63B78;
+
+
+// TABLES[k][b] is the CRC of byte b followed by k zero bytes, without inversion.
+struct Crc32cTables final {
+	uint32_t entries[8][256];
+
+	Crc32cTables() {
+		for (uint32_t b = 0; b < 256; b++) {
+			uint32_t crc = b;
+			for (int i = 0; i < 8; i++)
+				crc = (crc >> 1) ^ (POLYNOMIAL & (0 - (crc & 1)));
+			entries[0][b] = crc;
+		}
+		for (int k = 1; k < 8; k++) {
+			for (uint32_t b = 0; b < 256; b++)
+				entries[k][b] = (entries[k - 1][b] >> 8) ^ entries[0][entries[k - 1][b] & 0xFF];
+		}
+	}
+};
+
+static const Crc32cTables TABLES;
+
+
+static uint32_t updateSoftware(uint32_t crc, const uint8_t *data, size_t len) {
+	const uint32_t (*t)[256] = TABLES.entries;
+	for (; len > 0 && (reinterpret_cast<std::uintptr_t>(data) & 7) != 0; len--, data++)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+	for (; len >= 8; len -= 8, data += 8) {
+		uint32_t lo = crc ^ (static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+			| static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24);
+		crc = t[7][lo & 0xFF] ^ t[6][lo >> 8 & 0xFF] ^ t[5][lo >> 16 & 0xFF] ^ t[4][lo >> 24]
+			^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	for (; len > 0; len--, data++)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+	return crc;
+}
+
+
+#ifdef HUFF_CRC32C_SSE42
+
+__attribute__((target("sse4.2")))
+static uint32_t updateHardware(uint32_t crc, const uint8_t *data, size_t len) {
+	for (; len > 0 && (reinterpret_cast<std::uintptr_t>(data) & 7) != 0; len--, data++)
+		crc = _mm_crc32_u8(crc, *data);
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	for (; len >= 8; len -= 8, data += 8) {
+		uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = static_cast<uint32_t>(crc64);
+#endif
+	for (; len >= 4; len -= 4, data += 4) {
+		uint32_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc = _mm_crc32_u32(crc, word);
+	}
+	for (; len > 0; len--, data++)
+		crc = _mm_crc32_u8(crc, *data);
+	return crc;
+}
+
+
+static bool detectHardware() {
+	__builtin_cpu_init();  // Needed because this runs during static initialization
+	return __builtin_cpu_supports("sse4.2") != 0;
+}
+
+static const bool HARDWARE = detectHardware();
+
+#else
+
+static const bool HARDWARE = false;
+
+#endif
+
+
+uint32_t Crc32c::update(uint32_t crc, const uint8_t *data, size_t len) {
+	crc = ~crc;
+#ifdef HUFF_CRC32C_SSE42
+	if (HARDWARE)
+		return ~updateHardware(crc, data, len);
+#endif
+	return ~updateSoftware(crc, data, len);
+}
+
+
+// Returns a * b modulo the polynomial, with both operands and the result bit-reflected.
+static uint32_t multiplyModP(uint32_t a, uint32_t b) {
+	uint32_t product = 0;
+	for (uint32_t mask = static_cast<uint32_t>(1) << 31; mask != 0; mask >>= 1) {
+		if ((a & mask) != 0)
+			product ^= b;
+		b = (b >> 1) ^ (POLYNOMIAL & (0 - (b & 1)));
+	}
+	return product;
+}
+
+
+uint32_t Crc32c::combine(uint32_t crcA, uint32_t crcB, uint64_t lenB) {
+	// Shift crcA past lenB zero bytes by multiplying it with x^(8 * lenB) modulo the polynomial,
+	// using the squares x^(2^k) for the set bits of 8 * lenB.
+	uint32_t power = static_cast<uint32_t>(1) << 30;  // x^1
+	for (int k = 0; k < 3; k++)
+		power = multiplyModP(power, power);           // x^8
+	uint32_t shift = static_cast<uint32_t>(1) << 31;  // x^0
+	for (; lenB > 0; lenB >>= 1) {
+		if ((lenB & 1) != 0)
+			shift = multiplyModP(shift, power);
+		power = multiplyModP(power, power);
+	}
+	return multiplyModP(shift, crcA) ^ crcB;
+}
+
+
+bool Crc32c::isHardwareAccelerated() {
+	return HARDWARE;
+}
@@ -0,0 +1,36 @@
+/*
+ * CRC-32C (Castagnoli) checksums
+ *
+ * Uses the SSE4.2 CRC32 instruction when the processor has it (detected at run time),
+ * otherwise a slicing-by-8 table. Checksums of consecutive pieces of data can be combined
+ * without the data, so blocks checksummed on different threads yield the checksum of the
+ * whole stream.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+class Crc32c final {
+
+	// Returns the CRC-32C of the given bytes.
+	public: static std::uint32_t compute(const std::uint8_t *data, std::size_t len) {
+		return update(0, data, len);
+	}
+
+
+	// Returns the CRC-32C of the data whose CRC-32C is crc, followed by the given bytes.
+	public: static std::uint32_t update(std::uint32_t crc, const std::uint8_t *data, std::size_t len);
+
+
+	// Returns the CRC-32C of the concatenation of data A and data B,
+	// given the CRC-32C of each and the length of B in bytes.
+	public: static std::uint32_t combine(std::uint32_t crcA, std::uint32_t crcB, std::uint64_t lenB);
+
+
+	// Tests whether update() uses the hardware instruction.
+	public: static bool isHardwareAccelerated();
+
+};
@@ -0,0 +1,257 @@
+/*
+ * Delta block codec: a block of a new file as copies from a reference file and inserted bytes
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "BitBuffer.hpp"
+#include "CoderContext.hpp"
+#include "DeltaCodec.hpp"
+#include "HuffmanTable.hpp"
+#include "Instrumentation.hpp"
+#include "MatchCoding.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::int64_t;
+using std::size_t;
+using std::vector;
+
+
+const uint32_t DeltaCodec::MIN_COPY;
+const uint32_t DeltaCodec::MAX_COPY;
+const uint32_t DeltaCodec::SEED_LENGTH;
+const uint64_t DeltaCodec::MAX_REFERENCE_SIZE;
+const uint32_t DeltaCodec::END_SYMBOL;
+const uint32_t DeltaCodec::LITERAL_LIMIT;
+const uint32_t DeltaCodec::ADDRESS_LIMIT;
+const int DeltaCodec::MAX_CODE_LENGTH;
+
+static const uint32_t NO_POSITION = UINT32_MAX;
+
+// A copy token in the symbol buffer is (COPY_FLAG | length), followed by the zigzag-mapped address difference.
+static const uint32_t COPY_FLAG = static_cast<uint32_t>(1) << 31;
+
+// An aligned copy this long isn't worth looking up the index for a longer one.
+static const uint32_t NICE_COPY = 32;
+
+static const int MIN_HASH_BITS = 10;
+static const int MAX_HASH_BITS = 24;
+
+
+// Returns the reference address that the given alignment (address minus target position) expects at
+// the given target position, clamped to the reference.
+static uint64_t expectedAddress(int64_t alignment, uint32_t pos, uint64_t refSize) {
+	int64_t result = alignment + pos;
+	return result < 0 ? 0 : std::min(static_cast<uint64_t>(result), refSize);
+}
+
+
+static uint32_t zigzag(int64_t value) {
+	return static_cast<uint32_t>(value < 0 ? (-value) * 2 - 1 : value * 2);
+}
+
+
+static int64_t unzigzag(uint32_t value) {
+	return (value & 1) != 0 ? -static_cast<int64_t>(value >> 1) - 1 : static_cast<int64_t>(value >> 1);
+}
+
+
+DeltaCodec::Index::Index(const uint8_t *dat, size_t sz) :
+		data(dat),
+		size(sz),
+		hashBits(MIN_HASH_BITS) {
+	if (size > MAX_REFERENCE_SIZE)
+		throw std::length_error("Reference too large");
+	HUFF_PHASE(Phase::SYMBOLIZE);
+	while (hashBits < MAX_HASH_BITS && (static_cast<size_t>(1) << hashBits) < size)
+		hashBits++;
+	table.assign(static_cast<size_t>(1) << hashBits, NO_POSITION);
+	for (size_t i = 0; i + SEED_LENGTH <= size; i++)
+		table[hash(data + i)] = static_cast<uint32_t>(i);
+}
+
+
+uint32_t DeltaCodec::Index::find(const uint8_t *p) const {
+	return table[hash(p)];
+}
+
+
+uint32_t DeltaCodec::Index::hash(const uint8_t *p) const {
+	return static_cast<uint32_t>((MatchCoding::loadU64(p) * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - hashBits));
+}
+
+
+size_t DeltaCodec::encode(const Index &reference, const uint8_t *data, size_t len, uint64_t offset, vector<uint8_t> &out, CoderContext &ctx) {
+	if (len > UINT32_MAX)
+		throw std::length_error("Block too large");
+	if (!ctx.delta)
+		ctx.delta.reset(new Workspace);
+	Workspace &ws = *ctx.delta;
+	vector<uint32_t> &tokens = ctx.symbols;
+	tokens.clear();
+	ws.literalFreqs.fill(0);
+	ws.addressFreqs.fill(0);
+	const uint8_t *const ref = reference.getData();
+	const uint64_t refSize = reference.getSize();
+	size_t copied = 0;
+
+	{
+		HUFF_PHASE(Phase::SYMBOLIZE);
+		const uint32_t n = static_cast<uint32_t>(len);
+		int64_t alignment = static_cast<int64_t>(std::min(offset, refSize));  // Address minus target position
+		uint32_t literals = 0;  // Since the last copy
+		for (uint32_t i = 0; i < n; ) {
+			const uint32_t maxLen = std::min(MAX_COPY, n - i);
+
+			// The expected address, then the index
+			uint64_t address = expectedAddress(alignment, i, refSize);
+			uint32_t length = MatchCoding::matchLength(data + i, ref + address, static_cast<uint32_t>(std::min<uint64_t>(maxLen, refSize - address)));
+			uint32_t back = 0;  // Literals that the copy takes over
+			if (length < NICE_COPY && n - i >= SEED_LENGTH) {
+				const uint32_t cand = reference.find(data + i);
+				if (cand != NO_POSITION) {
+					uint32_t found = MatchCoding::matchLength(data + i, ref + cand, static_cast<uint32_t>(std::min<uint64_t>(maxLen, refSize - cand)));
+					uint32_t extend = 0;
+					while (extend < literals && extend < cand && found + extend < MAX_COPY && data[i - extend - 1] == ref[cand - extend - 1])
+						extend++;
+					if (found >= SEED_LENGTH && found + extend > length) {
+						length = found + extend;
+						address = cand - extend;
+						back = extend;
+					}
+				}
+			}
+
+			if (length < MIN_COPY) {
+				tokens.push_back(data[i]);
+				ws.literalFreqs[data[i]]++;
+				literals++;
+				i++;
+				continue;
+			}
+			for (uint32_t j = 0; j < back; j++) {
+				ws.literalFreqs[tokens.back()]--;
+				tokens.pop_back();
+			}
+			i -= back;
+			const uint32_t diff = zigzag(static_cast<int64_t>(address) - static_cast<int64_t>(expectedAddress(alignment, i, refSize)));
+			tokens.push_back(COPY_FLAG | length);
+			tokens.push_back(diff);
+			ws.literalFreqs[257 + MatchCoding::valueCode(length - MIN_COPY)]++;
+			ws.addressFreqs[MatchCoding::valueCode(diff)]++;
+			alignment = static_cast<int64_t>(address) - i;
+			i += length;
+			copied += length;
+			literals = 0;
+		}
+		ws.literalFreqs[END_SYMBOL]++;
+	}
+
+	{
+		HUFF_PHASE(Phase::BUILD_CODE);
+		std::copy(ws.literalFreqs.begin(), ws.literalFreqs.end(), ctx.freqs.begin());
+		std::fill(ctx.freqs.begin() + LITERAL_LIMIT, ctx.freqs.end(), 0);
+		ctx.buildCodeLengths(MAX_CODE_LENGTH);
+		std::copy(ctx.lengths.begin(), ctx.lengths.begin() + LITERAL_LIMIT, ws.literalLengths.begin());
+		std::copy(ws.addressFreqs.begin(), ws.addressFreqs.end(), ctx.freqs.begin());
+		std::fill(ctx.freqs.begin() + ADDRESS_LIMIT, ctx.freqs.end(), 0);
+		ctx.buildCodeLengths(MAX_CODE_LENGTH);
+		std::copy(ctx.lengths.begin(), ctx.lengths.begin() + ADDRESS_LIMIT, ws.addressLengths.begin());
+		ws.literalKernel.build(ws.literalLengths.data());
+		ws.addressKernel.build(ws.addressLengths.data());
+	}
+
+	BitWriter bout(out);
+	{
+		HUFF_PHASE(Phase::WRITE_HEADER);
+		CodeLengthIo::write(bout, ws.literalLengths.data(), LITERAL_LIMIT);
+		CodeLengthIo::write(bout, ws.addressLengths.data(), ADDRESS_LIMIT);
+	}
+	HUFF_PHASE(Phase::ENCODE);
+	const LiteralKernel &literals = ws.literalKernel;
+	const AddressKernel &addresses = ws.addressKernel;
+	for (size_t i = 0; i < tokens.size(); i++) {
+		uint32_t token = tokens[i];
+		if ((token & COPY_FLAG) == 0) {
+			literals.encode(&token, 1, bout);
+			continue;
+		}
+		uint32_t length = (token & ~COPY_FLAG) - MIN_COPY;
+		uint32_t code = MatchCoding::valueCode(length);
+		uint32_t sym = 257 + code;
+		literals.encode(&sym, 1, bout);
+		bout.write(length - MatchCoding::getBase(code), MatchCoding::getExtraBits(code));
+		uint32_t diff = tokens[++i];
+		code = MatchCoding::valueCode(diff);
+		addresses.encode(&code, 1, bout);
+		bout.write(diff - MatchCoding::getBase(code), MatchCoding::getExtraBits(code));
+	}
+	const uint32_t end = END_SYMBOL;
+	literals.encode(&end, 1, bout);
+	bout.finish();
+	return copied;
+}
+
+
+void DeltaCodec::decode(const uint8_t *reference, size_t refSize, const uint8_t *in, size_t inLen,
+		uint8_t *out, size_t rawLen, uint64_t offset, CoderContext &ctx) {
+	HUFF_PHASE(Phase::DECODE);
+	if (refSize > MAX_REFERENCE_SIZE)
+		throw std::length_error("Reference too large");
+	if (!ctx.delta)
+		ctx.delta.reset(new Workspace);
+	Workspace &ws = *ctx.delta;
+	BitReader bin(in, inLen);
+	CodeLengthIo::readUnchecked(bin, LITERAL_LIMIT, ws.literalLengths.data());
+	CodeLengthIo::readUnchecked(bin, ADDRESS_LIMIT, ws.addressLengths.data());
+	try {
+		ws.literalKernel.build(ws.literalLengths.data());
+		ws.addressKernel.build(ws.addressLengths.data());
+	} catch (const std::invalid_argument &e) {
+		throw std::runtime_error(std::string("Invalid code length table: ") + e.what());
+	}
+	const LiteralKernel &literals = ws.literalKernel;
+	const AddressKernel &addresses = ws.addressKernel;
+	static_assert(LiteralKernel::SYMBOLS_PER_REFILL >= 4, "Literals are decoded 4 per refill");
+
+	int64_t alignment = static_cast<int64_t>(std::min<uint64_t>(offset, refSize));
+	size_t pos = 0;
+	while (true) {
+		// Up to 4 symbols per refill, as long as they are literals
+		bin.refill();
+		uint32_t sym = 0;
+		for (int j = 0; j < 4; j++) {
+			sym = literals.decodeOne(bin);
+			if (sym >= 256)
+				break;
+			if (pos == rawLen)
+				throw std::runtime_error("Block data exceeds its declared size");
+			out[pos] = static_cast<uint8_t>(sym);
+			pos++;
+		}
+		if (sym < 256)
+			continue;
+		if (sym == END_SYMBOL)
+			break;
+
+		uint32_t code = sym - 257;
+		const uint32_t length = MIN_COPY + MatchCoding::getBase(code) + bin.read(MatchCoding::getExtraBits(code));
+		bin.refill();
+		code = addresses.decodeOne(bin);
+		const uint32_t diff = MatchCoding::getBase(code) + bin.read(MatchCoding::getExtraBits(code));
+		const int64_t address = static_cast<int64_t>(expectedAddress(alignment, static_cast<uint32_t>(pos), refSize)) + unzigzag(diff);
+		if (address < 0 || static_cast<uint64_t>(address) > refSize || length > refSize - static_cast<uint64_t>(address))
+			throw std::runtime_error("Copy outside the reference");
+		if (length > rawLen - pos)
+			throw std::runtime_error("Block data exceeds its declared size");
+		std::memcpy(out + pos, reference + address, length);
+		alignment = address - static_cast<int64_t>(pos);
+		pos += length;
+	}
+	if (pos != rawLen)
+		throw std::runtime_error("Block data is shorter than its declared size");
+}
@@ -0,0 +1,144 @@
+/*
+ * Delta block codec: a block of a new file as copies from a reference file and inserted bytes
+ *
+ * Successive builds of a program differ in a few places, and mostly in a way that keeps long
+ * stretches of bytes identical but shifted, or identical apart from a changed address here and
+ * there. This codec describes a block of the new file (the target) as a sequence of operations:
+ * insert a literal byte, or copy a run of at least MIN_COPY bytes from the reference. A copy's
+ * address is coded relative to the expected address, where the reference byte aligned with the
+ * current target byte by the previous copy is; so a copy that resumes the previous alignment
+ * after a few changed bytes codes its address with a single short code. The first expected
+ * address of a block is its offset in the target, so blocks are independent given the reference.
+ *
+ * Like Lz77Codec, there are two Huffman-coded alphabets:
+ * - literal/length: the 256 byte values, END_SYMBOL, and 32 length codes for copies of MIN_COPY to MAX_COPY bytes
+ * - address: 64 codes for the zigzag-mapped difference (0, -1, 1, -2, ...) between the address and the expected one
+ * Values are coded as in Lz77Codec: 0 to 3 have their own codes, and every further power of two is
+ * split into two codes with the offset within the range in (value's bit length - 2) extra bits.
+ *
+ * Block payload format: the code length tables of both alphabets (see CodeLengthIo), then for each
+ * literal its code, and for each copy its length code, length extra bits, address code and address
+ * extra bits, ending with END_SYMBOL, padded to a byte.
+ *
+ * The encoder finds copies with an Index of the reference, which maps the hash of the SEED_LENGTH
+ * bytes at each reference position to the last position with that hash, and by comparing the
+ * target with the reference at the expected address, which finds the copies after a changed byte
+ * that the hash would miss. A copy found through the index is also extended backwards over the
+ * literals before it.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "HuffmanKernel.hpp"
+
+class CoderContext;
+
+
+class DeltaCodec final {
+
+	/*---- Constants ----*/
+
+	public: static const std::uint32_t MIN_COPY = 4;
+
+	public: static const std::uint32_t MAX_COPY = MIN_COPY + 65535;
+
+	// Bytes hashed per reference position by Index.
+	public: static const std::uint32_t SEED_LENGTH = 8;
+
+	// Largest reference, so that an address difference maps to 32 bits.
+	public: static const std::uint64_t MAX_REFERENCE_SIZE = static_cast<std::uint64_t>(1) << 31;
+
+	public: static const std::uint32_t END_SYMBOL = 256;
+
+	// Byte values, END_SYMBOL and the length codes.
+	public: static const std::uint32_t LITERAL_LIMIT = 257 + 32;
+
+	public: static const std::uint32_t ADDRESS_LIMIT = 64;
+
+	public: static const int MAX_CODE_LENGTH = 12;
+
+
+	/*---- Types ----*/
+
+	public: typedef HuffmanKernel<LITERAL_LIMIT, MAX_CODE_LENGTH> LiteralKernel;
+
+	public: typedef HuffmanKernel<ADDRESS_LIMIT, MAX_CODE_LENGTH> AddressKernel;
+
+
+	/*
+	 * A hash table of the positions of a reference, for finding copies. The reference must outlive it.
+	 * It is only read while encoding, so all threads share one.
+	 */
+	public: class Index final {
+
+		private: const std::uint8_t *data;
+
+		private: std::size_t size;
+
+		private: int hashBits;
+
+		// Last position for each hash value, or UINT32_MAX.
+		private: std::vector<std::uint32_t> table;
+
+
+		// Indexes the given reference. Throws std::length_error if it is larger than MAX_REFERENCE_SIZE.
+		public: Index(const std::uint8_t *data, std::size_t size);
+
+
+		public: const std::uint8_t *getData() const {
+			return data;
+		}
+
+		public: std::size_t getSize() const {
+			return size;
+		}
+
+
+		// Returns a reference position whose SEED_LENGTH bytes might equal those at p, or UINT32_MAX.
+		public: std::uint32_t find(const std::uint8_t *p) const;
+
+
+		private: std::uint32_t hash(const std::uint8_t *p) const;
+
+	};
+
+
+	/*
+	 * Working memory of the codec. A CoderContext creates one on first use and keeps it.
+	 */
+	public: struct Workspace final {
+
+		std::array<std::uint32_t, LITERAL_LIMIT> literalFreqs;
+
+		std::array<std::uint32_t, LITERAL_LIMIT> literalLengths;
+
+		std::array<std::uint32_t, ADDRESS_LIMIT> addressFreqs;
+
+		std::array<std::uint32_t, ADDRESS_LIMIT> addressLengths;
+
+		LiteralKernel literalKernel;
+
+		AddressKernel addressKernel;
+
+	};
+
+
+	/*---- Methods ----*/
+
+	// Encodes the given target bytes, which start at the given offset of the target, against the indexed
+	// reference and appends the payload to out. Returns the number of bytes that are copied.
+	// The operations are kept as tokens in the symbols of the context.
+	public: static std::size_t encode(const Index &reference, const std::uint8_t *data, std::size_t len, std::uint64_t offset,
+		std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+
+	// Decodes a payload produced by encode() with the same reference and offset into exactly rawLen bytes at out.
+	// Throws std::runtime_error if the payload is malformed.
+	public: static void decode(const std::uint8_t *reference, std::size_t refSize, const std::uint8_t *in, std::size_t inLen,
+		std::uint8_t *out, std::size_t rawLen, std::uint64_t offset, CoderContext &ctx);
+
+};
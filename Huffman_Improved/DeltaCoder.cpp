@@ -0,0 +1,192 @@
+/*
+ * Streaming delta compression of a target file against a reference file
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include "BlockPipeline.hpp"
+#include "ByteIo.hpp"
+#include "Crc32c.hpp"
+#include "DeltaCodec.hpp"
+#include "DeltaCoder.hpp"
+#include "Instrumentation.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+const uint8_t DeltaCoder::BLOCK_STORED;
+const uint8_t DeltaCoder::BLOCK_DELTA;
+
+static const uint8_t MAGIC[] = {'H', 'U', 'F', 'D'};
+static const uint8_t VERSION = 1;
+static const uint8_t END_MARKER = 0xFF;
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 1 + 4 + 8 + 4;
+static const size_t BLOCK_HEADER_SIZE = 1 + 4 + 4 + 4;
+
+
+static void writeBytes(std::ostream &out, const vector<uint8_t> &data) {
+	out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	if (!out)
+		throw std::runtime_error("Error writing output");
+}
+
+
+static void readBytes(std::istream &in, uint8_t *data, size_t len) {
+	in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(len));
+	if (static_cast<size_t>(in.gcount()) != len)
+		throw std::runtime_error(in.bad() ? "Error reading input" : "Unexpected end of delta stream");
+}
+
+
+CodingStats DeltaCoder::compress(const vector<uint8_t> &reference, std::istream &in, std::ostream &out, uint32_t blockSize, unsigned int threads) {
+	if (blockSize == 0 || blockSize > BlockWriter::MAX_BLOCK_SIZE)
+		throw std::invalid_argument("Invalid block size");
+	const auto start = std::chrono::steady_clock::now();
+	CodingStats stats;
+	const DeltaCodec::Index index(reference.data(), reference.size());
+
+	vector<uint8_t> header(MAGIC, MAGIC + sizeof(MAGIC));
+	header.push_back(VERSION);
+	ByteIo::putU32(header, blockSize);
+	ByteIo::putU64(header, reference.size());
+	ByteIo::putU32(header, Crc32c::compute(reference.data(), reference.size()));
+	writeBytes(out, header);
+	stats.bytesOut = header.size();
+
+	std::atomic<uint64_t> copiedBytes(0);
+	BlockPipeline pipeline(std::max(threads, 1U));
+	pipeline.run(
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::READ_INPUT);
+			slot.input.resize(blockSize);
+			in.read(reinterpret_cast<char*>(slot.input.data()), static_cast<std::streamsize>(blockSize));
+			slot.rawLength = static_cast<uint32_t>(in.gcount());
+			if (in.bad())
+				throw std::runtime_error("Error reading input");
+			HUFF_COUNT(Counter::BYTES_IN, slot.rawLength);
+			return slot.rawLength > 0;
+		},
+		[&](PipelineSlot &slot, CoderContext &ctx) {
+			// The whole block, with its header, goes into the output
+			vector<uint8_t> &output = slot.output;
+			output.assign(BLOCK_HEADER_SIZE, 0);
+			const uint8_t *const raw = slot.input.data();
+			const size_t copied = DeltaCodec::encode(index, raw, slot.rawLength, slot.sequence * blockSize, output, ctx);
+			uint8_t kind = BLOCK_DELTA;
+			if (output.size() - BLOCK_HEADER_SIZE >= slot.rawLength) {
+				kind = BLOCK_STORED;
+				output.resize(BLOCK_HEADER_SIZE);
+				output.insert(output.end(), raw, raw + slot.rawLength);
+			} else
+				copiedBytes += copied;
+			vector<uint8_t> fields(1, kind);
+			ByteIo::putU32(fields, slot.rawLength);
+			ByteIo::putU32(fields, static_cast<uint32_t>(output.size() - BLOCK_HEADER_SIZE));
+			ByteIo::putU32(fields, Crc32c::compute(raw, slot.rawLength));
+			std::copy(fields.begin(), fields.end(), output.begin());
+		},
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::WRITE_OUTPUT);
+			HUFF_COUNT(Counter::BYTES_OUT, slot.output.size());
+			writeBytes(out, slot.output);
+			stats.bytesIn += slot.rawLength;
+			stats.bytesOut += slot.output.size();
+			stats.blocks++;
+		});
+	writeBytes(out, vector<uint8_t>(1, END_MARKER));
+	out.flush();
+	if (!out)
+		throw std::runtime_error("Error writing output");
+	stats.bytesOut++;
+	stats.copiedBytes = copiedBytes;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+
+CodingStats DeltaCoder::decompress(const vector<uint8_t> &reference, std::istream &in, std::ostream &out, unsigned int threads) {
+	const auto start = std::chrono::steady_clock::now();
+	CodingStats stats;
+
+	uint8_t header[HEADER_SIZE];
+	readBytes(in, header, sizeof(header));
+	if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), header))
+		throw std::runtime_error("Not a delta stream");
+	if (header[sizeof(MAGIC)] != VERSION)
+		throw std::runtime_error("Unsupported delta stream version");
+	const uint8_t *p = header + sizeof(MAGIC) + 1;
+	const uint8_t *const end = header + sizeof(header);
+	const uint32_t blockSize = ByteIo::getU32(p, end);
+	const uint64_t refSize = ByteIo::getU64(p, end);
+	const uint32_t refChecksum = ByteIo::getU32(p, end);
+	if (blockSize == 0 || blockSize > BlockWriter::MAX_BLOCK_SIZE)
+		throw std::runtime_error("Invalid block size");
+	if (refSize != reference.size() || refChecksum != Crc32c::compute(reference.data(), reference.size()))
+		throw std::runtime_error("Delta stream was made against a different reference");
+	stats.bytesIn = sizeof(header);
+
+	bool lastBlock = false;  // Whether a block shorter than the block size was read
+	BlockPipeline pipeline(std::max(threads, 1U));
+	pipeline.run(
+		[&](PipelineSlot &slot) {
+			// The whole block, with its header, goes into the input
+			HUFF_PHASE(Phase::READ_INPUT);
+			slot.input.resize(BLOCK_HEADER_SIZE);
+			readBytes(in, slot.input.data(), 1);
+			if (slot.input[0] == END_MARKER)
+				return false;
+			readBytes(in, slot.input.data() + 1, BLOCK_HEADER_SIZE - 1);
+			const uint8_t *q = slot.input.data() + 1;
+			const uint8_t *const fieldsEnd = slot.input.data() + BLOCK_HEADER_SIZE;
+			slot.rawLength = ByteIo::getU32(q, fieldsEnd);
+			const uint32_t payloadSize = ByteIo::getU32(q, fieldsEnd);
+			if (slot.input[0] != BLOCK_STORED && slot.input[0] != BLOCK_DELTA)
+				throw std::runtime_error("Unknown block kind");
+			if (lastBlock || slot.rawLength == 0 || slot.rawLength > blockSize || payloadSize > slot.rawLength)
+				throw std::runtime_error("Invalid block size");
+			lastBlock = slot.rawLength < blockSize;
+			slot.input.resize(BLOCK_HEADER_SIZE + payloadSize);
+			readBytes(in, slot.input.data() + BLOCK_HEADER_SIZE, payloadSize);
+			HUFF_COUNT(Counter::BYTES_IN, slot.input.size());
+			return true;
+		},
+		[&](PipelineSlot &slot, CoderContext &ctx) {
+			const uint8_t *q = slot.input.data() + 1 + 8;
+			const uint32_t checksum = ByteIo::getU32(q, slot.input.data() + BLOCK_HEADER_SIZE);
+			const uint8_t *const payload = slot.input.data() + BLOCK_HEADER_SIZE;
+			const size_t payloadSize = slot.input.size() - BLOCK_HEADER_SIZE;
+			slot.output.resize(slot.rawLength);
+			if (slot.input[0] == BLOCK_STORED) {
+				if (payloadSize != slot.rawLength)
+					throw std::runtime_error("Stored block size mismatch");
+				std::copy(payload, payload + payloadSize, slot.output.begin());
+			} else {
+				DeltaCodec::decode(reference.data(), reference.size(), payload, payloadSize,
+					slot.output.data(), slot.rawLength, slot.sequence * blockSize, ctx);
+			}
+			if (Crc32c::compute(slot.output.data(), slot.rawLength) != checksum)
+				throw std::runtime_error("Block checksum mismatch");
+		},
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::WRITE_OUTPUT);
+			HUFF_COUNT(Counter::BYTES_OUT, slot.rawLength);
+			out.write(reinterpret_cast<const char*>(slot.output.data()), static_cast<std::streamsize>(slot.rawLength));
+			if (!out)
+				throw std::runtime_error("Error writing output");
+			stats.bytesIn += slot.input.size();
+			stats.bytesOut += slot.rawLength;
+			stats.blocks++;
+		});
+	stats.bytesIn++;  // End marker
+	out.flush();
+	if (!out)
+		throw std::runtime_error("Error writing output");
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
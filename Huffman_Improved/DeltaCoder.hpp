@@ -0,0 +1,54 @@
+/*
+ * Streaming delta compression of a target file against a reference file
+ *
+ * The target is cut into blocks of a fixed size, and each block is coded with DeltaCodec against
+ * the whole reference, or stored if that doesn't shrink it. Reading, coding and writing run as a
+ * BlockPipeline, so neither direction needs the whole target in memory, the threads code several
+ * blocks at the same time, and a target that differs from the reference in a few places costs
+ * little more than the bytes of those places. Only the reference (and, when compressing, its
+ * Index, at most 64 MiB) is held in memory. All integers are big endian. Layout:
+ * - Stream header: the magic bytes "HUFD", a version byte (1), the block size (4 bytes), the
+ *   size of the reference (8 bytes) and its CRC-32C (4 bytes), so that decompressing against a
+ *   different reference is detected.
+ * - Each block: its kind (1 byte, BLOCK_DELTA or BLOCK_STORED), raw size (4 bytes), payload size
+ *   (4 bytes, at most the raw size), the CRC-32C of the raw bytes (4 bytes), then the payload.
+ *   Every block but the last has the block size.
+ * - End marker: the single byte 0xFF.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include "StreamCoder.hpp"
+
+
+class DeltaCoder final {
+
+	/*---- Constants ----*/
+
+	// Block kinds.
+	public: static const std::uint8_t BLOCK_STORED = 0;
+
+	public: static const std::uint8_t BLOCK_DELTA = 1;
+
+
+	/*---- Methods ----*/
+
+	// Compresses the given target stream against the given reference to the given output stream, in blocks
+	// of the given size (1 to BlockWriter::MAX_BLOCK_SIZE) coded by the given number of threads.
+	// Throws std::length_error if the reference is larger than DeltaCodec::MAX_REFERENCE_SIZE,
+	// and std::runtime_error on I/O errors.
+	public: static CodingStats compress(const std::vector<std::uint8_t> &reference, std::istream &in, std::ostream &out,
+		std::uint32_t blockSize, unsigned int threads);
+
+
+	// Decompresses a delta stream against the reference it was compressed with, decoding up to the given
+	// number of blocks concurrently. Throws std::runtime_error if the input is malformed, the reference
+	// is a different one, a checksum doesn't match, or on I/O errors.
+	public: static CodingStats decompress(const std::vector<std::uint8_t> &reference, std::istream &in, std::ostream &out,
+		unsigned int threads);
+
+};
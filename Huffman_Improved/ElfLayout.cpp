@@ -0,0 +1,195 @@
+/*
+ * Section layout of ELF files
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "ElfLayout.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+
+const uint64_t ElfLayout::MIN_REGION_SIZE;
+const uint64_t ElfLayout::MIN_LZ77_REGION_SIZE;
+
+// Section types and flags from the ELF specification
+static const uint32_t SHT_NULL = 0;
+static const uint32_t SHT_SYMTAB = 2;
+static const uint32_t SHT_STRTAB = 3;
+static const uint32_t SHT_RELA = 4;
+static const uint32_t SHT_HASH = 5;
+static const uint32_t SHT_DYNAMIC = 6;
+static const uint32_t SHT_NOBITS = 8;
+static const uint32_t SHT_REL = 9;
+static const uint32_t SHT_DYNSYM = 11;
+static const uint32_t SHT_RELR = 19;
+static const uint32_t SHT_GNU_HASH = 0x6FFFFFF6;
+static const uint32_t SHT_GNU_VERDEF = 0x6FFFFFFD;
+static const uint32_t SHT_GNU_VERNEED = 0x6FFFFFFE;
+static const uint32_t SHT_GNU_VERSYM = 0x6FFFFFFF;
+static const uint64_t SHF_EXECINSTR = 0x4;
+static const uint64_t SHF_STRINGS = 0x20;
+
+
+// Returns the unsigned integer of the given number of bytes at p, in the given byte order.
+static uint64_t getUint(const uint8_t *p, int size, bool bigEndian) {
+	uint64_t result = 0;
+	for (int i = 0; i < size; i++)
+		result |= static_cast<uint64_t>(p[bigEndian ? size - 1 - i : i]) << (i * 8);
+	return result;
+}
+
+
+static ElfLayout::Kind classify(uint32_t type, uint64_t flags) {
+	if ((flags & SHF_EXECINSTR) != 0)
+		return ElfLayout::Kind::CODE;
+	if (type == SHT_STRTAB || (flags & SHF_STRINGS) != 0)
+		return ElfLayout::Kind::STRINGS;
+	switch (type) {
+		case SHT_SYMTAB:
+		case SHT_DYNSYM:
+		case SHT_RELA:
+		case SHT_REL:
+		case SHT_RELR:
+		case SHT_HASH:
+		case SHT_GNU_HASH:
+		case SHT_DYNAMIC:
+		case SHT_GNU_VERDEF:
+		case SHT_GNU_VERNEED:
+		case SHT_GNU_VERSYM:
+			return ElfLayout::Kind::SYMBOLS;
+		default:
+			return ElfLayout::Kind::DATA;
+	}
+}
+
+
+static bool readAt(std::istream &in, uint64_t offset, uint8_t *buf, std::size_t len) {
+	in.clear();
+	in.seekg(static_cast<std::streamoff>(offset));
+	in.read(reinterpret_cast<char*>(buf), static_cast<std::streamsize>(len));
+	return static_cast<std::size_t>(in.gcount()) == len;
+}
+
+
+// Appends the given region, extending the last region instead if it has the same kind.
+static void append(vector<ElfLayout::Region> &regions, const ElfLayout::Region &r) {
+	if (!regions.empty() && regions.back().kind == r.kind)
+		regions.back().length += r.length;
+	else
+		regions.push_back(r);
+}
+
+
+// Reads the sections that occupy bytes of the file, or returns false if the headers are unusable.
+static bool readSections(std::istream &in, uint64_t fileSize, vector<ElfLayout::Region> &sections) {
+	// The identification bytes give the class, which determines the size of the rest of the header
+	uint8_t header[64];
+	if (fileSize < 16 || !readAt(in, 0, header, 16))
+		return false;
+	if (header[0] != 0x7F || header[1] != 'E' || header[2] != 'L' || header[3] != 'F')
+		return false;
+	if ((header[4] != 1 && header[4] != 2) || (header[5] != 1 && header[5] != 2))
+		return false;
+	const bool is64 = header[4] == 2;
+	const bool bigEndian = header[5] == 2;
+	const std::size_t headerSize = is64 ? 64 : 52;
+	if (fileSize < headerSize || !readAt(in, 16, header + 16, headerSize - 16))
+		return false;
+	const int word = is64 ? 8 : 4;
+	const uint64_t tableOffset = getUint(header + (is64 ? 0x28 : 0x20), word, bigEndian);
+	const uint64_t entrySize = getUint(header + (is64 ? 0x3A : 0x2E), 2, bigEndian);
+	const uint64_t count = getUint(header + (is64 ? 0x3C : 0x30), 2, bigEndian);
+	if (count == 0 || entrySize < (is64 ? 64U : 40U) || tableOffset > fileSize || count * entrySize > fileSize - tableOffset)
+		return false;
+
+	vector<uint8_t> table(static_cast<std::size_t>(count * entrySize));
+	if (!readAt(in, tableOffset, table.data(), table.size()))
+		return false;
+	for (uint64_t i = 0; i < count; i++) {
+		const uint8_t *entry = table.data() + i * entrySize;
+		uint32_t type = static_cast<uint32_t>(getUint(entry + 4, 4, bigEndian));
+		uint64_t flags = getUint(entry + 8, word, bigEndian);
+		uint64_t offset = getUint(entry + (is64 ? 24 : 16), word, bigEndian);
+		uint64_t size = getUint(entry + (is64 ? 32 : 20), word, bigEndian);
+		if (type == SHT_NULL || type == SHT_NOBITS || size == 0)
+			continue;
+		if (offset > fileSize || size > fileSize - offset)
+			return false;
+		sections.push_back(ElfLayout::Region{offset, size, classify(type, flags)});
+	}
+	return true;
+}
+
+
+vector<ElfLayout::Region> ElfLayout::parse(std::istream &in, uint64_t minRegionSize) {
+	vector<Region> result;
+	in.clear();
+	in.seekg(0, std::ios::end);
+	const std::streamoff end = in.tellg();
+	in.clear();
+	if (end <= 0)
+		return result;  // Not seekable, or empty
+	vector<Region> sections;
+	const bool ok = readSections(in, static_cast<uint64_t>(end), sections);
+	in.clear();
+	in.seekg(0);
+	if (!ok)
+		return result;
+	const uint64_t fileSize = static_cast<uint64_t>(end);
+
+	// Cover the file in order, with the bytes outside sections as OTHER
+	std::sort(sections.begin(), sections.end(),
+		[](const Region &a, const Region &b) { return a.offset < b.offset; });
+	vector<Region> exact;
+	uint64_t pos = 0;
+	for (const Region &s : sections) {
+		uint64_t sectionEnd = s.offset + s.length;
+		if (sectionEnd <= pos)
+			continue;  // Overlaps sections already covered
+		if (s.offset > pos)
+			append(exact, Region{pos, s.offset - pos, Kind::OTHER});
+		uint64_t start = std::max(s.offset, pos);
+		append(exact, Region{start, sectionEnd - start, s.kind});
+		pos = sectionEnd;
+	}
+	if (pos < fileSize)
+		append(exact, Region{pos, fileSize - pos, Kind::OTHER});
+
+	// Merge small regions into a neighbour, taking the kind of the larger part
+	vector<Region> merged;
+	for (const Region &r : exact) {
+		if (!merged.empty() && (r.length < minRegionSize || merged.back().length < minRegionSize)) {
+			if (merged.back().length < r.length)
+				merged.back().kind = r.kind;
+			merged.back().length += r.length;
+		} else
+			merged.push_back(r);
+	}
+	for (const Region &r : merged)
+		append(result, r);
+	return result;
+}
+
+
+vector<uint64_t> ElfLayout::getCuts(const vector<Region> &regions) {
+	vector<uint64_t> result;
+	for (std::size_t i = 0; i + 1 < regions.size(); i++)
+		result.push_back(regions[i].offset + regions[i].length);
+	return result;
+}
+
+
+const char *ElfLayout::getName(Kind kind) {
+	switch (kind) {
+		case Kind::OTHER:    return "other";
+		case Kind::CODE:     return "code";
+		case Kind::STRINGS:  return "strings";
+		case Kind::SYMBOLS:  return "symbols";
+		case Kind::DATA:     return "data";
+		default:  throw std::domain_error("Invalid region kind");
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Section layout of ELF files, for cutting them into blocks of similar content
+ *
+ * One code for a whole executable mixes machine code, string tables, symbol and relocation
+ * records and zero padding, which have very different statistics. ElfLayout reads the section
+ * header table (32- or 64-bit, either byte order) and partitions the file into regions of one
+ * kind each, in file order: sections are classified by type and flags, adjacent sections of the
+ * same kind are merged, and bytes outside any section (headers, alignment padding) form regions
+ * of kind OTHER. Regions shorter than a minimum size are merged into a neighbour, since a block
+ * of their own would cost more in headers and code tables than it saves. The minimum is larger
+ * for LZ77, which also loses the matches that would cross a boundary; in small executables that
+ * outweighs the gain, and the whole file stays one region.
+ *
+ * StreamCoder ends a block at every region boundary (see CompressOptions::blockCuts), so each
+ * region gets its own code table, codec choice and x86 filter decision, the regions are coded
+ * in parallel like any blocks, and the decoder reassembles the file by simply concatenating the
+ * blocks. The stream format is unchanged.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+
+class ElfLayout final {
+
+	/*---- Types and constants ----*/
+
+	public: enum class Kind {
+		OTHER,    // File and program headers, padding between sections, unknown sections
+		CODE,     // Executable sections
+		STRINGS,  // String tables and sections of null-terminated strings
+		SYMBOLS,  // Symbol, relocation, hash and dynamic linking tables
+		DATA,     // All other sections: read-only and writable data, unwinding and debug info
+	};
+
+	public: struct Region final {
+		std::uint64_t offset;
+		std::uint64_t length;
+		Kind kind;
+	};
+
+	// Minimum region size for entropy coders.
+	public: static const std::uint64_t MIN_REGION_SIZE = 4096;
+
+	// Minimum region size when blocks may be coded with LZ77.
+	public: static const std::uint64_t MIN_LZ77_REGION_SIZE = 65536;
+
+
+	/*---- Methods ----*/
+
+	// Reads the ELF section headers from the given seekable stream and returns the regions, none
+	// shorter than minRegionSize unless the file is, which cover the whole stream in order. Returns
+	// an empty vector if the stream isn't an ELF file or its section header table is missing or
+	// inconsistent. Leaves the stream at its start.
+	public: static std::vector<Region> parse(std::istream &in, std::uint64_t minRegionSize = MIN_REGION_SIZE);
+
+
+	// Returns the offsets where one region ends and the next begins, in increasing order.
+	public: static std::vector<std::uint64_t> getCuts(const std::vector<Region> &regions);
+
+
+	public: static const char *getName(Kind kind);
+
+};
@@ -10,6 +10,7 @@
 #include <cassert>
 #include <stdexcept>
 #include <utility>
+#include "CanonicalCode.hpp"
 #include "FrequencyTable.hpp"
 
 using std::uint32_t;
@@ -96,6 +97,64 @@ CodeTree FrequencyTable::buildCodeTree() const {
 }
 
 
+vector<uint32_t> FrequencyTable::buildCodeLengths(uint32_t maxLength) const {
+	if (maxLength < 1 || maxLength > 31 || (static_cast<uint64_t>(1) << maxLength) < frequencies.size())
+		throw std::domain_error("Maximum code length too small");
+	vector<uint32_t> lengths;
+	{
+		const CodeTree tree = buildCodeTree();
+		lengths = vector<uint32_t>(frequencies.size());
+		const CanonicalCode canonCode(tree, getSymbolLimit());
+		for (uint32_t i = 0; i < getSymbolLimit(); i++)
+			lengths[i] = canonCode.getCodeLength(i);
+	}
+	uint32_t maxLen = *std::max_element(lengths.cbegin(), lengths.cend());
+	if (maxLen <= maxLength)
+		return lengths;
+	
+	// Count codes per length, folding the overlong ones into maxLength
+	vector<uint32_t> numCodes(maxLen + 1, 0);
+	for (uint32_t len : lengths) {
+		if (len > 0)
+			numCodes[std::min(len, maxLength)]++;
+	}
+	// While the code is over-full, move a leaf from the deepest level to the
+	// next level up that has a leaf, splitting that leaf into two deeper ones
+	uint64_t kraft = 0;
+	for (uint32_t i = 1; i <= maxLength; i++)
+		kraft += static_cast<uint64_t>(numCodes[i]) << (maxLength - i);
+	for (; kraft > (static_cast<uint64_t>(1) << maxLength); kraft--) {
+		numCodes[maxLength]--;
+		for (uint32_t i = maxLength - 1; i > 0; i--) {
+			if (numCodes[i] > 0) {
+				numCodes[i]--;
+				numCodes[i + 1] += 2;
+				break;
+			}
+		}
+	}
+	
+	// Reassign the lengths: the longest codes go to the symbols that had the longest
+	// codes before, and among those to the least frequent ones
+	vector<uint32_t> order;
+	for (uint32_t i = 0; i < getSymbolLimit(); i++) {
+		if (lengths[i] > 0)
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [this, &lengths](uint32_t a, uint32_t b) {
+		if (lengths[a] != lengths[b])
+			return lengths[a] > lengths[b];
+		return frequencies[a] < frequencies[b];
+	});
+	std::size_t k = 0;
+	for (uint32_t len = maxLength; len > 0; len--) {
+		for (uint32_t j = 0; j < numCodes[len]; j++, k++)
+			lengths[order.at(k)] = len;
+	}
+	return lengths;
+}
+
+
 FrequencyTable::NodeWithFrequency::NodeWithFrequency(Node *nd, uint32_t lowSym, uint64_t freq) :
 	node(std::unique_ptr<Node>(nd)),
 	lowestSymbol(lowSym),
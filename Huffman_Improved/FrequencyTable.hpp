@@ -65,6 +65,13 @@ class FrequencyTable final {
 	public: CodeTree buildCodeTree() const;
 	
 	
+	// Returns the code lengths of a canonical code for the symbol frequencies in this table,
+	// where no code is longer than maxLength bits. If the optimal code is too long, lengths are
+	// redistributed (keeping the code full) so that the least frequent symbols get longer codes.
+	// Like buildCodeTree(), at least 2 symbols get a code. Requires 2^maxLength >= symbol limit.
+	public: std::vector<std::uint32_t> buildCodeLengths(std::uint32_t maxLength) const;
+	
+	
 	// Helper structure for buildCodeTree()
 	private: class NodeWithFrequency {
 		
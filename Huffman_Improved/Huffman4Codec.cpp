@@ -0,0 +1,146 @@
+/*
+ * Four-stream interleaved Huffman coding
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "BitBuffer.hpp"
+#include "ByteIo.hpp"
+#include "CoderContext.hpp"
+#include "Huffman4Codec.hpp"
+#include "HuffmanKernel.hpp"
+#include "HuffmanTable.hpp"
+#include "Instrumentation.hpp"
+#include "MultiSymbolTable.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::size_t;
+using std::vector;
+
+
+const int Huffman4Codec::NUM_STREAMS;
+const int Huffman4Codec::MAX_CODE_LENGTH;
+
+// Every code of this format takes a single lookup in the short kernel of a context.
+typedef HuffmanKernels::ShortKernel Kernel;
+static_assert(Kernel::MAX_LENGTH == Huffman4Codec::MAX_CODE_LENGTH, "Kernel must match the format");
+
+// Time per symbol of the 4-stream kernel, which overlaps the streams' lookups, relative to the single-stream
+// kernel (measured). The multi-symbol table must beat this instead.
+static const double KERNEL_LOOKUP_COST = 0.6;
+
+
+void Huffman4Codec::encode(vector<uint8_t> &out, CoderContext &ctx) {
+	{
+		HUFF_PHASE(Phase::COUNT);
+		ctx.countSymbols(0);
+	}
+	{
+		HUFF_PHASE(Phase::BUILD_CODE);
+		ctx.buildCodeLengths(MAX_CODE_LENGTH);
+	}
+	encodeWithCode(out, ctx, true);
+}
+
+
+void Huffman4Codec::encodeWithCode(vector<uint8_t> &out, CoderContext &ctx, bool writeTable) {
+	const vector<uint32_t> &symbols = ctx.symbols;
+	if (symbols.size() > UINT32_MAX)
+		throw std::length_error("Too many symbols");
+	{
+		HUFF_PHASE(Phase::BUILD_CODE);
+		ctx.shortKernel.build(ctx.lengths.data());
+	}
+	HUFF_RECORD_CODE(ctx.freqs.data(), ctx.lengths.data(), ZeroRun::SYMBOL_LIMIT);
+	const Kernel &kernel = ctx.shortKernel;
+
+	const size_t n = symbols.size();
+	ByteIo::putVarint(out, static_cast<uint32_t>(n));
+	const size_t jumpTable = out.size();
+	for (int k = 0; k < NUM_STREAMS - 1; k++)
+		ByteIo::putU32(out, 0);  // Filled in below
+	if (writeTable) {
+		HUFF_PHASE(Phase::WRITE_HEADER);
+		BitWriter bout(out);
+		CodeLengthIo::write(bout, ctx.lengths.data(), ctx.lengths.size());
+		bout.finish();
+	}
+
+	HUFF_PHASE(Phase::ENCODE);
+	const size_t seg = (n + NUM_STREAMS - 1) / NUM_STREAMS;
+	for (int k = 0; k < NUM_STREAMS; k++) {
+		size_t start = out.size();
+		BitWriter bout(out);
+		size_t begin = std::min(n, k * seg);
+		kernel.encode(symbols.data() + begin, std::min(n, (k + 1) * seg) - begin, bout);
+		bout.finish();
+		if (k < NUM_STREAMS - 1) {
+			uint32_t size = static_cast<uint32_t>(out.size() - start);
+			for (int j = 0; j < 4; j++)
+				out[jumpTable + k * 4 + j] = static_cast<uint8_t>(size >> (24 - j * 8));
+		}
+	}
+}
+
+
+void Huffman4Codec::decode(const uint8_t *in, size_t inLen, size_t maxSymbols, CoderContext &ctx, bool hasTable) {
+	const uint8_t *p = in;
+	const uint8_t *const end = in + inLen;
+	const size_t n = ByteIo::getVarint(p, end);
+	if (n > maxSymbols)
+		throw std::runtime_error("Too many symbols in block");
+	size_t streamSizes[NUM_STREAMS];
+	for (int k = 0; k < NUM_STREAMS - 1; k++)
+		streamSizes[k] = ByteIo::getU32(p, end);
+
+	if (hasTable) {
+		BitReader header(p, static_cast<size_t>(end - p));
+		CodeLengthIo::readUnchecked(header, ZeroRun::SYMBOL_LIMIT, ctx.lengths.data());
+		try {
+			ctx.shortKernel.build(ctx.lengths.data());
+		} catch (const std::invalid_argument &e) {
+			throw std::runtime_error(std::string("Invalid code length table: ") + e.what());
+		}
+		p += header.bytesConsumed(p);
+	}
+	const Kernel &kernel = ctx.shortKernel;
+
+	// Locate the four streams
+	size_t remaining = static_cast<size_t>(end - p);
+	for (int k = 0; k < NUM_STREAMS - 1; k++) {
+		if (streamSizes[k] > remaining)
+			throw std::runtime_error("Invalid jump table");
+		remaining -= streamSizes[k];
+	}
+	streamSizes[NUM_STREAMS - 1] = remaining;
+	BitReader r0(p, streamSizes[0]);
+	p += streamSizes[0];
+	BitReader r1(p, streamSizes[1]);
+	p += streamSizes[1];
+	BitReader r2(p, streamSizes[2]);
+	p += streamSizes[2];
+	BitReader r3(p, streamSizes[3]);
+	BitReader *readers[NUM_STREAMS] = {&r0, &r1, &r2, &r3};
+
+	vector<uint32_t> &symbols = ctx.symbols;
+	const size_t base = symbols.size();
+	symbols.resize(base + n);
+	const size_t seg = (n + NUM_STREAMS - 1) / NUM_STREAMS;
+	uint32_t *d0 = symbols.data() + base;
+	uint32_t *d1 = d0 + std::min(n, seg);
+	uint32_t *d2 = d0 + std::min(n, 2 * seg);
+	uint32_t *d3 = d0 + std::min(n, 3 * seg);
+	const size_t last = n - std::min(n, 3 * seg);  // The last segment is the shortest
+
+	uint32_t *const dests[NUM_STREAMS] = {d0, d1, d2, d3};
+	const size_t lengths[NUM_STREAMS] = {static_cast<size_t>(d1 - d0), static_cast<size_t>(d2 - d1), static_cast<size_t>(d3 - d2), last};
+	const int width = ctx.multiSymbolDecode ? MultiSymbolTable::chooseWidth(ctx.lengths.data(), ZeroRun::SYMBOL_LIMIT, n, KERNEL_LOOKUP_COST) : 0;
+	if (width != 0) {
+		ctx.multiTable.build(ctx.lengths.data(), ZeroRun::SYMBOL_LIMIT, width, ZeroRun::EOF_SYMBOL);
+		ctx.multiTable.decode4(readers, dests, lengths);
+	} else
+		kernel.decode4(readers, dests, lengths);
+}
@@ -0,0 +1,53 @@
+/*
+ * Four-stream interleaved Huffman coding
+ *
+ * With a single bit stream, the position of each code depends on the lengths of all the codes
+ * before it, so the decoder can only work on one symbol at a time. This format splits the symbols
+ * of a block into four consecutive segments, each coded into its own bit stream with the same
+ * canonical code, so that the decoder can advance four independent streams in one loop.
+ * Code lengths are limited to MAX_CODE_LENGTH, so every symbol takes a single lookup,
+ * and one refill of each stream is enough for several symbols.
+ *
+ * Block payload format:
+ * - number of symbols n (varint); segment k holds the symbols [k*s, min((k+1)*s, n)) where s = ceil(n/4)
+ * - jump table: the byte sizes of the first three streams (4 bytes each)
+ * - the code length table (see CodeLengthIo), padded to a byte, unless the block refers to a cached code
+ * - the four bit streams, each padded to a byte
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CoderContext;
+
+
+class Huffman4Codec final {
+
+	/*---- Constants ----*/
+
+	public: static const int NUM_STREAMS = 4;
+
+	public: static const int MAX_CODE_LENGTH = 11;
+
+
+	/*---- Methods ----*/
+
+	// Encodes the zero-run symbols (without EOF) of the given context and appends the payload to out.
+	public: static void encode(std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+
+	// Encodes the zero-run symbols of the given context with the code in its lengths, which must give
+	// every symbol a code of at most MAX_CODE_LENGTH bits, and writes the code length table only if writeTable is true.
+	public: static void encodeWithCode(std::vector<std::uint8_t> &out, CoderContext &ctx, bool writeTable);
+
+
+	// Decodes a payload produced by encode(), replacing the symbols of the given context. If hasTable is
+	// false, the payload has no code length table, and the lengths and short kernel of the context
+	// must already hold its code. Throws std::runtime_error if the payload is malformed or holds more
+	// than maxSymbols symbols.
+	public: static void decode(const std::uint8_t *in, std::size_t inLen, std::size_t maxSymbols, CoderContext &ctx, bool hasTable = true);
+
+};
@@ -20,73 +20,66 @@
 #include <stdexcept>
 #include <vector>
 #include "BitIoStream.hpp"
+#include "BitOps.hpp"
 #include "CanonicalCode.hpp"
 #include "FrequencyTable.hpp"
 #include "HuffmanCoder.hpp"
-#include "math.h"
 
 using std::uint32_t;
 
-std :: vector<uint32_t> breakNum(int counter){
+// Returns the exponents of the powers of two that sum to counter, from the largest down.
+std :: vector<uint32_t> breakNum(uint32_t counter){
     std :: vector<uint32_t> nums;
     while(counter != 0){
-        unsigned int num = log2(counter);
-        counter = counter - pow(2, num);
-        nums.push_back(num);
+        int num = BitOps::floorLog2(counter);
+        counter &= ~(static_cast<uint32_t>(1) << num);
+        nums.push_back(static_cast<uint32_t>(num));
     }
     return nums;
 }
 
 
+// Counts the symbols that a run of the given number of zeros is written as.
+static void countZeroRun(FrequencyTable &freqs, uint32_t counter){
+    for(const auto &i : breakNum(counter)){
+        if(i == 0)
+            freqs.increment(static_cast<uint32_t>(0));
+        else
+            freqs.increment(static_cast<uint32_t>(256 + i));
+    }
+}
+
+
 int main(int argc, char *argv[]) {
     // Handle command line arguments
 
-  /*  if (argc != 3) {
+    if (argc != 3) {
         std::cerr << "Usage: " << argv[0] << " InputFile OutputFile" << std::endl;
         return EXIT_FAILURE;
     }
     const char *inputFile  = argv[1];
-    const char *outputFile = argv[2];*/
-
-    const char *inputFile  = "/home/moshse/CLionProjects/Huffmam/BST.out";
-    const char *outputFile = "/home/moshse/CLionProjects/Huffmam/BST";
+    const char *outputFile = argv[2];
 
     // Read input file once to compute symbol frequencies.
     // The resulting generated code is optimal for static Huffman coding and also canonical.
     std::ifstream in(inputFile, std::ios::binary);
     FrequencyTable freqs(std::vector<uint32_t>(322, 0)); // add 2^32 0 00 0000 00000000 ..
     uint32_t null_counter  = 0;
-    std::string[] list_of_strings = {"_ZStlsISt11char_traitsIcEERSt13basic_ostreamIcT_ES5_PK"};
     while (true) {
         int b = in.get();
         if (b == EOF)
             break;
         if (b < 0 || b > 255)
             throw std::logic_error("Assertion error");
-        if (b == 0) {
+        if (b == 0)
             null_counter++;
-        }
         else {
-            if (null_counter == 0)
-                freqs.increment(static_cast<uint32_t>(b));
-            else if(null_counter == 1) {
-                freqs.increment(static_cast<uint32_t>(0));
-                freqs.increment(static_cast<uint32_t>(b)); //add breaking char
-                null_counter = 0;
-            }
-            else {
-                freqs.increment(static_cast<uint32_t>(b)); //add breaking char
-                std::vector<uint32_t> log_of_num = breakNum(null_counter);
-                for(const auto &i : log_of_num){
-                    if(i == 0)
-                        freqs.increment(static_cast<uint32_t>(0));
-                    else
-                        freqs.increment(static_cast<uint32_t>(256 + i));   //add null
-                }
-                null_counter = 0;
-            }
+            countZeroRun(freqs, null_counter);
+            null_counter = 0;
+            freqs.increment(static_cast<uint32_t>(b));
         }
     }
+    countZeroRun(freqs, null_counter);  // A run of zeros at the end of the file
     // we read a:
         // check if a is substr of word in the dic
         //if yes:: continute read
@@ -27,15 +27,12 @@ using std::uint32_t;
 
 int main(int argc, char *argv[]) {
     // Handle command line arguments
-    /*if (argc != 3) {
+    if (argc != 3) {
         std::cerr << "Usage: " << argv[0] << " InputFile OutputFile" << std::endl;
         return EXIT_FAILURE;
     }
-    const char *inputFile  = "/home/dvir/CLionProjects/huffman 3/binaryCoded";
-    const char outputFile = "/home/dvir/CLionProjects/huffman 3/binaryDecoded";*/
-
-    const char *inputFile  = "/home/moshse/CLionProjects/Huffmam/binarySerach";
-    const char *outputFile = "/home/moshse/CLionProjects/Huffmam/binarySerachV2.out";
+    const char *inputFile  = argv[1];
+    const char *outputFile = argv[2];
 
     // Perform file decompression
     std::ifstream in(inputFile, std::ios::binary);
@@ -45,7 +42,7 @@ int main(int argc, char *argv[]) {
 
         // Read code length table
         std::vector<uint32_t> codeLengths;
-        for (int i = 0; i < 321; i++) {
+        for (int i = 0; i < 322; i++) {
             // For this file format, we read 8 bits in big endian
             uint32_t val = 0;
             for (int j = 0; j < 8; j++)
@@ -63,7 +60,6 @@ int main(int argc, char *argv[]) {
             if (symbol == 256)  // EOF symbol
                 break;
             int b = static_cast<int>(symbol);
-            std::cout << b << " ";
          /*   if (std::numeric_limits<char>::is_signed)
                 b -= (b >> 7) << 8;
             std::cout << b << std::endl;*/
@@ -0,0 +1,34 @@
+/*
+ * Huffman coding kernels specialized at compile time
+ */
+
+#include "HuffmanKernel.hpp"
+#include "HuffmanTable.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint32_t;
+using std::size_t;
+using std::vector;
+
+
+static_assert(ZeroRun::SYMBOL_LIMIT == 322, "Kernel instantiations must match the zero-run alphabet");
+
+
+void HuffmanKernels::decodeUntil(const CanonicalCode &code, BitReader &in, uint32_t stop, size_t maxSymbols, vector<uint32_t> &out) {
+	bool done = dispatch(code, [&](const auto &kernel) {
+		kernel.decodeUntil(in, stop, maxSymbols, out);
+	});
+	if (done)
+		return;
+	const DecodeTable table(code);
+	size_t count = 0;
+	while (true) {
+		uint32_t symbol = table.read(in);
+		if (symbol == stop)
+			break;
+		if (count == maxSymbols)
+			throw std::runtime_error("Too many symbols in block");
+		out.push_back(symbol);
+		count++;
+	}
+}
@@ -0,0 +1,298 @@
+/*
+ * Huffman coding kernels specialized at compile time
+ *
+ * EncodeTable and DecodeTable accept any alphabet and code length, so their tables are vectors
+ * and the decoder needs a slow path for long codes. A HuffmanKernel fixes the alphabet size and
+ * the maximum code length as template parameters instead: the tables are std::arrays, every code
+ * is decoded with a single lookup, two codes always fit into one write, and the number of
+ * symbols decoded per refill is a constant, so the compiler can unroll the inner loops.
+ * All checks happen when the code is built. HuffmanKernels picks an instantiation at run time
+ * and falls back to the generic tables when none fits. The loops over many symbols run through
+ * BitOps::dispatch(), so they use the BMI2 shifts on processors that have them.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "BitBuffer.hpp"
+#include "BitOps.hpp"
+#include "CanonicalCode.hpp"
+
+
+template <std::uint32_t AlphabetSize, int MaxLength>
+class HuffmanKernel final {
+
+	static_assert(MaxLength >= 1 && MaxLength <= 15, "Lengths must fit in 4 bits");
+	static_assert(AlphabetSize >= 2 && AlphabetSize <= 4096, "Symbols must fit in 12 bits");
+
+
+	/*---- Constants ----*/
+
+	public: static const int MAX_LENGTH = MaxLength;
+
+	// Number of codes that fit in the 56 bits guaranteed after a refill.
+	public: static const int SYMBOLS_PER_REFILL = 56 / MaxLength;
+
+
+	/*---- Fields ----*/
+
+	private: std::array<std::uint32_t, AlphabetSize> codes;
+
+	private: std::array<std::uint8_t, AlphabetSize> lengths;
+
+	// Indexed by the next MaxLength bits of the stream. Each entry is (symbol << 4) | length.
+	private: std::array<std::uint16_t, static_cast<std::size_t>(1) << MaxLength> table;
+
+
+	/*---- Constructors ----*/
+
+	// Constructs a kernel without a code. build() must be called before coding.
+	public: HuffmanKernel() {}
+
+
+	// Builds the tables for the given canonical code. Throws std::invalid_argument if the code
+	// doesn't have exactly AlphabetSize symbols or has a code longer than MaxLength.
+	public: explicit HuffmanKernel(const CanonicalCode &code) {
+		if (!fits(code))
+			throw std::invalid_argument("Code doesn't fit kernel");
+		std::array<std::uint32_t, AlphabetSize> codeLengths;
+		for (std::uint32_t sym = 0; sym < AlphabetSize; sym++)
+			codeLengths[sym] = code.getCodeLength(sym);
+		build(codeLengths.data());
+	}
+
+
+	/*---- Methods ----*/
+
+	// Replaces the code with the given AlphabetSize code lengths, without allocating memory.
+	// Throws std::invalid_argument if a length exceeds MaxLength or the lengths don't form
+	// a complete prefix code (with at least 2 symbols).
+	public: void build(const std::uint32_t *codeLengths) {
+		std::array<std::uint32_t, MaxLength + 2> nextCode = {};
+		std::uint64_t kraft = 0;
+		for (std::uint32_t sym = 0; sym < AlphabetSize; sym++) {
+			std::uint32_t len = codeLengths[sym];
+			if (len > static_cast<std::uint32_t>(MaxLength))
+				throw std::invalid_argument("Code too long for kernel");
+			lengths[sym] = static_cast<std::uint8_t>(len);
+			nextCode[len]++;
+			if (len > 0)
+				kraft += static_cast<std::uint64_t>(1) << (MaxLength - len);
+		}
+		if (kraft != table.size())
+			throw std::invalid_argument(kraft < table.size() ? "Under-full Huffman code tree" : "Over-full Huffman code tree");
+
+		// Assign canonical code values in order of length, then symbol
+		nextCode[0] = 0;
+		std::uint32_t next = 0;
+		for (int len = 1; len <= MaxLength; len++) {
+			std::uint32_t count = nextCode[len];
+			nextCode[len] = next;
+			next = (next + count) << 1;
+		}
+
+		// A complete code fills every table entry exactly once
+		for (std::uint32_t sym = 0; sym < AlphabetSize; sym++) {
+			int len = lengths[sym];
+			codes[sym] = len == 0 ? 0 : nextCode[len]++;
+			if (len == 0)
+				continue;
+			std::size_t first = static_cast<std::size_t>(codes[sym]) << (MaxLength - len);
+			std::size_t count = static_cast<std::size_t>(1) << (MaxLength - len);
+			for (std::size_t j = 0; j < count; j++)
+				table[first + j] = static_cast<std::uint16_t>(sym << 4 | static_cast<std::uint32_t>(len));
+		}
+	}
+
+
+	// Tests whether the given code can be used with this kernel.
+	public: static bool fits(const CanonicalCode &code) {
+		if (code.getSymbolLimit() != AlphabetSize)
+			return false;
+		for (std::uint32_t sym = 0; sym < AlphabetSize; sym++) {
+			if (code.getCodeLength(sym) > static_cast<std::uint32_t>(MaxLength))
+				return false;
+		}
+		return true;
+	}
+
+
+	// Writes the codes of the given symbols, which must all have codes.
+	public: void encode(const std::uint32_t *symbols, std::size_t n, BitWriter &out) const {
+		BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+			std::size_t i = 0;
+			for (; i + 2 <= n; i += 2) {
+				std::uint32_t a = symbols[i];
+				std::uint32_t b = symbols[i + 1];
+				out.write(codes[a] << lengths[b] | codes[b], lengths[a] + lengths[b]);
+			}
+			if (i < n)
+				out.write(codes[symbols[i]], lengths[symbols[i]]);
+		});
+	}
+
+
+	// Reads one symbol without refilling. The reader must hold at least MaxLength bits or be at its end.
+	public: std::uint32_t decodeOne(BitReader &in) const {
+		std::uint32_t entry = table[in.peek(MaxLength)];
+		in.consume(static_cast<int>(entry & 0xF));
+		return entry >> 4;
+	}
+
+
+	// Reads exactly n symbols into the given array.
+	public: void decode(BitReader &in, std::uint32_t *out, std::size_t n) const {
+		BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+			decodeSymbols(in, out, n);
+		});
+	}
+
+
+	// Reads exactly lengths[k] symbols from each of the 4 given readers into outs[k], advancing the
+	// streams together so that their lookups overlap.
+	public: void decode4(BitReader *const readers[4], std::uint32_t *const outs[4], const std::size_t lengths[4]) const {
+		BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+			// Local copies stay in registers, whereas the stores to the outputs could alias the originals
+			BitReader r0(*readers[0]);
+			BitReader r1(*readers[1]);
+			BitReader r2(*readers[2]);
+			BitReader r3(*readers[3]);
+			std::uint32_t *const d0 = outs[0];
+			std::uint32_t *const d1 = outs[1];
+			std::uint32_t *const d2 = outs[2];
+			std::uint32_t *const d3 = outs[3];
+			const std::size_t shortest = std::min(std::min(lengths[0], lengths[1]), std::min(lengths[2], lengths[3]));
+			std::size_t i = 0;
+			for (; i + SYMBOLS_PER_REFILL <= shortest; i += SYMBOLS_PER_REFILL) {
+				r0.refill();
+				r1.refill();
+				r2.refill();
+				r3.refill();
+				for (std::size_t j = i; j < i + SYMBOLS_PER_REFILL; j++) {
+					d0[j] = decodeOne(r0);
+					d1[j] = decodeOne(r1);
+					d2[j] = decodeOne(r2);
+					d3[j] = decodeOne(r3);
+				}
+			}
+
+			// Finish each stream separately
+			*readers[0] = r0;
+			*readers[1] = r1;
+			*readers[2] = r2;
+			*readers[3] = r3;
+			for (int k = 0; k < 4; k++)
+				decodeSymbols(*readers[k], outs[k] + i, lengths[k] - i);
+		});
+	}
+
+
+	// Reads symbols until the stop symbol, appending all symbols before it to the given vector.
+	// Throws std::runtime_error if more than maxSymbols symbols precede the stop symbol.
+	public: void decodeUntil(BitReader &in, std::uint32_t stop, std::size_t maxSymbols, std::vector<std::uint32_t> &out) const {
+		BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+			const std::size_t base = out.size();
+			std::size_t count = 0;
+			std::size_t capacity = std::min<std::size_t>(maxSymbols, 1024);
+			out.resize(base + capacity);
+			while (true) {
+				if (count + SYMBOLS_PER_REFILL > capacity) {
+					if (capacity == maxSymbols && count + SYMBOLS_PER_REFILL > maxSymbols) {
+						// Near the limit: one symbol at a time with exact checks
+						in.refill();
+						std::uint32_t sym = decodeOne(in);
+						if (sym == stop)
+							break;
+						if (count == maxSymbols)
+							throw std::runtime_error("Too many symbols in block");
+						out[base + count] = sym;
+						count++;
+						continue;
+					}
+					capacity = std::min(maxSymbols, capacity * 2 + SYMBOLS_PER_REFILL);
+					out.resize(base + capacity);
+					continue;  // The new capacity may still be too small for a batch
+				}
+				in.refill();
+				std::uint32_t *dest = out.data() + base + count;
+				int j = 0;
+				for (; j < SYMBOLS_PER_REFILL; j++) {
+					std::uint32_t sym = decodeOne(in);
+					if (sym == stop)
+						break;
+					dest[j] = sym;
+				}
+				count += static_cast<std::size_t>(j);
+				if (j < SYMBOLS_PER_REFILL)
+					break;
+			}
+			out.resize(base + count);
+		});
+	}
+
+
+	// The loop of decode(), without dispatch.
+	private: HUFF_ALWAYS_INLINE void decodeSymbols(BitReader &in, std::uint32_t *out, std::size_t n) const {
+		std::size_t i = 0;
+		for (; i + SYMBOLS_PER_REFILL <= n; i += SYMBOLS_PER_REFILL) {
+			in.refill();
+			for (int j = 0; j < SYMBOLS_PER_REFILL; j++)
+				out[i + j] = decodeOne(in);
+		}
+		in.refill();
+		for (; i < n; i++)
+			out[i] = decodeOne(in);
+	}
+
+};
+
+
+template <std::uint32_t AlphabetSize, int MaxLength>
+const int HuffmanKernel<AlphabetSize, MaxLength>::MAX_LENGTH;
+
+template <std::uint32_t AlphabetSize, int MaxLength>
+const int HuffmanKernel<AlphabetSize, MaxLength>::SYMBOLS_PER_REFILL;
+
+
+
+/*
+ * Runtime dispatch to the kernel instantiations for the zero-run alphabet.
+ */
+class HuffmanKernels final {
+
+	// The instantiations, in order of preference. Longer codes use the generic tables,
+	// whose smaller lookup table is cheaper to build than a kernel table of 2^MaxLength entries.
+	public: typedef HuffmanKernel<322, 11> ShortKernel;
+
+	public: typedef HuffmanKernel<322, 13> LongKernel;
+
+
+	// Builds the first kernel that fits the given code and calls func(kernel), or returns false if none fits.
+	public: template <typename Func>
+	static bool dispatch(const CanonicalCode &code, Func func) {
+		// The tables are too large to put on the stack of a worker thread
+		if (ShortKernel::fits(code)) {
+			std::unique_ptr<ShortKernel> kernel(new ShortKernel(code));
+			func(static_cast<const ShortKernel&>(*kernel));
+			return true;
+		} else if (LongKernel::fits(code)) {
+			std::unique_ptr<LongKernel> kernel(new LongKernel(code));
+			func(static_cast<const LongKernel&>(*kernel));
+			return true;
+		} else
+			return false;
+	}
+
+
+	// Reads symbols up to the stop symbol with the given code, appending all symbols before it to the
+	// given vector. Throws std::runtime_error if more than maxSymbols symbols precede it or the stream ends early.
+	public: static void decodeUntil(const CanonicalCode &code, BitReader &in, std::uint32_t stop,
+		std::size_t maxSymbols, std::vector<std::uint32_t> &out);
+
+};
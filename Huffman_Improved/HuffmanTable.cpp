@@ -0,0 +1,188 @@
+/*
+ * Table-driven canonical Huffman coding
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "HuffmanTable.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+
+// Returns the canonical code values for the given code lengths (all at most 64).
+static vector<uint64_t> assignCodes(const CanonicalCode &code, uint32_t maxLen);
+
+
+const int DecodeTable::TABLE_BITS;
+const uint32_t CodeLengthIo::MAX_LENGTH;
+
+
+EncodeTable::EncodeTable(const CanonicalCode &code) {
+	uint32_t maxLen = 0;
+	for (uint32_t i = 0; i < code.getSymbolLimit(); i++)
+		maxLen = std::max(code.getCodeLength(i), maxLen);
+	if (maxLen > 64)
+		throw std::domain_error("Code too long for table");
+	codes = assignCodes(code, maxLen);
+	lengths.resize(code.getSymbolLimit());
+	for (uint32_t i = 0; i < code.getSymbolLimit(); i++)
+		lengths[i] = static_cast<std::uint8_t>(code.getCodeLength(i));
+}
+
+
+DecodeTable::DecodeTable(const CanonicalCode &code) {
+	uint32_t maxLen = 0;
+	for (uint32_t i = 0; i < code.getSymbolLimit(); i++)
+		maxLen = std::max(code.getCodeLength(i), maxLen);
+	if (maxLen > 64)
+		throw std::domain_error("Code too long for table");
+	if (code.getSymbolLimit() > (static_cast<uint32_t>(1) << 24))
+		throw std::domain_error("Too many symbols for table");
+	tableBits = static_cast<int>(std::min(maxLen, static_cast<uint32_t>(TABLE_BITS)));
+	singleLookup = maxLen <= static_cast<uint32_t>(TABLE_BITS);
+	table.assign(static_cast<std::size_t>(1) << tableBits, 0);
+	const vector<uint64_t> codes = assignCodes(code, maxLen);
+
+	// Fill the direct lookup entries: a code of length len owns 2^(tableBits - len) slots
+	for (uint32_t sym = 0; sym < code.getSymbolLimit(); sym++) {
+		uint32_t len = code.getCodeLength(sym);
+		if (len == 0 || len > static_cast<uint32_t>(tableBits))
+			continue;
+		uint32_t first = static_cast<uint32_t>(codes[sym]) << (tableBits - len);
+		uint32_t count = static_cast<uint32_t>(1) << (tableBits - len);
+		for (uint32_t j = 0; j < count; j++)
+			table[first + j] = sym << 8 | len;
+	}
+
+	// Set up the canonical search for long codes
+	firstCode.assign(maxLen + 1, 0);
+	numCodes.assign(maxLen + 1, 0);
+	firstIndex.assign(maxLen + 1, 0);
+	for (uint32_t sym = 0; sym < code.getSymbolLimit(); sym++)
+		numCodes[code.getCodeLength(sym)]++;
+	numCodes[0] = 0;
+	uint64_t nextCode = 0;
+	uint32_t index = 0;
+	for (uint32_t len = 1; len <= maxLen; len++) {
+		nextCode = (nextCode + numCodes[len - 1]) << 1;
+		firstCode[len] = nextCode;
+		firstIndex[len] = index;
+		index += numCodes[len];
+	}
+	sortedSymbols.resize(index);
+	vector<uint32_t> fill(firstIndex);
+	for (uint32_t sym = 0; sym < code.getSymbolLimit(); sym++) {
+		uint32_t len = code.getCodeLength(sym);
+		if (len > 0)
+			sortedSymbols[fill[len]++] = sym;
+	}
+}
+
+
+uint32_t DecodeTable::readSlow(BitReader &in) const {
+	uint64_t codeVal = 0;
+	for (std::size_t len = 1; len < firstCode.size(); len++) {
+		codeVal = (codeVal << 1) | in.read(1);
+		uint64_t offset = codeVal - firstCode[len];
+		if (offset < numCodes[len])
+			return sortedSymbols[firstIndex[len] + static_cast<uint32_t>(offset)];
+	}
+	throw std::logic_error("Assertion error: Violation of canonical code invariants");
+}
+
+
+void CodeLengthIo::write(BitWriter &out, const vector<uint32_t> &lengths) {
+	write(out, lengths.data(), lengths.size());
+}
+
+
+void CodeLengthIo::write(BitWriter &out, const uint32_t *lengths, std::size_t count) {
+	for (std::size_t i = 0; i < count; ) {
+		uint32_t len = lengths[i];
+		if (len > MAX_LENGTH)
+			throw std::domain_error("Code length too long");
+		if (len != 0) {
+			out.write(len, 4);
+			i++;
+		} else {
+			uint32_t run = 1;
+			while (run < 32 && i + run < count && lengths[i + run] == 0)
+				run++;
+			out.write(0, 4);
+			out.write(run - 1, 5);
+			i += run;
+		}
+	}
+}
+
+
+uint64_t CodeLengthIo::getBitSize(const uint32_t *lengths, std::size_t count) {
+	uint64_t result = 0;
+	for (std::size_t i = 0; i < count; ) {
+		if (lengths[i] != 0) {
+			result += 4;
+			i++;
+		} else {
+			uint32_t run = 1;
+			while (run < 32 && i + run < count && lengths[i + run] == 0)
+				run++;
+			result += 9;
+			i += run;
+		}
+	}
+	return result;
+}
+
+
+vector<uint32_t> CodeLengthIo::read(BitReader &in, uint32_t symbolLimit) {
+	vector<uint32_t> lengths(symbolLimit);
+	readUnchecked(in, symbolLimit, lengths.data());
+	try {
+		CanonicalCode check(lengths);
+		(void)check;
+	} catch (const std::invalid_argument &e) {
+		throw std::runtime_error(std::string("Invalid code length table: ") + e.what());
+	}
+	return lengths;
+}
+
+
+void CodeLengthIo::readUnchecked(BitReader &in, uint32_t symbolLimit, uint32_t *lengths) {
+	for (uint32_t i = 0; i < symbolLimit; ) {
+		uint32_t len = in.read(4);
+		if (len != 0)
+			lengths[i++] = len;
+		else {
+			uint32_t run = in.read(5) + 1;
+			if (run > symbolLimit - i)
+				throw std::runtime_error("Invalid code length table");
+			for (; run > 0; run--)
+				lengths[i++] = 0;
+		}
+	}
+}
+
+
+static vector<uint64_t> assignCodes(const CanonicalCode &code, uint32_t maxLen) {
+	// Count the codes of each length, then hand out consecutive values per length
+	vector<uint32_t> numCodes(maxLen + 1, 0);
+	for (uint32_t i = 0; i < code.getSymbolLimit(); i++)
+		numCodes[code.getCodeLength(i)]++;
+	numCodes[0] = 0;
+	vector<uint64_t> nextCode(maxLen + 1, 0);
+	uint64_t val = 0;
+	for (uint32_t len = 1; len <= maxLen; len++) {
+		val = (val + numCodes[len - 1]) << 1;
+		nextCode[len] = val;
+	}
+	vector<uint64_t> result(code.getSymbolLimit(), 0);
+	for (uint32_t i = 0; i < code.getSymbolLimit(); i++) {
+		uint32_t len = code.getCodeLength(i);
+		if (len > 0)
+			result[i] = nextCode[len]++;
+	}
+	return result;
+}
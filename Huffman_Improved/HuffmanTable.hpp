@@ -0,0 +1,162 @@
+/*
+ * Table-driven canonical Huffman coding
+ *
+ * These tables produce exactly the same bits as a CodeTree built by CanonicalCode::toCodeTree():
+ * codes are assigned in order of increasing length, breaking ties by increasing symbol value.
+ * Instead of walking a tree one bit at a time, the encoder looks up the whole code of a symbol,
+ * and the decoder looks up the next TABLE_BITS bits of the stream to find the symbol and its length.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "BitBuffer.hpp"
+#include "CanonicalCode.hpp"
+
+
+/*
+ * Maps each symbol to its code value and code length.
+ */
+class EncodeTable final {
+
+	/*---- Fields ----*/
+
+	private: std::vector<std::uint64_t> codes;
+
+	private: std::vector<std::uint8_t> lengths;
+
+
+	/*---- Constructor ----*/
+
+	// Builds the table for the given canonical code, whose codes must be at most 64 bits long.
+	public: explicit EncodeTable(const CanonicalCode &code);
+
+
+	/*---- Methods ----*/
+
+	// Writes the code of the given symbol, which must have a code.
+	public: void write(BitWriter &out, std::uint32_t symbol) const {
+		std::uint32_t len = lengths[symbol];
+		if (len <= 32)
+			out.write(static_cast<std::uint32_t>(codes[symbol]), static_cast<int>(len));
+		else
+			out.writeLong(codes[symbol], static_cast<int>(len));
+	}
+
+
+	// Returns the code length of the given symbol, or 0 if it has no code.
+	public: std::uint32_t getCodeLength(std::uint32_t symbol) const {
+		return lengths.at(symbol);
+	}
+
+};
+
+
+
+/*
+ * Decodes symbols with one table lookup for codes of up to TABLE_BITS bits,
+ * and a canonical bit-by-bit search for the rare longer codes.
+ */
+class DecodeTable final {
+
+	/*---- Constants ----*/
+
+	public: static const int TABLE_BITS = 11;
+
+
+	/*---- Fields ----*/
+
+	// Number of bits looked up at once, at most TABLE_BITS.
+	private: int tableBits;
+
+	// True if every code is at most tableBits long, so readFast() can be used.
+	private: bool singleLookup;
+
+	// Indexed by the next tableBits bits of the stream. Each entry is (symbol << 8) | length,
+	// or 0 if the code is longer than tableBits.
+	private: std::vector<std::uint32_t> table;
+
+	// For the slow path: per code length, the first code value, the number of codes,
+	// and the index of the first symbol in sortedSymbols.
+	private: std::vector<std::uint64_t> firstCode;
+
+	private: std::vector<std::uint32_t> numCodes;
+
+	private: std::vector<std::uint32_t> firstIndex;
+
+	private: std::vector<std::uint32_t> sortedSymbols;
+
+
+	/*---- Constructor ----*/
+
+	// Builds the table for the given canonical code, whose codes must be at most 64 bits long.
+	public: explicit DecodeTable(const CanonicalCode &code);
+
+
+	/*---- Methods ----*/
+
+	// Reads and returns the next symbol.
+	public: std::uint32_t read(BitReader &in) const {
+		in.refill();
+		std::uint32_t entry = table[in.peek(tableBits)];
+		if (entry != 0) {
+			in.consume(static_cast<int>(entry & 0xFF));
+			return entry >> 8;
+		}
+		return readSlow(in);
+	}
+
+
+	// Reads the next symbol without refilling the reader first. Requires isSingleLookup(),
+	// and that the reader holds at least as many bits as the code (or is at its end).
+	public: std::uint32_t readFast(BitReader &in) const {
+		std::uint32_t entry = table[in.peek(tableBits)];
+		in.consume(static_cast<int>(entry & 0xFF));
+		return entry >> 8;
+	}
+
+
+	// Returns true if every code can be decoded with a single table lookup.
+	public: bool isSingleLookup() const {
+		return singleLookup;
+	}
+
+
+	private: std::uint32_t readSlow(BitReader &in) const;
+
+};
+
+
+
+/*
+ * Compact serialization of code lengths between 0 and 15, used by the block formats.
+ * Each non-zero length is written as 4 bits. A length of 0 is written as 4 zero bits followed
+ * by 5 bits holding the number of consecutive zero lengths minus 1 (runs of up to 32).
+ */
+class CodeLengthIo final {
+
+	public: static const std::uint32_t MAX_LENGTH = 15;
+
+
+	// Writes the given code lengths, which must all be at most MAX_LENGTH.
+	public: static void write(BitWriter &out, const std::vector<std::uint32_t> &lengths);
+
+	public: static void write(BitWriter &out, const std::uint32_t *lengths, std::size_t count);
+
+
+	// Returns the number of bits that write() produces for the given code lengths.
+	public: static std::uint64_t getBitSize(const std::uint32_t *lengths, std::size_t count);
+
+
+	// Reads the given number of code lengths. Throws std::runtime_error if they don't form
+	// a valid canonical code.
+	public: static std::vector<std::uint32_t> read(BitReader &in, std::uint32_t symbolLimit);
+
+
+	// Reads the given number of code lengths into the given array, without checking that they
+	// form a valid code. Throws std::runtime_error if the table is malformed.
+	public: static void readUnchecked(BitReader &in, std::uint32_t symbolLimit, std::uint32_t *lengths);
+
+};
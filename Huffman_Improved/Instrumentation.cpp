@@ -0,0 +1,154 @@
+/*
+ * Hot-path instrumentation
+ */
+
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <mutex>
+#include "Instrumentation.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+
+
+const int Instrumentation::NUM_PHASES;
+const int Instrumentation::NUM_COUNTERS;
+
+static const char *PHASE_NAMES[Instrumentation::NUM_PHASES] = {
+	"read_input", "symbolize", "count", "build_code", "write_header",
+	"encode", "decode", "rebuild", "write_output", "filter"};
+
+static const char *COUNTER_NAMES[Instrumentation::NUM_COUNTERS] = {
+	"bytes_in", "bytes_out", "literal_symbols", "run_symbols", "eof_symbols", "tree_rebuilds"};
+
+static std::atomic<uint64_t> phaseCalls[Instrumentation::NUM_PHASES];
+static std::atomic<uint64_t> phaseWallNanos[Instrumentation::NUM_PHASES];
+static std::atomic<uint64_t> phaseCpuNanos[Instrumentation::NUM_PHASES];
+static std::atomic<uint64_t> counters[Instrumentation::NUM_COUNTERS];
+
+// Totals over all recorded codes, guarded by codeMutex.
+static std::mutex codeMutex;
+static uint64_t codesRecorded = 0;
+static uint64_t codedSymbols = 0;
+static double codeBits = 0;
+static double entropyBits = 0;
+
+
+bool Instrumentation::isEnabled() {
+#ifdef HUFF_INSTRUMENT
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void Instrumentation::addPhaseTime(Phase phase, uint64_t wallNanos, uint64_t cpuNanos) {
+	int i = static_cast<int>(phase);
+	phaseCalls[i].fetch_add(1, std::memory_order_relaxed);
+	phaseWallNanos[i].fetch_add(wallNanos, std::memory_order_relaxed);
+	phaseCpuNanos[i].fetch_add(cpuNanos, std::memory_order_relaxed);
+}
+
+
+void Instrumentation::add(Counter counter, uint64_t n) {
+	counters[static_cast<int>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+
+void Instrumentation::countSymbols(const uint32_t *symbols, std::size_t n) {
+	uint64_t literals = 0;
+	uint64_t runs = 0;
+	uint64_t eofs = 0;
+	for (std::size_t i = 0; i < n; i++) {
+		if (symbols[i] < 256)
+			literals++;
+		else if (symbols[i] == 256)
+			eofs++;
+		else
+			runs++;
+	}
+	add(Counter::LITERAL_SYMBOLS, literals);
+	add(Counter::RUN_SYMBOLS, runs);
+	add(Counter::EOF_SYMBOLS, eofs);
+}
+
+
+void Instrumentation::recordCode(const uint32_t *freqs, const uint32_t *lengths, uint32_t symbolLimit) {
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < symbolLimit; i++)
+		total += freqs[i];
+	double bits = 0;
+	double entropy = 0;
+	for (uint32_t i = 0; i < symbolLimit; i++) {
+		uint32_t f = freqs[i];
+		if (f == 0)
+			continue;
+		bits += static_cast<double>(f) * lengths[i];
+		entropy -= f * std::log2(static_cast<double>(f) / total);
+	}
+	std::lock_guard<std::mutex> lock(codeMutex);
+	codesRecorded++;
+	codedSymbols += total;
+	codeBits += bits;
+	entropyBits += entropy;
+}
+
+
+uint64_t Instrumentation::threadCpuNanos() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000U + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+	return static_cast<uint64_t>(std::clock()) * (1000000000U / CLOCKS_PER_SEC);
+}
+
+
+void Instrumentation::reset() {
+	for (int i = 0; i < NUM_PHASES; i++) {
+		phaseCalls[i] = 0;
+		phaseWallNanos[i] = 0;
+		phaseCpuNanos[i] = 0;
+	}
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		counters[i] = 0;
+	std::lock_guard<std::mutex> lock(codeMutex);
+	codesRecorded = 0;
+	codedSymbols = 0;
+	codeBits = 0;
+	entropyBits = 0;
+}
+
+
+void Instrumentation::writeJson(std::ostream &out) {
+	std::ios::fmtflags oldFlags = out.flags();
+	std::streamsize oldPrecision = out.precision();
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"enabled\": " << (isEnabled() ? "true" : "false") << ",\n";
+
+	out << "  \"phases\": {";
+	for (int i = 0; i < NUM_PHASES; i++) {
+		out << (i > 0 ? "," : "") << "\n    \"" << PHASE_NAMES[i] << "\": {\"calls\": " << phaseCalls[i].load()
+			<< ", \"wall_ms\": " << phaseWallNanos[i].load() / 1e6
+			<< ", \"cpu_ms\": " << phaseCpuNanos[i].load() / 1e6 << "}";
+	}
+	out << "\n  },\n";
+
+	out << "  \"counters\": {";
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		out << (i > 0 ? "," : "") << "\n    \"" << COUNTER_NAMES[i] << "\": " << counters[i].load();
+	out << "\n  },\n";
+
+	std::lock_guard<std::mutex> lock(codeMutex);
+	out << "  \"codes\": {\n    \"built\": " << codesRecorded << ",\n    \"symbols\": " << codedSymbols;
+	if (codedSymbols > 0) {
+		out << std::setprecision(4)
+			<< ",\n    \"avg_code_length\": " << codeBits / codedSymbols
+			<< ",\n    \"entropy\": " << entropyBits / codedSymbols;
+	}
+	out << "\n  }\n}\n";
+	out.flags(oldFlags);
+	out.precision(oldPrecision);
+}
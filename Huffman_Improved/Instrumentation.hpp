@@ -0,0 +1,144 @@
+/*
+ * Hot-path instrumentation
+ *
+ * The coders mark their phases and count what they process with the HUFF_* macros below.
+ * Unless the library is compiled with HUFF_INSTRUMENT defined (the CMake option of the same name),
+ * the macros expand to nothing, so the instrumentation costs nothing in normal builds.
+ * When enabled, the totals are process-wide and safe to update from several threads;
+ * phase times are summed over all calls and threads, and nested phases (a rebuild inside
+ * an adaptive encode) are counted in both. Instrumentation::writeJson() reports them.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+
+// The timed phases of compression and decompression.
+enum class Phase : int {
+	READ_INPUT = 0,    // Reading raw or compressed data from the input stream
+	SYMBOLIZE = 1,     // Converting bytes to the zero-run alphabet
+	COUNT = 2,         // Collecting symbol frequencies
+	BUILD_CODE = 3,    // Building Huffman code lengths or tables
+	WRITE_HEADER = 4,  // Writing code length tables
+	ENCODE = 5,        // Emitting coded symbols
+	DECODE = 6,        // Decoding a block, including its header
+	REBUILD = 7,       // Regenerating the adaptive code tree
+	WRITE_OUTPUT = 8,  // Writing compressed or raw data to the output stream
+	FILTER = 9,        // Detecting, applying or undoing the x86 branch filter
+};
+
+
+// The event counters.
+enum class Counter : int {
+	BYTES_IN = 0,
+	BYTES_OUT = 1,
+	LITERAL_SYMBOLS = 2,  // Symbols 0 to 255 coded
+	RUN_SYMBOLS = 3,      // Zero-run symbols 257 to 321 coded
+	EOF_SYMBOLS = 4,      // EOF symbols coded
+	TREE_REBUILDS = 5,    // Code tree rebuilds in the adaptive coder
+};
+
+
+
+class Instrumentation final {
+
+	/*---- Constants ----*/
+
+	public: static const int NUM_PHASES = 10;
+
+	public: static const int NUM_COUNTERS = 6;
+
+
+	/*---- Methods ----*/
+
+	// Tests whether this build records anything.
+	public: static bool isEnabled();
+
+
+	// Adds the given wall and CPU time, in nanoseconds, to the given phase.
+	public: static void addPhaseTime(Phase phase, std::uint64_t wallNanos, std::uint64_t cpuNanos);
+
+
+	public: static void add(Counter counter, std::uint64_t n);
+
+
+	// Classifies the given zero-run symbols into literals, runs and EOF and counts them.
+	public: static void countSymbols(const std::uint32_t *symbols, std::size_t n);
+
+
+	// Records the cost of coding the given per-symbol frequencies with the given code lengths,
+	// for the average code length versus entropy report.
+	public: static void recordCode(const std::uint32_t *freqs, const std::uint32_t *lengths, std::uint32_t symbolLimit);
+
+
+	// Returns the CPU time consumed by the calling thread, in nanoseconds.
+	public: static std::uint64_t threadCpuNanos();
+
+
+	// Clears all totals.
+	public: static void reset();
+
+
+	// Writes all totals as a JSON object.
+	public: static void writeJson(std::ostream &out);
+
+};
+
+
+
+/*
+ * Adds the lifetime of this object to a phase.
+ */
+class ScopedPhase final {
+
+	/*---- Fields ----*/
+
+	private: Phase phase;
+
+	private: std::chrono::steady_clock::time_point wallStart;
+
+	private: std::uint64_t cpuStart;
+
+
+	/*---- Constructor and destructor ----*/
+
+	public: explicit ScopedPhase(Phase ph) :
+		phase(ph),
+		wallStart(std::chrono::steady_clock::now()),
+		cpuStart(Instrumentation::threadCpuNanos()) {}
+
+
+	public: ~ScopedPhase() {
+		auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wallStart);
+		Instrumentation::addPhaseTime(phase, static_cast<std::uint64_t>(wall.count()), Instrumentation::threadCpuNanos() - cpuStart);
+	}
+
+
+	public: ScopedPhase(const ScopedPhase &) = delete;
+
+	public: ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+};
+
+
+
+#define HUFF_CONCAT_INNER(a, b) a##b
+#define HUFF_CONCAT(a, b) HUFF_CONCAT_INNER(a, b)
+
+#ifdef HUFF_INSTRUMENT
+	// Times the rest of the enclosing scope as the given Phase.
+	#define HUFF_PHASE(phase) ScopedPhase HUFF_CONCAT(huffScopedPhase, __LINE__)(phase)
+	#define HUFF_COUNT(counter, n) Instrumentation::add((counter), (n))
+	#define HUFF_COUNT_SYMBOLS(symbols, n) Instrumentation::countSymbols((symbols), (n))
+	#define HUFF_RECORD_CODE(freqs, lengths, symbolLimit) Instrumentation::recordCode((freqs), (lengths), (symbolLimit))
+#else
+	#define HUFF_PHASE(phase) ((void)0)
+	#define HUFF_COUNT(counter, n) ((void)0)
+	#define HUFF_COUNT_SYMBOLS(symbols, n) ((void)0)
+	#define HUFF_RECORD_CODE(freqs, lengths, symbolLimit) ((void)0)
+#endif
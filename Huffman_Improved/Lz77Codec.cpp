@@ -0,0 +1,328 @@
+/*
+ * LZ77 block codec
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "BitBuffer.hpp"
+#include "CoderContext.hpp"
+#include "HuffmanTable.hpp"
+#include "Instrumentation.hpp"
+#include "Lz77Codec.hpp"
+#include "MatchCoding.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+const int Lz77Codec::MIN_LEVEL;
+const int Lz77Codec::MAX_LEVEL;
+const int Lz77Codec::DEFAULT_LEVEL;
+const uint32_t Lz77Codec::MIN_MATCH;
+const uint32_t Lz77Codec::MAX_MATCH;
+const uint32_t Lz77Codec::WINDOW_SIZE;
+const uint32_t Lz77Codec::END_SYMBOL;
+const uint32_t Lz77Codec::LITERAL_LIMIT;
+const uint32_t Lz77Codec::DISTANCE_LIMIT;
+const int Lz77Codec::MAX_CODE_LENGTH;
+
+static const uint32_t NO_POSITION = UINT32_MAX;
+
+// A match token in the symbol buffer is (MATCH_FLAG | length), followed by the distance.
+static const uint32_t MATCH_FLAG = static_cast<uint32_t>(1) << 31;
+
+// A match of MIN_MATCH bytes farther back than this costs more bits than the literals it replaces.
+static const uint32_t TOO_FAR = static_cast<uint32_t>(1) << 14;
+
+static const int MIN_HASH_BITS = 10;
+static const int MAX_HASH_BITS = 20;
+
+
+// Search parameters per level, the same trade-offs as in zlib.
+struct LevelParams final {
+	bool lazy;            // Defer a match if the next position has a longer one
+	uint32_t goodLength;  // Search a quarter of the chain when the deferred match is this long
+	uint32_t lazyLength;  // Lazy: don't look for a better match than one this long.
+	                      // Greedy: only link the positions inside matches up to this long.
+	uint32_t niceLength;  // A match this long ends the search
+	uint32_t maxChain;    // Chain entries compared per position
+};
+
+static const LevelParams LEVELS[Lz77Codec::MAX_LEVEL] = {
+	{false,  4,   4,   8,    4},
+	{false,  4,   5,  16,    8},
+	{false,  4,   6,  32,   32},
+	{true ,  4,   4,  16,   16},
+	{true ,  8,  16,  32,   32},
+	{true ,  8,  16, 128,  128},
+	{true ,  8,  32, 128,  256},
+	{true , 32, 128, 258, 1024},
+	{true , 32, 258, 258, 4096},
+};
+
+
+static uint32_t loadU32(const uint8_t *p) {
+	uint32_t result;
+	std::memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+
+void Lz77Codec::encode(const uint8_t *data, size_t len, int level, vector<uint8_t> &out, CoderContext &ctx) {
+	if (level < MIN_LEVEL || level > MAX_LEVEL)
+		throw std::domain_error("LZ77 level out of range");
+	if (len > UINT32_MAX)
+		throw std::length_error("Block too large");
+	const LevelParams &params = LEVELS[level - 1];
+	if (!ctx.lz77)
+		ctx.lz77.reset(new Workspace);
+	Workspace &ws = *ctx.lz77;
+	vector<uint32_t> &tokens = ctx.symbols;
+	tokens.clear();
+	ws.literalFreqs.fill(0);
+	ws.distanceFreqs.fill(0);
+
+	{
+		HUFF_PHASE(Phase::SYMBOLIZE);
+		// Size the hash table to the block, so that small blocks don't pay for clearing a large one
+		int hashBits = MIN_HASH_BITS;
+		while (hashBits < MAX_HASH_BITS && (static_cast<size_t>(1) << hashBits) < len)
+			hashBits++;
+		ws.head.assign(static_cast<size_t>(1) << hashBits, NO_POSITION);
+		ws.chain.resize(std::min<size_t>(len, WINDOW_SIZE));
+		uint32_t *const head = ws.head.data();
+		uint32_t *const chain = ws.chain.data();
+		const uint32_t mask = WINDOW_SIZE - 1;
+		const uint32_t n = static_cast<uint32_t>(len);
+		const uint32_t hashable = n >= MIN_MATCH ? n - MIN_MATCH + 1 : 0;  // Positions with 4 bytes left
+
+		// Links position i into its hash chain and returns the previous head of the chain
+		auto insert = [&](uint32_t i) {
+			uint32_t h = (loadU32(data + i) * UINT32_C(2654435761)) >> (32 - hashBits);
+			uint32_t prev = head[h];
+			chain[i & mask] = prev;
+			head[h] = i;
+			return prev;
+		};
+
+		// Returns the longest match for position i among the chain starting at cand, or 0.
+		// Only matches longer than the deferred one are of interest.
+		auto findMatch = [&](uint32_t i, uint32_t cand, uint32_t deferred, uint32_t &distance) {
+			const uint32_t maxLen = std::min(MAX_MATCH, n - i);
+			uint32_t best = std::max(deferred, MIN_MATCH - 1);
+			if (best >= maxLen)
+				return static_cast<uint32_t>(0);
+			uint32_t left = deferred >= params.goodLength ? params.maxChain >> 2 : params.maxChain;
+			for (; left > 0 && cand != NO_POSITION && i - cand <= WINDOW_SIZE; left--) {
+				// Check the byte that would make the match longer first
+				if (data[cand + best] == data[i + best]) {
+					uint32_t length = MatchCoding::matchLength(data + cand, data + i, maxLen);
+					if (length > best) {
+						best = length;
+						distance = i - cand;
+						if (length >= params.niceLength || length == maxLen)
+							break;
+					}
+				}
+				uint32_t next = chain[cand & mask];
+				if (next >= cand)
+					break;
+				cand = next;
+			}
+			if (best <= deferred || best < MIN_MATCH || (best == MIN_MATCH && distance > TOO_FAR))
+				return static_cast<uint32_t>(0);
+			return best;
+		};
+
+		auto emitLiteral = [&](uint32_t i) {
+			tokens.push_back(data[i]);
+			ws.literalFreqs[data[i]]++;
+		};
+
+		auto emitMatch = [&](uint32_t length, uint32_t distance) {
+			tokens.push_back(MATCH_FLAG | length);
+			tokens.push_back(distance);
+			ws.literalFreqs[257 + MatchCoding::valueCode(length - MIN_MATCH)]++;
+			ws.distanceFreqs[MatchCoding::valueCode(distance - 1)]++;
+		};
+
+		// Inserts the positions after the start of a match that covers [start, start + length)
+		auto skipMatch = [&](uint32_t start, uint32_t length) {
+			uint32_t end = std::min(start + length, hashable);
+			for (uint32_t i = start + 1; i < end; i++)
+				insert(i);
+		};
+
+		uint32_t pendingLength = 0;  // Deferred match starting at the previous position
+		uint32_t pendingDistance = 0;
+		for (uint32_t i = 0; i < n; ) {
+			uint32_t length = 0;
+			uint32_t distance = 0;
+			if (i < hashable) {
+				uint32_t cand = insert(i);
+				if (pendingLength < params.lazyLength || !params.lazy)
+					length = findMatch(i, cand, pendingLength, distance);
+			}
+			if (pendingLength > 0) {
+				if (length > pendingLength) {
+					// The match here is longer: the previous byte becomes a literal
+					emitLiteral(i - 1);
+					pendingLength = length;
+					pendingDistance = distance;
+					i++;
+				} else {
+					emitMatch(pendingLength, pendingDistance);
+					skipMatch(i, pendingLength - 1);
+					i += pendingLength - 1;
+					pendingLength = 0;
+				}
+			} else if (length == 0) {
+				emitLiteral(i);
+				i++;
+			} else if (params.lazy && i + 1 < hashable) {
+				pendingLength = length;
+				pendingDistance = distance;
+				i++;
+			} else {
+				emitMatch(length, distance);
+				if (params.lazy || length <= params.lazyLength)
+					skipMatch(i, length);
+				i += length;
+			}
+		}
+		ws.literalFreqs[END_SYMBOL]++;
+	}
+
+	{
+		// Build both codes with the context's length-limited builder
+		HUFF_PHASE(Phase::BUILD_CODE);
+		std::copy(ws.literalFreqs.begin(), ws.literalFreqs.end(), ctx.freqs.begin());
+		std::fill(ctx.freqs.begin() + LITERAL_LIMIT, ctx.freqs.end(), 0);
+		ctx.buildCodeLengths(MAX_CODE_LENGTH);
+		std::copy(ctx.lengths.begin(), ctx.lengths.begin() + LITERAL_LIMIT, ws.literalLengths.begin());
+		std::copy(ws.distanceFreqs.begin(), ws.distanceFreqs.end(), ctx.freqs.begin());
+		std::fill(ctx.freqs.begin() + DISTANCE_LIMIT, ctx.freqs.end(), 0);
+		ctx.buildCodeLengths(MAX_CODE_LENGTH);
+		std::copy(ctx.lengths.begin(), ctx.lengths.begin() + DISTANCE_LIMIT, ws.distanceLengths.begin());
+		ws.literalKernel.build(ws.literalLengths.data());
+		ws.distanceKernel.build(ws.distanceLengths.data());
+	}
+
+	BitWriter bout(out);
+	{
+		HUFF_PHASE(Phase::WRITE_HEADER);
+		CodeLengthIo::write(bout, ws.literalLengths.data(), LITERAL_LIMIT);
+		CodeLengthIo::write(bout, ws.distanceLengths.data(), DISTANCE_LIMIT);
+	}
+	HUFF_PHASE(Phase::ENCODE);
+	const LiteralKernel &literals = ws.literalKernel;
+	const DistanceKernel &distances = ws.distanceKernel;
+	for (size_t i = 0; i < tokens.size(); i++) {
+		uint32_t token = tokens[i];
+		if ((token & MATCH_FLAG) == 0) {
+			literals.encode(&token, 1, bout);
+			continue;
+		}
+		uint32_t length = (token & ~MATCH_FLAG) - MIN_MATCH;
+		uint32_t code = MatchCoding::valueCode(length);
+		uint32_t sym = 257 + code;
+		literals.encode(&sym, 1, bout);
+		bout.write(length - MatchCoding::getBase(code), MatchCoding::getExtraBits(code));
+		uint32_t distance = tokens[++i] - 1;
+		code = MatchCoding::valueCode(distance);
+		distances.encode(&code, 1, bout);
+		bout.write(distance - MatchCoding::getBase(code), MatchCoding::getExtraBits(code));
+	}
+	const uint32_t end = END_SYMBOL;
+	literals.encode(&end, 1, bout);
+	bout.finish();
+}
+
+
+// Reads n extra bits, for 0 <= n <= 18, without refilling.
+static uint32_t readExtra(BitReader &in, int n) {
+	if (n == 0)
+		return 0;
+	uint32_t result = in.peek(n);
+	in.consume(n);
+	return result;
+}
+
+
+// Copies a match of the given length from distance bytes back, where the output ends at limit.
+static void copyMatch(uint8_t *dest, uint32_t distance, uint32_t length, const uint8_t *limit) {
+	const uint8_t *src = dest - distance;
+	if (distance >= 8 && static_cast<size_t>(limit - dest) >= static_cast<size_t>(length) + 7) {
+		// Each 8-byte chunk only reads bytes that are already written, and may overshoot the match
+		uint8_t *const end = dest + length;
+		do {
+			std::memcpy(dest, src, 8);
+			dest += 8;
+			src += 8;
+		} while (dest < end);
+	} else if (distance == 1)
+		std::memset(dest, *src, length);
+	else {
+		for (uint32_t i = 0; i < length; i++)
+			dest[i] = src[i];
+	}
+}
+
+
+void Lz77Codec::decode(const uint8_t *in, size_t inLen, uint8_t *out, size_t rawLen, CoderContext &ctx) {
+	if (!ctx.lz77)
+		ctx.lz77.reset(new Workspace);
+	Workspace &ws = *ctx.lz77;
+	BitReader bin(in, inLen);
+	CodeLengthIo::readUnchecked(bin, LITERAL_LIMIT, ws.literalLengths.data());
+	CodeLengthIo::readUnchecked(bin, DISTANCE_LIMIT, ws.distanceLengths.data());
+	try {
+		ws.literalKernel.build(ws.literalLengths.data());
+		ws.distanceKernel.build(ws.distanceLengths.data());
+	} catch (const std::invalid_argument &e) {
+		throw std::runtime_error(std::string("Invalid code length table: ") + e.what());
+	}
+	const LiteralKernel &literals = ws.literalKernel;
+	const DistanceKernel &distances = ws.distanceKernel;
+	static_assert(LiteralKernel::SYMBOLS_PER_REFILL >= 4, "Literals are decoded 4 per refill");
+
+	size_t pos = 0;
+	while (true) {
+		// Up to 4 symbols per refill, as long as they are literals
+		bin.refill();
+		uint32_t sym = 0;
+		for (int j = 0; j < 4; j++) {
+			sym = literals.decodeOne(bin);
+			if (sym >= 256)
+				break;
+			if (pos == rawLen)
+				throw std::runtime_error("Block data exceeds its declared size");
+			out[pos] = static_cast<uint8_t>(sym);
+			pos++;
+		}
+		if (sym < 256)
+			continue;
+		if (sym == END_SYMBOL)
+			break;
+
+		// A length code, its extra bits, a distance code and its extra bits take at most 14 + 12 + 18 bits
+		bin.refill();
+		uint32_t code = sym - 257;
+		uint32_t length = MIN_MATCH + MatchCoding::getBase(code) + readExtra(bin, MatchCoding::getExtraBits(code));
+		code = distances.decodeOne(bin);
+		uint32_t distance = 1 + MatchCoding::getBase(code) + readExtra(bin, MatchCoding::getExtraBits(code));
+		if (distance > pos)
+			throw std::runtime_error("Match distance before start of block");
+		if (length > rawLen - pos)
+			throw std::runtime_error("Block data exceeds its declared size");
+		copyMatch(out + pos, distance, length, out + rawLen);
+		pos += length;
+	}
+	if (pos != rawLen)
+		throw std::runtime_error("Block data is shorter than its declared size");
+}
@@ -0,0 +1,108 @@
+/*
+ * LZ77 block codec
+ *
+ * Entropy coding alone can't exploit a string that repeats, however long it is. This codec first
+ * replaces repeated strings of at least MIN_MATCH bytes by a reference (length, distance) to their
+ * previous occurrence at most WINDOW_SIZE bytes back, and then Huffman-codes the literals, lengths
+ * and distances, much like DEFLATE. There are two alphabets:
+ * - literal/length: the 256 byte values, END_SYMBOL, and 32 length codes for lengths MIN_MATCH to MAX_MATCH
+ * - distance: 40 codes for distances 1 to WINDOW_SIZE
+ * A length or distance code stands for a range of values, and the offset within the range follows
+ * the code as extra bits: values 0 to 3 (counted from the minimum) have their own codes, and every
+ * further power of two is split into two codes of (value's bit length - 2) extra bits each.
+ *
+ * Block payload format: the code length tables of the literal/length and the distance alphabet
+ * (see CodeLengthIo), then for each literal its code, and for each match its length code, length
+ * extra bits, distance code and distance extra bits, ending with END_SYMBOL, padded to a byte.
+ * Codes are limited to MAX_CODE_LENGTH bits, so that a whole match fits in one refill of the bit reader.
+ *
+ * Matches are found with hash chains: every position of the block is linked into the chain of
+ * its 4-byte hash, newest first. The level sets how many chain entries are compared per position,
+ * the match length that ends the search early, and whether a match is deferred when the next
+ * position has a longer one (lazy matching). Higher levels compress better and encode more slowly;
+ * decoding speed doesn't depend on the level. The decoder copies matches 8 bytes at a time,
+ * overlapping source and destination when the distance allows it.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "HuffmanKernel.hpp"
+
+class CoderContext;
+
+
+class Lz77Codec final {
+
+	/*---- Constants ----*/
+
+	public: static const int MIN_LEVEL = 1;
+
+	public: static const int MAX_LEVEL = 9;
+
+	public: static const int DEFAULT_LEVEL = 6;
+
+	public: static const std::uint32_t MIN_MATCH = 4;
+
+	public: static const std::uint32_t MAX_MATCH = MIN_MATCH + 65535;
+
+	public: static const std::uint32_t WINDOW_SIZE = static_cast<std::uint32_t>(1) << 20;
+
+	public: static const std::uint32_t END_SYMBOL = 256;
+
+	// Byte values, END_SYMBOL and the length codes.
+	public: static const std::uint32_t LITERAL_LIMIT = 257 + 32;
+
+	public: static const std::uint32_t DISTANCE_LIMIT = 40;
+
+	public: static const int MAX_CODE_LENGTH = 12;
+
+
+	/*---- Types ----*/
+
+	public: typedef HuffmanKernel<LITERAL_LIMIT, MAX_CODE_LENGTH> LiteralKernel;
+
+	public: typedef HuffmanKernel<DISTANCE_LIMIT, MAX_CODE_LENGTH> DistanceKernel;
+
+
+	/*
+	 * Working memory of the codec. A CoderContext creates one on first use and keeps it.
+	 */
+	public: struct Workspace final {
+
+		// Most recent position for each hash value, or NO_POSITION.
+		std::vector<std::uint32_t> head;
+
+		// Previous position with the same hash, indexed by position modulo WINDOW_SIZE.
+		std::vector<std::uint32_t> chain;
+
+		std::array<std::uint32_t, LITERAL_LIMIT> literalFreqs;
+
+		std::array<std::uint32_t, LITERAL_LIMIT> literalLengths;
+
+		std::array<std::uint32_t, DISTANCE_LIMIT> distanceFreqs;
+
+		std::array<std::uint32_t, DISTANCE_LIMIT> distanceLengths;
+
+		LiteralKernel literalKernel;
+
+		DistanceKernel distanceKernel;
+
+	};
+
+
+	/*---- Methods ----*/
+
+	// Encodes the given bytes at the given level (MIN_LEVEL to MAX_LEVEL) and appends the payload to out.
+	// The matches are kept as tokens in the symbols of the context.
+	public: static void encode(const std::uint8_t *data, std::size_t len, int level, std::vector<std::uint8_t> &out, CoderContext &ctx);
+
+
+	// Decodes a payload produced by encode() into exactly rawLen bytes at out.
+	// Throws std::runtime_error if the payload is malformed.
+	public: static void decode(const std::uint8_t *in, std::size_t inLen, std::uint8_t *out, std::size_t rawLen, CoderContext &ctx);
+
+};
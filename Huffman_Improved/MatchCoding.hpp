@@ -0,0 +1,64 @@
+/*
+ * Helpers shared by the match-based codecs (Lz77Codec and DeltaCodec)
+ *
+ * Match lengths, distances and addresses are coded like in Deflate, as a code plus extra bits:
+ * values 0 to 3 are their own codes with no extra bits, and each higher power-of-two range
+ * [2^k, 2^(k+1)) is split into two codes, 2k and 2k + 1, with k - 1 extra bits each. Codes
+ * 0 to NUM_CODES - 1 therefore cover every 32-bit value; a codec may use fewer of them.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "BitOps.hpp"
+
+
+class MatchCoding final {
+
+	/*---- Constants ----*/
+
+	public: static const std::uint32_t NUM_CODES = 64;
+
+
+	/*---- Methods ----*/
+
+	// Returns the code of the given value (counted from the smallest one the codec allows).
+	public: static std::uint32_t valueCode(std::uint32_t value) {
+		if (value < 4)
+			return value;
+		int k = BitOps::floorLog2(value);
+		return static_cast<std::uint32_t>(k) * 2 + ((value >> (k - 1)) & 1);
+	}
+
+
+	// Returns the smallest value of the given code.
+	public: static std::uint32_t getBase(std::uint32_t code) {
+		return code < 4 ? code : (2 | (code & 1)) << (code / 2 - 1);
+	}
+
+
+	// Returns the number of extra bits that follow the given code.
+	public: static int getExtraBits(std::uint32_t code) {
+		return code < 4 ? 0 : static_cast<int>(code / 2) - 1;
+	}
+
+
+	public: static std::uint64_t loadU64(const std::uint8_t *p) {
+		std::uint64_t result;
+		std::memcpy(&result, p, sizeof(result));
+		return result;
+	}
+
+
+	// Returns the number of equal bytes at a and b, up to maxLen.
+	public: static std::uint32_t matchLength(const std::uint8_t *a, const std::uint8_t *b, std::uint32_t maxLen) {
+		std::uint32_t n = 0;
+		while (n + 8 <= maxLen && loadU64(a + n) == loadU64(b + n))
+			n += 8;
+		while (n < maxLen && a[n] == b[n])
+			n++;
+		return n;
+	}
+
+};
@@ -0,0 +1,252 @@
+/*
+ * Huffman decoding of several symbols per table lookup
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "MultiSymbolTable.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+const int MultiSymbolTable::MAX_SYMBOLS;
+const int MultiSymbolTable::MIN_WIDTH;
+const int MultiSymbolTable::MAX_WIDTH;
+
+// Time of a lookup for each width from MIN_WIDTH, and of building one entry, in kernel lookups.
+// Measured on x86-64 with a 48 KiB L1 cache; the wider tables miss it more often.
+static const double LOOKUP_COSTS[] = {1.1, 1.1, 1.1, 1.1, 1.3, 1.6};
+static const double ENTRY_BUILD_COST = 1.5;
+static_assert(sizeof(LOOKUP_COSTS) / sizeof(LOOKUP_COSTS[0]) == MultiSymbolTable::MAX_WIDTH - MultiSymbolTable::MIN_WIDTH + 1, "One cost per width");
+
+
+MultiSymbolTable::MultiSymbolTable() :
+		width(0),
+		lookupsPerRefill(0),
+		stop(0) {}
+
+
+MultiSymbolTable::MultiSymbolTable(const CanonicalCode &code, int width, uint32_t stop) :
+		MultiSymbolTable() {
+	vector<uint32_t> codeLengths(code.getSymbolLimit());
+	for (uint32_t sym = 0; sym < code.getSymbolLimit(); sym++)
+		codeLengths[sym] = code.getCodeLength(sym);
+	build(codeLengths.data(), code.getSymbolLimit(), width, stop);
+}
+
+
+void MultiSymbolTable::build(const uint32_t *codeLengths, uint32_t symbolLimit, int w, uint32_t stopSymbol) {
+	if (w < MIN_WIDTH || w > MAX_WIDTH)
+		throw std::invalid_argument("Table width out of range");
+	if (symbolLimit > 65536)
+		throw std::invalid_argument("Too many symbols for table");
+	uint32_t nextCode[MAX_WIDTH + 1] = {};
+	uint64_t kraft = 0;
+	for (uint32_t sym = 0; sym < symbolLimit; sym++) {
+		uint32_t len = codeLengths[sym];
+		if (len > static_cast<uint32_t>(w))
+			throw std::invalid_argument("Code too long for table");
+		nextCode[len]++;
+		if (len > 0)
+			kraft += static_cast<uint64_t>(1) << (w - len);
+	}
+	const size_t size = static_cast<size_t>(1) << w;
+	if (kraft != size)
+		throw std::invalid_argument(kraft < size ? "Under-full Huffman code tree" : "Over-full Huffman code tree");
+	width = w;
+	lookupsPerRefill = 56 / w;
+	stop = stopSymbol;
+	table.resize(size);
+
+	// Assign canonical code values in order of length, then symbol
+	nextCode[0] = 0;
+	uint32_t next = 0;
+	for (int len = 1; len <= w; len++) {
+		uint32_t count = nextCode[len];
+		nextCode[len] = next;
+		next = (next + count) << 1;
+	}
+
+	// First symbol of each entry: a code of length len owns 2^(width - len) entries
+	for (uint32_t sym = 0; sym < symbolLimit; sym++) {
+		uint32_t len = codeLengths[sym];
+		if (len == 0)
+			continue;
+		size_t first = static_cast<size_t>(nextCode[len]++) << (w - len);
+		size_t count = static_cast<size_t>(1) << (w - len);
+		for (size_t j = 0; j < count; j++) {
+			Entry &entry = table[first + j];
+			entry.symbols[0] = static_cast<std::uint16_t>(sym);
+			entry.info = static_cast<std::uint16_t>(len << 8);
+		}
+	}
+
+	// Append the codes that follow within the entry's bits, each found by the first symbol of the
+	// entry for the remaining bits shifted up. The bits below them are unknown, so a code fits only
+	// if it doesn't reach them. Only the first symbols and lengths are read, which stay unchanged.
+	const size_t mask = size - 1;
+	for (size_t i = 0; i < size; i++) {
+		Entry &entry = table[i];
+		uint32_t bits = entry.info >> 8;
+		uint32_t count = 1;
+		uint32_t sym = entry.symbols[0];
+		for (; count < MAX_SYMBOLS && sym != stop; count++) {
+			const Entry &follow = table[(i << bits) & mask];
+			uint32_t len = follow.info >> 8;
+			if (bits + len > static_cast<uint32_t>(w))
+				break;
+			sym = follow.symbols[0];
+			entry.symbols[count] = static_cast<std::uint16_t>(sym);
+			bits += len;
+		}
+		for (uint32_t j = count; j < MAX_SYMBOLS; j++)
+			entry.symbols[j] = 0;
+		entry.info = static_cast<std::uint16_t>((entry.info & 0xFF00U) | bits << 2 | count);
+	}
+}
+
+
+int MultiSymbolTable::chooseWidth(const uint32_t *codeLengths, uint32_t symbolLimit, size_t numSymbols, double kernelCost) {
+	// Under the code, a symbol with a code of length len has probability 2^-len
+	double probs[MAX_WIDTH + 1] = {};
+	uint32_t longest = 0;
+	for (uint32_t sym = 0; sym < symbolLimit; sym++) {
+		uint32_t len = codeLengths[sym];
+		if (len > static_cast<uint32_t>(MAX_WIDTH))
+			return 0;
+		if (len > 0)
+			probs[len] += 1.0 / (static_cast<uint32_t>(1) << len);
+		longest = std::max(len, longest);
+	}
+	if (longest == 0)
+		return 0;
+
+	int result = 0;
+	double bestCost = numSymbols * kernelCost;  // One lookup per symbol
+	for (int w = std::max(static_cast<int>(longest), MIN_WIDTH); w <= MAX_WIDTH; w++) {
+		// Expected symbols per entry: the probability that the first k codes fit in w bits, summed over k
+		double fits[MAX_WIDTH + 1] = {1};  // By total length of the codes so far
+		double perEntry = 0;
+		for (int k = 0; k < MAX_SYMBOLS; k++) {
+			double next[MAX_WIDTH + 1] = {};
+			for (int bits = 0; bits < w; bits++) {
+				for (int len = 1; bits + len <= w && fits[bits] > 0; len++)
+					next[bits + len] += fits[bits] * probs[len];
+			}
+			for (int bits = 0; bits <= w; bits++) {
+				fits[bits] = next[bits];
+				perEntry += next[bits];
+			}
+		}
+		double cost = numSymbols / perEntry * LOOKUP_COSTS[w - MIN_WIDTH] + static_cast<double>(static_cast<size_t>(1) << w) * ENTRY_BUILD_COST;
+		if (cost < bestCost) {
+			bestCost = cost;
+			result = w;
+		}
+	}
+	return result;
+}
+
+
+void MultiSymbolTable::decode(BitReader &in, uint32_t *out, size_t n) const {
+	BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+		// Local copies stay in registers, whereas the stores to out could alias the originals
+		BitReader r(in);
+		decodeSymbols(table.data(), width, lookupsPerRefill, r, out, n);
+		in = r;
+	});
+}
+
+
+void MultiSymbolTable::decode4(BitReader *const readers[4], uint32_t *const outs[4], const size_t lengths[4]) const {
+	BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+		const Entry *const entries = table.data();
+		const int w = width;
+		const int lookups = lookupsPerRefill;
+		BitReader r0(*readers[0]);
+		BitReader r1(*readers[1]);
+		BitReader r2(*readers[2]);
+		BitReader r3(*readers[3]);
+		uint32_t *const d0 = outs[0];
+		uint32_t *const d1 = outs[1];
+		uint32_t *const d2 = outs[2];
+		uint32_t *const d3 = outs[3];
+		const size_t room = static_cast<size_t>(lookups) * MAX_SYMBOLS + 1;
+		const size_t shortest = std::min(std::min(lengths[0], lengths[1]), std::min(lengths[2], lengths[3]));
+		size_t i0 = 0, i1 = 0, i2 = 0, i3 = 0;
+		while (std::max(std::max(i0, i1), std::max(i2, i3)) + room <= shortest) {
+			r0.refill();
+			r1.refill();
+			r2.refill();
+			r3.refill();
+			if (std::min(std::min(r0.getBitCount(), r1.getBitCount()), std::min(r2.getBitCount(), r3.getBitCount())) < 56)
+				break;
+			for (int j = 0; j < lookups; j++) {
+				i0 += decodeEntry(entries, w, r0, d0 + i0);
+				i1 += decodeEntry(entries, w, r1, d1 + i1);
+				i2 += decodeEntry(entries, w, r2, d2 + i2);
+				i3 += decodeEntry(entries, w, r3, d3 + i3);
+			}
+		}
+
+		// Finish each stream separately
+		decodeSymbols(entries, w, lookups, r0, d0 + i0, lengths[0] - i0);
+		decodeSymbols(entries, w, lookups, r1, d1 + i1, lengths[1] - i1);
+		decodeSymbols(entries, w, lookups, r2, d2 + i2, lengths[2] - i2);
+		decodeSymbols(entries, w, lookups, r3, d3 + i3, lengths[3] - i3);
+		*readers[0] = r0;
+		*readers[1] = r1;
+		*readers[2] = r2;
+		*readers[3] = r3;
+	});
+}
+
+
+void MultiSymbolTable::decodeUntil(BitReader &in, size_t maxSymbols, vector<uint32_t> &out) const {
+	BitOps::dispatch([&]() HUFF_ALWAYS_INLINE {
+		const Entry *const entries = table.data();
+		const int w = width;
+		const int lookups = lookupsPerRefill;
+		BitReader r(in);
+		const size_t base = out.size();
+		const size_t room = static_cast<size_t>(lookups) * MAX_SYMBOLS + 1;
+		size_t count = 0;
+		size_t capacity = std::min<size_t>(maxSymbols, 1024);
+		out.resize(base + capacity);
+		while (true) {
+			r.refill();
+			if (count + room > capacity && capacity < maxSymbols) {
+				capacity = std::min(maxSymbols, capacity * 2 + room);
+				out.resize(base + capacity);
+			}
+			if (count + room <= capacity && r.getBitCount() >= 56) {
+				// An entry ends with the stop symbol if it holds it
+				uint32_t *dest = out.data() + base;
+				int j = 0;
+				for (; j < lookups; j++) {
+					count += decodeEntry(entries, w, r, dest + count);
+					if (dest[count - 1] == stop)
+						break;
+				}
+				if (j < lookups) {
+					count--;
+					break;
+				}
+			} else {
+				// Near the end of the stream or the symbol limit: one symbol at a time with exact checks
+				uint32_t sym = decodeOne(entries, w, r);
+				if (sym == stop)
+					break;
+				if (count == maxSymbols)
+					throw std::runtime_error("Too many symbols in block");
+				out[base + count] = sym;
+				count++;
+			}
+		}
+		out.resize(base + count);
+		in = r;
+	});
+}
@@ -0,0 +1,160 @@
+/*
+ * Huffman decoding of several symbols per table lookup
+ *
+ * A single-symbol table spends one lookup on every symbol, even when a block is dominated by a
+ * few bytes with 1- to 3-bit codes, such as zeros and common opcodes. A MultiSymbolTable is
+ * indexed by the next `width` bits of the stream like a kernel table, but each entry holds all
+ * the consecutive codes, up to MAX_SYMBOLS, that lie completely within those bits. An entry is
+ * 8 bytes, 16-bit symbols and a 16-bit word for the count and the lengths, so that a table of 12 bits
+ * still fits in a 48 KiB L1 cache. The decoder widens the entry to four 32-bit values and writes
+ * them to the output with one unaligned store (with SSE2; elsewhere with one store per symbol), then
+ * advances by the count, so a low-entropy block decodes several symbols per lookup. The loops run
+ * through BitOps::dispatch() like those of HuffmanKernel.
+ *
+ * The table is larger than a kernel table and costs a few lookups per entry to build, so it only
+ * pays for blocks that are long enough and whose codes are short enough. chooseWidth() predicts
+ * that from the code lengths alone (which is all a decoder has) and picks the width per block.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "BitBuffer.hpp"
+#include "BitOps.hpp"
+#include "CanonicalCode.hpp"
+
+#if defined(__SSE2__)
+	#define HUFF_MULTI_SYMBOL_SSE2
+	#include <emmintrin.h>
+#endif
+
+
+class MultiSymbolTable final {
+
+	/*---- Constants ----*/
+
+	// Most symbols in one entry.
+	public: static const int MAX_SYMBOLS = 3;
+
+	// Range of table widths. Every code must fit the width, so that the first symbol of an entry is always known.
+	public: static const int MIN_WIDTH = 8;
+
+	public: static const int MAX_WIDTH = 13;
+
+
+	/*---- Types ----*/
+
+	// The symbols an index decodes to (0 past the count), then (first code length << 8) | (total length << 2) | count.
+	private: struct Entry final {
+		std::uint16_t symbols[MAX_SYMBOLS];
+		std::uint16_t info;
+	};
+	static_assert(sizeof(Entry) == 8, "Entry must be one 8-byte load");
+
+
+	/*---- Fields ----*/
+
+	private: int width;
+
+	// Entries that fit in the 56 bits guaranteed after a refill.
+	private: int lookupsPerRefill;
+
+	// The symbol that ends an entry, and decodeUntil().
+	private: std::uint32_t stop;
+
+	// Indexed by the next width bits of the stream.
+	private: std::vector<Entry> table;
+
+
+	/*---- Constructors ----*/
+
+	// Constructs a table without a code. build() must be called before decoding.
+	public: MultiSymbolTable();
+
+
+	// Builds the table for the given canonical code with the given width and stop symbol (see build()).
+	public: MultiSymbolTable(const CanonicalCode &code, int width, std::uint32_t stop);
+
+
+	/*---- Methods ----*/
+
+	// Replaces the code with the given code lengths, with entries of the given width that end after the
+	// stop symbol (which need not have a code). Allocates memory only when the table grows. Throws
+	// std::invalid_argument if the width is out of range, a length exceeds it, or the lengths don't
+	// form a complete prefix code.
+	public: void build(const std::uint32_t *codeLengths, std::uint32_t symbolLimit, int width, std::uint32_t stop);
+
+
+	// Returns the width with which decoding about numSymbols symbols with the given code, including
+	// building the table, is predicted to be fastest, or 0 if a single-symbol kernel would be faster
+	// or the longest code exceeds MAX_WIDTH. The kernel's time per symbol is relative to a lookup of
+	// the single-stream kernel, so decoders that overlap several streams pass less than 1.
+	public: static int chooseWidth(const std::uint32_t *codeLengths, std::uint32_t symbolLimit, std::size_t numSymbols, double kernelCost = 1);
+
+
+	public: int getWidth() const {
+		return width;
+	}
+
+
+	// Reads exactly n symbols into the given array.
+	public: void decode(BitReader &in, std::uint32_t *out, std::size_t n) const;
+
+
+	// Reads exactly lengths[k] symbols from each of the 4 given readers into outs[k], advancing the
+	// streams together so that their lookups overlap.
+	public: void decode4(BitReader *const readers[4], std::uint32_t *const outs[4], const std::size_t lengths[4]) const;
+
+
+	// Reads symbols until the stop symbol given to build(), appending all symbols before it to the given
+	// vector. Throws std::runtime_error if more than maxSymbols symbols precede the stop symbol.
+	public: void decodeUntil(BitReader &in, std::size_t maxSymbols, std::vector<std::uint32_t> &out) const;
+
+
+	// Reads the symbols of one entry and returns their number. May write up to 4 values at out, of which
+	// the ones past the count are garbage. The reader must hold at least width bits that belong to the
+	// stream. The decoding loops pass the table address and width from local variables, because the
+	// stores to out could alias the fields and force them to be reloaded.
+	private: HUFF_ALWAYS_INLINE static std::uint32_t decodeEntry(const Entry *entries, int width, BitReader &in, std::uint32_t *out) {
+		const Entry &entry = entries[in.peek(width)];
+#ifdef HUFF_MULTI_SYMBOL_SSE2
+		const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&entry));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+#else
+		for (int i = 0; i < MAX_SYMBOLS; i++)
+			out[i] = entry.symbols[i];
+#endif
+		in.consume(static_cast<int>(entry.info >> 2 & 0x3F));
+		return entry.info & 3U;
+	}
+
+
+	// The loop of decode(), without dispatch.
+	private: HUFF_ALWAYS_INLINE static void decodeSymbols(const Entry *entries, int width, int lookups,
+			BitReader &in, std::uint32_t *out, std::size_t n) {
+		const std::size_t room = static_cast<std::size_t>(lookups) * MAX_SYMBOLS + 1;  // Values written by one refill's lookups
+		std::size_t i = 0;
+		while (i + room <= n) {
+			in.refill();
+			if (in.getBitCount() < 56)
+				break;  // Near the end of the stream, whose padding must not be decoded
+			for (int j = 0; j < lookups; j++)
+				i += decodeEntry(entries, width, in, out + i);
+		}
+		for (; i < n; i++) {
+			in.refill();
+			out[i] = decodeOne(entries, width, in);
+		}
+	}
+
+
+	// Reads one symbol without refilling. The reader must hold at least width bits or be at its end.
+	private: HUFF_ALWAYS_INLINE static std::uint32_t decodeOne(const Entry *entries, int width, BitReader &in) {
+		const Entry &entry = entries[in.peek(width)];
+		in.consume(static_cast<int>(entry.info >> 8));
+		return entry.symbols[0];
+	}
+
+};
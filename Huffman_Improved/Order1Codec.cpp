@@ -0,0 +1,163 @@
+/*
+ * Order-1 context-modelled Huffman coding
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "BitBuffer.hpp"
+#include "ByteIo.hpp"
+#include "FrequencyTable.hpp"
+#include "HuffmanTable.hpp"
+#include "Order1Codec.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+
+static double estimateCodedBits(const uint32_t *freqs);
+static double estimateHeaderBits(const uint32_t *freqs);
+
+
+const uint32_t Order1Codec::MAX_CODE_LENGTH;
+const uint32_t Order1Codec::MAX_OWN_CONTEXTS;
+
+
+void Order1Codec::encode(const vector<uint32_t> &symbols, vector<uint8_t> &out) {
+	const uint32_t n = ZeroRun::SYMBOL_LIMIT;
+	if (symbols.size() > UINT32_MAX)
+		throw std::length_error("Too many symbols");
+
+	// Count symbol frequencies per context
+	vector<uint32_t> counts(256 * n, 0);
+	vector<uint64_t> contextTotals(256, 0);
+	uint32_t ctx = 0;
+	for (uint32_t sym : symbols) {
+		counts[ctx * n + sym]++;
+		contextTotals[ctx]++;
+		ctx = nextContext(sym);
+	}
+
+	// Choose how many of the busiest contexts get their own table
+	vector<uint32_t> order(256);
+	for (uint32_t i = 0; i < 256; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&contextTotals](uint32_t a, uint32_t b) {
+		return contextTotals[a] > contextTotals[b];
+	});
+	uint32_t numUsed = 0;
+	while (numUsed < 256 && contextTotals[order[numUsed]] > 0)
+		numUsed++;
+	vector<uint32_t> rest(n, 0);
+	for (std::size_t i = 0; i < counts.size(); i++)
+		rest[i % n] += counts[i];
+	uint32_t bestK = 0;
+	double bestCost = estimateCodedBits(rest.data()) + estimateHeaderBits(rest.data());
+	double ownCost = 0;
+	for (uint32_t k = 1; k <= std::min(numUsed, MAX_OWN_CONTEXTS); k++) {
+		const uint32_t *own = &counts[order[k - 1] * n];
+		for (uint32_t i = 0; i < n; i++)
+			rest[i] -= own[i];
+		ownCost += estimateCodedBits(own) + estimateHeaderBits(own) + 8;
+		double cost = ownCost + estimateCodedBits(rest.data()) + estimateHeaderBits(rest.data());
+		if (cost < bestCost) {
+			bestCost = cost;
+			bestK = k;
+		}
+	}
+
+	// Assign contexts to tables and build them; table 0 is the fallback
+	vector<uint32_t> contextTable(256, 0);
+	for (uint32_t k = 0; k < bestK; k++)
+		contextTable[order[k]] = k + 1;
+	vector<vector<uint32_t> > tableFreqs(bestK + 1, vector<uint32_t>(n, 0));
+	for (uint32_t c = 0; c < 256; c++) {
+		for (uint32_t i = 0; i < n; i++)
+			tableFreqs[contextTable[c]][i] += counts[c * n + i];
+	}
+
+	ByteIo::putVarint(out, static_cast<uint32_t>(symbols.size()));
+	out.push_back(static_cast<uint8_t>(bestK));
+	for (uint32_t k = 0; k < bestK; k++)
+		out.push_back(static_cast<uint8_t>(order[k]));
+
+	BitWriter bout(out);
+	vector<EncodeTable> tables;
+	for (const vector<uint32_t> &freqs : tableFreqs) {
+		vector<uint32_t> lengths = FrequencyTable(freqs).buildCodeLengths(MAX_CODE_LENGTH);
+		CodeLengthIo::write(bout, lengths);
+		tables.push_back(EncodeTable(CanonicalCode(lengths)));
+	}
+	ctx = 0;
+	for (uint32_t sym : symbols) {
+		tables[contextTable[ctx]].write(bout, sym);
+		ctx = nextContext(sym);
+	}
+	bout.finish();
+}
+
+
+void Order1Codec::decode(const uint8_t *in, std::size_t inLen, std::size_t maxSymbols, vector<uint32_t> &symbols) {
+	const uint8_t *p = in;
+	const uint8_t *const end = in + inLen;
+	uint32_t numSymbols = ByteIo::getVarint(p, end);
+	if (numSymbols > maxSymbols)
+		throw std::runtime_error("Too many order-1 symbols");
+	uint32_t numOwn = ByteIo::getU8(p, end);
+	if (numOwn > MAX_OWN_CONTEXTS)
+		throw std::runtime_error("Too many order-1 tables");
+	vector<uint32_t> contextTable(256, 0);
+	for (uint32_t k = 0; k < numOwn; k++)
+		contextTable[ByteIo::getU8(p, end)] = k + 1;
+
+	BitReader bin(p, static_cast<std::size_t>(end - p));
+	vector<DecodeTable> tables;
+	for (uint32_t k = 0; k <= numOwn; k++)
+		tables.push_back(DecodeTable(CanonicalCode(CodeLengthIo::read(bin, ZeroRun::SYMBOL_LIMIT))));
+
+	std::size_t base = symbols.size();
+	symbols.resize(base + numSymbols);
+	uint32_t *outSyms = symbols.data() + base;
+	uint32_t ctx = 0;
+	for (uint32_t i = 0; i < numSymbols; i++) {
+		uint32_t sym = tables[contextTable[ctx]].read(bin);
+		outSyms[i] = sym;
+		ctx = nextContext(sym);
+	}
+}
+
+
+// Returns the entropy of the given frequencies in bits, counting at least 1 bit per symbol like Huffman coding.
+static double estimateCodedBits(const uint32_t *freqs) {
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < ZeroRun::SYMBOL_LIMIT; i++)
+		total += freqs[i];
+	double result = 0;
+	for (uint32_t i = 0; i < ZeroRun::SYMBOL_LIMIT; i++) {
+		if (freqs[i] > 0)
+			result += freqs[i] * std::max(std::log2(static_cast<double>(total) / freqs[i]), 1.0);
+	}
+	return result;
+}
+
+
+// Returns the size of the code length table that CodeLengthIo would write for the given frequencies.
+static double estimateHeaderBits(const uint32_t *freqs) {
+	double result = 0;
+	for (uint32_t i = 0; i < ZeroRun::SYMBOL_LIMIT; ) {
+		if (freqs[i] > 0) {
+			result += 4;
+			i++;
+		} else {
+			uint32_t run = 1;
+			while (run < 32 && i + run < ZeroRun::SYMBOL_LIMIT && freqs[i + run] == 0)
+				run++;
+			result += 9;
+			i += run;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,50 @@
+/*
+ * Order-1 context-modelled Huffman coding
+ *
+ * Each symbol of the zero-run alphabet is coded with a canonical code chosen by the previous
+ * byte (the last byte of the previous symbol's expansion, or 0 at the start of the block).
+ * Giving every context its own table would cost up to 256 code length tables of header, so
+ * only the busiest contexts get their own table, and all other contexts share one fallback
+ * table. The number of own tables is chosen to minimize the estimated total size.
+ * Code lengths are limited to 15 bits, and both directions are table-driven.
+ *
+ * Block payload format:
+ * - number of symbols (varint)
+ * - number of contexts with their own table K (1 byte), then those K context bytes
+ * - a bit stream holding K + 1 code length tables (see CodeLengthIo), fallback first,
+ *   followed by the Huffman-coded symbols, padded to a byte
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+class Order1Codec final {
+
+	/*---- Constants ----*/
+
+	public: static const std::uint32_t MAX_CODE_LENGTH = 15;
+
+	public: static const std::uint32_t MAX_OWN_CONTEXTS = 64;
+
+
+	/*---- Methods ----*/
+
+	// Encodes the given zero-run symbols (without EOF) and appends the payload to out.
+	public: static void encode(const std::vector<std::uint32_t> &symbols, std::vector<std::uint8_t> &out);
+
+
+	// Decodes a payload produced by encode(), appending the symbols to the given vector.
+	// Throws std::runtime_error if the payload is malformed or holds more than maxSymbols symbols.
+	public: static void decode(const std::uint8_t *in, std::size_t inLen, std::size_t maxSymbols, std::vector<std::uint32_t> &symbols);
+
+
+	// Returns the context that follows the given symbol.
+	private: static std::uint32_t nextContext(std::uint32_t symbol) {
+		return symbol < 256 ? symbol : 0;
+	}
+
+};
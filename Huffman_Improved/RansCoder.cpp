@@ -0,0 +1,178 @@
+/*
+ * Interleaved static rANS entropy coder
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "ByteIo.hpp"
+#include "RansCoder.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+
+const int RansCoder::SCALE_BITS;
+const int RansCoder::MAX_STATES;
+const uint32_t RansCoder::RANS_L;
+
+
+vector<uint32_t> RansCoder::normalize(const FrequencyTable &freqs, int scaleBits) {
+	const uint32_t target = static_cast<uint32_t>(1) << scaleBits;
+	uint64_t total = 0;
+	uint32_t numUsed = 0;
+	for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++) {
+		total += freqs.get(i);
+		if (freqs.get(i) > 0)
+			numUsed++;
+	}
+	if (total == 0)
+		throw std::invalid_argument("No symbols to normalize");
+	if (numUsed > target)
+		throw std::invalid_argument("Too many symbols for scale");
+
+	// Scale proportionally, rounding down but keeping every used symbol representable
+	vector<uint32_t> result(freqs.getSymbolLimit(), 0);
+	std::int64_t sum = 0;
+	for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++) {
+		uint32_t f = freqs.get(i);
+		if (f == 0)
+			continue;
+		result[i] = std::max(static_cast<uint32_t>(static_cast<uint64_t>(f) * target / total), static_cast<uint32_t>(1));
+		sum += result[i];
+	}
+
+	// Fix up the sum, taking from or giving to the most frequent symbols first, where it costs least
+	vector<uint32_t> order;
+	for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++) {
+		if (result[i] > 0)
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&result](uint32_t a, uint32_t b) { return result[a] > result[b]; });
+	std::int64_t diff = static_cast<std::int64_t>(target) - sum;
+	if (diff > 0)
+		result[order.front()] += static_cast<uint32_t>(diff);
+	while (diff < 0) {
+		for (uint32_t sym : order) {
+			if (diff == 0)
+				break;
+			if (result[sym] > 1) {
+				result[sym]--;
+				diff++;
+			}
+		}
+	}
+	return result;
+}
+
+
+void RansCoder::encode(const vector<uint32_t> &symbols, uint32_t symbolLimit, int numStates, vector<uint8_t> &out) {
+	if (numStates < 1 || numStates > MAX_STATES)
+		throw std::domain_error("Invalid number of rANS states");
+	if (symbols.size() > UINT32_MAX)
+		throw std::length_error("Too many symbols");
+
+	// Collect statistics and normalize them
+	FrequencyTable freqs(vector<uint32_t>(std::max(symbolLimit, static_cast<uint32_t>(2)), 0));
+	for (uint32_t sym : symbols)
+		freqs.increment(sym);
+	if (symbols.empty())
+		freqs.increment(0);
+	const vector<uint32_t> norm = normalize(freqs, SCALE_BITS);
+	vector<uint32_t> starts(norm.size(), 0);
+	for (std::size_t i = 1; i < norm.size(); i++)
+		starts[i] = starts[i - 1] + norm[i - 1];
+
+	// Write the header
+	out.push_back(static_cast<uint8_t>(numStates));
+	ByteIo::putVarint(out, static_cast<uint32_t>(symbols.size()));
+	uint32_t usedLimit = static_cast<uint32_t>(norm.size());
+	while (usedLimit > 0 && norm[usedLimit - 1] == 0)
+		usedLimit--;
+	ByteIo::putVarint(out, usedLimit);
+	for (uint32_t i = 0; i < usedLimit; i++)
+		ByteIo::putVarint(out, norm[i]);
+
+	// Encode backwards into a scratch buffer, so that the decoder can read forwards.
+	// Each symbol costs at most SCALE_BITS bits, so 2 bytes per symbol is always enough.
+	vector<uint8_t> buffer(symbols.size() * 2 + static_cast<std::size_t>(numStates) * 4 + 16);
+	uint8_t *const bufEnd = buffer.data() + buffer.size();
+	uint8_t *ptr = bufEnd;
+	uint32_t states[MAX_STATES];
+	for (int i = 0; i < numStates; i++)
+		states[i] = RANS_L;
+	for (std::size_t i = symbols.size(); i-- > 0; ) {
+		uint32_t &x = states[i % numStates];
+		uint32_t freq = norm[symbols[i]];
+		uint32_t xMax = ((RANS_L >> SCALE_BITS) << 8) * freq;
+		while (x >= xMax) {
+			*--ptr = static_cast<uint8_t>(x);
+			x >>= 8;
+		}
+		x = ((x / freq) << SCALE_BITS) + (x % freq) + starts[symbols[i]];
+	}
+	// Flush the states in reverse so that lane 0 comes first, each in big endian
+	for (int i = numStates - 1; i >= 0; i--) {
+		for (int j = 0; j < 32; j += 8)
+			*--ptr = static_cast<uint8_t>(states[i] >> j);
+	}
+	out.insert(out.end(), ptr, bufEnd);
+}
+
+
+void RansCoder::decode(const uint8_t *in, std::size_t inLen, std::size_t maxSymbols, vector<uint32_t> &symbols) {
+	const uint8_t *p = in;
+	const uint8_t *const end = in + inLen;
+	int numStates = static_cast<int>(ByteIo::getU8(p, end));
+	if (numStates < 1 || numStates > MAX_STATES)
+		throw std::runtime_error("Invalid number of rANS states");
+	uint32_t numSymbols = ByteIo::getVarint(p, end);
+	if (numSymbols > maxSymbols)
+		throw std::runtime_error("Too many rANS symbols");
+	uint32_t usedLimit = ByteIo::getVarint(p, end);
+	if (usedLimit > (static_cast<uint32_t>(1) << SCALE_BITS))
+		throw std::runtime_error("Invalid rANS symbol limit");
+
+	// Build the slot-to-symbol table
+	struct Slot {
+		uint32_t symbol;
+		uint32_t freq;
+		uint32_t start;
+	};
+	const uint32_t mask = (static_cast<uint32_t>(1) << SCALE_BITS) - 1;
+	vector<Slot> table(static_cast<std::size_t>(mask) + 1);
+	uint32_t start = 0;
+	for (uint32_t i = 0; i < usedLimit; i++) {
+		uint32_t freq = ByteIo::getVarint(p, end);
+		if (freq > mask + 1 - start)
+			throw std::runtime_error("Invalid rANS frequencies");
+		for (uint32_t j = 0; j < freq; j++)
+			table[start + j] = Slot{i, freq, start};
+		start += freq;
+	}
+	if (start != mask + 1)
+		throw std::runtime_error("Invalid rANS frequencies");
+
+	uint32_t states[MAX_STATES];
+	for (int i = 0; i < numStates; i++) {
+		states[i] = ByteIo::getU32(p, end);
+		if (states[i] < RANS_L)
+			throw std::runtime_error("Invalid rANS state");
+	}
+
+	std::size_t base = symbols.size();
+	symbols.resize(base + numSymbols);
+	uint32_t *outSyms = symbols.data() + base;
+	for (uint32_t i = 0; i < numSymbols; i++) {
+		uint32_t &x = states[i % static_cast<uint32_t>(numStates)];
+		const Slot &s = table[x & mask];
+		outSyms[i] = s.symbol;
+		x = s.freq * (x >> SCALE_BITS) + (x & mask) - s.start;
+		while (x < RANS_L) {
+			if (p == end)
+				throw std::runtime_error("End of stream");
+			x = (x << 8) | *p++;
+		}
+	}
+}
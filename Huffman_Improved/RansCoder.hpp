@@ -0,0 +1,54 @@
+/*
+ * Interleaved static rANS entropy coder
+ *
+ * An alternative to Huffman coding for the block container. Symbol statistics are
+ * collected in a FrequencyTable and normalized so that they sum to 2^SCALE_BITS, which
+ * lets each symbol cost a fractional number of bits. Several rANS states are interleaved
+ * (symbol i uses state i mod numStates) so that the decoder has independent dependency
+ * chains. Each state is 32 bits wide and renormalized a byte at a time.
+ *
+ * Block payload format:
+ * - numStates (1 byte, 1 to 4)
+ * - number of symbols (varint)
+ * - used symbol limit n (varint), then n normalized frequencies (varints)
+ * - the rANS byte stream, beginning with the final state of each lane
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "FrequencyTable.hpp"
+
+
+class RansCoder final {
+
+	/*---- Constants ----*/
+
+	public: static const int SCALE_BITS = 12;
+
+	public: static const int MAX_STATES = 4;
+
+	// Lower bound of the normalized state interval.
+	private: static const std::uint32_t RANS_L = static_cast<std::uint32_t>(1) << 23;
+
+
+	/*---- Methods ----*/
+
+	// Scales the frequencies of the given table so that they sum to 2^scaleBits, keeping every
+	// non-zero frequency at least 1. The table must contain at least one non-zero frequency,
+	// and at most 2^scaleBits of them.
+	public: static std::vector<std::uint32_t> normalize(const FrequencyTable &freqs, int scaleBits);
+
+
+	// Encodes the given symbols (each less than symbolLimit) and appends the payload to out.
+	public: static void encode(const std::vector<std::uint32_t> &symbols, std::uint32_t symbolLimit,
+		int numStates, std::vector<std::uint8_t> &out);
+
+
+	// Decodes a payload produced by encode(), appending the symbols to the given vector.
+	// Throws std::runtime_error if the payload is malformed or holds more than maxSymbols symbols.
+	public: static void decode(const std::uint8_t *in, std::size_t inLen, std::size_t maxSymbols, std::vector<std::uint32_t> &symbols);
+
+};
@@ -0,0 +1,233 @@
+/*
+ * Rebuild policies for adaptive Huffman coding
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include "RebuildPolicy.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+using std::string;
+using std::vector;
+
+
+static bool isPowerOf2(uint32_t x);
+static uint32_t parseNumber(const string &s);
+
+
+RebuildPolicy::~RebuildPolicy() {}
+
+
+void RebuildPolicy::updateStatistics(uint32_t count, FrequencyTable &freqs, const vector<uint32_t> &initFreqs) {
+	(void)count;
+	(void)freqs;
+	(void)initFreqs;
+}
+
+
+std::unique_ptr<RebuildPolicy> RebuildPolicy::parse(const string &spec) {
+	// Split the specification at colons
+	vector<string> parts;
+	std::size_t start = 0;
+	while (true) {
+		std::size_t end = spec.find(':', start);
+		parts.push_back(spec.substr(start, end - start));
+		if (end == string::npos)
+			break;
+		start = end + 1;
+	}
+
+	const string &name = parts.at(0);
+	if (name == "backoff" && parts.size() <= 2)
+		return std::unique_ptr<RebuildPolicy>(new BackoffPolicy(parts.size() > 1 ? parseNumber(parts[1]) : 262144));
+	else if (name == "interval" && parts.size() >= 2 && parts.size() <= 3)
+		return std::unique_ptr<RebuildPolicy>(new FixedIntervalPolicy(parseNumber(parts[1]), parts.size() > 2 ? parseNumber(parts[2]) : 0));
+	else if (name == "decay" && parts.size() <= 2)
+		return std::unique_ptr<RebuildPolicy>(new DecayPolicy(parts.size() > 1 ? parseNumber(parts[1]) : 65536));
+	else if (name == "gain" && parts.size() <= 3) {
+		uint32_t check = parts.size() > 1 ? parseNumber(parts[1]) : 4096;
+		double thresh = 0.02;
+		if (parts.size() > 2) {
+			char *endPtr = nullptr;
+			thresh = std::strtod(parts[2].c_str(), &endPtr);
+			if (parts[2].empty() || *endPtr != '\0' || !(thresh >= 0))
+				throw std::invalid_argument("Invalid gain threshold: " + parts[2]);
+		}
+		return std::unique_ptr<RebuildPolicy>(new GainThresholdPolicy(check, thresh));
+	} else
+		throw std::invalid_argument("Unknown rebuild policy: " + spec);
+}
+
+
+void RebuildPolicy::halveFrequencies(FrequencyTable &freqs) {
+	for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++) {
+		uint32_t f = freqs.get(i);
+		freqs.set(i, f > 1 ? f / 2 : f);
+	}
+}
+
+
+/*---- BackoffPolicy ----*/
+
+BackoffPolicy::BackoffPolicy(uint32_t per) :
+		period(per) {
+	if (per == 0)
+		throw std::domain_error("Period must be positive");
+}
+
+
+bool BackoffPolicy::shouldRebuild(uint32_t count, const FrequencyTable &freqs, const uint32_t *codeLengths) {
+	(void)freqs;
+	(void)codeLengths;
+	return (count < period && isPowerOf2(count)) || count % period == 0;
+}
+
+
+void BackoffPolicy::updateStatistics(uint32_t count, FrequencyTable &freqs, const vector<uint32_t> &initFreqs) {
+	if (count % period == 0)
+		freqs = FrequencyTable(initFreqs);
+}
+
+
+string BackoffPolicy::describe() const {
+	return "backoff:" + std::to_string(period);
+}
+
+
+/*---- FixedIntervalPolicy ----*/
+
+FixedIntervalPolicy::FixedIntervalPolicy(uint32_t intv, uint32_t reset) :
+		interval(intv),
+		resetPeriod(reset) {
+	if (intv == 0)
+		throw std::domain_error("Interval must be positive");
+}
+
+
+bool FixedIntervalPolicy::shouldRebuild(uint32_t count, const FrequencyTable &freqs, const uint32_t *codeLengths) {
+	(void)freqs;
+	(void)codeLengths;
+	return count % interval == 0;
+}
+
+
+void FixedIntervalPolicy::updateStatistics(uint32_t count, FrequencyTable &freqs, const vector<uint32_t> &initFreqs) {
+	if (resetPeriod != 0 && count % resetPeriod == 0)
+		freqs = FrequencyTable(initFreqs);
+}
+
+
+string FixedIntervalPolicy::describe() const {
+	string result = "interval:" + std::to_string(interval);
+	if (resetPeriod != 0)
+		result += ":" + std::to_string(resetPeriod);
+	return result;
+}
+
+
+/*---- DecayPolicy ----*/
+
+DecayPolicy::DecayPolicy(uint32_t per) :
+		period(per) {
+	if (per == 0)
+		throw std::domain_error("Period must be positive");
+}
+
+
+bool DecayPolicy::shouldRebuild(uint32_t count, const FrequencyTable &freqs, const uint32_t *codeLengths) {
+	(void)freqs;
+	(void)codeLengths;
+	return (count < period && isPowerOf2(count)) || count % period == 0;
+}
+
+
+void DecayPolicy::updateStatistics(uint32_t count, FrequencyTable &freqs, const vector<uint32_t> &initFreqs) {
+	(void)initFreqs;
+	if (count % period == 0)
+		halveFrequencies(freqs);
+}
+
+
+string DecayPolicy::describe() const {
+	return "decay:" + std::to_string(period);
+}
+
+
+/*---- GainThresholdPolicy ----*/
+
+GainThresholdPolicy::GainThresholdPolicy(uint32_t check, double thresh) :
+		checkInterval(check),
+		threshold(thresh) {
+	if (check == 0)
+		throw std::domain_error("Check interval must be positive");
+	if (!(thresh >= 0))
+		throw std::domain_error("Threshold must be non-negative");
+}
+
+
+bool GainThresholdPolicy::shouldRebuild(uint32_t count, const FrequencyTable &freqs, const uint32_t *codeLengths) {
+	// Early on the statistics change quickly, so follow the backoff schedule
+	if (count < checkInterval)
+		return isPowerOf2(count);
+	if (count % checkInterval != 0)
+		return false;
+
+	// Estimated saving = (cost of current code) - (entropy of current frequencies), in bits
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++)
+		total += freqs.get(i);
+	double currentBits = 0;
+	double entropyBits = 0;
+	for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++) {
+		uint32_t f = freqs.get(i);
+		if (f == 0)
+			continue;
+		currentBits += static_cast<double>(f) * codeLengths[i];
+		entropyBits += static_cast<double>(f) * std::log2(static_cast<double>(total) / f);
+	}
+	return currentBits - entropyBits > threshold * static_cast<double>(total);
+}
+
+
+void GainThresholdPolicy::updateStatistics(uint32_t count, FrequencyTable &freqs, const vector<uint32_t> &initFreqs) {
+	(void)initFreqs;
+	// Keep the totals bounded so that old data fades out and the estimate stays cheap
+	if (count % checkInterval == 0) {
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < freqs.getSymbolLimit(); i++)
+			total += freqs.get(i);
+		if (total >= 262144)
+			halveFrequencies(freqs);
+	}
+}
+
+
+string GainThresholdPolicy::describe() const {
+	// The shortest decimal that parse() reads back as the same threshold; 17 significant digits always are
+	char buf[32];
+	for (int precision = 1; precision <= 17; precision++) {
+		std::snprintf(buf, sizeof(buf), "%.*g", precision, threshold);
+		if (std::strtod(buf, nullptr) == threshold)
+			break;
+	}
+	return "gain:" + std::to_string(checkInterval) + ":" + buf;
+}
+
+
+/*---- Helper functions ----*/
+
+static bool isPowerOf2(uint32_t x) {
+	return x > 0 && (x & (x - 1)) == 0;
+}
+
+
+static uint32_t parseNumber(const string &s) {
+	char *endPtr = nullptr;
+	unsigned long val = std::strtoul(s.c_str(), &endPtr, 10);
+	if (s.empty() || *endPtr != '\0' || val == 0 || val > UINT32_MAX)
+		throw std::invalid_argument("Invalid number in rebuild policy: " + s);
+	return static_cast<uint32_t>(val);
+}
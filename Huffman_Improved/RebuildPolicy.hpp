@@ -0,0 +1,145 @@
+/*
+ * Rebuild policies for adaptive Huffman coding
+ *
+ * A policy decides after which symbols the adaptive coder regenerates its code, and
+ * how the collected statistics are aged afterwards (kept, reset or halved). The compressor
+ * and decompressor must be given policies with identical parameters, because both sides
+ * consult the policy at exactly the same points of the symbol stream.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "FrequencyTable.hpp"
+
+
+/*
+ * The strategy interface shared by the adaptive compressor and decompressor.
+ * Decisions may only depend on the arguments, so that both sides stay synchronized.
+ */
+class RebuildPolicy {
+
+	public: virtual ~RebuildPolicy() = 0;
+
+
+	// Returns true if the code should be regenerated after the count-th symbol has been added
+	// to the given frequency table. The code lengths (one per symbol) are those currently in use.
+	public: virtual bool shouldRebuild(std::uint32_t count, const FrequencyTable &freqs, const std::uint32_t *codeLengths) = 0;
+
+
+	// Ages the statistics after the count-th symbol, after any rebuild at the same point.
+	// The default implementation keeps all collected frequencies.
+	public: virtual void updateStatistics(std::uint32_t count, FrequencyTable &freqs, const std::vector<std::uint32_t> &initFreqs);
+
+
+	// Returns a specification string that parse() turns into the same policy, e.g. "backoff:262144".
+	public: virtual std::string describe() const = 0;
+
+
+	// Parses a policy specification of one of these forms (parameters are optional):
+	// - "backoff[:period]": rebuild at every power of 2 below period, then at every multiple of period,
+	//   where the frequencies are also reset (the classic schedule, period defaults to 262144)
+	// - "interval:n[:reset]": rebuild every n symbols, and reset the frequencies every reset symbols
+	// - "decay[:period]": the backoff schedule, but halving the frequencies instead of resetting them
+	// - "gain[:check[:threshold]]": every check symbols, rebuild only if the estimated saving
+	//   exceeds threshold bits per symbol, halving the frequencies before they get too large
+	// Throws std::invalid_argument for an unknown or malformed specification.
+	public: static std::unique_ptr<RebuildPolicy> parse(const std::string &spec);
+
+
+	// Halves every frequency in the given table, keeping each frequency at least 1.
+	protected: static void halveFrequencies(FrequencyTable &freqs);
+
+};
+
+
+
+/*
+ * Rebuilds at exponentially growing intervals until the period is reached,
+ * then at every multiple of the period, resetting the frequency table there.
+ */
+class BackoffPolicy final : public RebuildPolicy {
+
+	private: std::uint32_t period;
+
+
+	public: explicit BackoffPolicy(std::uint32_t per = 262144);
+
+	public: bool shouldRebuild(std::uint32_t count, const FrequencyTable &freqs, const std::uint32_t *codeLengths) override;
+
+	public: void updateStatistics(std::uint32_t count, FrequencyTable &freqs, const std::vector<std::uint32_t> &initFreqs) override;
+
+	public: std::string describe() const override;
+
+};
+
+
+
+/*
+ * Rebuilds at a fixed interval, optionally resetting the frequency table every resetPeriod symbols.
+ */
+class FixedIntervalPolicy final : public RebuildPolicy {
+
+	private: std::uint32_t interval;
+
+	// Zero means the frequencies are never reset.
+	private: std::uint32_t resetPeriod;
+
+
+	public: explicit FixedIntervalPolicy(std::uint32_t intv, std::uint32_t reset = 0);
+
+	public: bool shouldRebuild(std::uint32_t count, const FrequencyTable &freqs, const std::uint32_t *codeLengths) override;
+
+	public: void updateStatistics(std::uint32_t count, FrequencyTable &freqs, const std::vector<std::uint32_t> &initFreqs) override;
+
+	public: std::string describe() const override;
+
+};
+
+
+
+/*
+ * The backoff schedule, except that the frequencies are halved at every multiple
+ * of the period instead of being reset, so older statistics fade out gradually.
+ */
+class DecayPolicy final : public RebuildPolicy {
+
+	private: std::uint32_t period;
+
+
+	public: explicit DecayPolicy(std::uint32_t per = 65536);
+
+	public: bool shouldRebuild(std::uint32_t count, const FrequencyTable &freqs, const std::uint32_t *codeLengths) override;
+
+	public: void updateStatistics(std::uint32_t count, FrequencyTable &freqs, const std::vector<std::uint32_t> &initFreqs) override;
+
+	public: std::string describe() const override;
+
+};
+
+
+
+/*
+ * Every checkInterval symbols, compares the cost of the current code on the current
+ * frequencies against their entropy, and rebuilds only if the estimated saving exceeds
+ * the threshold (in bits per symbol). Frequencies are halved when their total gets large.
+ */
+class GainThresholdPolicy final : public RebuildPolicy {
+
+	private: std::uint32_t checkInterval;
+
+	private: double threshold;
+
+
+	public: explicit GainThresholdPolicy(std::uint32_t check = 4096, double thresh = 0.02);
+
+	public: bool shouldRebuild(std::uint32_t count, const FrequencyTable &freqs, const std::uint32_t *codeLengths) override;
+
+	public: void updateStatistics(std::uint32_t count, FrequencyTable &freqs, const std::vector<std::uint32_t> &initFreqs) override;
+
+	public: std::string describe() const override;
+
+};
@@ -0,0 +1,260 @@
+/*
+ * Whole-stream compression and decompression with the block container
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include "BlockContainer.hpp"
+#include "BlockPipeline.hpp"
+#include "BlockSplitter.hpp"
+#include "Crc32c.hpp"
+#include "Instrumentation.hpp"
+#include "StreamCoder.hpp"
+#include "X86Filter.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+
+
+// Size of the groups of blocks that can share codes, when blocks are smaller.
+static const uint32_t GROUP_SIZE = 1 << 20;
+
+
+void StreamCoder::countBlock(CodingStats &stats, const BlockHeader &block) {
+	stats.blocks++;
+	stats.blocksPerCodec[static_cast<int>(block.codec)]++;
+	stats.filteredBlocks += block.x86Filter ? 1 : 0;
+	stats.reusedCodes += block.codeReference != 0 ? 1 : 0;
+}
+
+
+// Tests whether blocks of the given options share codes within groups, and with the shared code.
+static bool reusesCodes(const CompressOptions &options) {
+	return options.reuseCodes && !options.autoCodec && BlockCoder::canCacheCode(options.codec);
+}
+
+
+static bool usesSharedCode(const CompressOptions &options) {
+	return options.sharedCode != nullptr && options.reuseCodes
+		&& (options.autoCodec || options.codec == options.sharedCode->codec);
+}
+
+
+// Codes the given bytes as one container block, appending its payload to out
+static BlockHeader encodeBlock(uint8_t *data, uint32_t len, std::vector<uint8_t> &out, CoderContext &ctx, const CompressOptions &options) {
+	BlockHeader block;
+	block.rawSize = len;
+	if (options.checksums != 0)
+		block.checksum = Crc32c::compute(data, len);
+	{
+		HUFF_PHASE(Phase::FILTER);
+		const bool detectX86 = options.filter == FilterMode::AUTO
+			&& (options.autoCodec || options.codec == BlockCodec::LZ77 || options.codec == BlockCodec::ORDER1);
+		block.x86Filter = options.filter == FilterMode::X86
+			|| (detectX86 && X86Filter::detect(data, len));
+		if (block.x86Filter)
+			X86Filter::encode(data, len);
+	}
+	const std::size_t start = out.size();
+	if (options.autoCodec) {
+		block.codec = BlockCoder::encodeBest(data, len, out, ctx, options.lz77Level);
+		if (usesSharedCode(options) && block.codec != BlockCodec::STORED) {
+			// Also try the shared code, which needs no table. Every block is a group of its own.
+			const std::size_t end = out.size();
+			int reference;
+			ctx.codeCache.clear();
+			BlockCodec codec = BlockCoder::encodeCached(options.sharedCode->codec, data, len, out, ctx, reference);
+			if (reference != 0 && out.size() - end < end - start) {
+				out.erase(out.begin() + static_cast<std::ptrdiff_t>(start), out.begin() + static_cast<std::ptrdiff_t>(end));
+				block.codec = codec;
+				block.codeReference = reference;
+			} else
+				out.resize(end);
+		}
+	} else if (reusesCodes(options))
+		block.codec = BlockCoder::encodeCached(options.codec, data, len, out, ctx, block.codeReference);
+	else if (options.codec == BlockCodec::ADAPTIVE || options.codec == BlockCodec::LZ77) {
+		block.codec = options.codec;
+		if (options.codec == BlockCodec::ADAPTIVE)
+			BlockCoder::encodeAdaptive(data, len, options.adaptivePolicy, out);
+		else
+			BlockCoder::encodeLz77(data, len, options.lz77Level, out, ctx);
+		if (out.size() - start >= len) {
+			block.codec = BlockCodec::STORED;
+			out.resize(start);
+			out.insert(out.end(), data, data + len);
+		}
+	} else
+		block.codec = BlockCoder::encodeOrStore(options.codec, data, len, out, ctx);
+	block.payloadSize = static_cast<uint32_t>(out.size() - start);
+	return block;
+}
+
+
+uint32_t StreamCoder::getGroupSize(const CompressOptions &options) {
+	// When blocks can share codes, small blocks are coded in groups of about GROUP_SIZE bytes
+	return reusesCodes(options) && options.blockSize < GROUP_SIZE ? GROUP_SIZE / options.blockSize * options.blockSize : options.blockSize;
+}
+
+
+uint8_t StreamCoder::getStreamFlags(const CompressOptions &options) {
+	return static_cast<uint8_t>(options.checksums | (usesSharedCode(options) ? BlockWriter::FLAG_SHARED_CODE : 0));
+}
+
+
+uint32_t StreamCoder::encodeGroup(PipelineSlot &slot, CoderContext &ctx, const CompressOptions &options) {
+	const bool splitBlocks = options.entropySplit && !options.autoCodec && BlockSplitter::supports(options.codec);
+	const bool reuseCodes = reusesCodes(options);
+	slot.output.clear();
+	slot.blocks.clear();
+	ctx.codeCache.setShared(usesSharedCode(options) ? options.sharedCode : nullptr);
+	uint32_t sharedUses = 0;
+	uint32_t offset = 0;
+	for (uint32_t blockStart = 0; blockStart < slot.rawLength; blockStart += options.blockSize) {
+		const uint32_t blockLength = std::min(options.blockSize, slot.rawLength - blockStart);
+		if (splitBlocks)
+			BlockSplitter::split(slot.input.data() + blockStart, blockLength, options.codec, ctx.partLengths, ctx);
+		else
+			ctx.partLengths.assign(1, blockLength);
+		for (uint32_t len : ctx.partLengths) {
+			BlockHeader &block = *slot.blocks.insert(slot.blocks.end(), encodeBlock(slot.input.data() + offset, len, slot.output, ctx, options));
+			block.continuesGroup = reuseCodes && offset > 0;
+			if (block.codeReference != 0 && ctx.codeCache.isShared(block.codeReference - 1))
+				sharedUses++;
+			offset += len;
+		}
+	}
+	return sharedUses;
+}
+
+
+CodingStats StreamCoder::compress(std::istream &in, std::ostream &out, const CompressOptions &options) {
+	if (options.blockSize == 0 || options.blockSize > BlockWriter::MAX_BLOCK_SIZE)
+		throw std::invalid_argument("Invalid block size");
+	const unsigned int threads = std::max(options.threads, 1U);
+	const auto start = std::chrono::steady_clock::now();
+	CodingStats stats;
+
+	BlockWriter writer(out, getStreamFlags(options));
+	const uint32_t groupSize = getGroupSize(options);
+	std::uint64_t position = 0;
+	std::size_t nextCut = 0;
+	BlockPipeline pipeline(threads);
+	pipeline.run(
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::READ_INPUT);
+			for (; nextCut < options.blockCuts.size() && options.blockCuts[nextCut] <= position; nextCut++);
+			uint32_t size = groupSize;
+			if (nextCut < options.blockCuts.size())
+				size = static_cast<uint32_t>(std::min<std::uint64_t>(size, options.blockCuts[nextCut] - position));
+			slot.input.resize(groupSize);
+			in.read(reinterpret_cast<char*>(slot.input.data()), static_cast<std::streamsize>(size));
+			slot.rawLength = static_cast<uint32_t>(in.gcount());
+			if (in.bad())
+				throw std::runtime_error("Error reading input");
+			position += slot.rawLength;
+			HUFF_COUNT(Counter::BYTES_IN, slot.rawLength);
+			return slot.rawLength > 0;
+		},
+		[&](PipelineSlot &slot, CoderContext &ctx) {
+			encodeGroup(slot, ctx, options);
+		},
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::WRITE_OUTPUT);
+			std::size_t offset = 0;
+			for (const BlockHeader &block : slot.blocks) {
+				HUFF_COUNT(Counter::BYTES_OUT, writer.getBlockHeaderSize() + block.payloadSize);
+				writer.writeBlock(block, slot.output.data() + offset);
+				offset += block.payloadSize;
+				stats.bytesIn += block.rawSize;
+				countBlock(stats, block);
+			}
+		});
+	writer.finish();
+	out.flush();
+	if (!out)
+		throw std::runtime_error("Error writing output");
+	stats.bytesOut = writer.getBytesWritten();
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+
+CodingStats StreamCoder::decompress(std::istream &in, std::ostream &out, unsigned int threads, const SharedCode *sharedCode) {
+	threads = std::max(threads, 1U);
+	const auto start = std::chrono::steady_clock::now();
+	CodingStats stats;
+
+	BlockReader reader(in);
+	if ((reader.getFlags() & BlockWriter::FLAG_SHARED_CODE) == 0)
+		sharedCode = nullptr;
+	const bool blockChecksums = (reader.getFlags() & BlockWriter::FLAG_BLOCK_CHECKSUMS) != 0;
+	const bool streamChecksum = (reader.getFlags() & BlockWriter::FLAG_STREAM_CHECKSUM) != 0;
+	const std::size_t blockHeaderSize = reader.getBlockHeaderSize();
+	uint32_t actualStreamChecksum = 0;
+	BlockPipeline pipeline(threads);
+	pipeline.run(
+		[&](PipelineSlot &slot) {
+			// A group of blocks that share codes goes into one slot
+			HUFF_PHASE(Phase::READ_INPUT);
+			slot.input.clear();
+			slot.blocks.clear();
+			slot.rawLength = 0;
+			do {
+				slot.blocks.emplace_back();
+				BlockHeader &block = slot.blocks.back();
+				if (!reader.readBlock(block, slot.input))
+					return false;
+				if (block.rawSize > BlockWriter::MAX_BLOCK_SIZE - slot.rawLength || slot.input.size() > BlockWriter::MAX_BLOCK_SIZE)
+					throw std::runtime_error("Block group too large");
+				slot.rawLength += block.rawSize;
+				HUFF_COUNT(Counter::BYTES_IN, blockHeaderSize + block.payloadSize);
+			} while (reader.nextContinuesGroup());
+			return true;
+		},
+		[&](PipelineSlot &slot, CoderContext &ctx) {
+			slot.output.resize(slot.rawLength);
+			ctx.codeCache.setShared(sharedCode);
+			std::size_t inOffset = 0;
+			std::size_t outOffset = 0;
+			for (BlockHeader &block : slot.blocks) {
+				uint8_t *raw = slot.output.data() + outOffset;
+				BlockCoder::decode(block.codec, slot.input.data() + inOffset, block.payloadSize, raw, block.rawSize, ctx, block.codeReference);
+				if (block.x86Filter) {
+					HUFF_PHASE(Phase::FILTER);
+					X86Filter::decode(raw, block.rawSize);
+				}
+				if (blockChecksums || streamChecksum) {
+					uint32_t actual = Crc32c::compute(raw, block.rawSize);
+					if (blockChecksums && actual != block.checksum)
+						throw std::runtime_error("Block checksum mismatch");
+					block.checksum = actual;
+				}
+				inOffset += block.payloadSize;
+				outOffset += block.rawSize;
+			}
+		},
+		[&](PipelineSlot &slot) {
+			HUFF_PHASE(Phase::WRITE_OUTPUT);
+			HUFF_COUNT(Counter::BYTES_OUT, slot.rawLength);
+			out.write(reinterpret_cast<const char*>(slot.output.data()), static_cast<std::streamsize>(slot.rawLength));
+			if (!out)
+				throw std::runtime_error("Error writing output");
+			for (const BlockHeader &block : slot.blocks) {
+				if (streamChecksum)
+					actualStreamChecksum = Crc32c::combine(actualStreamChecksum, block.checksum, block.rawSize);
+				stats.bytesIn += blockHeaderSize + block.payloadSize;
+				stats.bytesOut += block.rawSize;
+				countBlock(stats, block);
+			}
+		});
+	if (streamChecksum && actualStreamChecksum != reader.getStreamChecksum())
+		throw std::runtime_error("Stream checksum mismatch");
+	stats.bytesIn += reader.getFramingSize();
+	out.flush();
+	if (!out)
+		throw std::runtime_error("Error writing output");
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
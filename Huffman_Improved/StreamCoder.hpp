@@ -0,0 +1,150 @@
+/*
+ * Whole-stream compression and decompression with the block container
+ *
+ * The input is cut into blocks of a fixed size, and each block is coded with one codec
+ * (or the smallest of all codecs), after converting the branch targets of blocks that contain x86
+ * machine code. Blocks can also end early at given offsets, so that they don't mix regions of
+ * different content, and blocks for an order-0 codec are split further where their statistics
+ * change. Blocks that the codec doesn't shrink are stored. Reading, coding and writing run as a BlockPipeline, so the
+ * input and output streams stay busy while blocks are being coded, and blocks are independent,
+ * so the requested number of threads code several of them at the same time. Memory use is
+ * bounded by the pipeline's 2 * threads + 1 slots, each holding about twice the block size.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "BlockCodec.hpp"
+#include "BlockContainer.hpp"
+#include "BlockPipeline.hpp"
+
+
+/*
+ * Which blocks go through the x86 branch filter (see X86Filter) before coding.
+ */
+enum class FilterMode {
+	NONE,
+	X86,   // Every block
+	AUTO,  // Blocks that X86Filter::detect() accepts, unless the codec is order-0 (HUFFMAN, HUFFMAN4,
+	       // RANS, FIXED or ADAPTIVE), which gains nothing from repeated targets
+};
+
+
+
+/*
+ * Options for StreamCoder::compress().
+ */
+struct CompressOptions final {
+
+	// If true, every block is coded with all codecs and the smallest result is kept.
+	bool autoCodec = true;
+
+	// The codec for every block when autoCodec is false.
+	BlockCodec codec = BlockCodec::HUFFMAN;
+
+	// Rebuild policy specification (see RebuildPolicy::parse()) for the ADAPTIVE codec.
+	std::string adaptivePolicy = "backoff";
+
+	// Match finder level of the LZ77 codec, also when autoCodec tries it.
+	int lz77Level = Lz77Codec::DEFAULT_LEVEL;
+
+	FilterMode filter = FilterMode::AUTO;
+
+	// Number of input bytes per block, between 1 and 2^30.
+	std::uint32_t blockSize = 1 << 20;
+
+	// Input offsets at which a block ends early, in increasing order, such as the region boundaries
+	// of ElfLayout. The next block starts there and is again up to blockSize bytes long.
+	std::vector<std::uint64_t> blockCuts;
+
+	// If true, a block coded with HUFFMAN or HUFFMAN4 can use the code of an earlier block from the
+	// same input block instead of carrying its own table, when that is smaller (see BlockCoder::encodeCached()).
+	// This only happens between the parts that entropySplit makes, which are decoded in order.
+	bool reuseCodes = true;
+
+	// If true, every block is further split where its byte statistics change (see BlockSplitter),
+	// when autoCodec is false and the codec is HUFFMAN, HUFFMAN4 or RANS. Higher-order and
+	// dictionary codecs lose context at every cut and don't gain from it.
+	bool entropySplit = true;
+
+	// Checksums to store, as BlockWriter::FLAG_* bits. They are computed by the coding threads
+	// while each block is still in cache.
+	std::uint8_t checksums = BlockWriter::FLAG_BLOCK_CHECKSUMS | BlockWriter::FLAG_STREAM_CHECKSUM;
+
+	// Number of threads coding blocks concurrently, at least 1. Reading and writing use their own threads.
+	unsigned int threads = 1;
+
+	// A code that every group can refer to without a table, or null. If it is set and reuseCodes is
+	// true, blocks of its codec, and of autoCodec when that is smaller, may use it, and the stream gets
+	// BlockWriter::FLAG_SHARED_CODE; decompress() must then be given the same code if any block uses it.
+	const SharedCode *sharedCode = nullptr;
+
+};
+
+
+
+/*
+ * Counters filled in by StreamCoder.
+ */
+struct CodingStats final {
+
+	std::uint64_t bytesIn = 0;
+
+	std::uint64_t bytesOut = 0;
+
+	std::uint64_t blocks = 0;
+
+	// Number of blocks per codec identifier.
+	std::uint64_t blocksPerCodec[BlockCoder::NUM_CODECS] = {};
+
+	// Number of blocks that went through the x86 branch filter.
+	std::uint64_t filteredBlocks = 0;
+
+	// Number of blocks that use the code of an earlier block.
+	std::uint64_t reusedCodes = 0;
+
+	// Number of target bytes copied from the reference, when compressing with DeltaCoder.
+	std::uint64_t copiedBytes = 0;
+
+	// Wall time of the whole operation in seconds.
+	double seconds = 0;
+
+};
+
+
+
+class StreamCoder final {
+
+	// Compresses the given input stream to the given output stream in the block container format.
+	// Throws std::runtime_error on I/O errors.
+	public: static CodingStats compress(std::istream &in, std::ostream &out, const CompressOptions &options);
+
+
+	// Decompresses a block container stream, decoding up to the given number of blocks concurrently.
+	// Checksums present in the stream are verified by the decoding threads. A stream with
+	// BlockWriter::FLAG_SHARED_CODE needs the shared code it was compressed with, unless no block uses it.
+	// Throws std::runtime_error if the input is malformed, a checksum doesn't match, or on I/O errors.
+	public: static CodingStats decompress(std::istream &in, std::ostream &out, unsigned int threads, const SharedCode *sharedCode = nullptr);
+
+
+	// Codes the raw bytes of the given slot as container blocks in its output and blocks, as compress()
+	// does with each group of blocks of at most getGroupSize() bytes. Returns the number of blocks that
+	// use the shared code of the options.
+	public: static std::uint32_t encodeGroup(PipelineSlot &slot, CoderContext &ctx, const CompressOptions &options);
+
+
+	public: static std::uint32_t getGroupSize(const CompressOptions &options);
+
+
+	// Returns the stream header flags of the streams that compress() writes with the given options.
+	public: static std::uint8_t getStreamFlags(const CompressOptions &options);
+
+
+	// Adds the given block to the block counters of the given stats.
+	public: static void countBlock(CodingStats &stats, const BlockHeader &block);
+
+};
@@ -0,0 +1,261 @@
+/*
+ * Searching a compressed stream for a byte string without writing it out
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include "BitOps.hpp"
+#include "BlockCodec.hpp"
+#include "BlockContainer.hpp"
+#include "BlockPipeline.hpp"
+#include "ByteIo.hpp"
+#include "Crc32c.hpp"
+#include "Instrumentation.hpp"
+#include "StreamSearch.hpp"
+#include "X86Filter.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define HUFF_SEARCH_SIMD
+	#include <immintrin.h>
+#endif
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+const size_t StreamSearch::MAX_PATTERN_LENGTH;
+
+
+// Finds the pattern at or after position i, testing each position whose first byte matches.
+static const uint8_t *findScalar(const uint8_t *data, size_t len, const uint8_t *pattern, size_t patLen, size_t i) {
+	while (i + patLen <= len) {
+		const void *hit = std::memchr(data + i, pattern[0], len - patLen + 1 - i);
+		if (hit == nullptr)
+			return nullptr;
+		i = static_cast<size_t>(static_cast<const uint8_t*>(hit) - data);
+		if (std::memcmp(data + i, pattern, patLen) == 0)
+			return data + i;
+		i++;
+	}
+	return nullptr;
+}
+
+
+#ifdef HUFF_SEARCH_SIMD
+
+// Compares the bytes at the candidate positions i + k (bit k of mask set) with the whole pattern.
+static const uint8_t *checkCandidates(const uint8_t *data, size_t i, uint32_t mask, const uint8_t *pattern, size_t patLen) {
+	while (mask != 0) {
+		const size_t pos = i + static_cast<size_t>(BitOps::floorLog2(mask & (0 - mask)));
+		if (std::memcmp(data + pos, pattern, patLen) == 0)
+			return data + pos;
+		mask &= mask - 1;
+	}
+	return nullptr;
+}
+
+
+// A position is a candidate if both its first byte and the byte patLen - 1 later match the pattern's,
+// which rejects nearly all positions even when the first byte alone is common.
+__attribute__((target("sse2")))
+static const uint8_t *findSse2(const uint8_t *data, size_t len, const uint8_t *pattern, size_t patLen) {
+	const __m128i first = _mm_set1_epi8(static_cast<char>(pattern[0]));
+	const __m128i last = _mm_set1_epi8(static_cast<char>(pattern[patLen - 1]));
+	size_t i = 0;
+	for (; i + patLen - 1 + 16 <= len; i += 16) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + patLen - 1));
+		const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+		if (mask != 0) {
+			const uint8_t *hit = checkCandidates(data, i, mask, pattern, patLen);
+			if (hit != nullptr)
+				return hit;
+		}
+	}
+	return findScalar(data, len, pattern, patLen, i);
+}
+
+
+__attribute__((target("avx2")))
+static const uint8_t *findAvx2(const uint8_t *data, size_t len, const uint8_t *pattern, size_t patLen) {
+	const __m256i first = _mm256_set1_epi8(static_cast<char>(pattern[0]));
+	const __m256i last = _mm256_set1_epi8(static_cast<char>(pattern[patLen - 1]));
+	size_t i = 0;
+	for (; i + patLen - 1 + 32 <= len; i += 32) {
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + patLen - 1));
+		const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+			_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+		if (mask != 0) {
+			const uint8_t *hit = checkCandidates(data, i, mask, pattern, patLen);
+			if (hit != nullptr)
+				return hit;
+		}
+	}
+	return findScalar(data, len, pattern, patLen, i);
+}
+
+
+static int detectSimd() {
+	__builtin_cpu_init();  // Needed because this runs during static initialization
+	return __builtin_cpu_supports("avx2") != 0 ? 2 : __builtin_cpu_supports("sse2") != 0 ? 1 : 0;
+}
+
+// 2 for AVX2, 1 for SSE2, 0 for neither.
+static const int SIMD_LEVEL = detectSimd();
+
+#endif
+
+
+const uint8_t *StreamSearch::find(const uint8_t *data, size_t len, const uint8_t *pattern, size_t patLen) {
+	if (patLen == 0)
+		return data;
+	if (patLen > len)
+		return nullptr;
+#ifdef HUFF_SEARCH_SIMD
+	if (patLen > 1) {
+		if (SIMD_LEVEL == 2)
+			return findAvx2(data, len, pattern, patLen);
+		if (SIMD_LEVEL == 1)
+			return findSse2(data, len, pattern, patLen);
+	}
+#endif
+	return findScalar(data, len, pattern, patLen, 0);
+}
+
+
+SearchResult StreamSearch::search(std::istream &in, const vector<uint8_t> &pattern, unsigned int threads, const SharedCode *sharedCode) {
+	if (pattern.empty() || pattern.size() > MAX_PATTERN_LENGTH)
+		throw std::invalid_argument("Invalid pattern length");
+	const auto start = std::chrono::steady_clock::now();
+	const size_t patLen = pattern.size();
+	const size_t context = patLen - 1;  // Bytes of a group that a match crossing its boundary can use
+
+	// A byte value that the pattern doesn't contain stands in for the bytes of skipped blocks
+	std::array<bool, 256> inPattern = {};
+	for (uint8_t b : pattern)
+		inPattern[b] = true;
+	const auto unused = std::find(inPattern.begin(), inPattern.end(), false);
+	const bool canSkip = unused != inPattern.end();
+	const uint8_t filler = static_cast<uint8_t>(unused - inPattern.begin());
+
+	BlockReader reader(in);
+	if ((reader.getFlags() & BlockWriter::FLAG_SHARED_CODE) == 0)
+		sharedCode = nullptr;
+	const bool blockChecksums = (reader.getFlags() & BlockWriter::FLAG_BLOCK_CHECKSUMS) != 0;
+	SearchResult result;
+	vector<uint8_t> carry;  // The last bytes before the current group, up to context of them
+	vector<uint8_t> joined;
+	BlockPipeline pipeline(std::max(threads, 1U));
+	pipeline.run(
+		[&](PipelineSlot &slot) {
+			// A group of blocks that share codes goes into one slot
+			HUFF_PHASE(Phase::READ_INPUT);
+			slot.input.clear();
+			slot.blocks.clear();
+			slot.rawLength = 0;
+			do {
+				slot.blocks.emplace_back();
+				BlockHeader &block = slot.blocks.back();
+				if (!reader.readBlock(block, slot.input))
+					return false;
+				if (block.rawSize > BlockWriter::MAX_BLOCK_SIZE - slot.rawLength || slot.input.size() > BlockWriter::MAX_BLOCK_SIZE)
+					throw std::runtime_error("Block group too large");
+				slot.rawLength += block.rawSize;
+			} while (reader.nextContinuesGroup());
+			return true;
+		},
+		[&](PipelineSlot &slot, CoderContext &ctx) {
+			// Decode the group into the scratch buffer, leaving out the blocks that can't be part of a match
+			vector<uint8_t> &raw = ctx.scratch;
+			raw.resize(slot.rawLength);
+			ctx.codeCache.setShared(sharedCode);
+			uint32_t skippedBlocks = 0;
+			uint32_t skippedBytes = 0;
+			size_t inOffset = 0;
+			size_t outOffset = 0;
+			for (const BlockHeader &block : slot.blocks) {
+				const uint8_t *const payload = slot.input.data() + inOffset;
+				uint8_t *const out = raw.data() + outOffset;
+				bool skip = false;
+				if (canSkip && !block.x86Filter && block.rawSize >= context) {
+					std::array<bool, 256> present = {};
+					skip = BlockCoder::findByteValues(block.codec, payload, block.payloadSize, ctx, block.codeReference, present)
+						&& !present[pattern.front()] && !present[pattern.back()];
+				}
+				if (skip) {
+					BlockCoder::skip(block.codec, payload, block.payloadSize, ctx, block.codeReference);
+					std::memset(out, filler, block.rawSize);
+					skippedBlocks++;
+					skippedBytes += block.rawSize;
+				} else {
+					BlockCoder::decode(block.codec, payload, block.payloadSize, out, block.rawSize, ctx, block.codeReference);
+					if (block.x86Filter) {
+						HUFF_PHASE(Phase::FILTER);
+						X86Filter::decode(out, block.rawSize);
+					}
+					if (blockChecksums && Crc32c::compute(out, block.rawSize) != block.checksum)
+						throw std::runtime_error("Block checksum mismatch");
+				}
+				inOffset += block.payloadSize;
+				outOffset += block.rawSize;
+			}
+
+			// Output: the numbers of skipped blocks and bytes, the first and the last bytes of the group
+			// (up to context of each), then the offset in the group of each match (4 bytes each)
+			vector<uint8_t> &output = slot.output;
+			output.clear();
+			ByteIo::putU32(output, skippedBlocks);
+			ByteIo::putU32(output, skippedBytes);
+			const size_t edge = std::min(context, static_cast<size_t>(slot.rawLength));
+			output.insert(output.end(), raw.begin(), raw.begin() + static_cast<std::ptrdiff_t>(edge));
+			output.insert(output.end(), raw.begin() + static_cast<std::ptrdiff_t>(slot.rawLength - edge), raw.begin() + slot.rawLength);
+			for (const uint8_t *p = raw.data(), *end = raw.data() + slot.rawLength; ; p++) {
+				p = find(p, static_cast<size_t>(end - p), pattern.data(), patLen);
+				if (p == nullptr)
+					break;
+				ByteIo::putU32(output, static_cast<uint32_t>(p - raw.data()));
+			}
+		},
+		[&](PipelineSlot &slot) {
+			const uint8_t *p = slot.output.data();
+			const uint8_t *const end = p + slot.output.size();
+			result.skippedBlocks += ByteIo::getU32(p, end);
+			result.skippedBytes += ByteIo::getU32(p, end);
+
+			// Matches that start in the carried bytes and end in this group
+			const size_t edge = std::min(context, static_cast<size_t>(slot.rawLength));
+			const uint8_t *const head = p;
+			const uint8_t *const tail = head + edge;
+			joined.assign(carry.begin(), carry.end());
+			joined.insert(joined.end(), head, head + edge);
+			const uint64_t carryStart = result.rawBytes - carry.size();
+			for (const uint8_t *q = joined.data(); ; q++) {
+				q = find(q, static_cast<size_t>(joined.data() + joined.size() - q), pattern.data(), patLen);
+				if (q == nullptr || static_cast<size_t>(q - joined.data()) >= carry.size())
+					break;
+				result.matches.push_back(carryStart + static_cast<uint64_t>(q - joined.data()));
+			}
+			for (p = tail + edge; p != end; )
+				result.matches.push_back(result.rawBytes + ByteIo::getU32(p, end));
+
+			// Carry the last bytes of the stream so far into the next group
+			if (slot.rawLength >= context)
+				carry.assign(tail, tail + edge);
+			else {
+				carry.insert(carry.end(), tail, tail + edge);
+				carry.erase(carry.begin(), carry.end() - static_cast<std::ptrdiff_t>(std::min(context, carry.size())));
+			}
+			result.rawBytes += slot.rawLength;
+			result.blocks += slot.blocks.size();
+		});
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
@@ -0,0 +1,74 @@
+/*
+ * Searching a compressed stream for a byte string without writing it out
+ *
+ * The blocks of a block container stream go through a BlockPipeline like StreamCoder::decompress(),
+ * but each group of blocks is decoded into the scratch buffer of the worker's CoderContext and scanned
+ * there with find(), so the threads search several groups at the same time and nothing is written.
+ * Before a block is decoded, BlockCoder::findByteValues() reads the byte values it can contain from
+ * its code table. A match that touches a block either starts in it, ends in it, or covers it from
+ * before its start to after its end; so a block that can't contain the first nor the last byte of
+ * the pattern, and isn't shorter than the pattern minus one byte, can't be part of any match and is
+ * not decoded at all. Its bytes are replaced by a byte value that the pattern doesn't use.
+ * Matches that cross from one group into the next are found by the in-order write stage, from the
+ * last bytes of one group and the first bytes of the next. Decoded blocks are checked against their
+ * block checksums; the stream checksum is not, since it covers the skipped blocks too.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <vector>
+#include "CoderContext.hpp"
+
+
+/*
+ * Result of StreamSearch::search().
+ */
+struct SearchResult final {
+
+	// Offsets of the matches in the decompressed stream, in increasing order. Matches may overlap.
+	std::vector<std::uint64_t> matches;
+
+	// Size of the decompressed stream.
+	std::uint64_t rawBytes = 0;
+
+	std::uint64_t blocks = 0;
+
+	// Number of blocks that weren't decoded because they can't contain a match, and their raw size.
+	std::uint64_t skippedBlocks = 0;
+
+	std::uint64_t skippedBytes = 0;
+
+	// Wall time of the whole search in seconds.
+	double seconds = 0;
+
+};
+
+
+
+class StreamSearch final {
+
+	/*---- Constants ----*/
+
+	public: static const std::size_t MAX_PATTERN_LENGTH = 4096;
+
+
+	/*---- Methods ----*/
+
+	// Returns a pointer to the first occurrence of the given pattern in the given data, or null if there
+	// is none. An empty pattern occurs at the start. Compares 16 or 32 positions at a time with SIMD
+	// instructions where available, checking the first and last byte of the pattern before the rest.
+	public: static const std::uint8_t *find(const std::uint8_t *data, std::size_t len, const std::uint8_t *pattern, std::size_t patLen);
+
+
+	// Finds all occurrences of the given pattern (1 to MAX_PATTERN_LENGTH bytes) in the decompressed
+	// contents of the given block container stream, searching up to the given number of groups concurrently.
+	// The shared code is used like in StreamCoder::decompress(). Throws std::invalid_argument if the pattern
+	// is empty or too long, and std::runtime_error if the input is malformed, a block checksum of a decoded
+	// block doesn't match, or on I/O errors.
+	public: static SearchResult search(std::istream &in, const std::vector<std::uint8_t> &pattern, unsigned int threads,
+		const SharedCode *sharedCode = nullptr);
+
+};
@@ -0,0 +1,132 @@
+/*
+ * Branch filter for x86 machine code
+ */
+
+#include <cstring>
+#include "X86Filter.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::int32_t;
+using std::int64_t;
+using std::uint64_t;
+using std::size_t;
+
+
+const uint32_t X86Filter::POSITION_RANGE;
+
+// A block is filtered if at least one in this many bytes starts a plausible call or jump.
+static const size_t DETECT_DENSITY = 256;
+
+
+static uint64_t loadWord(const uint8_t *p) {
+	uint64_t result;
+	std::memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+
+// Returns the index of the first E8 or E9 byte among the 8 bytes at p, or 8 if there is none.
+static size_t findBranchInWord(const uint8_t *p) {
+	// E8 and E9 are the bytes that become zero after clearing the low bit and xoring with E8
+	uint64_t x = (loadWord(p) & UINT64_C(0xFEFEFEFEFEFEFEFE)) ^ UINT64_C(0xE8E8E8E8E8E8E8E8);
+	uint64_t zeros = (x - UINT64_C(0x0101010101010101)) & ~x & UINT64_C(0x8080808080808080);  // Exact up to the first zero byte
+	if (zeros == 0)
+		return 8;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return static_cast<size_t>(__builtin_ctzll(zeros)) >> 3;
+#else
+	size_t i = 0;
+	while ((p[i] & 0xFE) != 0xE8)
+		i++;
+	return i;
+#endif
+}
+
+
+// Returns the position of the first E8 or E9 byte at or after start, or len if there is none.
+static size_t findBranch(const uint8_t *data, size_t start, size_t len) {
+	size_t i = start;
+	for (; i + 8 <= len; i += 8) {
+		size_t j = findBranchInWord(data + i);
+		if (j < 8)
+			return i + j;
+	}
+	while (i < len && (data[i] & 0xFE) != 0xE8)
+		i++;
+	return i;
+}
+
+
+static uint32_t loadLittle32(const uint8_t *p) {
+	return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8
+		| static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+
+static void storeLittle32(uint8_t *p, uint32_t x) {
+	p[0] = static_cast<uint8_t>(x);
+	p[1] = static_cast<uint8_t>(x >> 8);
+	p[2] = static_cast<uint8_t>(x >> 16);
+	p[3] = static_cast<uint8_t>(x >> 24);
+}
+
+
+/*
+ * With N = POSITION_RANGE and p the position after the displacement modulo N, encoding maps
+ * a displacement d to d + p if d is in [-p, N - p) (the target is in [0, N)), to d - N if d is
+ * in [N - p, N), and leaves it unchanged otherwise. The three ranges map onto [0, N), [-p, 0)
+ * and the rest, so decoding can tell them apart. The opcode bytes themselves are never changed,
+ * so both directions visit the same positions.
+ */
+template <bool ENCODE>
+static void convert(uint8_t *data, size_t len) {
+	const int64_t n = X86Filter::POSITION_RANGE;
+	if (len < 5)
+		return;
+	const size_t end = len - 4;  // Last position where a branch fits
+	for (size_t i = findBranch(data, 0, end); i < end; i = findBranch(data, i, end)) {
+		const int64_t p = static_cast<int64_t>((i + 5) & (X86Filter::POSITION_RANGE - 1));
+		const int64_t x = static_cast<int32_t>(loadLittle32(data + i + 1));
+		// Which range x is in decides unpredictably, so select without branches
+		int64_t y = x;
+		if (ENCODE) {
+			y = static_cast<uint64_t>(x + p) < static_cast<uint64_t>(n) ? x + p : y;
+			y = static_cast<uint64_t>(x - (n - p)) < static_cast<uint64_t>(p) ? x - n : y;
+		} else {
+			y = static_cast<uint64_t>(x) < static_cast<uint64_t>(n) ? x - p : y;
+			y = static_cast<uint64_t>(x + p) < static_cast<uint64_t>(p) ? x + n : y;
+		}
+		storeLittle32(data + i + 1, static_cast<uint32_t>(y));
+		i += 5;
+	}
+}
+
+
+void X86Filter::encode(uint8_t *data, size_t len) {
+	convert<true>(data, len);
+}
+
+
+void X86Filter::decode(uint8_t *data, size_t len) {
+	convert<false>(data, len);
+}
+
+
+bool X86Filter::detect(const uint8_t *data, size_t len) {
+	if (len < 5)
+		return false;
+	// Near calls and jumps have a displacement whose top byte is 00 or FF;
+	// random bytes produce about 1 such branch in 16000 bytes
+	const size_t end = len - 4;
+	size_t branches = 0;
+	for (size_t i = findBranch(data, 0, end); i < end; i = findBranch(data, i, end)) {
+		uint8_t top = data[i + 4];
+		if (top == 0x00 || top == 0xFF) {
+			branches++;
+			i += 5;
+		} else
+			i++;
+	}
+	return branches >= len / DETECT_DENSITY;
+}
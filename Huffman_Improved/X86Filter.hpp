@@ -0,0 +1,42 @@
+/*
+ * Branch filter for x86 machine code
+ *
+ * The x86 call (E8) and jmp (E9) instructions hold their target as a 32-bit displacement from
+ * the next instruction, so calls to the same function from different places have different bytes.
+ * The filter replaces each displacement by the absolute target, which turns repeated calls into
+ * repeated strings and concentrates the displacement bytes on fewer values. Like the BCJ filters
+ * of other compressors, it doesn't decode instructions: every E8 or E9 byte is taken as an opcode
+ * and the 4 bytes after it are converted and skipped. The conversion is a bijection on 32-bit
+ * values for every position, so any data can be filtered and restored, and only displacements
+ * whose target lies within POSITION_RANGE of the start of the buffer are changed.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+class X86Filter final {
+
+	/*---- Constants ----*/
+
+	// Positions in the buffer are taken modulo this value.
+	public: static const std::uint32_t POSITION_RANGE = static_cast<std::uint32_t>(1) << 24;
+
+
+	/*---- Methods ----*/
+
+	// Converts the relative branch displacements in the given buffer to absolute targets, in place.
+	public: static void encode(std::uint8_t *data, std::size_t len);
+
+
+	// Undoes encode() on the given buffer, in place.
+	public: static void decode(std::uint8_t *data, std::size_t len);
+
+
+	// Returns whether the given bytes look like x86 machine code, i.e. whether enough E8 and E9
+	// bytes are followed by a displacement of less than 16 MiB for the filter to pay off.
+	public: static bool detect(const std::uint8_t *data, std::size_t len);
+
+};
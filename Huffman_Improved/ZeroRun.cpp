@@ -0,0 +1,329 @@
+/*
+ * Zero-run symbol alphabet
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "BitOps.hpp"
+#include "ByteIo.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+
+const uint32_t ZeroRun::SYMBOL_LIMIT;
+const uint32_t ZeroRun::EOF_SYMBOL;
+
+
+void ZeroRun::appendRun(uint32_t runLength, vector<uint32_t> &symbols) {
+	for (int k = 31; k >= 0; k--) {
+		if (((runLength >> k) & 1) == 0)
+			continue;
+		if (k == 0)
+			symbols.push_back(0);
+		else
+			symbols.push_back(256 + static_cast<uint32_t>(k));
+	}
+}
+
+
+void ZeroRun::toSymbols(const std::uint8_t *data, std::size_t len, vector<uint32_t> &symbols) {
+	std::size_t i = 0;
+	while (i < len) {
+		if (data[i] != 0) {
+			symbols.push_back(data[i]);
+			i++;
+		} else {
+			std::size_t start = i;
+			while (i < len && data[i] == 0 && i - start < UINT32_MAX)
+				i++;
+			appendRun(static_cast<uint32_t>(i - start), symbols);
+		}
+	}
+}
+
+
+uint32_t ZeroRun::expandedLength(uint32_t symbol) {
+	if (symbol < 256)
+		return 1;
+	if (symbol == EOF_SYMBOL || symbol >= 256 + 32)
+		throw std::domain_error("Symbol is not a byte or zero run");
+	return static_cast<uint32_t>(1) << (symbol - 256);
+}
+
+
+bool ZeroRun::isRun(uint32_t symbol) {
+	return symbol > EOF_SYMBOL;
+}
+
+
+
+/*---- RunTable ----*/
+
+const int RunTable::MAX_TUNED;
+
+// Number of power-of-two run symbols, 257 (2 zeros) to 287 (2^31 zeros).
+static const int NUM_POWERS = 31;
+
+// A length is only added to the table if it saves at least this many symbols in the block.
+static const uint64_t MIN_GAIN = 4;
+
+// Runs shorter than this are counted in an array by tune(), longer ones are sorted.
+static const uint32_t SHORT_RUNS = 1024;
+
+
+static uint64_t loadWord(const uint8_t *p) {
+	uint64_t result;
+	std::memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+
+static bool hasZeroByte(uint64_t word) {
+	return ((word - UINT64_C(0x0101010101010101)) & ~word & UINT64_C(0x8080808080808080)) != 0;
+}
+
+
+// Returns the end of the run of zeros starting at data[start], which is at most UINT32_MAX long.
+static std::size_t skipZeros(const uint8_t *data, std::size_t start, std::size_t len) {
+	std::size_t i = start;
+	for (; i + 8 <= len && i - start <= UINT32_MAX - 8 && loadWord(data + i) == 0; i += 8);
+	while (i < len && data[i] == 0 && i - start < UINT32_MAX)
+		i++;
+	return i;
+}
+
+
+RunTable::RunTable() {
+	setTuned(nullptr, 0);
+}
+
+
+void RunTable::setTuned(const uint32_t *tuned, int count) {
+	if (count < 0 || count > MAX_TUNED)
+		throw std::invalid_argument("Too many run lengths");
+	lengths.fill(0);
+	for (int k = 1; k <= NUM_POWERS; k++)
+		lengths[k] = static_cast<uint32_t>(1) << k;
+	for (int i = 0; i < count; i++) {
+		if (tuned[i] < 2)
+			throw std::invalid_argument("Run length too short");
+		lengths[1 + NUM_POWERS + i] = tuned[i];
+	}
+	numTuned = count;
+	sortBySize();
+}
+
+
+void RunTable::tune(const uint8_t *data, std::size_t len, vector<uint64_t> &scratch) {
+	setTuned(nullptr, 0);
+
+	// Count the runs of 2 or more zeros, short ones in an array and long ones by sorting their lengths,
+	// and count the bytes coded as single symbols
+	std::array<uint32_t, SHORT_RUNS> shortCounts = {};
+	scratch.clear();
+	uint64_t literals = 0;
+	uint64_t singleZeros = 0;
+	for (std::size_t i = 0; i < len; ) {
+		std::size_t start = i;
+		if (data[i] != 0) {
+			for (i++; i + 8 <= len && !hasZeroByte(loadWord(data + i)); i += 8);
+			while (i < len && data[i] != 0)
+				i++;
+			literals += i - start;
+			continue;
+		}
+		i = skipZeros(data, i, len);
+		std::size_t run = i - start;
+		if (run == 1)
+			singleZeros++;
+		else if (run < SHORT_RUNS)
+			shortCounts[run] += shortCounts[run] < UINT32_MAX ? 1 : 0;
+		else
+			scratch.push_back(run);
+	}
+
+	// Turn the lengths into a histogram of (length << 32 | count), in place
+	std::sort(scratch.begin(), scratch.end());
+	std::size_t distinct = 0;
+	for (std::size_t i = 0; i < scratch.size(); ) {
+		uint64_t length = scratch[i];
+		std::size_t j = i;
+		while (j < scratch.size() && scratch[j] == length)
+			j++;
+		scratch[distinct] = length << 32 | std::min<uint64_t>(j - i, UINT32_MAX);
+		distinct++;
+		i = j;
+	}
+	scratch.resize(distinct);
+	for (uint32_t length = 2; length < SHORT_RUNS; length++) {
+		if (shortCounts[length] > 0)
+			scratch.push_back(static_cast<uint64_t>(length) << 32 | shortCounts[length]);
+	}
+	if (scratch.empty())
+		return;
+
+	// Predicted size in bits of the run symbols, the single zeros and the table, ignoring the literals' own
+	// contribution, which is the same for every table: with N symbols in total and f occurrences of a symbol,
+	// the block costs N log2 N minus the sum of f log2 f over all symbols.
+	auto predictBits = [&](const RunTable &table) {
+		std::array<uint64_t, ZeroRun::SYMBOL_LIMIT - 256> freqs = {};
+		freqs[0] = singleZeros;
+		for (uint64_t entry : scratch) {
+			uint64_t count = entry & UINT32_MAX;
+			table.split(static_cast<uint32_t>(entry >> 32), [&](uint32_t sym) {
+				freqs[sym == 0 ? 0 : sym - 256] += count;
+			});
+		}
+		double total = static_cast<double>(literals);
+		double bits = 0;
+		for (uint64_t f : freqs) {
+			if (f > 0) {
+				total += f;
+				bits -= f * std::log2(static_cast<double>(f));
+			}
+		}
+		bits += total * std::log2(total);
+		double headerBytes = 1;
+		for (int i = 0; i < table.numTuned; i++) {
+			for (uint32_t n = table.lengths[1 + NUM_POWERS + i]; n >= 0x80; n >>= 7)
+				headerBytes++;
+			headerBytes++;
+		}
+		return bits + headerBytes * 8;
+	};
+	const double powersBits = predictBits(*this);
+
+	// Add the length that saves the most symbols with the lengths chosen so far, until none saves enough
+	std::array<uint32_t, MAX_TUNED> tuned;
+	int count = 0;
+	while (count < MAX_TUNED) {
+		uint64_t bestGain = 0;
+		uint32_t bestLength = 0;
+		for (uint64_t entry : scratch) {
+			uint32_t length = static_cast<uint32_t>(entry >> 32);
+			uint64_t gain = (entry & UINT32_MAX) * (countSymbols(length) - 1);
+			if (gain > bestGain) {
+				bestGain = gain;
+				bestLength = length;
+			}
+		}
+		if (bestGain < MIN_GAIN)
+			break;
+		tuned[count] = bestLength;
+		count++;
+		setTuned(tuned.data(), count);
+	}
+	if (count == 0)
+		return;
+	std::sort(tuned.begin(), tuned.begin() + count);
+	setTuned(tuned.data(), count);
+	if (predictBits(*this) >= powersBits)
+		setTuned(nullptr, 0);
+}
+
+
+int RunTable::getNumTuned() const {
+	return numTuned;
+}
+
+
+void RunTable::appendRun(uint32_t runLength, vector<uint32_t> &symbols) const {
+	if (numTuned == 0)
+		ZeroRun::appendRun(runLength, symbols);
+	else
+		split(runLength, [&symbols](uint32_t sym) { symbols.push_back(sym); });
+}
+
+
+void RunTable::toSymbols(const uint8_t *data, std::size_t len, vector<uint32_t> &symbols) const {
+	if (numTuned == 0) {
+		ZeroRun::toSymbols(data, len, symbols);
+		return;
+	}
+	std::size_t i = 0;
+	while (i < len) {
+		if (data[i] != 0) {
+			symbols.push_back(data[i]);
+			i++;
+		} else {
+			std::size_t start = i;
+			i = skipZeros(data, i, len);
+			appendRun(static_cast<uint32_t>(i - start), symbols);
+		}
+	}
+}
+
+
+void RunTable::write(vector<uint8_t> &out) const {
+	out.push_back(static_cast<uint8_t>(numTuned));
+	for (int i = 0; i < numTuned; i++)
+		ByteIo::putVarint(out, lengths[1 + NUM_POWERS + i]);
+}
+
+
+void RunTable::read(const uint8_t *&p, const uint8_t *end) {
+	uint32_t count = ByteIo::getU8(p, end);
+	if (count > static_cast<uint32_t>(MAX_TUNED))
+		throw std::runtime_error("Invalid run table");
+	std::array<uint32_t, MAX_TUNED> tuned;
+	for (uint32_t i = 0; i < count; i++) {
+		tuned[i] = ByteIo::getVarint(p, end);
+		if (tuned[i] < 2)
+			throw std::runtime_error("Invalid run table");
+	}
+	setTuned(tuned.data(), static_cast<int>(count));
+}
+
+
+uint32_t RunTable::countSymbols(uint32_t runLength) const {
+	uint32_t result = 0;
+	split(runLength, [&result](uint32_t) { result++; });
+	return result;
+}
+
+
+template <typename Emit>
+void RunTable::split(uint32_t runLength, Emit emit) const {
+	if (runLength < 2) {
+		if (runLength == 1)
+			emit(0);
+		return;
+	}
+	// Skip the symbols longer than the run. With all powers of two present, each symbol is taken at most once.
+	for (int i = firstBelow[BitOps::floorLog2(runLength)]; i < numRuns && runLength >= 2; i++) {
+		uint32_t sym = bySize[i];
+		uint32_t n = lengths[sym - 256];
+		if (runLength >= n) {
+			emit(sym);
+			runLength -= n;
+		}
+	}
+	if (runLength == 1)
+		emit(0);
+}
+
+
+void RunTable::sortBySize() {
+	numRuns = 0;
+	for (uint32_t sym = ZeroRun::EOF_SYMBOL + 1; sym < ZeroRun::SYMBOL_LIMIT; sym++) {
+		if (lengths[sym - 256] != 0)
+			bySize[numRuns++] = sym;
+	}
+	std::sort(bySize.begin(), bySize.begin() + numRuns, [this](uint32_t x, uint32_t y) {
+		uint32_t lx = lengths[x - 256];
+		uint32_t ly = lengths[y - 256];
+		return lx != ly ? lx > ly : x < y;
+	});
+	int i = 0;
+	for (int k = 31; k >= 0; k--) {
+		while (i < numRuns && lengths[bySize[i] - 256] >= static_cast<uint64_t>(2) << k)
+			i++;
+		firstBelow[k] = static_cast<uint8_t>(i);
+	}
+}
@@ -0,0 +1,139 @@
+/*
+ * Zero-run symbol alphabet
+ *
+ * The alphabet used by HuffmanCompress and the block codecs has 322 symbols:
+ * - 0 to 255: the literal byte values (symbol 0 is a single zero byte)
+ * - 256: the EOF marker
+ * - 256 + k for k >= 1: a run of 2^k zero bytes
+ * A run of zero bytes is split into its set binary bits, highest first,
+ * so a run of 6 zeros becomes the symbols 258 (4 zeros) and 257 (2 zeros).
+ *
+ * The block codecs use a RunTable instead, which keeps the powers of two as symbols 257 to 287
+ * and can assign the 34 remaining symbols 288 to 321 to the run lengths that are common in a
+ * block. A run of 255 zeros takes 8 symbols with powers of two, but just one if 255 is in the table.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+class ZeroRun final {
+
+	/*---- Constants ----*/
+
+	public: static const std::uint32_t SYMBOL_LIMIT = 322;
+
+	public: static const std::uint32_t EOF_SYMBOL = 256;
+
+
+	/*---- Methods ----*/
+
+	// Appends the symbols for a run of the given number of zero bytes (which may be 0).
+	public: static void appendRun(std::uint32_t runLength, std::vector<std::uint32_t> &symbols);
+
+
+	// Converts the given bytes into symbols, appending them to the given vector.
+	// No EOF symbol is appended.
+	public: static void toSymbols(const std::uint8_t *data, std::size_t len, std::vector<std::uint32_t> &symbols);
+
+
+	// Returns the number of bytes the given non-EOF symbol expands to.
+	public: static std::uint32_t expandedLength(std::uint32_t symbol);
+
+
+	// Returns true if the given symbol is a run of more than one zero byte.
+	public: static bool isRun(std::uint32_t symbol);
+
+};
+
+
+
+/*
+ * The lengths of the zero-run symbols 257 to 321 for one block.
+ * Runs are split greedily, taking the longest run symbol that fits first, so any length can be coded.
+ */
+class RunTable final {
+
+	/*---- Constants ----*/
+
+	// Number of symbols (288 to 321) that can be given a chosen run length.
+	public: static const int MAX_TUNED = 34;
+
+
+	/*---- Fields ----*/
+
+	// Run length of each symbol minus 256, or 0 for the EOF symbol and unused symbols.
+	private: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT - 256> lengths;
+
+	private: int numTuned;
+
+	// The run symbols in order of decreasing length.
+	private: std::array<std::uint32_t, ZeroRun::SYMBOL_LIMIT - 257> bySize;
+
+	private: int numRuns;
+
+	// Index in bySize of the first symbol shorter than 2^(k+1), for each k.
+	private: std::array<std::uint8_t, 32> firstBelow;
+
+
+	/*---- Constructor ----*/
+
+	// Constructs a table with just the powers of two, which codes like ZeroRun::toSymbols().
+	public: RunTable();
+
+
+	/*---- Methods ----*/
+
+	// Assigns the given run lengths (each at least 2) to the symbols starting at 288, keeping the
+	// powers of two. Throws std::invalid_argument if there are more than MAX_TUNED lengths.
+	public: void setTuned(const std::uint32_t *tuned, int count);
+
+
+	// Picks the run lengths for the given block: the lengths that would save the most symbols are
+	// added one at a time, and the table is kept if the predicted coded size of the run symbols,
+	// including the table itself, beats the powers of two alone. The scratch vector is overwritten.
+	public: void tune(const std::uint8_t *data, std::size_t len, std::vector<std::uint64_t> &scratch);
+
+
+	public: int getNumTuned() const;
+
+
+	// Returns the number of zero bytes that the given symbol expands to,
+	// or 0 if the symbol is not a run symbol in this table.
+	public: std::uint32_t expandedLength(std::uint32_t symbol) const {
+		return symbol > ZeroRun::EOF_SYMBOL && symbol < ZeroRun::SYMBOL_LIMIT ? lengths[symbol - 256] : 0;
+	}
+
+
+	// Appends the symbols for a run of the given number of zero bytes (which may be 0).
+	public: void appendRun(std::uint32_t runLength, std::vector<std::uint32_t> &symbols) const;
+
+
+	// Converts the given bytes into symbols, appending them to the given vector.
+	// No EOF symbol is appended.
+	public: void toSymbols(const std::uint8_t *data, std::size_t len, std::vector<std::uint32_t> &symbols) const;
+
+
+	// Appends the table: the number of chosen lengths as a byte, then each length as a varint.
+	public: void write(std::vector<std::uint8_t> &out) const;
+
+
+	// Reads a table written by write(), advancing the given pointer.
+	// Throws std::runtime_error if the data is truncated or malformed.
+	public: void read(const std::uint8_t *&p, const std::uint8_t *end);
+
+
+	// Returns the number of symbols that a run of the given length is split into.
+	private: std::uint32_t countSymbols(std::uint32_t runLength) const;
+
+	// Calls emit(symbol) for each symbol of a run of the given length, in order.
+	private: template <typename Emit>
+	void split(std::uint32_t runLength, Emit emit) const;
+
+	private: void sortBySize();
+
+};
@@ -1,9 +1,717 @@
+/*
+ * The huff command line tool
+ *
+ * Usage:
+ *   huff compress   [-1|-2|-3] [-c Codec] [-p Policy] [-l Level] [-f Filter] [-s Split] [-t Tables] [-b BlockSize] [-k Checksums] [-T Threads] [-q] [-j StatsFile] [InputFile [OutputFile]]
+ *   huff decompress [-T Threads] [-q] [-j StatsFile] [InputFile [OutputFile]]
+ *   huff archive    [compress options] ArchiveFile InputFile...
+ *   huff list       ArchiveFile
+ *   huff extract    [-T Threads] [-q] [-j StatsFile] ArchiveFile [Member [OutputFile]]
+ *   huff search     [-x] [-T Threads] [-q] Pattern [InputFile|ArchiveFile]
+ *   huff delta      [-b BlockSize] [-T Threads] [-q] [-j StatsFile] ReferenceFile [TargetFile [DeltaFile]]
+ *   huff patch      [-T Threads] [-q] [-j StatsFile] ReferenceFile [DeltaFile [OutputFile]]
+ *   huff analyze    [-l Level] [-b BlockSize] [InputFile]
+ *   huff bench      [-l Level] [-s Split] [-b BlockSize] [-T Threads] [InputFile]
+ *
+ * A missing file name or "-" means standard input or standard output, so the tool can be used in pipes.
+ * Compressed data uses the block container format (see BlockContainer.hpp). Codec is one of
+ * "static" (or "huffman"), "huffman4", "rans", "order1", "adaptive", "fixed", "stored", "lz77", or "auto"
+ * (the default), which tries every static codec on each block and keeps the smallest result, but
+ * stores incompressible blocks and packs near-uniform ones with a fixed-length code without trying.
+ * Any codec falls back to storing blocks it doesn't shrink. The levels are shorthands: -1 is
+ * huffman4 (fastest decoding), -2 is order1, and -3 is auto. Policy is the rebuild policy of the
+ * adaptive codec (see RebuildPolicy::parse()); the decompressor reads it from the stream. Level is the
+ * LZ77 match finder level from 1 (fastest) to 9 (smallest output), default 6, used by lz77 and auto.
+ * Filter is "auto" (the default), which runs the x86 branch filter (see X86Filter.hpp) on the
+ * blocks that look like x86 machine code when the codec is order1, lz77 or auto, "x86" to filter
+ * every block, or "none". Split is "elf", which ends blocks at the boundaries between regions of
+ * different content in ELF files (see ElfLayout.hpp) if the input is seekable, "entropy", which
+ * splits the blocks of the static, huffman4 and rans codecs where their byte statistics change
+ * (see BlockSplitter.hpp), "all" (the default) for both, or "none". Tables is "reuse" (the
+ * default), which lets the parts of a split block use the code of an earlier part when that is
+ * smaller than a new code and its table, or "new".
+ * Checksums is "all" (the default: CRC-32C per block and of the whole stream),
+ * "block", "stream" or "none"; decompress verifies whatever the stream contains.
+ * Archive compresses several files into one archive (see Archive.hpp) with the same options as
+ * compress, storing each under its path without a leading "/"; blocks of different files are coded
+ * concurrently, and a corpus-level code shared by all files saves the code tables of small ones.
+ * List prints the members of an archive. Extract decompresses one member, to OutputFile or to a file
+ * of the member's name, or without Member every member to a file of its name (in existing directories).
+ * Search prints the offset of every occurrence of Pattern (its bytes as given, or with -x written in
+ * hexadecimal) in the decompressed contents of a compressed stream, or in each member of an archive as
+ * "name:offset", without writing the contents anywhere (see StreamSearch.hpp); like grep, it fails
+ * if nothing is found.
+ * Delta compresses a new version of a file against an older one, the reference, as copies from the
+ * reference and inserted bytes (see DeltaCoder.hpp), and patch rebuilds the new version from the
+ * reference and the delta; both stream the target and hold only the reference in memory.
+ * All commands but list, analyze and bench print throughput statistics to standard error unless -q is given.
+ * Analyze prints the entropy of the input, its ELF regions if any, and the size each codec achieves, and bench measures
+ * the in-memory encode and decode speed of each codec. With -j, a JSON report of per-phase timings
+ * and counters is written to StatsFile; it is only filled in if the library was built with HUFF_INSTRUMENT.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <queue>
-int main() {
-    std::priority_queue<int> pqueue;
-    pqueue.push(5);
-    pqueue.push(1);
-    pqueue.push(7);
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Archive.hpp"
+#include "BlockCodec.hpp"
+#include "BlockContainer.hpp"
+#include "CoderContext.hpp"
+#include "DeltaCoder.hpp"
+#include "ElfLayout.hpp"
+#include "Instrumentation.hpp"
+#include "Lz77Codec.hpp"
+#include "RebuildPolicy.hpp"
+#include "StreamCoder.hpp"
+#include "StreamSearch.hpp"
+#include "ZeroRun.hpp"
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+
+
+/*---- Command line parsing ----*/
+
+struct Arguments final {
+	CompressOptions options;
+	bool splitElf = true;  // Cut ELF inputs into blocks at region boundaries
+	bool quiet = false;
+	bool hexPattern = false;  // The search pattern is written in hexadecimal
+	std::string statsFile;  // Empty for no report
+	vector<std::string> files;
+};
+
+
+static void usage() {
+	std::cerr << "Usage:" << std::endl
+		<< "  huff compress   [-1|-2|-3] [-c static|huffman4|rans|order1|adaptive|fixed|stored|lz77|auto] [-p Policy] [-l 1-9] [-f auto|x86|none] [-s all|elf|entropy|none] [-t reuse|new] [-b BlockSize] [-k all|block|stream|none] [-T Threads] [-q] [-j StatsFile] [InputFile [OutputFile]]" << std::endl
+		<< "  huff decompress [-T Threads] [-q] [-j StatsFile] [InputFile [OutputFile]]" << std::endl
+		<< "  huff archive    [compress options] ArchiveFile InputFile..." << std::endl
+		<< "  huff list       ArchiveFile" << std::endl
+		<< "  huff extract    [-T Threads] [-q] [-j StatsFile] ArchiveFile [Member [OutputFile]]" << std::endl
+		<< "  huff search     [-x] [-T Threads] [-q] Pattern [InputFile|ArchiveFile]" << std::endl
+		<< "  huff delta      [-b BlockSize] [-T Threads] [-q] [-j StatsFile] ReferenceFile [TargetFile [DeltaFile]]" << std::endl
+		<< "  huff patch      [-T Threads] [-q] [-j StatsFile] ReferenceFile [DeltaFile [OutputFile]]" << std::endl
+		<< "  huff analyze    [-l 1-9] [-b BlockSize] [InputFile]" << std::endl
+		<< "  huff bench      [-l 1-9] [-s all|elf|entropy|none] [-b BlockSize] [-T Threads] [InputFile]" << std::endl
+		<< "A missing file name or \"-\" means standard input or output." << std::endl;
+}
+
+
+static unsigned long parseNumber(const char *s) {
+	char *end;
+	unsigned long result = std::strtoul(s, &end, 10);
+	if (*s == '\0' || *end != '\0')
+		throw std::invalid_argument(std::string("Invalid number: ") + s);
+	return result;
+}
+
+
+static Arguments parseArguments(int argc, char *argv[]) {
+	Arguments result;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.size() < 2 || arg[0] != '-') {
+			result.files.push_back(arg);
+			continue;
+		}
+		if (arg == "-q") {
+			result.quiet = true;
+			continue;
+		}
+		if (arg == "-x") {
+			result.hexPattern = true;
+			continue;
+		}
+		if (arg == "-1" || arg == "-2" || arg == "-3") {
+			result.options.autoCodec = arg == "-3";
+			result.options.codec = arg == "-1" ? BlockCodec::HUFFMAN4 : BlockCodec::ORDER1;
+			continue;
+		}
+		if (arg != "-c" && arg != "-p" && arg != "-l" && arg != "-f" && arg != "-s" && arg != "-t" && arg != "-b" && arg != "-k" && arg != "-T" && arg != "-j")
+			throw std::invalid_argument("Unknown option " + arg);
+		if (i + 1 >= argc)
+			throw std::invalid_argument("Missing value for option " + arg);
+		const char *value = argv[++i];
+		if (arg == "-c") {
+			result.options.autoCodec = std::strcmp(value, "auto") == 0;
+			if (!result.options.autoCodec)
+				result.options.codec = BlockCoder::parseName(value);
+		} else if (arg == "-p") {
+			RebuildPolicy::parse(value);  // Validate now rather than in the middle of the stream
+			result.options.adaptivePolicy = value;
+		} else if (arg == "-l") {
+			unsigned long level = parseNumber(value);
+			if (level < Lz77Codec::MIN_LEVEL || level > Lz77Codec::MAX_LEVEL)
+				throw std::invalid_argument("LZ77 level out of range");
+			result.options.lz77Level = static_cast<int>(level);
+		} else if (arg == "-f") {
+			if (std::strcmp(value, "auto") == 0)
+				result.options.filter = FilterMode::AUTO;
+			else if (std::strcmp(value, "x86") == 0)
+				result.options.filter = FilterMode::X86;
+			else if (std::strcmp(value, "none") == 0)
+				result.options.filter = FilterMode::NONE;
+			else
+				throw std::invalid_argument(std::string("Unknown filter: ") + value);
+		} else if (arg == "-s") {
+			if (std::strcmp(value, "all") == 0) {
+				result.splitElf = true;
+				result.options.entropySplit = true;
+			} else if (std::strcmp(value, "elf") == 0) {
+				result.splitElf = true;
+				result.options.entropySplit = false;
+			} else if (std::strcmp(value, "entropy") == 0) {
+				result.splitElf = false;
+				result.options.entropySplit = true;
+			} else if (std::strcmp(value, "none") == 0) {
+				result.splitElf = false;
+				result.options.entropySplit = false;
+			} else
+				throw std::invalid_argument(std::string("Unknown split mode: ") + value);
+		} else if (arg == "-t") {
+			if (std::strcmp(value, "reuse") == 0)
+				result.options.reuseCodes = true;
+			else if (std::strcmp(value, "new") == 0)
+				result.options.reuseCodes = false;
+			else
+				throw std::invalid_argument(std::string("Unknown table mode: ") + value);
+		} else if (arg == "-b") {
+			unsigned long size = parseNumber(value);
+			if (size == 0 || size > BlockWriter::MAX_BLOCK_SIZE)
+				throw std::invalid_argument("Block size out of range");
+			result.options.blockSize = static_cast<uint32_t>(size);
+		} else if (arg == "-k") {
+			if (std::strcmp(value, "all") == 0)
+				result.options.checksums = BlockWriter::FLAG_BLOCK_CHECKSUMS | BlockWriter::FLAG_STREAM_CHECKSUM;
+			else if (std::strcmp(value, "block") == 0)
+				result.options.checksums = BlockWriter::FLAG_BLOCK_CHECKSUMS;
+			else if (std::strcmp(value, "stream") == 0)
+				result.options.checksums = BlockWriter::FLAG_STREAM_CHECKSUM;
+			else if (std::strcmp(value, "none") == 0)
+				result.options.checksums = 0;
+			else
+				throw std::invalid_argument(std::string("Unknown checksum mode: ") + value);
+		} else if (arg == "-T") {
+			unsigned long threads = parseNumber(value);
+			if (threads == 0 || threads > 256)
+				throw std::invalid_argument("Thread count out of range");
+			result.options.threads = static_cast<unsigned int>(threads);
+		} else if (arg == "-j")
+			result.statsFile = value;
+	}
+	return result;
+}
+
+
+/*---- File helpers ----*/
+
+// Opens the named input, or returns standard input for "-".
+static std::istream &openInput(const std::string &name, std::ifstream &file) {
+	if (name == "-")
+		return std::cin;
+	file.open(name, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Cannot open " + name);
+	return file;
+}
+
+
+// Opens the named output, or returns standard output for "-".
+static std::ostream &openOutput(const std::string &name, std::ofstream &file) {
+	if (name == "-")
+		return std::cout;
+	file.open(name, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Cannot create " + name);
+	return file;
+}
+
+
+static vector<uint8_t> readAll(std::istream &in) {
+	return vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+
+static double megabytesPerSecond(uint64_t bytes, double seconds) {
+	return seconds > 0 ? bytes / seconds / 1e6 : 0;
+}
+
+
+static void printStats(const char *operation, const CodingStats &stats, uint64_t rawBytes) {
+	std::cerr << operation << ": " << stats.bytesIn << " -> " << stats.bytesOut << " bytes";
+	if (stats.bytesIn > 0 && stats.bytesOut > 0) {
+		double ratio = static_cast<double>(std::min(stats.bytesIn, stats.bytesOut)) / std::max(stats.bytesIn, stats.bytesOut);
+		std::cerr << " (ratio " << std::fixed << std::setprecision(3) << ratio << ")";
+	}
+	std::cerr << std::fixed << std::setprecision(3) << " in " << stats.seconds << " s, "
+		<< std::setprecision(1) << megabytesPerSecond(rawBytes, stats.seconds) << " MB/s;";
+	bool byCodec = false;  // Delta streams don't count their blocks per codec
+	for (int i = 0; i < BlockCoder::NUM_CODECS; i++) {
+		if (stats.blocksPerCodec[i] > 0) {
+			std::cerr << " " << BlockCoder::getName(static_cast<BlockCodec>(i)) << "=" << stats.blocksPerCodec[i];
+			byCodec = true;
+		}
+	}
+	if (!byCodec)
+		std::cerr << " " << stats.blocks;
+	std::cerr << " blocks";
+	if (stats.filteredBlocks > 0)
+		std::cerr << " (" << stats.filteredBlocks << " x86-filtered)";
+	if (stats.reusedCodes > 0)
+		std::cerr << " (" << stats.reusedCodes << " with reused codes)";
+	if (stats.copiedBytes > 0)
+		std::cerr << ", " << stats.copiedBytes << " bytes copied from the reference";
+	std::cerr << std::endl;
+}
+
+
+// Returns the block cuts at the region boundaries of an ELF input, or none for other inputs.
+static vector<uint64_t> findElfCuts(std::istream &in, const CompressOptions &options) {
+	bool lz77 = options.autoCodec || options.codec == BlockCodec::LZ77;
+	return ElfLayout::getCuts(ElfLayout::parse(in, lz77 ? ElfLayout::MIN_LZ77_REGION_SIZE : ElfLayout::MIN_REGION_SIZE));
+}
+
+
+/*---- Subcommands ----*/
+
+static int compressCommand(const Arguments &args) {
+	if (args.files.size() > 2)
+		throw std::invalid_argument("Too many file names");
+	std::ifstream inFile;
+	std::ofstream outFile;
+	const std::string inName = args.files.size() >= 1 ? args.files[0] : "-";
+	std::istream &in = openInput(inName, inFile);
+	std::ostream &out = openOutput(args.files.size() >= 2 ? args.files[1] : "-", outFile);
+	CompressOptions options = args.options;
+	if (args.splitElf && inName != "-")
+		options.blockCuts = findElfCuts(in, options);
+	CodingStats stats = StreamCoder::compress(in, out, options);
+	if (!args.quiet)
+		printStats("compress", stats, stats.bytesIn);
+	return EXIT_SUCCESS;
+}
+
+
+static int decompressCommand(const Arguments &args) {
+	if (args.files.size() > 2)
+		throw std::invalid_argument("Too many file names");
+	std::ifstream inFile;
+	std::ofstream outFile;
+	std::istream &in = openInput(args.files.size() >= 1 ? args.files[0] : "-", inFile);
+	std::ostream &out = openOutput(args.files.size() >= 2 ? args.files[1] : "-", outFile);
+	CodingStats stats = StreamCoder::decompress(in, out, args.options.threads);
+	if (!args.quiet)
+		printStats("decompress", stats, stats.bytesOut);
+	return EXIT_SUCCESS;
+}
+
+
+static int archiveCommand(const Arguments &args) {
+	if (args.files.size() < 2)
+		throw std::invalid_argument("Need an archive and at least one input file");
+	vector<std::string> paths(args.files.begin() + 1, args.files.end());
+	vector<std::string> names;
+	for (const std::string &path : paths) {
+		size_t start = path.find_first_not_of('/');
+		names.push_back(start == std::string::npos ? path : path.substr(start));
+	}
+	std::ofstream outFile;
+	std::ostream &out = openOutput(args.files[0], outFile);
+	CodingStats stats = Archive::create(out, paths, names, args.options, args.splitElf);
+	if (!args.quiet)
+		printStats("archive", stats, stats.bytesIn);
+	return EXIT_SUCCESS;
+}
+
+
+static ArchiveDirectory openArchive(const std::string &name, std::ifstream &file) {
+	file.open(name, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Cannot open " + name);
+	return Archive::readDirectory(file);
+}
+
+
+static int listCommand(const Arguments &args) {
+	if (args.files.size() != 1)
+		throw std::invalid_argument("Need exactly one archive");
+	std::ifstream file;
+	const ArchiveDirectory dir = openArchive(args.files[0], file);
+	std::cout << std::setw(14) << "size" << std::setw(14) << "compressed" << "  name" << std::endl;
+	for (const ArchiveMember &entry : dir.members)
+		std::cout << std::setw(14) << entry.rawSize << std::setw(14) << entry.compressedSize << "  " << entry.name << std::endl;
+	if (dir.hasSharedCode)
+		std::cout << "shared code: " << BlockCoder::getName(dir.sharedCode.codec) << std::endl;
+	return EXIT_SUCCESS;
+}
+
+
+// Tests whether a member name can be used as a relative path without leaving the current directory.
+static bool isSafePath(const std::string &name) {
+	if (name.empty() || name[0] == '/')
+		return false;
+	for (size_t start = 0; start <= name.size(); ) {
+		size_t end = std::min(name.find('/', start), name.size());
+		if (name.compare(start, end - start, "..") == 0)
+			return false;
+		start = end + 1;
+	}
+	return true;
+}
+
+
+static int extractCommand(const Arguments &args) {
+	if (args.files.empty() || args.files.size() > 3)
+		throw std::invalid_argument("Need an archive, and optionally a member and an output file");
+	std::ifstream file;
+	const ArchiveDirectory dir = openArchive(args.files[0], file);
+	vector<size_t> indexes;
+	if (args.files.size() >= 2) {
+		size_t index = Archive::findMember(dir, args.files[1]);
+		if (index == dir.members.size())
+			throw std::runtime_error("No member named " + args.files[1]);
+		indexes.push_back(index);
+	} else {
+		for (size_t i = 0; i < dir.members.size(); i++)
+			indexes.push_back(i);
+	}
+
+	CodingStats total;
+	for (size_t index : indexes) {
+		const std::string &name = dir.members[index].name;
+		if (args.files.size() < 3 && !isSafePath(name))
+			throw std::runtime_error("Unsafe member name: " + name);
+		std::ofstream outFile;
+		std::ostream &out = openOutput(args.files.size() >= 3 ? args.files[2] : name, outFile);
+		CodingStats stats = Archive::extract(file, dir, index, out, args.options.threads);
+		total.bytesIn += stats.bytesIn;
+		total.bytesOut += stats.bytesOut;
+		total.blocks += stats.blocks;
+		for (int i = 0; i < BlockCoder::NUM_CODECS; i++)
+			total.blocksPerCodec[i] += stats.blocksPerCodec[i];
+		total.filteredBlocks += stats.filteredBlocks;
+		total.reusedCodes += stats.reusedCodes;
+		total.seconds += stats.seconds;
+	}
+	if (!args.quiet)
+		printStats("extract", total, total.bytesOut);
+	return EXIT_SUCCESS;
+}
+
+
+// Returns the bytes written in hexadecimal in the given string, two digits per byte.
+static vector<uint8_t> parseHex(const std::string &s) {
+	if (s.size() % 2 != 0 || s.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+		throw std::invalid_argument("Invalid hexadecimal pattern: " + s);
+	vector<uint8_t> result;
+	for (size_t i = 0; i < s.size(); i += 2)
+		result.push_back(static_cast<uint8_t>(std::stoul(s.substr(i, 2), nullptr, 16)));
+	return result;
+}
+
+
+static int searchCommand(const Arguments &args) {
+	if (args.files.empty() || args.files.size() > 2)
+		throw std::invalid_argument("Need a pattern, and optionally an input file");
+	const vector<uint8_t> pattern = args.hexPattern ? parseHex(args.files[0])
+		: vector<uint8_t>(args.files[0].begin(), args.files[0].end());
+	const std::string name = args.files.size() >= 2 ? args.files[1] : "-";
+	std::ifstream file;
+	std::istream &in = openInput(name, file);
+
+	// An archive is searched member by member, a plain stream as a whole
+	SearchResult total;
+	if (name != "-" && Archive::isArchive(in)) {
+		const ArchiveDirectory dir = Archive::readDirectory(in);
+		for (size_t i = 0; i < dir.members.size(); i++) {
+			const SearchResult result = Archive::search(in, dir, i, pattern, args.options.threads);
+			for (uint64_t offset : result.matches)
+				std::cout << dir.members[i].name << ":" << offset << "\n";
+			total.matches.insert(total.matches.end(), result.matches.begin(), result.matches.end());
+			total.rawBytes += result.rawBytes;
+			total.blocks += result.blocks;
+			total.skippedBlocks += result.skippedBlocks;
+			total.skippedBytes += result.skippedBytes;
+			total.seconds += result.seconds;
+		}
+	} else {
+		total = StreamSearch::search(in, pattern, args.options.threads);
+		for (uint64_t offset : total.matches)
+			std::cout << offset << "\n";
+	}
+	std::cout.flush();
+	if (!args.quiet) {
+		std::cerr << "search: " << total.rawBytes << " bytes" << std::fixed << std::setprecision(3) << " in " << total.seconds << " s, "
+			<< std::setprecision(1) << megabytesPerSecond(total.rawBytes, total.seconds) << " MB/s; " << total.blocks << " blocks, "
+			<< total.skippedBlocks << " skipped (" << total.skippedBytes << " bytes); " << total.matches.size() << " matches" << std::endl;
+	}
+	return total.matches.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+static vector<uint8_t> readReference(const Arguments &args) {
+	if (args.files.empty() || args.files.size() > 3)
+		throw std::invalid_argument("Need a reference, and optionally an input and an output file");
+	if (args.files[0] == "-")
+		throw std::invalid_argument("The reference must be a file");
+	std::ifstream file;
+	return readAll(openInput(args.files[0], file));
+}
+
+
+static int deltaCommand(const Arguments &args) {
+	const vector<uint8_t> reference = readReference(args);
+	std::ifstream inFile;
+	std::ofstream outFile;
+	std::istream &in = openInput(args.files.size() >= 2 ? args.files[1] : "-", inFile);
+	std::ostream &out = openOutput(args.files.size() >= 3 ? args.files[2] : "-", outFile);
+	CodingStats stats = DeltaCoder::compress(reference, in, out, args.options.blockSize, args.options.threads);
+	if (!args.quiet)
+		printStats("delta", stats, stats.bytesIn);
+	return EXIT_SUCCESS;
+}
+
+
+static int patchCommand(const Arguments &args) {
+	const vector<uint8_t> reference = readReference(args);
+	std::ifstream inFile;
+	std::ofstream outFile;
+	std::istream &in = openInput(args.files.size() >= 2 ? args.files[1] : "-", inFile);
+	std::ostream &out = openOutput(args.files.size() >= 3 ? args.files[2] : "-", outFile);
+	CodingStats stats = DeltaCoder::decompress(reference, in, out, args.options.threads);
+	if (!args.quiet)
+		printStats("patch", stats, stats.bytesOut);
+	return EXIT_SUCCESS;
+}
+
+
+// Returns the Shannon entropy in bits of the given histogram, or 0 if it is empty.
+static double entropyBits(const vector<uint64_t> &freqs) {
+	uint64_t total = 0;
+	for (uint64_t f : freqs)
+		total += f;
+	double result = 0;
+	for (uint64_t f : freqs) {
+		if (f > 0)
+			result -= f * std::log2(static_cast<double>(f) / total);
+	}
+	return result;
+}
+
+
+// Encodes one block with the given codec, using the LZ77 level of the arguments.
+static void encodeBlock(BlockCodec codec, const Arguments &args, const uint8_t *data, size_t len, vector<uint8_t> &out, CoderContext &ctx) {
+	if (codec == BlockCodec::LZ77)
+		BlockCoder::encodeLz77(data, len, args.options.lz77Level, out, ctx);
+	else
+		BlockCoder::encode(codec, data, len, out, ctx);
+}
+
+
+static int analyzeCommand(const Arguments &args) {
+	if (args.files.size() > 1)
+		throw std::invalid_argument("Too many file names");
+	std::ifstream inFile;
+	const vector<uint8_t> data = readAll(openInput(args.files.empty() ? "-" : args.files[0], inFile));
+
+	// Order-0 and order-1 byte statistics
+	vector<uint64_t> byteFreqs(256, 0);
+	vector<vector<uint64_t> > contextFreqs(256, vector<uint64_t>(256, 0));
+	for (size_t i = 0; i < data.size(); i++) {
+		byteFreqs[data[i]]++;
+		contextFreqs[i > 0 ? data[i - 1] : 0][data[i]]++;
+	}
+	double order1Bits = 0;
+	for (const vector<uint64_t> &freqs : contextFreqs)
+		order1Bits += entropyBits(freqs);
+
+	// Zero-run symbol statistics
+	vector<uint32_t> symbols;
+	ZeroRun::toSymbols(data.data(), data.size(), symbols);
+	vector<uint64_t> symbolFreqs(ZeroRun::SYMBOL_LIMIT, 0);
+	for (uint32_t sym : symbols)
+		symbolFreqs[sym]++;
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "input_bytes:          " << data.size() << std::endl;
+	std::cout << "distinct_bytes:       " << std::count_if(byteFreqs.begin(), byteFreqs.end(), [](uint64_t f) { return f > 0; }) << std::endl;
+	std::cout << "zero_run_symbols:     " << symbols.size() << std::endl;
+	if (!data.empty()) {
+		std::cout << "order0_bits_per_byte: " << entropyBits(byteFreqs) / data.size() << std::endl;
+		std::cout << "order1_bits_per_byte: " << order1Bits / data.size() << std::endl;
+		std::cout << "zero_run_bits_per_byte: " << entropyBits(symbolFreqs) / data.size() << std::endl;
+	}
+
+	// Regions of ELF inputs, with the order-0 entropy of each
+	std::istringstream dataIn(std::string(data.begin(), data.end()));
+	for (const ElfLayout::Region &r : ElfLayout::parse(dataIn)) {
+		vector<uint64_t> freqs(256, 0);
+		for (uint64_t i = r.offset; i < r.offset + r.length; i++)
+			freqs[data[i]]++;
+		std::cout << "elf_region:           " << std::left << std::setw(8) << ElfLayout::getName(r.kind) << std::right
+			<< std::setw(12) << r.offset << std::setw(12) << r.length << "  "
+			<< entropyBits(freqs) / r.length << " bits/byte" << std::endl;
+	}
+
+	// Actual sizes per codec, with the container overhead of 9 bytes per block
+	const size_t blockSize = args.options.blockSize;
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+	for (int i = 0; i < BlockCoder::NUM_CODECS; i++) {
+		BlockCodec codec = static_cast<BlockCodec>(i);
+		uint64_t total = 0;
+		vector<uint8_t> payload;
+		for (size_t off = 0; off < data.size(); off += blockSize) {
+			payload.clear();
+			encodeBlock(codec, args, data.data() + off, std::min(blockSize, data.size() - off), payload, *ctx);
+			total += 9 + payload.size();
+		}
+		std::cout << std::left << std::setw(10) << BlockCoder::getName(codec) << std::right
+			<< std::setw(12) << total << " bytes";
+		if (!data.empty())
+			std::cout << "  " << total * 8.0 / data.size() << " bits/byte";
+		std::cout << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+static int benchCommand(const Arguments &args) {
+	if (args.files.size() > 1)
+		throw std::invalid_argument("Too many file names");
+	std::ifstream inFile;
+	const vector<uint8_t> data = readAll(openInput(args.files.empty() ? "-" : args.files[0], inFile));
+	if (data.empty())
+		throw std::invalid_argument("Empty input");
+	const size_t blockSize = args.options.blockSize;
+	typedef std::chrono::steady_clock Clock;
+	std::unique_ptr<CoderContext> ctx(new CoderContext);
+
+	std::cout << std::left << std::setw(10) << "codec" << std::right << std::setw(12) << "size"
+		<< std::setw(8) << "ratio" << std::setw(12) << "enc MB/s" << std::setw(12) << "dec MB/s" << std::endl;
+	for (int i = 0; i < BlockCoder::NUM_CODECS; i++) {
+		const BlockCodec codec = static_cast<BlockCodec>(i);
+		vector<vector<uint8_t> > payloads;
+
+		// Repeat each phase until it has run for a while, to get stable numbers on small inputs
+		int encRuns = 0;
+		const Clock::time_point encStart = Clock::now();
+		do {
+			payloads.clear();
+			for (size_t off = 0; off < data.size(); off += blockSize) {
+				payloads.emplace_back();
+				encodeBlock(codec, args, data.data() + off, std::min(blockSize, data.size() - off), payloads.back(), *ctx);
+			}
+			encRuns++;
+		} while (Clock::now() - encStart < std::chrono::milliseconds(200));
+		const double encSeconds = std::chrono::duration<double>(Clock::now() - encStart).count() / encRuns;
+
+		vector<uint8_t> output(data.size());
+		int decRuns = 0;
+		const Clock::time_point decStart = Clock::now();
+		do {
+			for (size_t j = 0, off = 0; j < payloads.size(); j++, off += blockSize) {
+				BlockCoder::decode(codec, payloads[j].data(), payloads[j].size(),
+					output.data() + off, std::min(blockSize, data.size() - off), *ctx);
+			}
+			decRuns++;
+		} while (Clock::now() - decStart < std::chrono::milliseconds(200));
+		const double decSeconds = std::chrono::duration<double>(Clock::now() - decStart).count() / decRuns;
+		if (output != data)
+			throw std::logic_error(std::string("Round trip mismatch with codec ") + BlockCoder::getName(codec));
+
+		uint64_t size = 0;
+		for (const vector<uint8_t> &payload : payloads)
+			size += 9 + payload.size();
+		std::cout << std::left << std::setw(10) << BlockCoder::getName(codec) << std::right
+			<< std::setw(12) << size << std::fixed << std::setprecision(3) << std::setw(8) << static_cast<double>(size) / data.size()
+			<< std::setprecision(1) << std::setw(12) << megabytesPerSecond(data.size(), encSeconds)
+			<< std::setw(12) << megabytesPerSecond(data.size(), decSeconds) << std::endl;
+	}
+
+	// Whole-stream throughput with the requested thread count
+	std::ostringstream compressed;
+	std::istringstream rawIn(std::string(data.begin(), data.end()));
+	CompressOptions options = args.options;
+	if (args.splitElf)
+		options.blockCuts = findElfCuts(rawIn, options);
+	CodingStats enc = StreamCoder::compress(rawIn, compressed, options);
+	std::ostringstream restored;
+	std::istringstream compIn(compressed.str());
+	CodingStats dec = StreamCoder::decompress(compIn, restored, options.threads);
+	std::cout << "auto, " << options.threads << " thread(s): " << enc.bytesOut << " bytes, "
+		<< std::setprecision(1) << megabytesPerSecond(enc.bytesIn, enc.seconds) << " MB/s compress, "
+		<< megabytesPerSecond(dec.bytesOut, dec.seconds) << " MB/s decompress" << std::endl;
+	return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char *argv[]) {
+	std::ios::sync_with_stdio(false);
+	if (argc < 2) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	const std::string command = argv[1];
+	Arguments args;
+	try {
+		args = parseArguments(argc, argv);
+	} catch (const std::invalid_argument &e) {
+		std::cerr << e.what() << std::endl;
+		usage();
+		return EXIT_FAILURE;
+	}
 
+	try {
+		int status;
+		if (command == "compress")
+			status = compressCommand(args);
+		else if (command == "decompress")
+			status = decompressCommand(args);
+		else if (command == "archive")
+			status = archiveCommand(args);
+		else if (command == "list")
+			status = listCommand(args);
+		else if (command == "extract")
+			status = extractCommand(args);
+		else if (command == "search")
+			status = searchCommand(args);
+		else if (command == "delta")
+			status = deltaCommand(args);
+		else if (command == "patch")
+			status = patchCommand(args);
+		else if (command == "analyze")
+			status = analyzeCommand(args);
+		else if (command == "bench")
+			status = benchCommand(args);
+		else {
+			usage();
+			return EXIT_FAILURE;
+		}
+		if (!args.statsFile.empty()) {
+			std::ofstream statsOut(args.statsFile);
+			Instrumentation::writeJson(statsOut);
+			if (!statsOut)
+				throw std::runtime_error("Cannot write " + args.statsFile);
+		}
+		return status;
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
 }